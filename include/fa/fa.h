@@ -5,6 +5,7 @@
 #include "../fa_error.h"
 #include <stddef.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -79,6 +80,8 @@ typedef struct fa_auto {
     size_t capacity;              /**< Number of states in the automaton */
     Set *alphabet;            /**< Input alphabet (set of symbols) */
     fa_state **states;        /**< Array of pointers to states */
+    bool sink_accepts;        /**< Missing transitions of this DFA lead to an implicit
+                                   accepting sink (see fa_auto_complement) */
 } fa_auto;
 
 
@@ -165,6 +168,80 @@ fa_state* fa_state_with_max_trans(const fa_auto* automaton);
 fa_state** fa_state_get_dests(fa_state* state, const char* symbol, int capacity);
 
 
+// ============================================================================
+// Interval Labels
+// ============================================================================
+
+/**
+ * Symbolic transitions over Unicode code points.
+ *
+ * A transition symbol of the form `[...]` is an interval label: the list
+ * of code points and ranges between the brackets (`[a-z0-9_]`), read as
+ * UTF-8, with `\xHH`, `\u{H...}` and `\<char>` escapes. A symbol that is
+ * exactly one UTF-8 character is the single code point it encodes, so `a`
+ * and `[a]` are the same set; every other symbol (and FA_EPS_SYMBOL)
+ * stays an opaque string.
+ *
+ * Operations working on fa_index (determinization, products,
+ * minimization, ...) split the labels of their operands into minterms,
+ * the coarsest intervals that no label or code-point symbol straddles, so
+ * one `[\x00-\u{10FFFF}]` transition costs one edge instead of one per
+ * code point. Their results merge the minterms going to the same state
+ * back into one label.
+ */
+#define FA_RANGE_MAX 0x10FFFFu
+
+typedef struct fa_range {
+    uint32_t lo;              /**< First code point */
+    uint32_t hi;              /**< Last code point, inclusive */
+} fa_range;
+
+/**
+ * @brief Formats code-point ranges as a canonical symbol.
+ *
+ * Ranges are sorted and merged first. A single code point gives the plain
+ * UTF-8 character when it has one, anything else an interval label.
+ *
+ * @return malloc'd symbol, or NULL if a range is empty or past FA_RANGE_MAX,
+ *         `count` is 0, or on allocation failure
+ */
+char* fa_range_label(const fa_range* ranges, size_t count);
+
+/**
+ * @brief Reads the code points a symbol stands for.
+ * @param symbol Interval label or single-character symbol
+ * @param ranges Receives a malloc'd array of sorted, disjoint, non-adjacent ranges
+ * @param count Receives the number of ranges
+ * @return FA_SUCCESS, FA_ERR_INVALID_ARGUMENT for an opaque symbol, or
+ *         FA_ERR_OUT_OF_MEMORY
+ */
+fa_error_t fa_range_parse(const char* symbol, fa_range** ranges, size_t* count);
+
+/**
+ * @brief Checks whether an interval label or single-character symbol
+ *        contains a code point.
+ */
+bool fa_range_contains(const char* symbol, uint32_t cp);
+
+/**
+ * @brief Decodes the UTF-8 character at the start of `text`.
+ * @return Its length in bytes, or 0 if `text` is empty or not valid UTF-8
+ */
+size_t fa_range_decode(const char* text, uint32_t* cp);
+
+/**
+ * @brief Encodes a code point as UTF-8 into `out` (at least 4 bytes), without
+ *        a terminator.
+ * @return Its length in bytes
+ */
+size_t fa_range_encode(uint32_t cp, char* out);
+
+/**
+ * @brief Creates a transition labelled with the canonical label of `ranges`.
+ * @return FA_SUCCESS, FA_ERR_NULL_ARGUMENT, FA_ERR_INVALID_ARGUMENT or FA_ERR_OUT_OF_MEMORY
+ */
+fa_error_t fa_trans_create_ranges(fa_state* src, fa_state* dest, const fa_range* ranges, size_t count);
+
 
 // ============================================================================
 // Automaton Creation and Initialization
@@ -186,11 +263,35 @@ fa_auto* fa_auto_from_symbol(char* symbol);
 
 /**
  * @brief Constructs an automaton from a regular expression.
+ *
+ * The pattern is parsed with regex_parse (see regex/regexpr.h for the
+ * syntax), shrunk with regex_simplify and turned into an ε-NFA by Thompson
+ * construction, with at most two states per literal or operator. A
+ * character class becomes one interval-label transition for its ASCII
+ * members plus one transition per member byte above 0x7F. `^` matches
+ * only before the first byte and `$` only after the last, so an anchor
+ * inside the word makes its branch match nothing; a pattern with anchors
+ * gets up to four copies of each state, telling whether a byte has been
+ * read and whether a `$` has been passed.
+ *
  * @param regex Regular expression string
- * @return Automaton accepting the language defined by the regex
+ * @return Automaton accepting the language defined by the regex, or NULL
+ *         if the regex is malformed
  */
 fa_auto* fa_auto_from_regex(const char* regex);
 
+/**
+ * @brief Constructs the Glushkov (position) automaton of a regular expression.
+ *
+ * The result has one state per literal or class occurrence plus an initial state and
+ * no ε-transitions, so it can be fed to matchers without ε-removal.
+ *
+ * @param regex Regular expression string
+ * @return ε-free automaton accepting the language of the regex, or NULL if
+ *         the regex is malformed
+ */
+fa_auto* fa_auto_from_regex_glushkov(const char* regex);
+
 /**
  * @brief Reads an automaton from a file.
  * @param filepath Path to the automaton definition file
@@ -206,6 +307,13 @@ fa_auto* fa_auto_read(const char *filepath);
 
 /**
  * @brief Removes epsilon transitions from an automaton.
+ *
+ * Every state gets the non-ε transitions of its ε-closure and becomes
+ * accepting if its closure is. Closures are computed once per ε-SCC over
+ * the condensation, so long ε-chains stay cheap. An implicit accepting sink
+ * (sink_accepts) becomes an ordinary state first: the moves a state lacks
+ * would otherwise be hidden by those copied from its closure.
+ *
  * @param automaton The automaton to modify (modified in place)
  */
 void fa_auto_remove_epsilon(fa_auto *automaton);
@@ -213,13 +321,17 @@ void fa_auto_remove_epsilon(fa_auto *automaton);
 /**
  * @brief Computes the epsilon closure of a state.
  * @param state Starting state
- * @param closure Array to store closure states (output)
+ * @param closure Array to store closure states, `state` first; must have
+ *                room for every state of the automaton (output)
  * @param size Pointer to store the number of states in closure (output)
  */
 void fa_auto_epsilon_closure(fa_state *state, fa_state **closure, int *size);
 
 /**
  * @brief Adds transitions via epsilon closure computation.
+ *
+ * Like fa_auto_remove_epsilon, but the original ε-transitions are kept.
+ *
  * @param automaton The automaton to process
  */
 void fa_auto_add_epsilon_trans(fa_auto *automaton);
@@ -283,8 +395,23 @@ int fa_state_contains(fa_state **states, int size, fa_state *state);
  */
 fa_state** fa_auto_get_trans_states(const fa_auto* automaton, const char* symbol);
 
+/**
+ * @brief Checks whether an automaton is a DFA (possibly partial).
+ * @param automaton The automaton
+ * @return true if it has at most one start state, no ε-transitions and at
+ *         most one transition per state and symbol
+ */
+bool fa_auto_is_deterministic(const fa_auto* automaton);
+
 /**
  * @brief Simulates the automaton on an input word.
+ *
+ * All paths are followed at once, through ε-transitions as well. One-byte
+ * symbols read one byte; interval labels and other single-character
+ * symbols read one UTF-8 character. With sink_accepts, a missing move on an
+ * alphabet symbol leads to the implicit accepting sink, which then reads
+ * any further alphabet symbols (as fa_auto_materialize_sink would make it).
+ *
  * @param automaton The automaton
  * @param word Input word to process
  * @return Non-zero if word is accepted, 0 otherwise
@@ -0,0 +1,267 @@
+#ifndef FA_INDEX_H
+#define FA_INDEX_H
+
+#include "fa.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Integer views of automata.
+ *
+ * `fa_auto` is pointer- and string-based, which makes every algorithm pay
+ * for label comparisons and linked-list walks. The structures below give
+ * the algorithms in fa_operations.c dense state ids, interned symbol ids
+ * and flat (CSR) adjacency, built once per input in O(n + m).
+ */
+
+#define FA_INDEX_START  0x01
+#define FA_INDEX_ACCEPT 0x02
+
+
+// ============================================================================
+// Symbol Table
+// ============================================================================
+
+/**
+ * @brief Interns transition symbols to dense integer ids.
+ *
+ * A single table can be shared by several indexes so that two automata
+ * agree on symbol ids (needed by products, inclusion, equivalence, ...).
+ *
+ * Interval labels (see fa.h) are never interned themselves: an index
+ * stands each one for the minterms it covers. Minterms are the blocks
+ * between consecutive `bounds`, which come from every registered label and
+ * single-character symbol, so the partition has to know all of them before
+ * its first use. Tables shared by several automata therefore register each
+ * of them with fa_symtab_register before building any index.
+ */
+typedef struct fa_symtab {
+    char **symbols;           /**< Id -> owned copy of the symbol */
+    fa_range *spans;          /**< Id -> code points of a one-range symbol, lo > hi if none */
+    size_t count;             /**< Number of interned symbols */
+    size_t capacity;          /**< Allocated length of symbols and spans */
+    int *slots;               /**< Open-addressing slots holding ids, -1 if empty */
+    size_t nslots;            /**< Number of slots (power of two) */
+    int eps;                  /**< Id of FA_EPS_SYMBOL, or -1 if never interned */
+    bool symbolic;            /**< Some registered symbol is an interval label */
+    uint32_t *bounds;         /**< Sorted first code points of the minterms */
+    size_t nbounds;
+    size_t bound_capacity;
+    int *blocks;              /**< Minterm -> symbol id, -1 until used; NULL until the partition is fixed */
+} fa_symtab;
+
+fa_symtab* fa_symtab_create(void);
+void fa_symtab_destroy(fa_symtab *symtab);
+
+/**
+ * @brief Returns the id of a symbol, interning it if needed.
+ * @return Symbol id, or -1 on allocation failure
+ */
+int fa_symtab_intern(fa_symtab *symtab, const char *symbol);
+
+/**
+ * @brief Returns the id of an already interned symbol.
+ * @return Symbol id, or -1 if the symbol is unknown
+ */
+int fa_symtab_lookup(const fa_symtab *symtab, const char *symbol);
+
+/**
+ * @brief Declares the symbols of an automaton before it is indexed.
+ *
+ * Plain symbols are interned, interval labels contribute their bounds to
+ * the minterm partition. Until some automaton with labels is registered,
+ * plain automata are left alone so that ids keep the indexing order.
+ *
+ * @return false on allocation failure, or if the partition is already in
+ *         use and the automaton would split one of its minterms
+ */
+bool fa_symtab_register(fa_symtab *symtab, const fa_auto *automaton);
+
+/**
+ * @brief Interns the symbol ids that `symbol` stands for on index edges.
+ *
+ * A plain symbol is its own id. An interval label of a registered
+ * automaton stands for the minterms it covers, in code-point order.
+ *
+ * @param ids Receives up to `capacity` ids
+ * @return The number of ids (possibly more than `capacity`), or 0 on
+ *         allocation failure or for a label that was never registered
+ */
+size_t fa_symtab_resolve(fa_symtab *symtab, const char *symbol, int *ids, size_t capacity);
+
+/**
+ * @brief Code points of a symbol that is one interval (a single character
+ *        or a minterm).
+ * @return false for opaque symbols and unknown ids
+ */
+bool fa_symtab_range(const fa_symtab *symtab, int id, fa_range *range);
+
+
+// ============================================================================
+// Indexed Automaton
+// ============================================================================
+
+/**
+ * @brief Read-only integer snapshot of an automaton.
+ *
+ * State ids follow the order of the non-NULL entries of the automaton's
+ * state array. Outgoing edges of state `s` are
+ * [offsets[s], offsets[s + 1]) in `syms`/`dests`, sorted by symbol id.
+ * The index borrows `states`; it must not outlive the automaton.
+ */
+typedef struct fa_index {
+    size_t nstates;           /**< Number of states */
+    size_t nedges;            /**< Number of transitions */
+    fa_state **states;        /**< Id -> original state */
+    uint8_t *flags;           /**< FA_INDEX_START / FA_INDEX_ACCEPT per state */
+    size_t *offsets;          /**< nstates + 1 edge offsets */
+    int *syms;                /**< Symbol id of each edge */
+    int *dests;               /**< Destination id of each edge */
+    fa_symtab *symtab;        /**< Symbol ids used by syms */
+    bool owns_symtab;         /**< Whether symtab is freed with the index */
+    bool sink_accepts;        /**< Copied from the automaton: missing moves accept */
+    const void **ptr_keys;    /**< State pointer -> id lookup (open addressing) */
+    int *ptr_ids;
+    size_t ptr_nslots;
+} fa_index;
+
+/**
+ * @brief Builds an integer index of an automaton.
+ *
+ * Alphabet symbols are interned too, so symbols without transitions still
+ * get an id. The automaton is registered in `symtab` first, and a
+ * transition with an interval label becomes one edge per minterm it covers.
+ *
+ * @param automaton Automaton to index
+ * @param symtab Symbol table to intern into, or NULL for a private one
+ * @return The index, or NULL on failure or if a transition leaves the automaton
+ */
+fa_index* fa_index_build(const fa_auto *automaton, fa_symtab *symtab);
+
+void fa_index_destroy(fa_index *index);
+
+/**
+ * @brief Returns the id of a state of the indexed automaton.
+ * @return State id, or -1 if the state does not belong to it
+ */
+int fa_index_state_id(const fa_index *index, const fa_state *state);
+
+/**
+ * @brief Checks for at most one start state, no ε-edges and at most one
+ *        edge per (state, symbol).
+ */
+bool fa_index_is_deterministic(const fa_index *index);
+
+/**
+ * @brief Symbol ids the alphabet of the indexed automaton stands for.
+ *
+ * Interval labels contribute the minterms they cover. The ids are sorted
+ * and unique, and ε is left out. These are the moves an implicit
+ * accepting sink (fa_auto.sink_accepts) takes.
+ *
+ * @param ids Receives a malloc'd array of the ids (free it)
+ * @param count Receives the number of ids
+ * @return false on allocation failure
+ */
+bool fa_index_alphabet(const fa_index *index, const fa_auto *automaton, int **ids, size_t *count);
+
+/**
+ * @brief Whether state `state` has an edge on symbol id `sym`.
+ */
+bool fa_index_has_move(const fa_index *index, size_t state, int sym);
+
+
+// ============================================================================
+// Reversed View
+// ============================================================================
+
+/**
+ * @brief The edges of an index seen backwards, without a new automaton.
+ *
+ * The incoming edges of state `s` are [offsets[s], offsets[s + 1]) in
+ * `edges`/`srcs`: edges[i] is the id of the forward edge (its symbol is
+ * index->syms[edges[i]]) and srcs[i] the state it leaves from. Like a
+ * forward index, each run is sorted by symbol id, then by source. Built
+ * in O(n + m + |Σ|) by two counting sorts; the view borrows the index.
+ */
+typedef struct fa_index_reverse {
+    const fa_index *index;    /**< Borrowed forward index */
+    size_t *offsets;          /**< nstates + 1 incoming-edge offsets */
+    size_t *edges;            /**< Forward edge id of each incoming edge */
+    int *srcs;                /**< Source state of each incoming edge */
+} fa_index_reverse;
+
+/**
+ * @brief Builds the reversed view of an index.
+ * @return The view, or NULL on allocation failure
+ */
+fa_index_reverse* fa_index_reverse_build(const fa_index *index);
+
+void fa_index_reverse_destroy(fa_index_reverse *reverse);
+
+
+// ============================================================================
+// Automaton Builder
+// ============================================================================
+
+typedef struct fa_index_edge {
+    int src;
+    int sym;
+    int dest;
+} fa_index_edge;
+
+/**
+ * @brief Accumulates integer states and edges, then emits an fa_auto.
+ */
+typedef struct fa_builder {
+    size_t nstates;
+    size_t state_capacity;
+    uint8_t *flags;
+    size_t nedges;
+    size_t edge_capacity;
+    fa_index_edge *edges;
+} fa_builder;
+
+/**
+ * @brief Produces the label of state `id` while emitting.
+ * @return malloc'd label (freed by the builder), or NULL for the default
+ */
+typedef char* (*fa_builder_label_fn)(void *ctx, int id);
+
+bool fa_builder_init(fa_builder *builder, size_t state_hint, size_t edge_hint);
+void fa_builder_free(fa_builder *builder);
+
+/**
+ * @brief Appends a state.
+ * @return The new state id, or -1 on allocation failure
+ */
+int fa_builder_add_state(fa_builder *builder, uint8_t flags);
+bool fa_builder_add_edge(fa_builder *builder, int src, int sym, int dest);
+
+/**
+ * @brief Materializes the built automaton.
+ *
+ * Transitions keep their insertion order per state. States are labelled
+ * "q<id>" unless `label` is given. With a table holding interval labels,
+ * the single-character and minterm edges from one state to the same
+ * destination become one transition, labelled at the first of them.
+ *
+ * @param builder The builder
+ * @param symtab Symbol table the edge symbols refer to
+ * @param alphabet Alphabet to copy, or NULL to use every non-ε symbol of symtab
+ * @param label Optional label formatter
+ * @param label_ctx Context passed to label
+ * @return New automaton, or NULL on failure
+ */
+fa_auto* fa_builder_emit(const fa_builder *builder, const fa_symtab *symtab,
+                         const Set *alphabet, fa_builder_label_fn label,
+                         void *label_ctx);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // FA_INDEX_H
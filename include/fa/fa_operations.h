@@ -3,6 +3,7 @@
 
 #include "fa.h"
 #include <stdarg.h>
+#include <stdint.h>
 
 
 
@@ -27,8 +28,9 @@
  * 
  * 3. FA_DETERMINIZE_BFS: Breadth-first construction
  *    - Explores states level by level
- *    - Good for finding shortest paths
- *    - Can be combined with early termination
+ *    - Expands each frontier on all cores; ids come from a shared
+ *      concurrent subset table
+ *    - Output is numbered exactly like the single-threaded run
  * 
  * 4. FA_DETERMINIZE_DFS: Depth-first construction
  *    - Explores one branch fully before others
@@ -150,16 +152,120 @@ typedef struct fa_operation_results {
 } fa_operation_results;
 
 
+/**
+ * Resource budgets for the operations that can blow up exponentially
+ * (subset construction, products, Brzozowski minimization).
+ *
+ * A budget caps the states and transitions an operation builds, an
+ * estimate of its working memory, and its wall-clock time. When a limit is
+ * hit, or the progress callback asks to stop, the operation frees what it
+ * built and fails with FA_ERR_BUDGET_EXCEEDED. `stats` then tells how far
+ * it got and why it stopped. A zeroed budget has no limits.
+ */
+typedef enum {
+    FA_BUDGET_OK = 0,                   /**< Finished within the budget */
+    FA_BUDGET_STATES,                   /**< max_states reached */
+    FA_BUDGET_BYTES,                    /**< max_bytes reached */
+    FA_BUDGET_DEADLINE,                 /**< deadline passed */
+    FA_BUDGET_CANCELLED,                /**< The progress callback returned false */
+} fa_budget_reason;
+
+typedef struct fa_budget_stats {
+    size_t states;                      /**< States built, intermediates included */
+    size_t transitions;                 /**< Transitions built */
+    size_t bytes;                       /**< Estimated working memory */
+    double elapsed;                     /**< Seconds since the call started */
+    fa_budget_reason reason;
+} fa_budget_stats;
+
+/**
+ * @brief Called every few thousand states or transitions.
+ *
+ * In parallel modes it may run on a worker thread, never on two at once.
+ * @return false to cancel the operation
+ */
+typedef bool (*fa_budget_progress_fn)(void* ctx, const fa_budget_stats* stats);
+
+typedef struct fa_budget {
+    size_t max_states;                  /**< 0 for no limit */
+    size_t max_bytes;                   /**< 0 for no limit */
+    double deadline;                    /**< fa_budget_now() value to stop at, 0 for none */
+    fa_budget_progress_fn progress;     /**< Optional */
+    void* progress_ctx;
+    fa_budget_stats stats;              /**< Filled in by every budgeted call */
+} fa_budget;
+
+/**
+ * @brief Monotonic clock in seconds, the time base of fa_budget.deadline.
+ */
+double fa_budget_now(void);
+
 #define FA_MINIMIZE_USES_ALGO(flags, algo) (((flags) & 0x0F) & (algo))
 
-// Main composition function
+/**
+ * @brief Runs every operation requested in `flags` on A (and B).
+ *
+ * When more than one of union, intersection, difference and symmetric
+ * difference is requested, their common product graph is explored once
+ * and each result only differs in which pairs accept. Operations that fail
+ * are left NULL and missing from performed_ops.
+ *
+ * @param a First operand (the only one for unary operations)
+ * @param b Second operand, may be NULL without binary operations
+ * @param flags Combination of fa_operation_flags
+ * @return Results to free with fa_operation_results_destroy, or NULL
+ */
 fa_operation_results* fa_auto_compose(const fa_auto* a, const fa_auto* b, 
                                      fa_operation_flags flags);
 
+/**
+ * @brief fa_auto_compose under one budget shared by all requested operations.
+ *
+ * Once the budget runs out the remaining operations are skipped, the
+ * results report success = false, and *error is FA_ERR_BUDGET_EXCEEDED.
+ *
+ * @param budget Limits, and usage on return (may be NULL)
+ * @param error Receives FA_SUCCESS or the reason of failure (may be NULL)
+ */
+fa_operation_results* fa_auto_compose_budget(const fa_auto* a, const fa_auto* b,
+                                            fa_operation_flags flags, fa_budget* budget,
+                                            fa_error_t* error);
+
 
+/**
+ * @brief Folds every automaton of a stack with one binary operation.
+ *
+ * The operation is the first of union, intersection, difference, symmetric
+ * difference and concatenation set in `flags` (union if none), applied with
+ * the bottom of the stack as the first operand. Associative operations are
+ * reduced as a balanced tree of adjacent pairs, which accepts the same
+ * language as the sequential fold in either mode; with FA_OP_PARALLEL the
+ * pairs of each level run on worker threads. Difference follows `mode`:
+ * left-associative ((A - B) - C) is computed as A - (B ∪ C), and
+ * FA_OP_RIGHT_ASSOCIATIVE (A - (B - C)) is folded sequentially.
+ *
+ * The automata in the stack are consumed and the stack is left empty,
+ * except that a single automaton only gets the unary operations of `flags`.
+ *
+ * @return Results with the folded automaton in the field of the operation,
+ *         or NULL on failure
+ */
 fa_operation_results* fa_auto_stack_compose(fa_stack* stack, 
                                            fa_operation_flags flags, fa_composition_mode mode);
 
+/**
+ * @brief fa_auto_stack_compose under one budget shared by every pairwise step.
+ *
+ * The stack is consumed even when the budget runs out.
+ *
+ * @param budget Limits, and usage on return (may be NULL)
+ * @param error Receives FA_SUCCESS or the reason of failure (may be NULL)
+ * @return Results, or NULL on failure
+ */
+fa_operation_results* fa_auto_stack_compose_budget(fa_stack* stack, fa_operation_flags flags,
+                                                  fa_composition_mode mode, fa_budget* budget,
+                                                  fa_error_t* error);
+
 fa_operation_results* fa_auto_ncompose(fa_operation_flags flags,
                                        fa_composition_mode mode, 
                                        int count, ...);
@@ -189,12 +295,26 @@ fa_auto* fa_auto_union(const fa_auto* a1, const fa_auto* a2);
 
 /**
  * @brief Computes the product (intersection) of two automata.
+ *
+ * Only state pairs reachable from the start pairs are created. Works on
+ * NFAs and ε-NFAs directly.
+ *
  * @param a1 First automaton
  * @param a2 Second automaton
  * @return New automaton accepting L(a1) ∩ L(a2)
  */
 fa_auto* fa_auto_product(const fa_auto* a1, const fa_auto* a2);
 
+/**
+ * @brief fa_auto_product under a budget (the pair graph counts against it).
+ *
+ * @param budget Limits, and usage on return (may be NULL)
+ * @param error Receives FA_SUCCESS or the reason of failure (may be NULL)
+ * @return New automaton, or NULL on failure
+ */
+fa_auto* fa_auto_product_budget(const fa_auto* a1, const fa_auto* a2,
+                                fa_budget* budget, fa_error_t* error);
+
 
 /**
  * @brief Concatenates two automata (L1 · L2).
@@ -204,9 +324,185 @@ fa_auto* fa_auto_product(const fa_auto* a1, const fa_auto* a2);
  */
 fa_auto* fa_auto_concat(const fa_auto* a1, const fa_auto* a2);
 
+/**
+ * @brief Computes the difference of two automata (L1 - L2).
+ *
+ * Reachable product of `a` with `b`, where a missing move of `b` counts as
+ * an implicit rejecting sink. `b` is determinized first if it is an NFA.
+ *
+ * @param a First automaton
+ * @param b Second automaton
+ * @return New automaton accepting L(a) - L(b)
+ */
 fa_auto* fa_auto_difference(const fa_auto* a, const fa_auto* b);
+
+/**
+ * @brief Computes the symmetric difference of two automata.
+ *
+ * Same reachable product as fa_auto_difference, with implicit sinks on
+ * both sides. NFA inputs are determinized first.
+ *
+ * @param a First automaton
+ * @param b Second automaton
+ * @return New automaton accepting (L(a) - L(b)) ∪ (L(b) - L(a))
+ */
 fa_auto* fa_auto_symmetric_difference(const fa_auto* a, const fa_auto* b);
+
+/**
+ * @brief Complements an automaton relative to its alphabet.
+ *
+ * NFAs are determinized first. The result has the input's transitions with
+ * the accepting states flipped and sink_accepts set: a missing transition
+ * leads to an accepting sink that is never stored, so the complement of a
+ * partial DFA over a large alphabet costs no more than a copy.
+ * Complementing twice gives back the partial DFA. Products, emptiness of
+ * intersections, determinization and Hopcroft minimization use the
+ * implicit sink as is; the exporters and the remaining operations work on
+ * fa_auto_materialize_sink's copy.
+ *
+ * @param a Automaton to complement
+ * @return New DFA accepting Σ* - L(a), or NULL on allocation failure
+ */
 fa_auto* fa_auto_complement(const fa_auto* a);
+
+/**
+ * @brief Copies an automaton with its implicit accepting sink made explicit.
+ *
+ * Every missing (state, alphabet symbol) transition of a DFA with
+ * sink_accepts is sent to a new accepting state that loops on the whole
+ * alphabet. Automata without an implicit sink are copied unchanged.
+ *
+ * @return New automaton, or NULL on allocation failure
+ */
+fa_auto* fa_auto_materialize_sink(const fa_auto* a);
+
+/**
+ * @brief Removes unreachable and dead states in place.
+ *
+ * A forward pass from the start states and a backward pass from the
+ * accepting ones run in O(n + m) over integer ids; the remaining states
+ * are compacted to the front of the state array (labels are kept).
+ * Start states always stay. With an implicit accepting sink only
+ * unreachable states are removed, since every state can still accept.
+ *
+ * @param automaton The automaton to trim (modified in place)
+ * @return FA_SUCCESS, FA_ERR_NULL_ARGUMENT or FA_ERR_OUT_OF_MEMORY
+ */
+fa_error_t fa_auto_trim(fa_auto* automaton);
+
+/**
+ * @brief Shrinks an NFA without determinizing it.
+ *
+ * ε-edges are removed first. Forward and backward simulation preorders
+ * are then computed by partition refinement over bit-matrix relations;
+ * mutually simulating states are merged, and transitions (and start or
+ * accepting flags) subsumed by a simulating sibling are pruned. Passes
+ * alternate until neither direction finds anything more. The language is
+ * unchanged; the result is never larger than the ε-free input and keeps
+ * the labels of one merged state per class. Memory is quadratic in the
+ * number of states (one bit per pair).
+ *
+ * @param a Automaton to reduce (left unchanged)
+ * @return New ε-free automaton, or NULL on failure
+ */
+fa_auto* fa_auto_reduce_nfa(const fa_auto* a);
+
+/**
+ * @brief Number of words of bounded length, as a 128-bit integer.
+ */
+typedef struct fa_word_count {
+    uint64_t low;                      /**< Low 64 bits of the count */
+    uint64_t high;                     /**< High 64 bits of the count */
+    bool saturated;                    /**< The true count is at least 2^128 - 1 */
+} fa_word_count;
+
+/**
+ * @brief Counts the distinct words of length at most `max_len` in L(a).
+ *
+ * The empty word counts when accepted, and an interval label counts once
+ * per code point it covers. NFAs are determinized first, and
+ * the count runs on the useful states only: per-length dynamic programming
+ * for small bounds, repeated squaring of the transition-count matrix when
+ * that is cheaper, so bounds like UINT64_MAX stay tractable for small
+ * automata. Counts beyond 2^128 - 1 are clamped and flagged.
+ *
+ * @param a Automaton to measure
+ * @param max_len Length bound (inclusive)
+ * @param count Receives the count
+ * @return FA_SUCCESS, FA_ERR_NULL_ARGUMENT or FA_ERR_OUT_OF_MEMORY
+ */
+fa_error_t fa_auto_count_words(const fa_auto* a, uint64_t max_len, fa_word_count* count);
+
+/**
+ * @brief Checks whether L(a) is infinite.
+ *
+ * True iff a cycle of useful (reachable and co-reachable) states reads at
+ * least one symbol; linear in the automaton, and NFAs are not determinized.
+ *
+ * @return true if L(a) is infinite; false otherwise or on failure
+ */
+bool fa_auto_is_infinite(const fa_auto* a);
+
+/**
+ * Uniform sampler over the words of one length in L(a).
+ *
+ * Built once per (automaton, length) from per-state path counts, then
+ * shared freely: drawing does not allocate or modify the sampler, and each
+ * caller passes its own random state, so threads can draw concurrently.
+ */
+typedef struct fa_word_sampler fa_word_sampler;
+
+/**
+ * @brief Precomputes the path counts for words of exactly `length` symbols.
+ *
+ * NFAs are determinized first. Counts are exact up to 2^128 - 1 and
+ * rescaled doubles beyond (uniform up to rounding). The table takes
+ * (length + 1) * n counters over the n useful states of the DFA. To draw
+ * words that do not match, build the sampler from fa_auto_complement(a).
+ *
+ * @param a Automaton whose words are drawn
+ * @param length Exact length of the drawn words, in symbols
+ * @param error Receives FA_SUCCESS or the reason of failure (may be NULL)
+ * @return The sampler, or NULL on failure
+ */
+fa_word_sampler* fa_word_sampler_create(const fa_auto* a, size_t length, fa_error_t* error);
+
+void fa_word_sampler_destroy(fa_word_sampler* sampler);
+
+/**
+ * @brief Number of words the sampler draws from (saturated when inexact).
+ */
+void fa_word_sampler_count(const fa_word_sampler* sampler, fa_word_count* count);
+
+/**
+ * @brief Draws one word into a caller buffer.
+ *
+ * The word is the concatenation of its symbols, NUL-terminated. An
+ * interval label contributes the UTF-8 encoding of one of its code points,
+ * which may be U+0000 or a surrogate if the label covers them; `written`
+ * is the length to trust then.
+ *
+ * @param sampler The sampler
+ * @param rng Random state, advanced by the draw (any seed works)
+ * @param buffer Output buffer
+ * @param size Size of the buffer in bytes
+ * @param written Receives the word length without the NUL (may be NULL)
+ * @return FA_SUCCESS, FA_ERR_NULL_ARGUMENT, FA_ERR_BUFFER_TOO_SMALL, or
+ *         FA_ERR_INVALID_OPERATION when no word has the sampler's length
+ */
+fa_error_t fa_word_sampler_draw(const fa_word_sampler* sampler, uint64_t* rng,
+                                char* buffer, size_t size, size_t* written);
+
+/**
+ * @brief Reverses an automaton (the result accepts the mirror of L(a)).
+ *
+ * Start and accepting states swap roles and every transition is flipped,
+ * in O(n + m) through fa_index_reverse. The result may have several start
+ * states. Callers that only need to walk edges backwards can use
+ * fa_index_reverse directly and skip building an automaton.
+ *
+ * @return New automaton, or NULL on allocation failure
+ */
 fa_auto* fa_auto_reverse(const fa_auto* a);
 
 
@@ -217,20 +513,137 @@ fa_auto* fa_auto_reverse(const fa_auto* a);
 /**
  * Apply Kleene closure operation to automaton
  * 
- * @param automaton The automaton to modify
+ * @param automaton The automaton to close (left unchanged)
  * @param flags FA_KLEENE_STAR for zero-or-more (a*)
  *             FA_KLEENE_PLUS for one-or-more (a+)
- * @return fa_auto
+ * @return New automaton, or NULL on allocation failure
  */
 fa_auto* fa_auto_kleene(fa_auto* automaton, fa_kleene_type type);
 fa_auto* fa_auto_minimize(const fa_auto* a, fa_minimize_algorithm algorithm);
+
+/**
+ * @brief fa_auto_minimize under a budget.
+ *
+ * The subset constructions of Brzozowski's algorithm, and the one that
+ * precedes Hopcroft's on an NFA, count against the budget.
+ *
+ * @param budget Limits, and usage on return (may be NULL)
+ * @param error Receives FA_SUCCESS or the reason of failure (may be NULL)
+ * @return New automaton, or NULL on failure
+ */
+fa_auto* fa_auto_minimize_budget(const fa_auto* a, fa_minimize_algorithm algorithm,
+                                 fa_budget* budget, fa_error_t* error);
 fa_auto* fa_auto_minimize_moore(const fa_auto *automaton);
 fa_auto* fa_auto_minimize_hopcroft(const fa_auto *automaton);
 fa_auto* fa_auto_minimize_table(const fa_auto *automaton);
 fa_auto* fa_auto_minimize_brzozowski(const fa_auto *automaton);
 fa_auto* fa_auto_optimize(fa_auto* automaton, fa_minimize_algorithm min_algo, fa_determinize_algorithm det_algo);
+
+/**
+ * @brief Converts an NFA/ε-NFA into an equivalent DFA (subset construction).
+ *
+ * Only subsets reachable from the ε-closure of the start states are built,
+ * and empty successor sets are left out, so the result may be partial.
+ * With FA_DETERMINIZE_BFS each frontier is expanded by a pool of worker
+ * threads; every other mode runs on the calling thread.
+ *
+ * @param a Automaton to determinize
+ * @param algorithm Algorithm, naming and option flags
+ * @return New DFA, or NULL on failure
+ */
 fa_auto* fa_auto_determinize(const fa_auto* a, fa_determinize_algorithm algorithm);
 
+/**
+ * @brief fa_auto_determinize under a budget (every subset counts).
+ *
+ * @param budget Limits, and usage on return (may be NULL)
+ * @param error Receives FA_SUCCESS or the reason of failure (may be NULL)
+ * @return New DFA, or NULL on failure
+ */
+fa_auto* fa_auto_determinize_budget(const fa_auto* a, fa_determinize_algorithm algorithm,
+                                    fa_budget* budget, fa_error_t* error);
+
+/**
+ * @brief Checks language inclusion L(a) ⊆ L(b).
+ *
+ * Explores pairs of a state of `a` and a set of states of `b` on the fly,
+ * pruning pairs subsumed by an antichain of smaller sets, so `b` is never
+ * determinized or complemented. Stops at the first counterexample.
+ *
+ * @param a Candidate subset automaton
+ * @param b Candidate superset automaton
+ * @param counterexample If non-NULL, receives a malloc'd word accepted by
+ *                       `a` but not by `b` when the result is false
+ * @return true if L(a) ⊆ L(b); false otherwise or on failure
+ */
+bool fa_auto_is_subset(const fa_auto* a, const fa_auto* b, char** counterexample);
+
+/**
+ * @brief Checks whether an automaton accepts every word over its alphabet.
+ *
+ * Same antichain search as fa_auto_is_subset with Σ* on the left.
+ *
+ * @param a Automaton to check
+ * @param counterexample If non-NULL, receives a malloc'd word rejected by
+ *                       `a` when the result is false
+ * @return true if L(a) = Σ*; false otherwise or on failure
+ */
+bool fa_auto_is_universal(const fa_auto* a, char** counterexample);
+
+/**
+ * @brief Checks whether two automata share no accepted word.
+ *
+ * Walks the reachable product breadth-first and stops at the first pair
+ * accepted by both sides.
+ *
+ * @param a First automaton
+ * @param b Second automaton
+ * @param witness If non-NULL, receives a malloc'd word accepted by both
+ *                automata when the result is false
+ * @return true if L(a) ∩ L(b) = ∅; false otherwise or on failure
+ */
+bool fa_auto_is_empty_intersection(const fa_auto* a, const fa_auto* b, char** witness);
+
+/**
+ * @brief Checks whether two automata accept the same language.
+ *
+ * Works on the fly without minimizing either side: DFAs are compared with
+ * Hopcroft–Karp union-find over state pairs, NFAs over pairs of state sets
+ * pruned by congruence closure.
+ *
+ * @param a First automaton
+ * @param b Second automaton
+ * @param counterexample If non-NULL, receives a malloc'd word accepted by
+ *                       exactly one of the automata when the result is false
+ * @return true if L(a) = L(b); false otherwise or on failure
+ */
+bool fa_auto_equivalent(const fa_auto* a, const fa_auto* b, char** counterexample);
+
+/**
+ * @brief Computes a 128-bit canonical hash of a DFA.
+ *
+ * States are numbered in BFS order from the start, taking each state's
+ * moves in code-point order (then opaque symbols in byte order), and the
+ * hash covers that numbering, the accepting flags and the moves. State
+ * labels and storage order do not enter it, nor does the way character
+ * moves to one state are split into symbols (`[a-c]` hashes like `a`, `b`
+ * and `c`). States that cannot reach an accepting one are left out. The
+ * implicit accepting sink (fa_auto.sink_accepts) and any state accepting
+ * all of Σ* count as one state, so fa_auto_materialize_sink does not
+ * change the hash. Runs in O(n + m) after sorting the symbols, or
+ * O(n·|Σ| + m) with an accepting sink.
+ *
+ * The minimal DFA of a language is unique, so on minimized inputs (see
+ * fa_auto_minimize) equal fingerprints mean equal languages, up to hash
+ * collisions.
+ *
+ * @param dfa Deterministic automaton
+ * @param fingerprint Receives the hash
+ * @return FA_SUCCESS, FA_ERR_NULL_ARGUMENT, FA_ERR_NOT_DETERMINISTIC or
+ *         FA_ERR_OUT_OF_MEMORY
+ */
+fa_error_t fa_auto_fingerprint(const fa_auto* dfa, uint64_t fingerprint[2]);
+
 // Result management functions
 void fa_operation_results_destroy(fa_operation_results* results);
 void fa_operation_results_print(const fa_operation_results* results);
@@ -21,6 +21,7 @@ typedef enum {
     FA_ERR_NOT_IMPLEMENTED = 5,
     FA_ERR_BUFFER_TOO_SMALL = 6,
     FA_ERR_INVALID_OPERATION = 7,
+    FA_ERR_BUDGET_EXCEEDED = 8,
     
     /* ===== SET & COLLECTION ERRORS (100-199) ===== */
     FA_ERR_SET_DUPLICATE = 100,
@@ -85,6 +86,7 @@ typedef enum {
     FA_ERR_REGEX_UNBALANCED_PARENTHESES = 802,
     FA_ERR_REGEX_UNEXPECTED_TOKEN = 803,
     FA_ERR_REGEX_TRAILING_BACKSLASH = 804,
+    FA_ERR_REGEX_TOO_COMPLEX = 805,
     
     /* ===== CONVERSION ERRORS (900-999) ===== */
     FA_ERR_CONVERSION_FAILED = 900,
@@ -0,0 +1,82 @@
+#ifndef FA_DFA_IMAGE_H
+#define FA_DFA_IMAGE_H
+
+#include "../fa/fa.h"
+#include "../fa_error.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Flat, position-independent image of a DFA.
+ *
+ * The image is a header followed by plain uint32 arrays (CSR transitions
+ * sorted by symbol, accept flags, symbol strings and a byte -> symbol
+ * map), so a file written by fa_dfa_image_save can be mapped read-only and
+ * matched against without any parsing or allocation per state. Images
+ * carry a caller-chosen 128-bit tag that callers use to check what the
+ * image was built from. A complemented DFA keeps its sink implicit in the
+ * image too: a missing move on a known symbol then accepts.
+ *
+ * Images use the native byte order; a file written on a machine with a
+ * different one is rejected as FA_ERR_IO_INVALID_FORMAT.
+ */
+typedef struct fa_dfa_image fa_dfa_image;
+
+#define FA_DFA_IMAGE_VERSION 1
+
+/**
+ * @brief Serializes a DFA into an in-memory image.
+ * @param dfa Deterministic automaton (at most one start state, no ε)
+ * @param tag 128-bit tag stored in the header, or NULL for zero
+ * @param error Receives FA_SUCCESS, FA_ERR_NOT_DETERMINISTIC, ... (may be NULL)
+ * @return The image, or NULL on failure
+ */
+fa_dfa_image* fa_dfa_image_create(const fa_auto* dfa, const uint64_t tag[2], fa_error_t* error);
+
+/**
+ * @brief Writes an image to `path`.
+ * @return FA_SUCCESS, FA_ERR_IO_FILE_OPEN or FA_ERR_IO_WRITE_FAILED
+ */
+fa_error_t fa_dfa_image_save(const fa_dfa_image* image, const char* path);
+
+/**
+ * @brief Opens an image file, memory-mapping it where mmap is available.
+ *
+ * The whole file is validated (sizes, offsets, symbol and state ids), so a
+ * truncated or corrupted file is rejected instead of being matched.
+ *
+ * @param path File written by fa_dfa_image_save
+ * @param error Receives FA_SUCCESS or the reason of failure (may be NULL)
+ * @return The image, or NULL on failure
+ */
+fa_dfa_image* fa_dfa_image_load(const char* path, fa_error_t* error);
+
+void fa_dfa_image_close(fa_dfa_image* image);
+
+/**
+ * @brief Runs the DFA over the bytes of `word`.
+ * @return true if the whole word is accepted
+ */
+bool fa_dfa_image_matches(const fa_dfa_image* image, const char* word);
+
+size_t fa_dfa_image_nstates(const fa_dfa_image* image);
+
+/**
+ * @brief Copies the tag stored in the header into `tag`.
+ */
+void fa_dfa_image_tag(const fa_dfa_image* image, uint64_t tag[2]);
+
+/**
+ * @brief Materializes the image as an ordinary automaton.
+ * @return New automaton, or NULL on allocation failure
+ */
+fa_auto* fa_dfa_image_to_auto(const fa_dfa_image* image);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // FA_DFA_IMAGE_H
@@ -0,0 +1,69 @@
+#ifndef FA_PARALLEL_H
+#define FA_PARALLEL_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifdef FA_HAVE_PTHREADS
+#include <pthread.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Work callback for fa_parallel_for.
+ *
+ * Called once per chunk with the half-open item range [begin, end).
+ * `worker` is a stable index in [0, nworkers) that callers can use to
+ * address per-thread scratch buffers without locking.
+ */
+typedef void (*fa_parallel_fn)(void* ctx, size_t worker, size_t begin, size_t end);
+
+/**
+ * @brief Portable mutex used by the library's concurrent structures.
+ *
+ * Falls back to a no-op when the library is built without thread support.
+ */
+typedef struct fa_mutex {
+#ifdef FA_HAVE_PTHREADS
+    pthread_mutex_t handle;
+#else
+    int unused;
+#endif
+} fa_mutex;
+
+bool fa_mutex_init(fa_mutex* mutex);
+void fa_mutex_lock(fa_mutex* mutex);
+void fa_mutex_unlock(fa_mutex* mutex);
+void fa_mutex_destroy(fa_mutex* mutex);
+
+/**
+ * @brief Number of worker threads worth spawning on this machine.
+ * @return Online CPU count, or 1 when threads are unavailable
+ */
+size_t fa_parallel_workers(void);
+
+/**
+ * @brief Runs `fn` over [0, count) split into chunks across worker threads.
+ *
+ * Chunks are handed out dynamically so uneven items balance out. The call
+ * returns once every chunk has been processed. With `nworkers <= 1`, or when
+ * the library is built without thread support, everything runs inline on
+ * the calling thread as worker 0.
+ *
+ * @param count Number of items
+ * @param nworkers Maximum number of workers (including the caller)
+ * @param grain Items per chunk (use 0 for a default)
+ * @param fn Work callback
+ * @param ctx User context passed to every call
+ */
+void fa_parallel_for(size_t count, size_t nworkers, size_t grain,
+                     fa_parallel_fn fn, void* ctx);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // FA_PARALLEL_H
@@ -0,0 +1,111 @@
+#ifndef REGEX_CACHE_H
+#define REGEX_CACHE_H
+
+#include "../fa/fa.h"
+#include "../fa_error.h"
+#include "../io/fa_dfa_image.h"
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Compiled-pattern cache.
+ *
+ * Maps a pattern and its compile flags to an immutable automaton. The cache
+ * holds at most `capacity` entries and evicts the least recently used one
+ * when full. Entries are reference counted: an acquired entry stays valid
+ * until it is released, even if it is evicted or the cache is destroyed in
+ * the meantime.
+ *
+ * All functions are thread-safe. A hit takes the cache lock once and does
+ * not allocate; a miss compiles the pattern outside the lock.
+ */
+typedef struct fa_regex_cache fa_regex_cache;
+typedef struct fa_regex_entry fa_regex_entry;
+
+typedef enum {
+    FA_REGEX_COMPILE_THOMPSON = 0x00,   // fa_auto_from_regex (default)
+    FA_REGEX_COMPILE_GLUSHKOV = 0x01,   // fa_auto_from_regex_glushkov
+    FA_REGEX_COMPILE_DFA      = 0x02,   // Determinize the compiled automaton
+} fa_regex_compile_flags;
+
+typedef struct fa_regex_cache_stats {
+    size_t hits;
+    size_t misses;
+    size_t evictions;
+    size_t size;                        /**< Entries currently cached */
+    size_t capacity;
+} fa_regex_cache_stats;
+
+/**
+ * @brief Creates an empty cache.
+ * @param capacity Maximum number of cached patterns (at least 1)
+ * @return The cache, or NULL on invalid capacity or allocation failure
+ */
+fa_regex_cache* fa_regex_cache_create(size_t capacity);
+
+/**
+ * @brief Destroys the cache; entries still acquired are freed on release.
+ */
+void fa_regex_cache_destroy(fa_regex_cache* cache);
+
+/**
+ * @brief Returns the compiled form of `pattern`, compiling it on a miss.
+ *
+ * Malformed patterns are not cached.
+ *
+ * @param cache The cache
+ * @param pattern Regular expression string
+ * @param flags Combination of fa_regex_compile_flags
+ * @param error Receives FA_SUCCESS or the reason of failure (may be NULL)
+ * @return Acquired entry to release with fa_regex_entry_release, or NULL
+ */
+fa_regex_entry* fa_regex_cache_acquire(fa_regex_cache* cache, const char* pattern,
+                                       unsigned flags, fa_error_t* error);
+
+/**
+ * @brief Automaton of an acquired entry; must not be modified.
+ */
+const fa_auto* fa_regex_entry_auto(const fa_regex_entry* entry);
+
+/**
+ * @brief Drops a reference obtained from fa_regex_cache_acquire.
+ */
+void fa_regex_entry_release(fa_regex_entry* entry);
+
+/**
+ * @brief Empties the cache; acquired entries stay valid until released.
+ */
+void fa_regex_cache_clear(fa_regex_cache* cache);
+
+void fa_regex_cache_get_stats(fa_regex_cache* cache, fa_regex_cache_stats* stats);
+
+/**
+ * @brief Compiles a pattern list into a minimal DFA, reusing an on-disk copy.
+ *
+ * The result matches a word if any of the patterns does. Images are stored
+ * in `cache_dir` under a 128-bit content hash of the patterns, `flags` and
+ * the image format version, so changing any input selects a different file
+ * and stale entries are simply never read again. On a hit the image is
+ * memory-mapped and validated, and nothing is compiled; on a miss the union
+ * is built, determinized and minimized, then written to a temporary file
+ * that is renamed into place, so concurrent processes never see a partial
+ * image. A cache directory that cannot be written only costs the reuse.
+ *
+ * @param cache_dir Existing directory for the images
+ * @param patterns Regular expressions
+ * @param npatterns Number of patterns (at least 1)
+ * @param flags Combination of fa_regex_compile_flags (the result is always a DFA)
+ * @param error Receives FA_SUCCESS or the reason of failure (may be NULL)
+ * @return Image to close with fa_dfa_image_close, or NULL on failure
+ */
+fa_dfa_image* fa_regex_compile_cached(const char* cache_dir, const char* const* patterns,
+                                      size_t npatterns, unsigned flags, fa_error_t* error);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // REGEX_CACHE_H
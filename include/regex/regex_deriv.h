@@ -0,0 +1,64 @@
+#ifndef REGEX_DERIV_H
+#define REGEX_DERIV_H
+
+#include "../fa/fa.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Regex derivatives with a lazily built DFA.
+ *
+ * Expressions are hash-consed terms kept in a canonical form (alternatives
+ * and intersections are flattened, sorted and deduplicated), so the set of
+ * Brzozowski derivatives of a regex is finite. Each term is a DFA state;
+ * its transitions are computed the first time an input needs them and
+ * cached on the term.
+ *
+ * Patterns are parsed with regex_parse in REGEX_PARSE_BOOLEAN mode, so on
+ * top of the syntax of fa_auto_from_regex the engine understands
+ * intersection `r&s` (binds tighter than `|`) and complement `!r` (binds
+ * to the following postfix expression), e.g. `(a|b)*&!(a*)`. Bytes that
+ * belong to the same literals and classes share one transition column.
+ */
+typedef struct regex_deriv regex_deriv;
+
+/**
+ * @brief Parses a regex into a derivative engine.
+ * @param regex Regular expression string
+ * @return The engine, or NULL if the regex is malformed or on allocation failure
+ */
+regex_deriv* regex_deriv_create(const char* regex);
+
+void regex_deriv_destroy(regex_deriv* deriv);
+
+/**
+ * @brief Matches a whole word, materializing DFA states on demand.
+ * @return true if the regex accepts `word`
+ */
+bool regex_deriv_matches(regex_deriv* deriv, const char* word);
+
+/**
+ * @brief Number of DFA states materialized so far.
+ */
+size_t regex_deriv_nstates(const regex_deriv* deriv);
+
+/**
+ * @brief Explores every derivative and emits the resulting DFA.
+ *
+ * Transitions are emitted for the bytes matched by some literal or class
+ * of the regex only; complements are taken relative to all bytes when
+ * matching, so the exported automaton is exact on words over those bytes.
+ *
+ * @return New partial DFA (the empty-language state is left out), or NULL
+ */
+fa_auto* regex_deriv_to_auto(regex_deriv* deriv);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // REGEX_DERIV_H
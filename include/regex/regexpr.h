@@ -1,34 +1,134 @@
 #ifndef REGEXPR_H
 #define REGEXPR_H
 
-#define MAX_LEN 100
+#include "../fa_error.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Regular expression syntax tree.
+ *
+ * Patterns are parsed by recursive descent into an AST whose nodes, child
+ * arrays and character classes all live in one arena owned by the
+ * regex_ast, so there is no length limit and the whole tree is released
+ * with a single regex_ast_destroy. Nesting is limited to REGEX_DEPTH_MAX
+ * levels and the tree to REGEX_SIZE_MAX leaves once every repeat is
+ * expanded (`a{1000}{1000}` would be a million); beyond either the parse
+ * fails with FA_ERR_REGEX_TOO_COMPLEX.
+ *
+ * Supported syntax:
+ *   literals      any byte that is not a metacharacter
+ *   escapes       \n \t \r \f \v \xHH, \d \D \w \W \s \S, \<punct>
+ *   classes       [abc] [^abc] [a-z0-9] (escapes allowed inside)
+ *   any byte      .  (everything except '\0' and '\n')
+ *   anchors       ^ $  (start and end of the word; elsewhere they match nothing)
+ *   grouping      ( )
+ *   alternation   |
+ *   repetition    * + ? {m} {m,} {m,n}
+ *
+ * With REGEX_PARSE_BOOLEAN, `&` (intersection, binds tighter than `|`) and
+ * prefix `!` (complement) are operators too; otherwise they are literals.
+ */
+
+#define REGEX_UNBOUNDED (-1)
+#define REGEX_REPEAT_MAX 1000
+#define REGEX_DEPTH_MAX 1000
+#define REGEX_SIZE_MAX 100000
+
+typedef enum {
+    REGEX_PARSE_DEFAULT = 0,
+    REGEX_PARSE_BOOLEAN = 0x01,   // Enable `&` and `!`
+} regex_parse_flags;
 
 typedef enum {
-    TOKEN_LITERAL,
-    TOKEN_UNION,       // '|'
-    TOKEN_STAR,        // '*'
-    TOKEN_PLUS,        // '+'
-    TOKEN_QUESTION,    // '?'
-    TOKEN_CONCAT,      // Explicit concatenation
-    TOKEN_LPAREN,      // '('
-    TOKEN_RPAREN,      // ')'
-    TOKEN_END
-} TokenType;
-
-typedef struct {
-    char data[MAX_LEN];
-    int top;
-} Stack;
-
-
-int precedence(const char op);
-void push(Stack *s, const char c);
-char pop(Stack *s);
-char peek(const Stack *s);
-int is_stack_empty(const Stack *s);
-char* infix_to_postfix(const char *regex);
-int needs_concat(const char prev, const char curr);
-
-
-
-#endif //REGEXPR_H
\ No newline at end of file
+    REGEX_EMPTY,         // ε
+    REGEX_CHAR,          // single byte
+    REGEX_CLASS,         // set of bytes: [...], ., \d, ...
+    REGEX_CONCAT,        // n-ary
+    REGEX_ALT,           // n-ary '|'
+    REGEX_STAR,          // '*'
+    REGEX_PLUS,          // '+'
+    REGEX_QUESTION,      // '?'
+    REGEX_REPEAT,        // {min,max}
+    REGEX_AND,           // n-ary '&'
+    REGEX_NOT,           // '!'
+    REGEX_ANCHOR_START,  // '^'
+    REGEX_ANCHOR_END,    // '$'
+} regex_kind;
+
+/**
+ * @brief A set of bytes, one bit per byte value.
+ */
+typedef struct regex_class {
+    uint64_t bits[4];
+} regex_class;
+
+typedef struct regex_node {
+    regex_kind kind;
+    unsigned char ch;            /**< REGEX_CHAR */
+    int min;                     /**< REGEX_REPEAT lower bound */
+    int max;                     /**< REGEX_REPEAT upper bound or REGEX_UNBOUNDED */
+    const regex_class *cls;      /**< REGEX_CLASS */
+    struct regex_node **kids;    /**< Operands, in pattern order */
+    size_t nkids;
+} regex_node;
+
+typedef struct regex_arena_block regex_arena_block;
+
+typedef struct regex_ast {
+    regex_node *root;
+    regex_arena_block *arena;
+} regex_ast;
+
+/**
+ * @brief Parses a pattern into an AST.
+ * @param pattern Regular expression string
+ * @param flags Parser options
+ * @param error Receives FA_SUCCESS or the reason of failure (may be NULL)
+ * @return The AST, or NULL on failure
+ */
+regex_ast* regex_parse(const char* pattern, regex_parse_flags flags, fa_error_t* error);
+
+void regex_ast_destroy(regex_ast* ast);
+
+/**
+ * @brief Rewrites the AST into a smaller equivalent one.
+ *
+ * Meant to run between regex_parse and automaton construction. Common
+ * leading factors of alternatives are factored out (`abc|abd` becomes
+ * `ab(c|d)`, so a union of literals becomes a trie), single-byte
+ * alternatives are merged into one class, nested and adjacent repetitions
+ * of the same expression are collapsed and redundant ε are dropped.
+ *
+ * @param ast Tree to simplify in place; new nodes come from its arena
+ * @return FA_SUCCESS, or FA_ERR_OUT_OF_MEMORY, in which case the tree is
+ *         only partly simplified but still matches the same language
+ */
+fa_error_t regex_simplify(regex_ast* ast);
+
+/**
+ * @brief Allocates zeroed memory from the AST's arena.
+ *
+ * Lets later passes build new nodes that are released with the tree.
+ * @return Pointer to `size` bytes, or NULL on allocation failure
+ */
+void* regex_ast_alloc(regex_ast* ast, size_t size);
+
+static inline bool regex_class_has(const regex_class* cls, unsigned char c) {
+    return (cls->bits[c >> 6] >> (c & 63)) & 1;
+}
+
+static inline void regex_class_add(regex_class* cls, unsigned char c) {
+    cls->bits[c >> 6] |= 1ULL << (c & 63);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //REGEXPR_H
@@ -0,0 +1,81 @@
+#ifndef BITSET_H
+#define BITSET_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Dense set of small integers (state ids), one bit each. Bits past `nbits`
+ * are always zero, so whole words can be compared and counted. Binary
+ * operations take sets of the same size.
+ *
+ * The word kernels below also work on rows that are not wrapped in a
+ * BitSet (bit matrices, closures kept in arenas). They use AVX2 when the
+ * library is built with it and SSE2 on any x86-64, plain words otherwise.
+ */
+typedef struct {
+    uint64_t* words;          // nwords words, low bit of word 0 is element 0
+    size_t nwords;            // (nbits + 63) / 64
+    size_t nbits;             // Universe size: elements are 0 .. nbits - 1
+} BitSet;
+
+#define BITSET_WORDS(nbits) (((nbits) + 63) / 64)
+#define BITSET_END SIZE_MAX
+
+// Word kernels; the in-place ones return whether `dst` changed
+bool bitset_words_or(uint64_t* dst, const uint64_t* src, size_t nwords);
+bool bitset_words_and(uint64_t* dst, const uint64_t* src, size_t nwords);
+bool bitset_words_andnot(uint64_t* dst, const uint64_t* src, size_t nwords);
+bool bitset_words_equal(const uint64_t* a, const uint64_t* b, size_t nwords);
+bool bitset_words_is_subset(const uint64_t* a, const uint64_t* b, size_t nwords);    // a ⊆ b
+bool bitset_words_intersects(const uint64_t* a, const uint64_t* b, size_t nwords);
+bool bitset_words_is_empty(const uint64_t* words, size_t nwords);
+size_t bitset_words_count(const uint64_t* words, size_t nwords);
+uint64_t bitset_words_hash(const uint64_t* words, size_t nwords);
+size_t bitset_words_next(const uint64_t* words, size_t nwords, size_t from);
+
+static inline bool bitset_words_contains(const uint64_t* words, size_t bit) {
+    return (words[bit / 64] >> (bit % 64)) & 1;
+}
+
+static inline void bitset_words_add(uint64_t* words, size_t bit) {
+    words[bit / 64] |= 1ULL << (bit % 64);
+}
+
+// Basic set operations
+BitSet* bitset_create(size_t nbits);
+BitSet* bitset_copy(const BitSet* set);
+void bitset_destroy(BitSet* set);
+void bitset_clear(BitSet* set);
+void bitset_assign(BitSet* dst, const BitSet* src);
+
+// Element operations
+static inline void bitset_add(BitSet* set, size_t bit) {
+    bitset_words_add(set->words, bit);
+}
+
+static inline void bitset_remove(BitSet* set, size_t bit) {
+    set->words[bit / 64] &= ~(1ULL << (bit % 64));
+}
+
+static inline bool bitset_contains(const BitSet* set, size_t bit) {
+    return bit < set->nbits && bitset_words_contains(set->words, bit);
+}
+
+// In-place set operations; return whether `dst` changed
+bool bitset_union(BitSet* dst, const BitSet* src);
+bool bitset_intersection(BitSet* dst, const BitSet* src);
+bool bitset_difference(BitSet* dst, const BitSet* src);
+
+// Set relations and summaries
+bool bitset_is_equal(const BitSet* a, const BitSet* b);
+bool bitset_is_empty(const BitSet* set);
+size_t bitset_count(const BitSet* set);
+uint64_t bitset_hash(const BitSet* set);
+
+// Iteration: first element >= `from`, or BITSET_END
+//   for (size_t q = bitset_next(set, 0); q != BITSET_END; q = bitset_next(set, q + 1))
+size_t bitset_next(const BitSet* set, size_t from);
+
+#endif // BITSET_H
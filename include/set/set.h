@@ -11,6 +11,10 @@ typedef bool (*SetCompareFunction)(const void*, const void*);
 typedef void* (*SetCopyFunction)(const void*);
 typedef void (*SetFreeFunction)(void*);
 
+/*
+ * Members keep their insertion order for iteration; lookups go through a
+ * hash index over them, so `hash` must agree with `compare`.
+ */
 typedef struct {
     void** members;           // Array of void pointers to elements
     size_t length;           // Current number of elements
@@ -20,6 +24,9 @@ typedef struct {
     SetHashFunction hash;       // Function to hash an element 
     SetCopyFunction copy;       // Function to copy an element 
     SetFreeFunction free;       // Function to free an element 
+    size_t* hashes;             // Hash of each member, parallel to members
+    size_t* slots;              // Open-addressing index into members, SIZE_MAX if empty
+    size_t nslots;              // Number of slots (power of two)
 } Set;
 
 // Basic set operations
@@ -20,12 +20,15 @@ size_t hash_string(const void* a) {
 
 size_t hash_int(const void* a){
     int value = *(const int*)a;
-    return *(size_t*)&value;
+    return (size_t)(unsigned int)value;
 }
 
 size_t hash_double(const void* a) {
     double value = *(const double*)a;
-    return *(size_t*)&value;
+    if (value == 0.0) return 0; // 0.0 and -0.0 compare equal
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return (size_t)bits;
 }
 
 size_t hash_pointer(const void* a) {
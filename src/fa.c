@@ -1,11 +1,14 @@
 #include "../include/fa/fa.h"
+#include "../include/fa/fa_index.h"
 #include "../include/set/set.h"
+#include "../include/set/bitset.h"
 #include "../include/common.h"
 #include "../include/hash/hash_table.h"
 #include "../include/regex/regexpr.h"
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <stdint.h>
 #define FA_STACK_DEFAULT_CAPACITY 16
 
 
@@ -167,6 +170,240 @@ fa_error_t fa_auto_create_epsilon_trans(const fa_auto *automaton, fa_state *src,
 }
 
 
+// Interval labels
+
+size_t fa_range_decode(const char* text, uint32_t* cp){
+    const unsigned char *p = (const unsigned char*)text;
+    if (!p || !p[0]) return 0;
+    if (p[0] < 0x80) {
+        *cp = p[0];
+        return 1;
+    }
+
+    size_t length = p[0] >= 0xF0 ? 4 : p[0] >= 0xE0 ? 3 : p[0] >= 0xC0 ? 2 : 0;
+    if (length == 0 || p[0] > 0xF4) return 0;
+
+    uint32_t value = p[0] & (0x7F >> length);
+    for (size_t i = 1; i < length; i++) {
+        if ((p[i] & 0xC0) != 0x80) return 0;
+        value = (value << 6) | (p[i] & 0x3F);
+    }
+
+    // Reject overlong forms, surrogates and values past U+10FFFF
+    static const uint32_t min_value[] = { 0, 0, 0x80, 0x800, 0x10000 };
+    if (value < min_value[length] || value > FA_RANGE_MAX || (value >= 0xD800 && value <= 0xDFFF)) {
+        return 0;
+    }
+    *cp = value;
+    return length;
+}
+
+size_t fa_range_encode(uint32_t cp, char* out){
+    if (cp < 0x80) {
+        out[0] = (char)cp;
+        return 1;
+    }
+    if (cp < 0x800) {
+        out[0] = (char)(0xC0 | (cp >> 6));
+        out[1] = (char)(0x80 | (cp & 0x3F));
+        return 2;
+    }
+    if (cp < 0x10000) {
+        out[0] = (char)(0xE0 | (cp >> 12));
+        out[1] = (char)(0x80 | ((cp >> 6) & 0x3F));
+        out[2] = (char)(0x80 | (cp & 0x3F));
+        return 3;
+    }
+    out[0] = (char)(0xF0 | (cp >> 18));
+    out[1] = (char)(0x80 | ((cp >> 12) & 0x3F));
+    out[2] = (char)(0x80 | ((cp >> 6) & 0x3F));
+    out[3] = (char)(0x80 | (cp & 0x3F));
+    return 4;
+}
+
+/* Whether `cp` can stand alone as a plain single-character symbol. */
+static bool range_plain(uint32_t cp) {
+    char buf[5];
+    buf[fa_range_encode(cp, buf)] = '\0';
+    return cp != 0 && !(cp >= 0xD800 && cp <= 0xDFFF) && strcmp(buf, FA_EPS_SYMBOL) != 0;
+}
+
+/* Writes one code point of a label body; returns the number of bytes. */
+static size_t range_write(uint32_t cp, char *out) {
+    if (cp > 0x20 && cp < 0x7F) {
+        if (strchr("\\[]-", (int)cp)) {
+            out[0] = '\\';
+            out[1] = (char)cp;
+            return 2;
+        }
+        out[0] = (char)cp;
+        return 1;
+    }
+    if (cp < 0x80) return (size_t)sprintf(out, "\\x%02X", (unsigned)cp);
+    if (cp >= 0xD800 && cp <= 0xDFFF) return (size_t)sprintf(out, "\\u{%X}", (unsigned)cp);
+    return fa_range_encode(cp, out);
+}
+
+static int range_compare(const void *x, const void *y) {
+    const fa_range *a = x, *b = y;
+    if (a->lo != b->lo) return a->lo < b->lo ? -1 : 1;
+    return (a->hi > b->hi) - (a->hi < b->hi);
+}
+
+/* Sorts and merges overlapping or adjacent ranges in place; returns the new count. */
+static size_t range_normalize(fa_range *ranges, size_t count) {
+    if (count == 0) return 0;
+    qsort(ranges, count, sizeof(fa_range), range_compare);
+
+    size_t out = 0;
+    for (size_t i = 1; i < count; i++) {
+        if (ranges[i].lo <= ranges[out].hi || ranges[i].lo - 1 == ranges[out].hi) {
+            if (ranges[i].hi > ranges[out].hi) ranges[out].hi = ranges[i].hi;
+        } else {
+            ranges[++out] = ranges[i];
+        }
+    }
+    return out + 1;
+}
+
+char* fa_range_label(const fa_range* ranges, size_t count){
+    if (!ranges || count == 0) return NULL;
+    for (size_t i = 0; i < count; i++) {
+        if (ranges[i].lo > ranges[i].hi || ranges[i].hi > FA_RANGE_MAX) return NULL;
+    }
+
+    fa_range *sorted = malloc(count * sizeof(fa_range));
+    if (!sorted) return NULL;
+    memcpy(sorted, ranges, count * sizeof(fa_range));
+    count = range_normalize(sorted, count);
+
+    // An escaped code point takes at most 10 bytes ("\u{10FFFF}")
+    char *label = malloc(count * 21 + 3);
+    if (label) {
+        size_t pos = 0;
+        if (count == 1 && sorted[0].lo == sorted[0].hi && range_plain(sorted[0].lo)) {
+            pos = fa_range_encode(sorted[0].lo, label);
+        } else {
+            label[pos++] = '[';
+            for (size_t i = 0; i < count; i++) {
+                pos += range_write(sorted[i].lo, label + pos);
+                if (sorted[i].hi == sorted[i].lo) continue;
+                if (sorted[i].hi > sorted[i].lo + 1) label[pos++] = '-';
+                pos += range_write(sorted[i].hi, label + pos);
+            }
+            label[pos++] = ']';
+        }
+        label[pos] = '\0';
+    }
+    free(sorted);
+    return label;
+}
+
+static uint32_t range_hex(char c) {
+    return (uint32_t)(isdigit((unsigned char)c) ? c - '0' : tolower((unsigned char)c) - 'a' + 10);
+}
+
+/* Reads one code point of a label body; returns its length, or 0 if malformed. */
+static size_t range_read(const char *p, uint32_t *cp) {
+    if (*p != '\\') return *p == ']' ? 0 : fa_range_decode(p, cp);
+
+    if (p[1] == 'x') {
+        if (!isxdigit((unsigned char)p[2]) || !isxdigit((unsigned char)p[3])) return 0;
+        *cp = range_hex(p[2]) * 16 + range_hex(p[3]);
+        return 4;
+    }
+    if (p[1] == 'u' && p[2] == '{') {
+        uint32_t value = 0;
+        size_t i = 3;
+        for (; isxdigit((unsigned char)p[i]) && i < 9; i++) value = value * 16 + range_hex(p[i]);
+        if (i == 3 || p[i] != '}' || value > FA_RANGE_MAX) return 0;
+        *cp = value;
+        return i + 1;
+    }
+    if (p[1] > 0 && p[1] < 0x7F && !isalnum((unsigned char)p[1])) {
+        *cp = (unsigned char)p[1];
+        return 2;
+    }
+    return 0;
+}
+
+fa_error_t fa_range_parse(const char* symbol, fa_range** ranges, size_t* count){
+    if (!symbol || !ranges || !count) return FA_ERR_NULL_ARGUMENT;
+    *ranges = NULL;
+    *count = 0;
+    if (strcmp(symbol, FA_EPS_SYMBOL) == 0) return FA_ERR_INVALID_ARGUMENT;
+
+    uint32_t cp;
+    size_t length = fa_range_decode(symbol, &cp);
+    if (length && symbol[length] == '\0') {
+        if (!(*ranges = malloc(sizeof(fa_range)))) return FA_ERR_OUT_OF_MEMORY;
+        (*ranges)[0].lo = (*ranges)[0].hi = cp;
+        *count = 1;
+        return FA_SUCCESS;
+    }
+
+    size_t end = strlen(symbol);
+    if (end < 3 || symbol[0] != '[' || symbol[end - 1] != ']') return FA_ERR_INVALID_ARGUMENT;
+
+    // Every item takes at least one byte
+    fa_range *out = malloc((end - 2) * sizeof(fa_range));
+    if (!out) return FA_ERR_OUT_OF_MEMORY;
+
+    size_t n = 0;
+    const char *p = symbol + 1;
+    while (p < symbol + end - 1) {
+        uint32_t lo, hi;
+        size_t step = range_read(p, &lo);
+        if (!step) break;
+        p += step;
+        hi = lo;
+        if (p[0] == '-' && p + 1 < symbol + end - 1) {
+            step = range_read(p + 1, &hi);
+            if (!step || hi < lo) break;
+            p += 1 + step;
+        }
+        out[n].lo = lo;
+        out[n].hi = hi;
+        n++;
+    }
+    if (p != symbol + end - 1) {
+        free(out);
+        return FA_ERR_INVALID_ARGUMENT;
+    }
+
+    *ranges = out;
+    *count = range_normalize(out, n);
+    return FA_SUCCESS;
+}
+
+bool fa_range_contains(const char* symbol, uint32_t cp){
+    fa_range *ranges;
+    size_t count;
+    if (fa_range_parse(symbol, &ranges, &count) != FA_SUCCESS) return false;
+
+    bool found = false;
+    for (size_t i = 0; i < count && !found; i++) found = ranges[i].lo <= cp && cp <= ranges[i].hi;
+    free(ranges);
+    return found;
+}
+
+fa_error_t fa_trans_create_ranges(fa_state* src, fa_state* dest, const fa_range* ranges, size_t count){
+    if (!src || !dest || !ranges) return FA_ERR_NULL_ARGUMENT;
+
+    char *label = fa_range_label(ranges, count);
+    if (!label) {
+        // Validation failures are cheap to tell apart from allocation ones
+        for (size_t i = 0; i < count; i++) {
+            if (ranges[i].lo > ranges[i].hi || ranges[i].hi > FA_RANGE_MAX) return FA_ERR_INVALID_ARGUMENT;
+        }
+        return count ? FA_ERR_OUT_OF_MEMORY : FA_ERR_INVALID_ARGUMENT;
+    }
+    fa_error_t status = fa_trans_create(src, dest, label);
+    free(label);
+    return status;
+}
+
+
 fa_state* fa_state_find(const fa_auto* automaton, const char* label){
 
 }
@@ -283,6 +520,7 @@ fa_auto* fa_auto_create(int capacity){
 
     automaton->capacity = capacity;
     automaton->nstates = 0;
+    automaton->sink_accepts = false;
     return automaton;
 }
 
@@ -354,59 +592,601 @@ cleanup:
     return NULL;
 }
 
+/*
+ * Both constructors below work on the AST from regex_parse. Byte symbols
+ * are interned on first use into one symbol table shared by the whole
+ * construction. A class contributes one interval-label edge for its ASCII
+ * members, whose bytes are code points, and one edge per member byte
+ * above 0x7F, which are not characters on their own.
+ */
+typedef struct regex_symbols {
+    fa_symtab *symtab;
+    int ids[256];                   // byte -> symbol id, -1 until interned
+    regex_class *classes;           // distinct classes seen so far
+    int *class_ids;                 // label id of their ASCII part, -1 if empty
+    size_t nclasses;
+    size_t class_capacity;
+} regex_symbols;
+
+static bool regex_symbols_init(regex_symbols *symbols) {
+    symbols->symtab = fa_symtab_create();
+    memset(symbols->ids, -1, sizeof(symbols->ids));
+    symbols->classes = NULL;
+    symbols->class_ids = NULL;
+    symbols->nclasses = symbols->class_capacity = 0;
+    return symbols->symtab != NULL;
+}
+
+static void regex_symbols_free(regex_symbols *symbols) {
+    fa_symtab_destroy(symbols->symtab);
+    free(symbols->classes);
+    free(symbols->class_ids);
+}
+
+static int regex_symbol(regex_symbols *symbols, unsigned char c) {
+    if (symbols->ids[c] < 0) {
+        char sym[2] = { (char)c, '\0' };
+        symbols->ids[c] = fa_symtab_intern(symbols->symtab, sym);
+    }
+    return symbols->ids[c];
+}
+
+/* Label id of the ASCII members of a class, -1 if it has none, -2 on failure. */
+static int regex_class_symbol(regex_symbols *symbols, const regex_class *cls) {
+    for (size_t i = 0; i < symbols->nclasses; i++) {
+        if (memcmp(&symbols->classes[i], cls, sizeof(regex_class)) == 0) return symbols->class_ids[i];
+    }
+
+    if (symbols->nclasses >= symbols->class_capacity) {
+        size_t new_capacity = symbols->class_capacity ? symbols->class_capacity * 2 : 8;
+        regex_class *classes = realloc(symbols->classes, new_capacity * sizeof(regex_class));
+        if (!classes) return -2;
+        symbols->classes = classes;
+        int *ids = realloc(symbols->class_ids, new_capacity * sizeof(int));
+        if (!ids) return -2;
+        symbols->class_ids = ids;
+        symbols->class_capacity = new_capacity;
+    }
+
+    // At most 64 runs among the 127 ASCII bytes
+    fa_range ranges[64];
+    size_t count = 0;
+    for (unsigned c = 1; c < 0x80; c++) {
+        if (!regex_class_has(cls, (unsigned char)c)) continue;
+        if (count && ranges[count - 1].hi + 1 == c) {
+            ranges[count - 1].hi = c;
+        } else {
+            ranges[count].lo = ranges[count].hi = c;
+            count++;
+        }
+    }
+
+    int id = -1;
+    if (count) {
+        char *label = fa_range_label(ranges, count);
+        id = label ? fa_symtab_intern(symbols->symtab, label) : -2;
+        free(label);
+        if (id < 0) return -2;
+    }
+    symbols->classes[symbols->nclasses] = *cls;
+    symbols->class_ids[symbols->nclasses++] = id;
+    return id;
+}
+
+/* Adds the edges src -> dest reading the bytes matched by a CHAR or CLASS node. */
+static bool regex_add_edges(fa_builder *builder, regex_symbols *symbols,
+                            const regex_node *node, int src, int dest) {
+    if (node->kind == REGEX_CHAR) {
+        int sym = regex_symbol(symbols, node->ch);
+        return sym >= 0 && fa_builder_add_edge(builder, src, sym, dest);
+    }
+    int label = regex_class_symbol(symbols, node->cls);
+    if (label == -2 || (label >= 0 && !fa_builder_add_edge(builder, src, label, dest))) return false;
+    for (unsigned c = 0x80; c < 256; c++) {
+        if (!regex_class_has(node->cls, (unsigned char)c)) continue;
+        int sym = regex_symbol(symbols, (unsigned char)c);
+        if (sym < 0 || !fa_builder_add_edge(builder, src, sym, dest)) return false;
+    }
+    return true;
+}
+
+
+/*
+ * Thompson construction into a single builder: every fragment is a
+ * (start, accept) pair of state ids in one growing pool, and each node only
+ * adds O(1) states and ε-edges, so the whole automaton is built in
+ * O(|regex|) time and memory. Counted repetition builds one fragment per
+ * copy. Anchors become edges with a marker symbol, resolved afterwards by
+ * thompson_resolve_anchors.
+ */
+#define THOMPSON_AT_START   (-2)    // marker symbol of a `^` edge
+#define THOMPSON_AT_END     (-3)    // marker symbol of a `$` edge
+
+typedef struct thompson_frag {
+    int start;
+    int accept;
+} thompson_frag;
+
+typedef struct thompson_ctx {
+    fa_builder builder;
+    regex_symbols symbols;
+    int eps;
+    bool anchored;                  // some edge carries an anchor marker
+} thompson_ctx;
+
+static bool thompson_new_frag(thompson_ctx *ctx, thompson_frag *frag) {
+    frag->start = fa_builder_add_state(&ctx->builder, 0);
+    frag->accept = fa_builder_add_state(&ctx->builder, 0);
+    return frag->start >= 0 && frag->accept >= 0;
+}
+
+static bool thompson_link(thompson_ctx *ctx, int src, int dest) {
+    return fa_builder_add_edge(&ctx->builder, src, ctx->eps, dest);
+}
+
+/* Wraps `a` in a *, + or ? loop, according to `kind`. */
+static bool thompson_loop(thompson_ctx *ctx, regex_kind kind, thompson_frag a, thompson_frag *out) {
+    if (!thompson_new_frag(ctx, out) ||
+        !thompson_link(ctx, out->start, a.start) ||
+        !thompson_link(ctx, a.accept, out->accept)) {
+        return false;
+    }
+    if (kind != REGEX_PLUS && !thompson_link(ctx, out->start, out->accept)) return false;
+    if (kind != REGEX_QUESTION && !thompson_link(ctx, a.accept, a.start)) return false;
+    return true;
+}
+
+static bool thompson_build(thompson_ctx *ctx, const regex_node *node, thompson_frag *out) {
+    switch (node->kind) {
+        case REGEX_EMPTY:
+            out->start = out->accept = fa_builder_add_state(&ctx->builder, 0);
+            return out->start >= 0;
+
+        case REGEX_ANCHOR_START:
+        case REGEX_ANCHOR_END:
+            ctx->anchored = true;
+            return thompson_new_frag(ctx, out) &&
+                   fa_builder_add_edge(&ctx->builder, out->start,
+                                       node->kind == REGEX_ANCHOR_START ? THOMPSON_AT_START : THOMPSON_AT_END,
+                                       out->accept);
+
+        case REGEX_CHAR:
+        case REGEX_CLASS:
+            return thompson_new_frag(ctx, out) &&
+                   regex_add_edges(&ctx->builder, &ctx->symbols, node, out->start, out->accept);
+
+        case REGEX_CONCAT:
+            for (size_t i = 0; i < node->nkids; i++) {
+                thompson_frag part;
+                if (!thompson_build(ctx, node->kids[i], &part)) return false;
+                if (i == 0) {
+                    out->start = part.start;
+                } else if (!thompson_link(ctx, out->accept, part.start)) {
+                    return false;
+                }
+                out->accept = part.accept;
+            }
+            return true;
+
+        case REGEX_ALT:
+            if (!thompson_new_frag(ctx, out)) return false;
+            for (size_t i = 0; i < node->nkids; i++) {
+                thompson_frag part;
+                if (!thompson_build(ctx, node->kids[i], &part) ||
+                    !thompson_link(ctx, out->start, part.start) ||
+                    !thompson_link(ctx, part.accept, out->accept)) {
+                    return false;
+                }
+            }
+            return true;
+
+        case REGEX_STAR:
+        case REGEX_PLUS:
+        case REGEX_QUESTION: {
+            thompson_frag a;
+            return thompson_build(ctx, node->kids[0], &a) && thompson_loop(ctx, node->kind, a, out);
+        }
+
+        case REGEX_REPEAT: {
+            // x{m,n} = x...x (m times) followed by x* or by n - m copies of x?
+            size_t copies = node->max == REGEX_UNBOUNDED ? (size_t)node->min + 1 : (size_t)node->max;
+            out->start = out->accept = fa_builder_add_state(&ctx->builder, 0);
+            if (out->start < 0) return false;
+
+            for (size_t i = 0; i < copies; i++) {
+                thompson_frag part;
+                if (!thompson_build(ctx, node->kids[0], &part)) return false;
+                if (i >= (size_t)node->min) {
+                    regex_kind kind = node->max == REGEX_UNBOUNDED ? REGEX_STAR : REGEX_QUESTION;
+                    thompson_frag looped;
+                    if (!thompson_loop(ctx, kind, part, &looped)) return false;
+                    part = looped;
+                }
+                if (!thompson_link(ctx, out->accept, part.start)) return false;
+                out->accept = part.accept;
+            }
+            return true;
+        }
+
+        default:
+            // `&` and `!` have no Thompson construction
+            return false;
+    }
+}
+
+/* Returns the copy of state `key` in `out`, adding it if new; -1 on failure. */
+static int thompson_copy(fa_builder *out, int *copy, size_t *origin, size_t key, uint8_t flags) {
+    if (copy[key] < 0) {
+        copy[key] = fa_builder_add_state(out, flags);
+        if (copy[key] >= 0) origin[copy[key]] = key;
+    }
+    return copy[key];
+}
+
+/*
+ * Anchors test the position, they do not match ε anywhere: `^` holds only
+ * while no byte has been read and `$` only if no byte follows. Every state
+ * q of `in` is split into up to four copies (q, read, ended): `^` edges
+ * leave only copies that have read nothing, `$` edges lead to copies with
+ * ended set, and byte edges leave only copies with ended unset. Only the
+ * copies reachable from the start are built, so a branch with an anchor in
+ * the middle of the word ends up dead.
+ */
+static bool thompson_resolve_anchors(const fa_builder *in, int eps, int start, int accept,
+                                     fa_builder *out) {
+    size_t n = in->nstates;
+    size_t *offsets = calloc(n + 1, sizeof(size_t));   // edges of q: offsets[q] .. offsets[q + 1]
+    size_t *fill = malloc((n ? n : 1) * sizeof(size_t));
+    fa_index_edge *sorted = malloc((in->nedges ? in->nedges : 1) * sizeof(fa_index_edge));
+    int *copy = malloc(4 * (n ? n : 1) * sizeof(int));     // q * 4 + read * 2 + ended -> state
+    size_t *origin = malloc(4 * (n ? n : 1) * sizeof(size_t));
+    bool ok = offsets && fill && sorted && copy && origin;
+
+    if (ok) {
+        for (size_t i = 0; i < in->nedges; i++) offsets[in->edges[i].src + 1]++;
+        for (size_t q = 0; q < n; q++) {
+            offsets[q + 1] += offsets[q];
+            fill[q] = offsets[q];
+        }
+        for (size_t i = 0; i < in->nedges; i++) sorted[fill[in->edges[i].src]++] = in->edges[i];
+        for (size_t key = 0; key < 4 * n; key++) copy[key] = -1;
+
+        uint8_t flags = FA_INDEX_START | (start == accept ? FA_INDEX_ACCEPT : 0);
+        ok = thompson_copy(out, copy, origin, (size_t)start * 4, flags) >= 0;
+    }
+
+    for (size_t src = 0; ok && src < out->nstates; src++) {
+        size_t key = origin[src];
+        bool read = key & 2, ended = key & 1;
+        size_t q = key / 4;
+        for (size_t e = offsets[q]; ok && e < offsets[q + 1]; e++) {
+            int sym = sorted[e].sym;
+            size_t next = (size_t)sorted[e].dest * 4 + (key & 3);
+            if (sym == THOMPSON_AT_START) {
+                if (read) continue;
+                sym = eps;
+            } else if (sym == THOMPSON_AT_END) {
+                next |= 1;
+                sym = eps;
+            } else if (sym != eps) {
+                if (ended) continue;
+                next = (size_t)sorted[e].dest * 4 + 2;
+            }
+            int dest = thompson_copy(out, copy, origin, next,
+                                     sorted[e].dest == accept ? FA_INDEX_ACCEPT : 0);
+            ok = dest >= 0 && fa_builder_add_edge(out, (int)src, sym, dest);
+        }
+    }
+
+    free(offsets);
+    free(fill);
+    free(sorted);
+    free(copy);
+    free(origin);
+    return ok;
+}
+
 fa_auto* fa_auto_from_regex(const char* regex){
-    // const char* postfix = infix_to_postfix(regex);
-    // fa_stack* stack = fa_stack_create(FA_STACK_DEFAULT_CAPACITY);
-
-    // for (int i = 0; postfix[i] != '\0'; i++) {
-    //     if (postfix[i] == '*') {
-    //         fa_auto* automaton = fa_stack_pop(stack);
-    //         automaton = fa_auto_kleene(automaton, 0);
-    //         fa_stack_push(stack, automaton);
-
-    //     }else if (postfix[i] == '?') {
-    //         fa_auto* automaton = fa_stack_pop(stack);
-    //         for (int k = 0; k < automaton->capacity; k++) {
-    //             for (int j = 0; j < automaton->capacity; j++) {
-    //                 if (automaton->states[k]->is_start) {
-    //                     if (automaton->states[j]->is_accept) {
-    //                         fa_trans_create(automaton->states[k], automaton->states[j], "eps");
-    //                     }
-    //                 }
-    //             }
-    //         }
-    //         fa_stack_push(stack, automaton);
-
-    //     }else if (postfix[i] == '+') {
-    //         fa_auto* automaton = fa_stack_pop(stack);
-    //         automaton = fa_auto_kleene(automaton, 1);
-    //         fa_stack_push(stack, automaton);
-    //     }else if (postfix[i] == '.') {
-    //         const fa_auto *a2 = fa_stack_pop(stack);
-    //         const fa_auto *a1 = fa_stack_pop(stack);
-
-    //         fa_auto* result = fa_auto_concat(a1, a2);
-    //         if (result) {
-    //             fa_stack_push(stack, result);
-    //         }
-
-    //     }else if (postfix[i] == '|') {
-    //         const fa_auto *a2 = fa_stack_pop(stack);
-    //         const fa_auto *a1 = fa_stack_pop(stack);
-
-    //         fa_auto* result = fa_auto_union(a1, a2);
-    //         if (result) {
-    //             fa_stack_push(stack, result);
-    //         }
-
-    //     }else if (isalnum(postfix[i])) {
-    //         char sym[2] = {postfix[i], '\0'};
-    //         fa_auto* automaton = fa_auto_from_symbol(sym);
-    //         fa_stack_push(stack, automaton);
-
-    //     }
-    // }
-    // return fa_stack_peek(stack);
+    regex_ast *ast = regex_parse(regex, REGEX_PARSE_DEFAULT, NULL);
+    if (!ast) return NULL;
+    // A partial simplification on allocation failure is still equivalent
+    regex_simplify(ast);
+
+    thompson_ctx ctx = { .anchored = false };
+    bool built = fa_builder_init(&ctx.builder, 64, 64);
+    bool ok = regex_symbols_init(&ctx.symbols);
+    fa_auto *automaton = NULL;
+    thompson_frag root;
+
+    if (built && ok) {
+        ctx.eps = fa_symtab_intern(ctx.symbols.symtab, FA_EPS_SYMBOL);
+        if (ctx.eps >= 0 && thompson_build(&ctx, ast->root, &root)) {
+            if (!ctx.anchored) {
+                ctx.builder.flags[root.start] |= FA_INDEX_START;
+                ctx.builder.flags[root.accept] |= FA_INDEX_ACCEPT;
+                automaton = fa_builder_emit(&ctx.builder, ctx.symbols.symtab, NULL, NULL, NULL);
+            } else {
+                fa_builder resolved;
+                if (fa_builder_init(&resolved, ctx.builder.nstates, ctx.builder.nedges)) {
+                    if (thompson_resolve_anchors(&ctx.builder, ctx.eps, root.start, root.accept, &resolved)) {
+                        automaton = fa_builder_emit(&resolved, ctx.symbols.symtab, NULL, NULL, NULL);
+                    }
+                    fa_builder_free(&resolved);
+                }
+            }
+        }
+    }
+
+    if (built) fa_builder_free(&ctx.builder);
+    regex_symbols_free(&ctx.symbols);
+    regex_ast_destroy(ast);
+    return automaton;
+}
+
+
+/*
+ * Glushkov (position) automaton: one state per CHAR or CLASS occurrence
+ * plus an initial state, no ε-edges. Each subtree yields its nullability
+ * and its first/last position lists; concatenation and iteration add the
+ * follow edges last(x) -> first(y) directly into the builder, labelled by
+ * the bytes of the target position.
+ *
+ * Anchors make both depend on where the subtree sits. A point of the word
+ * is inside it, at its end, at its start, or both (the empty word); the
+ * nullability is the mask of points at which the subtree matches ε, and a
+ * first (last) position records the points at which the subtree may start
+ * (end) just before (after) it. Joining two subtrees at a point intersects
+ * their masks, and follow edges need both positions to allow the inside.
+ */
+#define GLUSHKOV_INSIDE     0x1
+#define GLUSHKOV_END        0x2
+#define GLUSHKOV_START      0x4
+#define GLUSHKOV_WHOLE      0x8
+#define GLUSHKOV_ANYWHERE   0xF
+
+typedef struct glushkov_pos {
+    int state;
+    uint8_t at;                     // GLUSHKOV_* points the position is first or last at
+} glushkov_pos;
+
+typedef struct glushkov_frag {
+    uint8_t nullable;               // GLUSHKOV_* points matching ε
+    glushkov_pos *first;
+    size_t nfirst;
+    glushkov_pos *last;
+    size_t nlast;
+} glushkov_frag;
+
+typedef struct glushkov_ctx {
+    fa_builder builder;
+    regex_symbols symbols;
+    const regex_node **positions;   // state id -> CHAR/CLASS node
+    size_t position_capacity;
+} glushkov_ctx;
+
+static void glushkov_frag_free(glushkov_frag *frag) {
+    free(frag->first);
+    free(frag->last);
+    frag->first = frag->last = NULL;
+    frag->nfirst = frag->nlast = 0;
+}
+
+/*
+ * Concatenates two disjoint position lists into a fresh one, restricting
+ * the points of each side to `x_at` and `y_at` and dropping the positions
+ * left with none.
+ */
+static glushkov_pos* glushkov_join(const glushkov_pos *x, size_t nx, uint8_t x_at,
+                                   const glushkov_pos *y, size_t ny, uint8_t y_at, size_t *count) {
+    glushkov_pos *out = malloc((nx + ny ? nx + ny : 1) * sizeof(glushkov_pos));
+    if (!out) return NULL;
+    size_t n = 0;
+    for (size_t i = 0; i < nx; i++) {
+        if (x[i].at & x_at) out[n++] = (glushkov_pos){ x[i].state, (uint8_t)(x[i].at & x_at) };
+    }
+    for (size_t i = 0; i < ny; i++) {
+        if (y[i].at & y_at) out[n++] = (glushkov_pos){ y[i].state, (uint8_t)(y[i].at & y_at) };
+    }
+    *count = n;
+    return out;
+}
+
+/* Adds an edge p -> q for every p in `from` and q in `to` that may meet inside the word. */
+static bool glushkov_follow(glushkov_ctx *ctx, const glushkov_pos *from, size_t nfrom,
+                            const glushkov_pos *to, size_t nto) {
+    for (size_t i = 0; i < nfrom; i++) {
+        if (!(from[i].at & GLUSHKOV_INSIDE)) continue;
+        for (size_t j = 0; j < nto; j++) {
+            if (!(to[j].at & GLUSHKOV_INSIDE)) continue;
+            if (!regex_add_edges(&ctx->builder, &ctx->symbols, ctx->positions[to[j].state],
+                                 from[i].state, to[j].state)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+/* Replaces `a` by a·b (or a|b when `alt` is set); consumes `b`. */
+static bool glushkov_combine(glushkov_ctx *ctx, glushkov_frag *a, glushkov_frag *b, bool alt) {
+    glushkov_frag out = { 0, NULL, 0, NULL, 0 };
+
+    if (alt) {
+        out.nullable = a->nullable | b->nullable;
+        out.first = glushkov_join(a->first, a->nfirst, GLUSHKOV_ANYWHERE,
+                                  b->first, b->nfirst, GLUSHKOV_ANYWHERE, &out.nfirst);
+        out.last = glushkov_join(a->last, a->nlast, GLUSHKOV_ANYWHERE,
+                                 b->last, b->nlast, GLUSHKOV_ANYWHERE, &out.nlast);
+    } else {
+        if (!glushkov_follow(ctx, a->last, a->nlast, b->first, b->nfirst)) {
+            glushkov_frag_free(b);
+            return false;
+        }
+        // b starts where a matched ε, and a ends where b matches ε
+        out.nullable = a->nullable & b->nullable;
+        out.first = glushkov_join(a->first, a->nfirst, GLUSHKOV_ANYWHERE,
+                                  b->first, b->nfirst, a->nullable, &out.nfirst);
+        out.last = glushkov_join(a->last, a->nlast, b->nullable,
+                                 b->last, b->nlast, GLUSHKOV_ANYWHERE, &out.nlast);
+    }
+
+    glushkov_frag_free(a);
+    glushkov_frag_free(b);
+    *a = out;
+    return out.first && out.last;
+}
+
+static bool glushkov_build(glushkov_ctx *ctx, const regex_node *node, glushkov_frag *out) {
+    memset(out, 0, sizeof(glushkov_frag));
+
+    switch (node->kind) {
+        case REGEX_EMPTY:
+            out->nullable = GLUSHKOV_ANYWHERE;
+            return true;
+
+        case REGEX_ANCHOR_START:
+            out->nullable = GLUSHKOV_START | GLUSHKOV_WHOLE;
+            return true;
+
+        case REGEX_ANCHOR_END:
+            out->nullable = GLUSHKOV_END | GLUSHKOV_WHOLE;
+            return true;
+
+        case REGEX_CHAR:
+        case REGEX_CLASS: {
+            int pos = fa_builder_add_state(&ctx->builder, 0);
+            if (pos < 0) return false;
+            if ((size_t)pos >= ctx->position_capacity) {
+                size_t new_capacity = ctx->builder.state_capacity;
+                const regex_node **grown = realloc(ctx->positions, new_capacity * sizeof(regex_node*));
+                if (!grown) return false;
+                ctx->positions = grown;
+                ctx->position_capacity = new_capacity;
+            }
+            ctx->positions[pos] = node;
+
+            out->first = malloc(sizeof(glushkov_pos));
+            out->last = malloc(sizeof(glushkov_pos));
+            if (!out->first || !out->last) return false;
+            out->first[0] = (glushkov_pos){ pos, GLUSHKOV_INSIDE | GLUSHKOV_START };
+            out->last[0] = (glushkov_pos){ pos, GLUSHKOV_INSIDE | GLUSHKOV_END };
+            out->nfirst = out->nlast = 1;
+            return true;
+        }
+
+        case REGEX_CONCAT:
+        case REGEX_ALT:
+            out->nullable = node->kind == REGEX_CONCAT ? GLUSHKOV_ANYWHERE : 0;
+            for (size_t i = 0; i < node->nkids; i++) {
+                glushkov_frag part;
+                if (!glushkov_build(ctx, node->kids[i], &part)) {
+                    glushkov_frag_free(&part);
+                    return false;
+                }
+                if (i == 0) {
+                    *out = part;
+                } else if (!glushkov_combine(ctx, out, &part, node->kind == REGEX_ALT)) {
+                    return false;
+                }
+            }
+            return true;
+
+        case REGEX_STAR:
+        case REGEX_PLUS:
+        case REGEX_QUESTION:
+            if (!glushkov_build(ctx, node->kids[0], out)) return false;
+            if (node->kind != REGEX_QUESTION &&
+                !glushkov_follow(ctx, out->last, out->nlast, out->first, out->nfirst)) {
+                return false;
+            }
+            if (node->kind != REGEX_PLUS) out->nullable = GLUSHKOV_ANYWHERE;
+            return true;
+
+        case REGEX_REPEAT: {
+            // Same expansion as the Thompson path: m copies, then x* or x?...
+            size_t copies = node->max == REGEX_UNBOUNDED ? (size_t)node->min + 1 : (size_t)node->max;
+            out->nullable = GLUSHKOV_ANYWHERE;
+            for (size_t i = 0; i < copies; i++) {
+                glushkov_frag part;
+                if (!glushkov_build(ctx, node->kids[0], &part)) {
+                    glushkov_frag_free(&part);
+                    return false;
+                }
+                if (i >= (size_t)node->min) {
+                    if (node->max == REGEX_UNBOUNDED &&
+                        !glushkov_follow(ctx, part.last, part.nlast, part.first, part.nfirst)) {
+                        glushkov_frag_free(&part);
+                        return false;
+                    }
+                    part.nullable = GLUSHKOV_ANYWHERE;
+                }
+                if (!glushkov_combine(ctx, out, &part, false)) return false;
+            }
+            return true;
+        }
+
+        default:
+            return false;
+    }
+}
+
+static int glushkov_compare_edges(const void *x, const void *y) {
+    const fa_index_edge *a = x, *b = y;
+    if (a->src != b->src) return a->src < b->src ? -1 : 1;
+    if (a->sym != b->sym) return a->sym < b->sym ? -1 : 1;
+    return (a->dest > b->dest) - (a->dest < b->dest);
+}
+
+fa_auto* fa_auto_from_regex_glushkov(const char* regex){
+    regex_ast *ast = regex_parse(regex, REGEX_PARSE_DEFAULT, NULL);
+    if (!ast) return NULL;
+    // A partial simplification on allocation failure is still equivalent
+    regex_simplify(ast);
+
+    glushkov_ctx ctx = { .positions = NULL, .position_capacity = 0 };
+    bool built = fa_builder_init(&ctx.builder, 64, 64);
+    bool ok = regex_symbols_init(&ctx.symbols);
+    fa_auto *automaton = NULL;
+    glushkov_frag root = { 0, NULL, 0, NULL, 0 };
+
+    // State 0 is the initial state, positions follow
+    if (!built || !ok || fa_builder_add_state(&ctx.builder, FA_INDEX_START) < 0) goto cleanup;
+    if (!glushkov_build(&ctx, ast->root, &root)) goto cleanup;
+
+    // The initial state is the start of the word, and accepting states its end
+    for (size_t i = 0; i < root.nfirst; i++) {
+        int pos = root.first[i].state;
+        if ((root.first[i].at & GLUSHKOV_START) &&
+            !regex_add_edges(&ctx.builder, &ctx.symbols, ctx.positions[pos], 0, pos)) {
+            goto cleanup;
+        }
+    }
+    if (root.nullable & GLUSHKOV_WHOLE) ctx.builder.flags[0] |= FA_INDEX_ACCEPT;
+    for (size_t i = 0; i < root.nlast; i++) {
+        if (root.last[i].at & GLUSHKOV_END) ctx.builder.flags[root.last[i].state] |= FA_INDEX_ACCEPT;
+    }
+
+    // Nested iterations can repeat a follow edge
+    if (ctx.builder.nedges > 1) {
+        qsort(ctx.builder.edges, ctx.builder.nedges, sizeof(fa_index_edge), glushkov_compare_edges);
+        size_t unique = 1;
+        for (size_t i = 1; i < ctx.builder.nedges; i++) {
+            if (glushkov_compare_edges(&ctx.builder.edges[unique - 1], &ctx.builder.edges[i]) != 0) {
+                ctx.builder.edges[unique++] = ctx.builder.edges[i];
+            }
+        }
+        ctx.builder.nedges = unique;
+    }
+
+    automaton = fa_builder_emit(&ctx.builder, ctx.symbols.symtab, NULL, NULL, NULL);
+
+cleanup:
+    glushkov_frag_free(&root);
+    if (built) fa_builder_free(&ctx.builder);
+    free(ctx.positions);
+    regex_symbols_free(&ctx.symbols);
+    regex_ast_destroy(ast);
+    return automaton;
 }
 
 
@@ -519,18 +1299,486 @@ void fa_auto_rename_states(const fa_auto* automaton){
 }
 
 
+// Epsilon Removal
+
+/*
+ * ε-closures are computed on the condensation of the ε-graph. States on an
+ * ε-cycle share their closure, so each ε-SCC (found with an iterative
+ * Tarjan) is handled once, and Tarjan emits components successors-first,
+ * which is the order in which closures can be built bottom-up.
+ *
+ * Closures are bitsets over the "useful" components only: those holding an
+ * accepting state or a non-ε transition. Pure ε glue, the bulk of
+ * Thompson-built NFAs, adds no bit, and a glue component with a single
+ * successor shares that successor's bitset instead of copying it.
+ */
+
+typedef struct eps_frame {
+    int state;
+    size_t edge;
+} eps_frame;
+
+typedef struct eps_graph {
+    const fa_index *index;
+    int eps;
+    int *comp;                  // state -> component, in Tarjan emission order
+    int *members;               // states grouped by component
+    size_t *comp_start;         // ncomp + 1 offsets into members
+    size_t ncomp;
+    bool all_useful;            // Every state has edges (to an explicit sink)
+    int *bit;                   // component -> closure bit, -1 if not useful
+    int *bit_comp;              // closure bit -> component
+    size_t nbits;
+    size_t words;
+    uint64_t **closure;         // component -> bitset, NULL if empty
+    bool *owned;                // whether closure[c] is freed with c
+} eps_graph;
+
+
+/* Bounds of the ε run of `state`; edges are sorted by symbol id. */
+static void eps_run(const fa_index *index, int eps, int state, size_t *begin, size_t *end) {
+    size_t lo = index->offsets[state], hi = index->offsets[state + 1];
+    while (lo < hi && index->syms[lo] < eps) lo++;
+    size_t e = lo;
+    while (e < hi && index->syms[e] == eps) e++;
+    *begin = lo;
+    *end = e;
+}
+
+static bool eps_tarjan(eps_graph *g) {
+    const fa_index *index = g->index;
+    size_t n = index->nstates;
+    size_t alloc = n ? n : 1;
+
+    int *num = malloc(alloc * sizeof(int));
+    int *low = malloc(alloc * sizeof(int));
+    int *stack = malloc(alloc * sizeof(int));
+    eps_frame *frames = malloc(alloc * sizeof(eps_frame));
+    bool *on_stack = calloc(alloc, sizeof(bool));
+    bool ok = num && low && stack && frames && on_stack;
+
+    size_t counter = 0, top = 0, nframes = 0;
+    if (ok) memset(num, -1, alloc * sizeof(int));
+
+    for (size_t root = 0; ok && root < n; root++) {
+        if (num[root] >= 0) continue;
+
+        num[root] = low[root] = (int)counter++;
+        stack[top++] = (int)root;
+        on_stack[root] = true;
+        frames[nframes].state = (int)root;
+        frames[nframes].edge = 0;
+        nframes++;
+
+        while (nframes > 0) {
+            eps_frame *f = &frames[nframes - 1];
+            int v = f->state;
+            size_t begin, end;
+            eps_run(index, g->eps, v, &begin, &end);
+            if (f->edge < begin) f->edge = begin;
+
+            bool descended = false;
+            while (f->edge < end) {
+                int w = index->dests[f->edge++];
+                if (num[w] < 0) {
+                    num[w] = low[w] = (int)counter++;
+                    stack[top++] = w;
+                    on_stack[w] = true;
+                    frames[nframes].state = w;
+                    frames[nframes].edge = 0;
+                    nframes++;
+                    descended = true;
+                    break;
+                }
+                if (on_stack[w] && num[w] < low[v]) low[v] = num[w];
+            }
+            if (descended) continue;
+
+            nframes--;
+            if (low[v] == num[v]) {
+                int w;
+                do {
+                    w = stack[--top];
+                    on_stack[w] = false;
+                    g->comp[w] = (int)g->ncomp;
+                } while (w != v);
+                g->ncomp++;
+            }
+            if (nframes > 0) {
+                int parent = frames[nframes - 1].state;
+                if (low[v] < low[parent]) low[parent] = low[v];
+            }
+        }
+    }
+
+    free(num);
+    free(low);
+    free(stack);
+    free(frames);
+    free(on_stack);
+    return ok;
+}
+
+/* Groups states by component and picks the components that get a bit. */
+static bool eps_group(eps_graph *g) {
+    const fa_index *index = g->index;
+    size_t n = index->nstates;
+
+    g->comp_start = calloc(g->ncomp + 1, sizeof(size_t));
+    g->members = malloc((n ? n : 1) * sizeof(int));
+    g->bit = malloc((g->ncomp ? g->ncomp : 1) * sizeof(int));
+    g->bit_comp = malloc((g->ncomp ? g->ncomp : 1) * sizeof(int));
+    if (!g->comp_start || !g->members || !g->bit || !g->bit_comp) return false;
+
+    for (size_t s = 0; s < n; s++) g->comp_start[g->comp[s] + 1]++;
+    for (size_t c = 0; c < g->ncomp; c++) g->comp_start[c + 1] += g->comp_start[c];
+    for (size_t s = 0; s < n; s++) {
+        // comp_start[c] is used as a cursor and shifted back below
+        g->members[g->comp_start[g->comp[s]]++] = (int)s;
+    }
+    for (size_t c = g->ncomp; c > 0; c--) g->comp_start[c] = g->comp_start[c - 1];
+    g->comp_start[0] = 0;
+
+    for (size_t c = 0; c < g->ncomp; c++) {
+        bool useful = g->all_useful;
+        for (size_t i = g->comp_start[c]; i < g->comp_start[c + 1] && !useful; i++) {
+            int s = g->members[i];
+            size_t begin, end;
+            eps_run(index, g->eps, s, &begin, &end);
+            useful = (index->flags[s] & FA_INDEX_ACCEPT) ||
+                     end - begin < index->offsets[s + 1] - index->offsets[s];
+        }
+        g->bit[c] = useful ? (int)g->nbits : -1;
+        if (useful) g->bit_comp[g->nbits++] = (int)c;
+    }
+    g->words = (g->nbits + 63) / 64;
+    return true;
+}
+
+static bool eps_closures(eps_graph *g) {
+    const fa_index *index = g->index;
+    size_t nc = g->ncomp ? g->ncomp : 1;
+
+    g->closure = calloc(nc, sizeof(uint64_t*));
+    g->owned = calloc(nc, sizeof(bool));
+    int *seen = malloc(nc * sizeof(int));
+    int *succ = malloc(nc * sizeof(int));
+    bool ok = g->closure && g->owned && seen && succ;
+    if (ok) memset(seen, -1, nc * sizeof(int));
+
+    // Successor components always have smaller ids
+    for (size_t c = 0; ok && c < g->ncomp; c++) {
+        size_t nsucc = 0;
+        for (size_t i = g->comp_start[c]; i < g->comp_start[c + 1]; i++) {
+            size_t begin, end;
+            eps_run(index, g->eps, g->members[i], &begin, &end);
+            for (size_t e = begin; e < end; e++) {
+                int d = g->comp[index->dests[e]];
+                if ((size_t)d == c || seen[d] == (int)c || !g->closure[d]) continue;
+                seen[d] = (int)c;
+                succ[nsucc++] = d;
+            }
+        }
+
+        if (g->bit[c] < 0 && nsucc <= 1) {
+            g->closure[c] = nsucc ? g->closure[succ[0]] : NULL;
+            continue;
+        }
+
+        uint64_t *bits = calloc(g->words, sizeof(uint64_t));
+        if (!bits) {
+            ok = false;
+            break;
+        }
+        if (g->bit[c] >= 0) bitset_words_add(bits, (size_t)g->bit[c]);
+        for (size_t k = 0; k < nsucc; k++) {
+            bitset_words_or(bits, g->closure[succ[k]], g->words);
+        }
+        g->closure[c] = bits;
+        g->owned[c] = true;
+    }
+
+    free(seen);
+    free(succ);
+    return ok;
+}
+
+static void eps_graph_free(eps_graph *g) {
+    if (g->closure) {
+        for (size_t c = 0; c < g->ncomp; c++) {
+            if (g->owned[c]) free(g->closure[c]);
+        }
+    }
+    free(g->closure);
+    free(g->owned);
+    free(g->comp);
+    free(g->members);
+    free(g->comp_start);
+    free(g->bit);
+    free(g->bit_comp);
+}
+
+static int eps_compare_edges(const void *x, const void *y) {
+    const int *a = x, *b = y;
+    if (a[0] != b[0]) return a[0] < b[0] ? -1 : 1;
+    return (a[1] > b[1]) - (a[1] < b[1]);
+}
+
+static bool eps_push_edge(int **edges, size_t *nedges, size_t *capacity, int sym, int dest) {
+    if (*nedges >= *capacity) {
+        size_t new_capacity = *capacity ? *capacity * 2 : 64;
+        int *grown = realloc(*edges, new_capacity * 2 * sizeof(int));
+        if (!grown) return false;
+        *edges = grown;
+        *capacity = new_capacity;
+    }
+    (*edges)[2 * *nedges] = sym;
+    (*edges)[2 * *nedges + 1] = dest;
+    (*nedges)++;
+    return true;
+}
+
+/*
+ * An implicit accepting sink is taken on the moves a state lacks itself,
+ * which ε-removal would hide behind moves copied from its closure. It
+ * becomes an ordinary accepting state, looping on `alphabet`; returns
+ * NULL if no state lacks a move or on allocation failure (*ok false).
+ */
+static fa_state* eps_add_sink(fa_auto *automaton, const fa_index *index,
+                              const int *alphabet, size_t nalphabet, bool *ok) {
+    bool needed = false;
+    *ok = true;
+    for (size_t s = 0; s < index->nstates && !needed; s++) {
+        for (size_t i = 0; i < nalphabet && !needed; i++) {
+            needed = !fa_index_has_move(index, s, alphabet[i]);
+        }
+    }
+    if (!needed) return NULL;
+
+    if (automaton->nstates >= automaton->capacity) {
+        fa_state **grown = realloc(automaton->states, (automaton->capacity + 1) * sizeof(fa_state*));
+        if (!grown) {
+            *ok = false;
+            return NULL;
+        }
+        automaton->states = grown;
+        automaton->states[automaton->capacity++] = NULL;
+    }
+    fa_state *sink = fa_state_create("sink", false, true);
+    if (!sink) {
+        *ok = false;
+        return NULL;
+    }
+    for (size_t i = nalphabet; i > 0; i--) {
+        if (fa_trans_create(sink, sink, index->symtab->symbols[alphabet[i - 1]]) != FA_SUCCESS) {
+            fa_state_destroy(sink);
+            *ok = false;
+            return NULL;
+        }
+    }
+    automaton->states[automaton->nstates++] = sink;
+    return sink;
+}
+
+/*
+ * Replaces the transitions of every state p by the non-ε transitions of its
+ * ε-closure (plus its own ε-edges when `keep_eps` is set), and makes p
+ * accepting if its closure is. States sharing a component share one
+ * rewired edge list, which is built once. An implicit accepting sink is
+ * made explicit first (see eps_add_sink).
+ */
+static void eps_saturate(fa_auto *automaton, bool keep_eps) {
+    if (!automaton) return;
+
+    fa_index *index = fa_index_build(automaton, NULL);
+    if (!index) return;
+
+    eps_graph g;
+    memset(&g, 0, sizeof(eps_graph));
+    g.index = index;
+    g.eps = index->symtab->eps;
+
+    int *edges = NULL;              // (sym, dest) pairs of one component
+    size_t nedges = 0, edge_capacity = 0;
+    int *alphabet = NULL;           // Moves of the implicit sink, if any
+    size_t nalphabet = 0;
+    fa_state *sink = NULL;          // Destination id nstates on `edges`
+    int sink_id = (int)index->nstates;
+
+    if (g.eps < 0) goto cleanup;    // nothing to do
+
+    if (automaton->sink_accepts) {
+        bool ok;
+        if (!fa_index_alphabet(index, automaton, &alphabet, &nalphabet)) goto cleanup;
+        // Unreachable until edges lead to it, so failing below is harmless
+        sink = eps_add_sink(automaton, index, alphabet, nalphabet, &ok);
+        if (!ok) goto cleanup;
+        g.all_useful = sink != NULL;
+    }
+
+    g.comp = malloc((index->nstates ? index->nstates : 1) * sizeof(int));
+    if (!g.comp || !eps_tarjan(&g) || !eps_group(&g) || !eps_closures(&g)) goto cleanup;
+
+    for (size_t c = 0; c < g.ncomp; c++) {
+        const uint64_t *bits = g.closure[c];
+        bool accept = false;
+        nedges = 0;
+
+        for (size_t b = bits ? bitset_words_next(bits, g.words, 0) : BITSET_END; b != BITSET_END;
+             b = bitset_words_next(bits, g.words, b + 1)) {
+            int d = g.bit_comp[b];
+            for (size_t i = g.comp_start[d]; i < g.comp_start[d + 1]; i++) {
+                int s = g.members[i];
+                if (index->flags[s] & FA_INDEX_ACCEPT) accept = true;
+                for (size_t e = index->offsets[s]; e < index->offsets[s + 1]; e++) {
+                    if (index->syms[e] == g.eps) continue;
+                    if (!eps_push_edge(&edges, &nedges, &edge_capacity, index->syms[e],
+                                       index->dests[e])) goto cleanup;
+                }
+                for (size_t k = 0; sink && k < nalphabet; k++) {
+                    if (fa_index_has_move(index, (size_t)s, alphabet[k])) continue;
+                    if (!eps_push_edge(&edges, &nedges, &edge_capacity, alphabet[k], sink_id)) goto cleanup;
+                }
+            }
+        }
+
+        if (nedges > 1) qsort(edges, nedges, 2 * sizeof(int), eps_compare_edges);
+        size_t unique = 0;
+        for (size_t i = 0; i < nedges; i++) {
+            if (unique && edges[2 * unique - 2] == edges[2 * i] &&
+                edges[2 * unique - 1] == edges[2 * i + 1]) {
+                continue;
+            }
+            edges[2 * unique] = edges[2 * i];
+            edges[2 * unique + 1] = edges[2 * i + 1];
+            unique++;
+        }
+
+        for (size_t i = g.comp_start[c]; i < g.comp_start[c + 1]; i++) {
+            int p = g.members[i];
+            fa_state *state = index->states[p];
+            size_t begin, end;
+            eps_run(index, g.eps, p, &begin, &end);
+
+            fa_trans *t = state->trans;
+            while (t) {
+                fa_trans *next = t->next;
+                free(t->symbol);
+                free(t);
+                t = next;
+            }
+            state->trans = NULL;
+            state->ntrans = 0;
+            if (accept) state->is_accept = true;
+
+            // Prepending in reverse keeps every list sorted by symbol
+            for (size_t k = unique; k > 0; k--) {
+                int d = edges[2 * k - 1];
+                fa_trans_create(state, d == sink_id ? sink : index->states[d],
+                                index->symtab->symbols[edges[2 * k - 2]]);
+            }
+            if (keep_eps) {
+                for (size_t e = end; e > begin; e--) {
+                    fa_trans_create(state, index->states[index->dests[e - 1]], FA_EPS_SYMBOL);
+                }
+            }
+        }
+    }
+    if (sink) automaton->sink_accepts = false;
+
+cleanup:
+    free(edges);
+    free(alphabet);
+    eps_graph_free(&g);
+    fa_index_destroy(index);
+}
 
+void fa_auto_remove_epsilon(fa_auto *automaton){
+    eps_saturate(automaton, false);
+}
 
+void fa_auto_add_epsilon_trans(fa_auto *automaton){
+    eps_saturate(automaton, true);
+}
 
 
+typedef struct eps_visited {
+    const fa_state **slots;
+    size_t nslots;
+    size_t count;
+} eps_visited;
 
+static size_t eps_ptr_hash(const fa_state *state) {
+    uint64_t h = (uint64_t)(uintptr_t)state;
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    return (size_t)h;
+}
 
+/* Returns 1 if newly inserted, 0 if already present, -1 on failure. */
+static int eps_visit(eps_visited *visited, const fa_state *state) {
+    if ((visited->count + 1) * 2 > visited->nslots) {
+        size_t nslots = visited->nslots ? visited->nslots * 2 : 64;
+        const fa_state **slots = calloc(nslots, sizeof(fa_state*));
+        if (!slots) return -1;
+        for (size_t i = 0; i < visited->nslots; i++) {
+            if (!visited->slots[i]) continue;
+            size_t h = eps_ptr_hash(visited->slots[i]) & (nslots - 1);
+            while (slots[h]) h = (h + 1) & (nslots - 1);
+            slots[h] = visited->slots[i];
+        }
+        free(visited->slots);
+        visited->slots = slots;
+        visited->nslots = nslots;
+    }
 
+    size_t mask = visited->nslots - 1;
+    size_t h = eps_ptr_hash(state) & mask;
+    while (visited->slots[h]) {
+        if (visited->slots[h] == state) return 0;
+        h = (h + 1) & mask;
+    }
+    visited->slots[h] = state;
+    visited->count++;
+    return 1;
+}
 
+void fa_auto_epsilon_closure(fa_state *state, fa_state **closure, int *size){
+    if (!size) return;
+    *size = 0;
+    if (!state || !closure) return;
+
+    eps_visited visited = { NULL, 0, 0 };
+    if (eps_visit(&visited, state) < 0) return;
+    closure[(*size)++] = state;
+
+    // The closure array doubles as the worklist
+    for (int i = 0; i < *size; i++) {
+        for (fa_trans *t = closure[i]->trans; t; t = t->next) {
+            if (strcmp(t->symbol, FA_EPS_SYMBOL) != 0) continue;
+            int inserted = eps_visit(&visited, t->dest);
+            if (inserted < 0) break;
+            if (inserted) closure[(*size)++] = t->dest;
+        }
+    }
+    free(visited.slots);
+}
 
 
 void fa_state_destroy(fa_state* s){
+    if (!s) return;
+
+    fa_trans* current = s->trans;
+    while (current) {
+        fa_trans* next = current->next;
+        free(current->symbol);
+        free(current);
+        current = next;
+    }
 
+    free(s->label);
+    free(s);
 }
 
 void fa_auto_destroy(fa_auto* a) {
@@ -655,76 +1903,184 @@ bool fa_stack_is_full(const fa_stack *stack) {
 
 
 
-bool fa_auto_accepts(const fa_auto* automaton, const char* word){
-    if (!automaton || !word || !automaton->states) return false;
+bool fa_auto_is_deterministic(const fa_auto* automaton){
+    fa_index* index = fa_index_build(automaton, NULL);
+    if (!index) return false;
 
-    //0 -> word rejected
-    //1 -> word accepted
+    bool deterministic = fa_index_is_deterministic(index);
+    fa_index_destroy(index);
+    return deterministic;
+}
 
-    for (int i = 0; i < automaton->capacity; i++) {
-        fa_state* state = automaton->states[i];
 
-        if (state->is_start) {
-            fa_state* current_state = state;
-            int symbol_idx = 0;
+/*
+ * Runs all paths at once over the index. Interval labels skip a whole UTF-8
+ * character, so the state set of each of the next few byte offsets is kept
+ * in a ring of bitsets; offset i only receives moves from i - 4 .. i - 1.
+ *
+ * An implicit accepting sink is bit n of the sets. As in
+ * fa_auto_materialize_sink, a state without a move on an alphabet symbol
+ * falls into it, and it loops on the alphabet only.
+ */
+#define ACCEPTS_RING 5
+
+typedef struct accepts_span {
+    fa_range range;
+    int id;
+} accepts_span;
+
+typedef struct accepts_sink {
+    int byte[256];              // one-byte alphabet symbol -> id, -1 if none
+    accepts_span *spans;        // ranged alphabet symbols, sorted by lo
+    size_t nspans;
+} accepts_sink;
+
+static void accepts_closure(const fa_index *index, BitSet *set, int *stack) {
+    int eps = index->symtab->eps;
+    size_t top = 0;
+    if (eps < 0) return;
+
+    for (size_t s = bitset_next(set, 0); s < index->nstates; s = bitset_next(set, s + 1)) {
+        stack[top++] = (int)s;
+    }
+    while (top) {
+        int s = stack[--top];
+        for (size_t e = index->offsets[s]; e < index->offsets[s + 1]; e++) {
+            int d = index->dests[e];
+            if (index->syms[e] != eps || bitset_contains(set, (size_t)d)) continue;
+            bitset_add(set, (size_t)d);
+            stack[top++] = d;
+        }
+    }
+}
 
-            while (1) {
-                fa_trans* current_transition = current_state->trans;
-                int found = 0;
+static int accepts_compare_spans(const void *x, const void *y) {
+    const accepts_span *a = x, *b = y;
+    return (a->range.lo > b->range.lo) - (a->range.lo < b->range.lo);
+}
 
+/* Collects the alphabet symbols the sink moves on; false on allocation failure. */
+static bool accepts_sink_init(accepts_sink *sink, const fa_auto *automaton, const fa_index *index) {
+    int *ids;
+    size_t count;
+
+    for (int c = 0; c < 256; c++) sink->byte[c] = -1;
+    if (!fa_index_alphabet(index, automaton, &ids, &count)) return false;
+    sink->spans = malloc((count ? count : 1) * sizeof(accepts_span));
+    if (!sink->spans) {
+        free(ids);
+        return false;
+    }
+    for (size_t i = 0; i < count; i++) {
+        const char *symbol = index->symtab->symbols[ids[i]];
+        if (symbol[0] && !symbol[1]) sink->byte[(unsigned char)symbol[0]] = ids[i];
+        accepts_span *span = &sink->spans[sink->nspans];
+        if (fa_symtab_range(index->symtab, ids[i], &span->range)) {
+            span->id = ids[i];
+            sink->nspans++;
+        }
+    }
+    qsort(sink->spans, sink->nspans, sizeof(accepts_span), accepts_compare_spans);
+    free(ids);
+    return true;
+}
 
-                char symbol[2] = {word[symbol_idx], '\0'};
+/* Id of the ranged alphabet symbol holding `cp`, or -1. */
+static int accepts_sink_range(const accepts_sink *sink, uint32_t cp) {
+    size_t lo = 0, hi = sink->nspans;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (sink->spans[mid].range.hi < cp) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo < sink->nspans && sink->spans[lo].range.lo <= cp ? sink->spans[lo].id : -1;
+}
 
-                while (current_transition) {
-                    if (strcmp(current_transition->symbol, "eps") == 0) {
+bool fa_auto_accepts(const fa_auto* automaton, const char* word){
+    if (!automaton || !word || !automaton->states) return false;
 
-                        current_state = current_transition->dest;
-                        found = 1;
-                        break;
-                    }
-                    else if (strcmp(current_transition->symbol, symbol) == 0) {
-                        current_state = current_transition->dest;
-                        found = 1;
-                        symbol_idx++;
-                        break;
-                    }
-                    current_transition = current_transition->next;
-                }
+    fa_index *index = fa_index_build(automaton, NULL);
+    if (!index) return false;
+
+    size_t n = index->nstates, nsyms = index->symtab->count;
+    bool has_sink = automaton->sink_accepts;
+    accepts_sink sink = { .spans = NULL, .nspans = 0 };
+    BitSet *ring[ACCEPTS_RING] = { NULL };
+    int *stack = malloc((n ? n : 1) * sizeof(int));
+    int *byte = malloc((nsyms ? nsyms : 1) * sizeof(int));
+    bool ok = stack && byte, accepted = false;
+    for (size_t k = 0; k < ACCEPTS_RING; k++) {
+        ring[k] = bitset_create(n + 1);
+        ok = ok && ring[k];
+    }
+    if (!ok || (has_sink && !accepts_sink_init(&sink, automaton, index))) goto cleanup;
 
-                if (!found) {
-                    break;
-                }
+    // One-byte symbols match bytes; characters and minterms match code points
+    for (size_t id = 0; id < nsyms; id++) {
+        const char *symbol = index->symtab->symbols[id];
+        byte[id] = symbol[0] && !symbol[1] ? (unsigned char)symbol[0] : -1;
+    }
+    for (size_t s = 0; s < n; s++) {
+        if (index->flags[s] & FA_INDEX_START) bitset_add(ring[0], s);
+    }
 
+    size_t length = strlen(word);
+    bool live = true;
+    for (size_t i = 0; i <= length && live; i++) {
+        BitSet *current = ring[i % ACCEPTS_RING];
+        if (bitset_is_empty(current)) continue;
+        accepts_closure(index, current, stack);
 
-                if (word[symbol_idx] == '\0') {
-                    if (current_state->is_accept) {
-                        return 1;
-                    }
-                    //Checking for epsilon transitions after the stopping state
-                    int epsilon_found;
-                    do {
-                        epsilon_found = 0;
-                        fa_trans* epsilon_transition = current_state->trans;
-
-                        while (epsilon_transition) {
-                            if (strcmp(epsilon_transition->symbol, "eps") == 0) {
-                                
-                                current_state = epsilon_transition->dest;
-
-
-                                if (current_state->is_accept) {
-                                    return 1;
-                                }
-                                epsilon_found = 1;
-                            }
-                            epsilon_transition = epsilon_transition->next;
-                        }
-                    } while (epsilon_found);
-                    break;
+        if (i == length) {
+            for (size_t s = bitset_next(current, 0); s != BITSET_END; s = bitset_next(current, s + 1)) {
+                if (s == n || (index->flags[s] & FA_INDEX_ACCEPT)) accepted = true;
+            }
+            break;
+        }
+
+        uint32_t cp;
+        size_t cp_len = fa_range_decode(word + i, &cp);
+        fa_range range;
+        for (size_t s = bitset_next(current, 0); s < n; s = bitset_next(current, s + 1)) {
+            for (size_t e = index->offsets[s]; e < index->offsets[s + 1]; e++) {
+                int sym = index->syms[e];
+                size_t step = 0;
+                if (byte[sym] == (unsigned char)word[i]) {
+                    step = 1;
+                } else if (cp_len && fa_symtab_range(index->symtab, sym, &range) &&
+                           range.lo <= cp && cp <= range.hi) {
+                    step = cp_len;
+                }
+                if (step) bitset_add(ring[(i + step) % ACCEPTS_RING], (size_t)index->dests[e]);
+            }
+        }
+
+        if (has_sink) {
+            // At most a one-byte symbol and a ranged one read this position
+            int ids[2] = { sink.byte[(unsigned char)word[i]], cp_len ? accepts_sink_range(&sink, cp) : -1 };
+            size_t steps[2] = { 1, cp_len };
+            if (ids[1] == ids[0]) ids[1] = -1;
+            for (int k = 0; k < 2; k++) {
+                if (ids[k] < 0) continue;
+                BitSet *next = ring[(i + steps[k]) % ACCEPTS_RING];
+                bool falls = bitset_contains(current, n);
+                for (size_t s = bitset_next(current, 0); s < n && !falls; s = bitset_next(current, s + 1)) {
+                    falls = !fa_index_has_move(index, s, ids[k]);
                 }
+                if (falls) bitset_add(next, n);
             }
         }
+        bitset_clear(current);
+
+        live = false;
+        for (size_t k = 0; k < ACCEPTS_RING; k++) live |= !bitset_is_empty(ring[k]);
     }
 
-    return 0;
-}
\ No newline at end of file
+cleanup:
+    for (size_t k = 0; k < ACCEPTS_RING; k++) bitset_destroy(ring[k]);
+    free(sink.spans);
+    free(stack);
+    free(byte);
+    fa_index_destroy(index);
+    return accepted;
+}
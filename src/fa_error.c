@@ -25,6 +25,8 @@ const char* fa_error_str(fa_error_t err) {
             return "Buffer too small";
         case FA_ERR_INVALID_OPERATION:
             return "Invalid operation";
+        case FA_ERR_BUDGET_EXCEEDED:
+            return "Resource budget exceeded";
             
         /* ===== SET & COLLECTION ERRORS ===== */
         case FA_ERR_SET_DUPLICATE:
@@ -137,6 +139,8 @@ const char* fa_error_str(fa_error_t err) {
             return "Unexpected token";
         case FA_ERR_REGEX_TRAILING_BACKSLASH:
             return "Trailing backslash";
+        case FA_ERR_REGEX_TOO_COMPLEX:
+            return "Regular expression nests too deep or expands too far";
             
         /* ===== CONVERSION ERRORS ===== */
         case FA_ERR_CONVERSION_FAILED:
@@ -0,0 +1,913 @@
+#include "../include/fa/fa_index.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+#define FA_SYMTAB_INITIAL_SLOTS 64
+
+
+static size_t fa_index_hash_string(const char *str) {
+    // FNV-1a
+    size_t hash = (size_t)1469598103934665603ULL;
+    while (*str) {
+        hash ^= (unsigned char)*str++;
+        hash *= (size_t)1099511628211ULL;
+    }
+    return hash;
+}
+
+static size_t fa_index_hash_pointer(const void *ptr) {
+    uint64_t x = (uint64_t)(uintptr_t)ptr;
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    return (size_t)x;
+}
+
+static size_t fa_index_round_pow2(size_t n) {
+    size_t p = 1;
+    while (p < n) p <<= 1;
+    return p;
+}
+
+
+// Symbol table
+
+fa_symtab* fa_symtab_create(void) {
+    fa_symtab *symtab = malloc(sizeof(fa_symtab));
+    if (!symtab) return NULL;
+
+    symtab->count = 0;
+    symtab->capacity = 16;
+    symtab->symbols = malloc(symtab->capacity * sizeof(char*));
+    symtab->spans = malloc(symtab->capacity * sizeof(fa_range));
+    symtab->nslots = FA_SYMTAB_INITIAL_SLOTS;
+    symtab->slots = malloc(symtab->nslots * sizeof(int));
+    symtab->eps = -1;
+    symtab->symbolic = false;
+    symtab->bounds = NULL;
+    symtab->nbounds = symtab->bound_capacity = 0;
+    symtab->blocks = NULL;
+
+    if (!symtab->symbols || !symtab->spans || !symtab->slots) {
+        free(symtab->symbols);
+        free(symtab->spans);
+        free(symtab->slots);
+        free(symtab);
+        return NULL;
+    }
+
+    memset(symtab->slots, -1, symtab->nslots * sizeof(int));
+    return symtab;
+}
+
+void fa_symtab_destroy(fa_symtab *symtab) {
+    if (!symtab) return;
+
+    for (size_t i = 0; i < symtab->count; i++) {
+        free(symtab->symbols[i]);
+    }
+    free(symtab->symbols);
+    free(symtab->spans);
+    free(symtab->slots);
+    free(symtab->bounds);
+    free(symtab->blocks);
+    free(symtab);
+}
+
+static bool fa_symtab_grow_slots(fa_symtab *symtab) {
+    size_t nslots = symtab->nslots * 2;
+    int *slots = malloc(nslots * sizeof(int));
+    if (!slots) return false;
+
+    memset(slots, -1, nslots * sizeof(int));
+    for (size_t i = 0; i < symtab->count; i++) {
+        size_t h = fa_index_hash_string(symtab->symbols[i]) & (nslots - 1);
+        while (slots[h] != -1) h = (h + 1) & (nslots - 1);
+        slots[h] = (int)i;
+    }
+
+    free(symtab->slots);
+    symtab->slots = slots;
+    symtab->nslots = nslots;
+    return true;
+}
+
+int fa_symtab_lookup(const fa_symtab *symtab, const char *symbol) {
+    if (!symtab || !symbol) return -1;
+
+    size_t mask = symtab->nslots - 1;
+    size_t h = fa_index_hash_string(symbol) & mask;
+    while (symtab->slots[h] != -1) {
+        int id = symtab->slots[h];
+        if (strcmp(symtab->symbols[id], symbol) == 0) return id;
+        h = (h + 1) & mask;
+    }
+    return -1;
+}
+
+int fa_symtab_intern(fa_symtab *symtab, const char *symbol) {
+    if (!symtab || !symbol) return -1;
+
+    int id = fa_symtab_lookup(symtab, symbol);
+    if (id >= 0) return id;
+
+    // Keep the load factor under 1/2
+    if ((symtab->count + 1) * 2 > symtab->nslots && !fa_symtab_grow_slots(symtab)) {
+        return -1;
+    }
+
+    if (symtab->count >= symtab->capacity) {
+        size_t new_capacity = symtab->capacity * 2;
+        char **symbols = realloc(symtab->symbols, new_capacity * sizeof(char*));
+        if (!symbols) return -1;
+        symtab->symbols = symbols;
+        fa_range *spans = realloc(symtab->spans, new_capacity * sizeof(fa_range));
+        if (!spans) return -1;
+        symtab->spans = spans;
+        symtab->capacity = new_capacity;
+    }
+
+    char *copy = strdup(symbol);
+    if (!copy) return -1;
+
+    // Single characters and minterm labels cover one interval
+    fa_range span = { 1, 0 };
+    uint32_t cp;
+    size_t length = fa_range_decode(symbol, &cp);
+    if (length && symbol[length] == '\0') {
+        if (strcmp(symbol, FA_EPS_SYMBOL) != 0) span.lo = span.hi = cp;
+    } else if (symbol[0] == '[') {
+        fa_range *ranges;
+        size_t count;
+        if (fa_range_parse(symbol, &ranges, &count) == FA_SUCCESS && count == 1) span = ranges[0];
+        free(ranges);
+    }
+
+    id = (int)symtab->count;
+    symtab->spans[symtab->count] = span;
+    symtab->symbols[symtab->count++] = copy;
+
+    size_t mask = symtab->nslots - 1;
+    size_t h = fa_index_hash_string(symbol) & mask;
+    while (symtab->slots[h] != -1) h = (h + 1) & mask;
+    symtab->slots[h] = id;
+
+    if (symtab->eps < 0 && strcmp(symbol, FA_EPS_SYMBOL) == 0) {
+        symtab->eps = id;
+    }
+
+    return id;
+}
+
+bool fa_symtab_range(const fa_symtab *symtab, int id, fa_range *range) {
+    if (!symtab || id < 0 || (size_t)id >= symtab->count) return false;
+    if (symtab->spans[id].lo > symtab->spans[id].hi) return false;
+    if (range) *range = symtab->spans[id];
+    return true;
+}
+
+/*
+ * Parses `symbol` if it is an interval label. Single characters are not
+ * labels: they keep their own id and only split the partition.
+ */
+static fa_error_t fa_symtab_parse_label(const char *symbol, fa_range **ranges, size_t *count) {
+    *ranges = NULL;
+    *count = 0;
+    if (symbol[0] != '[' || symbol[1] == '\0') return FA_ERR_INVALID_ARGUMENT;
+    return fa_range_parse(symbol, ranges, count);
+}
+
+static bool fa_symtab_has_bound(const fa_symtab *symtab, uint32_t bound) {
+    if (bound > FA_RANGE_MAX) return true;
+
+    size_t lo = 0, hi = symtab->nbounds;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (symtab->bounds[mid] < bound) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo < symtab->nbounds && symtab->bounds[lo] == bound;
+}
+
+static bool fa_symtab_add_bound(fa_symtab *symtab, uint32_t bound) {
+    if (bound > FA_RANGE_MAX) return true;
+    if (symtab->blocks) return fa_symtab_has_bound(symtab, bound);
+
+    if (symtab->nbounds >= symtab->bound_capacity) {
+        size_t new_capacity = symtab->bound_capacity ? symtab->bound_capacity * 2 : 64;
+        uint32_t *bounds = realloc(symtab->bounds, new_capacity * sizeof(uint32_t));
+        if (!bounds) return false;
+        symtab->bounds = bounds;
+        symtab->bound_capacity = new_capacity;
+    }
+    symtab->bounds[symtab->nbounds++] = bound;
+    return true;
+}
+
+static bool fa_symtab_register_symbol(fa_symtab *symtab, const char *symbol) {
+    fa_range *ranges;
+    size_t count;
+    fa_error_t status = fa_symtab_parse_label(symbol, &ranges, &count);
+    if (status == FA_ERR_OUT_OF_MEMORY) return false;
+
+    if (status != FA_SUCCESS) {
+        bool known = fa_symtab_lookup(symtab, symbol) >= 0;
+        int id = fa_symtab_intern(symtab, symbol);
+        if (id < 0) return false;
+        // A new character must not cut a minterm that is already in use
+        fa_range span;
+        if (known || !symtab->blocks || !fa_symtab_range(symtab, id, &span)) return true;
+        return fa_symtab_has_bound(symtab, span.lo) && fa_symtab_has_bound(symtab, span.hi + 1);
+    }
+
+    bool ok = true;
+    for (size_t i = 0; i < count && ok; i++) {
+        ok = fa_symtab_add_bound(symtab, ranges[i].lo) &&
+             fa_symtab_add_bound(symtab, ranges[i].hi + 1);
+    }
+    free(ranges);
+    symtab->symbolic = true;
+    return ok;
+}
+
+static bool fa_symtab_has_labels(const fa_auto *automaton) {
+    if (automaton->alphabet) {
+        for (size_t i = 0; i < automaton->alphabet->length; i++) {
+            const char *symbol = *(const char* const*)automaton->alphabet->members[i];
+            if (symbol && symbol[0] == '[' && symbol[1] != '\0') return true;
+        }
+    }
+    for (size_t i = 0; automaton->states && i < automaton->capacity; i++) {
+        if (!automaton->states[i]) continue;
+        for (fa_trans *t = automaton->states[i]->trans; t; t = t->next) {
+            if (t->symbol[0] == '[' && t->symbol[1] != '\0') return true;
+        }
+    }
+    return false;
+}
+
+bool fa_symtab_register(fa_symtab *symtab, const fa_auto *automaton) {
+    if (!symtab || !automaton) return false;
+    if (!symtab->symbolic && !fa_symtab_has_labels(automaton)) return true;
+
+    if (automaton->alphabet) {
+        for (size_t i = 0; i < automaton->alphabet->length; i++) {
+            const char *symbol = *(const char* const*)automaton->alphabet->members[i];
+            if (symbol && !fa_symtab_register_symbol(symtab, symbol)) return false;
+        }
+    }
+    if (automaton->states) {
+        for (size_t i = 0; i < automaton->capacity; i++) {
+            if (!automaton->states[i]) continue;
+            for (fa_trans *t = automaton->states[i]->trans; t; t = t->next) {
+                if (!fa_symtab_register_symbol(symtab, t->symbol)) return false;
+            }
+        }
+    }
+    return true;
+}
+
+static int fa_symtab_compare_bounds(const void *x, const void *y) {
+    uint32_t a = *(const uint32_t*)x, b = *(const uint32_t*)y;
+    return (a > b) - (a < b);
+}
+
+/*
+ * Fixes the minterm partition: label bounds, plus a singleton block for
+ * every character interned so far so that it keeps its own id.
+ */
+static bool fa_symtab_fix(fa_symtab *symtab) {
+    if (!fa_symtab_add_bound(symtab, 0)) return false;
+    for (size_t i = 0; i < symtab->count; i++) {
+        const fa_range *span = &symtab->spans[i];
+        if (span->lo != span->hi) continue;
+        if (!fa_symtab_add_bound(symtab, span->lo) || !fa_symtab_add_bound(symtab, span->hi + 1)) {
+            return false;
+        }
+    }
+
+    qsort(symtab->bounds, symtab->nbounds, sizeof(uint32_t), fa_symtab_compare_bounds);
+    size_t n = 0;
+    for (size_t i = 0; i < symtab->nbounds; i++) {
+        if (n == 0 || symtab->bounds[i] != symtab->bounds[n - 1]) symtab->bounds[n++] = symtab->bounds[i];
+    }
+    symtab->nbounds = n;
+
+    symtab->blocks = malloc(n * sizeof(int));
+    if (!symtab->blocks) return false;
+    memset(symtab->blocks, -1, n * sizeof(int));
+    return true;
+}
+
+static int fa_symtab_block_id(fa_symtab *symtab, size_t block) {
+    if (symtab->blocks[block] >= 0) return symtab->blocks[block];
+
+    fa_range range = { symtab->bounds[block], FA_RANGE_MAX };
+    if (block + 1 < symtab->nbounds) range.hi = symtab->bounds[block + 1] - 1;
+
+    char *label = fa_range_label(&range, 1);
+    if (!label) return -1;
+    int id = fa_symtab_intern(symtab, label);
+    free(label);
+    symtab->blocks[block] = id;
+    return id;
+}
+
+size_t fa_symtab_resolve(fa_symtab *symtab, const char *symbol, int *ids, size_t capacity) {
+    if (!symtab || !symbol) return 0;
+
+    fa_range *ranges = NULL;
+    size_t count = 0;
+    fa_error_t status = symtab->symbolic ? fa_symtab_parse_label(symbol, &ranges, &count)
+                                         : FA_ERR_INVALID_ARGUMENT;
+    if (status == FA_ERR_OUT_OF_MEMORY) return 0;
+    if (status != FA_SUCCESS) {
+        int id = fa_symtab_intern(symtab, symbol);
+        if (id < 0) return 0;
+        if (capacity > 0) ids[0] = id;
+        return 1;
+    }
+
+    size_t n = 0;
+    if (!symtab->blocks && !fa_symtab_fix(symtab)) goto fail;
+
+    for (size_t i = 0; i < count; i++) {
+        // Binary search for the block starting at lo
+        size_t lo = 0, hi = symtab->nbounds;
+        while (lo < hi) {
+            size_t mid = lo + (hi - lo) / 2;
+            if (symtab->bounds[mid] < ranges[i].lo) lo = mid + 1;
+            else hi = mid;
+        }
+        if (lo == symtab->nbounds || symtab->bounds[lo] != ranges[i].lo) goto fail;
+
+        for (size_t b = lo; b < symtab->nbounds && symtab->bounds[b] <= ranges[i].hi; b++) {
+            uint32_t end = b + 1 < symtab->nbounds ? symtab->bounds[b + 1] - 1 : FA_RANGE_MAX;
+            if (end > ranges[i].hi) goto fail;
+            int id = fa_symtab_block_id(symtab, b);
+            if (id < 0) goto fail;
+            if (n < capacity) ids[n] = id;
+            n++;
+        }
+    }
+    free(ranges);
+    return n;
+
+fail:
+    free(ranges);
+    return 0;
+}
+
+
+// Indexed automaton
+
+int fa_index_state_id(const fa_index *index, const fa_state *state) {
+    if (!index || !state || index->ptr_nslots == 0) return -1;
+
+    size_t mask = index->ptr_nslots - 1;
+    size_t h = fa_index_hash_pointer(state) & mask;
+    while (index->ptr_keys[h]) {
+        if (index->ptr_keys[h] == state) return index->ptr_ids[h];
+        h = (h + 1) & mask;
+    }
+    return -1;
+}
+
+bool fa_index_is_deterministic(const fa_index *index) {
+    if (!index) return false;
+
+    size_t starts = 0;
+    for (size_t s = 0; s < index->nstates; s++) {
+        if ((index->flags[s] & FA_INDEX_START) && ++starts > 1) return false;
+
+        for (size_t e = index->offsets[s]; e < index->offsets[s + 1]; e++) {
+            if (index->syms[e] == index->symtab->eps) return false;
+            // Edges are sorted by symbol, so duplicates are adjacent
+            if (e > index->offsets[s] && index->syms[e] == index->syms[e - 1]) return false;
+        }
+    }
+    return true;
+}
+
+static int index_compare_ids(const void *a, const void *b) {
+    int x = *(const int*)a, y = *(const int*)b;
+    return (x > y) - (x < y);
+}
+
+bool fa_index_alphabet(const fa_index *index, const fa_auto *automaton, int **ids, size_t *count) {
+    *ids = NULL;
+    *count = 0;
+    if (!index || !automaton) return false;
+
+    size_t alphabet_size = automaton->alphabet ? automaton->alphabet->length : 0;
+    size_t capacity = alphabet_size ? alphabet_size : 1, n = 0;
+    int *out = malloc(capacity * sizeof(int));
+    if (!out) return false;
+
+    for (size_t i = 0; i < alphabet_size; i++) {
+        const char *symbol = *(const char* const*)automaton->alphabet->members[i];
+        size_t k = symbol ? fa_symtab_resolve(index->symtab, symbol, NULL, 0) : 0;
+        if (n + k > capacity) {
+            while (n + k > capacity) capacity *= 2;
+            int *grown = realloc(out, capacity * sizeof(int));
+            if (!grown) goto fail;
+            out = grown;
+        }
+        if (k && fa_symtab_resolve(index->symtab, symbol, out + n, k) != k) goto fail;
+        n += k;
+    }
+
+    // Interval labels stand for their minterms, which need not come in order
+    qsort(out, n, sizeof(int), index_compare_ids);
+    size_t unique = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (out[i] == index->symtab->eps) continue;
+        if (unique == 0 || out[unique - 1] != out[i]) out[unique++] = out[i];
+    }
+    *ids = out;
+    *count = unique;
+    return true;
+
+fail:
+    free(out);
+    return false;
+}
+
+bool fa_index_has_move(const fa_index *index, size_t state, int sym) {
+    size_t lo = index->offsets[state], end = index->offsets[state + 1], hi = end;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (index->syms[mid] < sym) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo < end && index->syms[lo] == sym;
+}
+
+void fa_index_destroy(fa_index *index) {
+    if (!index) return;
+
+    free(index->states);
+    free(index->flags);
+    free(index->offsets);
+    free(index->syms);
+    free(index->dests);
+    free(index->ptr_keys);
+    free(index->ptr_ids);
+    if (index->owns_symtab) fa_symtab_destroy(index->symtab);
+    free(index);
+}
+
+static int fa_index_compare_edges(const void *x, const void *y) {
+    uint64_t a = *(const uint64_t*)x, b = *(const uint64_t*)y;
+    return (a > b) - (a < b);
+}
+
+fa_index* fa_index_build(const fa_auto *automaton, fa_symtab *symtab) {
+    if (!automaton || !automaton->states) return NULL;
+
+    int *resolved = NULL;
+    uint64_t *packed = NULL;
+
+    fa_index *index = calloc(1, sizeof(fa_index));
+    if (!index) return NULL;
+
+    index->symtab = symtab;
+    index->sink_accepts = automaton->sink_accepts;
+    if (!index->symtab) {
+        index->symtab = fa_symtab_create();
+        index->owns_symtab = true;
+        if (!index->symtab) goto fail;
+    }
+
+    if (!fa_symtab_register(index->symtab, automaton)) goto fail;
+
+    // Alphabet first, so that symbol ids follow alphabet order
+    size_t resolved_capacity = 16;
+    resolved = malloc(resolved_capacity * sizeof(int));
+    if (!resolved) goto fail;
+    if (automaton->alphabet) {
+        for (size_t i = 0; i < automaton->alphabet->length; i++) {
+            const char *symbol = *(const char* const*)automaton->alphabet->members[i];
+            if (symbol && fa_symtab_resolve(index->symtab, symbol, resolved, 0) == 0) goto fail;
+        }
+    }
+
+    size_t n = 0, m = 0;
+    for (size_t i = 0; i < automaton->capacity; i++) {
+        fa_state *state = automaton->states[i];
+        if (!state) continue;
+        n++;
+        for (fa_trans *t = state->trans; t; t = t->next) m++;
+    }
+
+    index->nstates = n;
+    index->nedges = m;
+    index->states = malloc((n ? n : 1) * sizeof(fa_state*));
+    index->flags = calloc(n ? n : 1, sizeof(uint8_t));
+    index->offsets = calloc(n + 1, sizeof(size_t));
+    index->syms = malloc((m ? m : 1) * sizeof(int));
+    index->dests = malloc((m ? m : 1) * sizeof(int));
+    index->ptr_nslots = fa_index_round_pow2(2 * n + 2);
+    index->ptr_keys = calloc(index->ptr_nslots, sizeof(void*));
+    index->ptr_ids = malloc(index->ptr_nslots * sizeof(int));
+
+    if (!index->states || !index->flags || !index->offsets || !index->syms ||
+        !index->dests || !index->ptr_keys || !index->ptr_ids) {
+        goto fail;
+    }
+
+    size_t id = 0;
+    size_t mask = index->ptr_nslots - 1;
+    for (size_t i = 0; i < automaton->capacity; i++) {
+        fa_state *state = automaton->states[i];
+        if (!state) continue;
+
+        index->states[id] = state;
+        index->flags[id] = (state->is_start ? FA_INDEX_START : 0) |
+                           (state->is_accept ? FA_INDEX_ACCEPT : 0);
+
+        size_t h = fa_index_hash_pointer(state) & mask;
+        while (index->ptr_keys[h]) h = (h + 1) & mask;
+        index->ptr_keys[h] = state;
+        index->ptr_ids[h] = (int)id;
+        id++;
+    }
+
+    // Resolve edges per state, then sort each run by symbol. Runs are short,
+    // so insertion sort beats a general-purpose sort here; interval labels
+    // can make them long, and those get a real sort.
+    size_t e = 0, edge_capacity = m ? m : 1;
+    for (size_t s = 0; s < n; s++) {
+        index->offsets[s] = e;
+        size_t run = e;
+
+        for (fa_trans *t = index->states[s]->trans; t; t = t->next) {
+            int dest = fa_index_state_id(index, t->dest);
+            size_t k = fa_symtab_resolve(index->symtab, t->symbol, resolved, resolved_capacity);
+            if (k > resolved_capacity) {
+                int *grown = realloc(resolved, k * sizeof(int));
+                if (!grown) goto fail;
+                resolved = grown;
+                resolved_capacity = k;
+                k = fa_symtab_resolve(index->symtab, t->symbol, resolved, resolved_capacity);
+            }
+            if (k == 0 || dest < 0) goto fail;
+
+            if (e + k > edge_capacity) {
+                while (e + k > edge_capacity) edge_capacity *= 2;
+                int *syms = realloc(index->syms, edge_capacity * sizeof(int));
+                if (!syms) goto fail;
+                index->syms = syms;
+                int *dests = realloc(index->dests, edge_capacity * sizeof(int));
+                if (!dests) goto fail;
+                index->dests = dests;
+            }
+
+            if (k > 1) {
+                for (size_t i = 0; i < k; i++) {
+                    index->syms[e] = resolved[i];
+                    index->dests[e++] = dest;
+                }
+                continue;
+            }
+
+            int sym = resolved[0];
+            k = e++;
+            while (k > run && (index->syms[k - 1] > sym ||
+                   (index->syms[k - 1] == sym && index->dests[k - 1] > dest))) {
+                index->syms[k] = index->syms[k - 1];
+                index->dests[k] = index->dests[k - 1];
+                k--;
+            }
+            index->syms[k] = sym;
+            index->dests[k] = dest;
+        }
+
+        // Expanded labels were appended unsorted
+        bool sorted = true;
+        for (size_t k = run + 1; k < e && sorted; k++) {
+            sorted = index->syms[k - 1] < index->syms[k] ||
+                     (index->syms[k - 1] == index->syms[k] && index->dests[k - 1] <= index->dests[k]);
+        }
+        if (!sorted) {
+            uint64_t *grown = realloc(packed, (e - run) * sizeof(uint64_t));
+            if (!grown) goto fail;
+            packed = grown;
+            for (size_t k = run; k < e; k++) {
+                packed[k - run] = ((uint64_t)(uint32_t)index->syms[k] << 32) | (uint32_t)index->dests[k];
+            }
+            qsort(packed, e - run, sizeof(uint64_t), fa_index_compare_edges);
+            for (size_t k = run; k < e; k++) {
+                index->syms[k] = (int)(packed[k - run] >> 32);
+                index->dests[k] = (int)(uint32_t)packed[k - run];
+            }
+        }
+    }
+    index->offsets[n] = e;
+    index->nedges = e;
+
+    free(resolved);
+    free(packed);
+    return index;
+
+fail:
+    free(resolved);
+    free(packed);
+    fa_index_destroy(index);
+    return NULL;
+}
+
+
+// Reversed view
+
+fa_index_reverse* fa_index_reverse_build(const fa_index *index) {
+    if (!index) return NULL;
+
+    size_t n = index->nstates, m = index->nedges, nsyms = index->symtab->count;
+    fa_index_reverse *reverse = calloc(1, sizeof(fa_index_reverse));
+    size_t *by_sym = malloc((m ? m : 1) * sizeof(size_t));
+    size_t *sym_off = calloc(nsyms + 1, sizeof(size_t));
+    int *src_of = malloc((m ? m : 1) * sizeof(int));
+    if (!reverse || !by_sym || !sym_off || !src_of) goto fail;
+
+    reverse->index = index;
+    reverse->offsets = calloc(n + 1, sizeof(size_t));
+    reverse->edges = malloc((m ? m : 1) * sizeof(size_t));
+    reverse->srcs = malloc((m ? m : 1) * sizeof(int));
+    if (!reverse->offsets || !reverse->edges || !reverse->srcs) goto fail;
+
+    // Edge ids grow with the source, so a stable pass by symbol and then a
+    // stable pass by destination leaves each run sorted by (symbol, source)
+    for (size_t s = 0; s < n; s++) {
+        for (size_t e = index->offsets[s]; e < index->offsets[s + 1]; e++) {
+            src_of[e] = (int)s;
+            sym_off[index->syms[e] + 1]++;
+            reverse->offsets[index->dests[e] + 1]++;
+        }
+    }
+    for (size_t i = 0; i < nsyms; i++) sym_off[i + 1] += sym_off[i];
+    for (size_t s = 0; s < n; s++) reverse->offsets[s + 1] += reverse->offsets[s];
+
+    for (size_t e = 0; e < m; e++) by_sym[sym_off[index->syms[e]]++] = e;
+    for (size_t i = 0; i < m; i++) {
+        size_t e = by_sym[i];
+        size_t slot = reverse->offsets[index->dests[e]]++;
+        reverse->edges[slot] = e;
+        reverse->srcs[slot] = src_of[e];
+    }
+    for (size_t s = n; s > 0; s--) reverse->offsets[s] = reverse->offsets[s - 1];
+    reverse->offsets[0] = 0;
+
+    free(by_sym);
+    free(sym_off);
+    free(src_of);
+    return reverse;
+
+fail:
+    free(by_sym);
+    free(sym_off);
+    free(src_of);
+    fa_index_reverse_destroy(reverse);
+    return NULL;
+}
+
+void fa_index_reverse_destroy(fa_index_reverse *reverse) {
+    if (!reverse) return;
+
+    free(reverse->offsets);
+    free(reverse->edges);
+    free(reverse->srcs);
+    free(reverse);
+}
+
+
+// Builder
+
+bool fa_builder_init(fa_builder *builder, size_t state_hint, size_t edge_hint) {
+    if (!builder) return false;
+
+    builder->nstates = 0;
+    builder->state_capacity = state_hint > 0 ? state_hint : 16;
+    builder->nedges = 0;
+    builder->edge_capacity = edge_hint > 0 ? edge_hint : 16;
+    builder->flags = malloc(builder->state_capacity * sizeof(uint8_t));
+    builder->edges = malloc(builder->edge_capacity * sizeof(fa_index_edge));
+
+    if (!builder->flags || !builder->edges) {
+        fa_builder_free(builder);
+        return false;
+    }
+    return true;
+}
+
+void fa_builder_free(fa_builder *builder) {
+    if (!builder) return;
+
+    free(builder->flags);
+    free(builder->edges);
+    builder->flags = NULL;
+    builder->edges = NULL;
+    builder->nstates = builder->nedges = 0;
+    builder->state_capacity = builder->edge_capacity = 0;
+}
+
+int fa_builder_add_state(fa_builder *builder, uint8_t flags) {
+    if (builder->nstates >= builder->state_capacity) {
+        size_t new_capacity = builder->state_capacity * 2;
+        uint8_t *new_flags = realloc(builder->flags, new_capacity * sizeof(uint8_t));
+        if (!new_flags) return -1;
+        builder->flags = new_flags;
+        builder->state_capacity = new_capacity;
+    }
+
+    builder->flags[builder->nstates] = flags;
+    return (int)builder->nstates++;
+}
+
+bool fa_builder_add_edge(fa_builder *builder, int src, int sym, int dest) {
+    if (builder->nedges >= builder->edge_capacity) {
+        size_t new_capacity = builder->edge_capacity * 2;
+        fa_index_edge *new_edges = realloc(builder->edges, new_capacity * sizeof(fa_index_edge));
+        if (!new_edges) return false;
+        builder->edges = new_edges;
+        builder->edge_capacity = new_capacity;
+    }
+
+    fa_index_edge *edge = &builder->edges[builder->nedges++];
+    edge->src = src;
+    edge->sym = sym;
+    edge->dest = dest;
+    return true;
+}
+
+static bool fa_builder_insert_symbol(Set *alphabet, const char *symbol) {
+    // Alphabet sets hold borrowed char*, so hand them a private copy
+    if (set_contains(alphabet, &symbol)) return true;
+
+    char *copy = strdup(symbol);
+    if (!copy) return false;
+    if (!set_insert(alphabet, &copy)) {
+        free(copy);
+        return false;
+    }
+    return true;
+}
+
+/*
+ * Emits the edges of a table with interval labels. Per source state, the
+ * edges whose symbol covers one interval are grouped by destination and
+ * merged into a single label at the position of the group's first edge.
+ */
+static bool fa_builder_emit_ranges(const fa_builder *builder, const fa_symtab *symtab,
+                                   fa_auto *automaton) {
+    size_t n = builder->nstates, m = builder->nedges;
+    size_t *offsets = calloc(n + 1, sizeof(size_t));
+    size_t *order = malloc((m ? m : 1) * sizeof(size_t));
+    int *group = malloc((n ? n : 1) * sizeof(int));
+    size_t *heads = malloc((m ? m : 1) * sizeof(size_t));
+    int *of = malloc((m ? m : 1) * sizeof(int));
+    size_t *starts = malloc((m ? m : 1) * sizeof(size_t));
+    size_t *ends = malloc((m ? m : 1) * sizeof(size_t));
+    fa_range *ranges = malloc((m ? m : 1) * sizeof(fa_range));
+    bool ok = offsets && order && group && heads && of && starts && ends && ranges;
+
+    if (ok) {
+        // Stable bucket of the edges by source
+        for (size_t i = 0; i < m; i++) offsets[builder->edges[i].src + 1]++;
+        for (size_t s = 0; s < n; s++) offsets[s + 1] += offsets[s];
+        for (size_t i = 0; i < m; i++) order[offsets[builder->edges[i].src]++] = i;
+        for (size_t s = n; s > 0; s--) offsets[s] = offsets[s - 1];
+        offsets[0] = 0;
+        for (size_t s = 0; s < n; s++) group[s] = -1;
+    }
+
+    for (size_t s = 0; s < n && ok; s++) {
+        // One output transition per opaque edge or per ranged destination
+        size_t nout = 0;
+        for (size_t k = offsets[s]; k < offsets[s + 1]; k++) {
+            const fa_index_edge *edge = &builder->edges[order[k]];
+            of[k] = -1;
+            if (!fa_symtab_range(symtab, edge->sym, NULL)) {
+                heads[nout++] = k;
+                continue;
+            }
+            if (group[edge->dest] < 0) {
+                group[edge->dest] = (int)nout;
+                ends[nout] = 0;
+                heads[nout++] = k;
+            }
+            of[k] = group[edge->dest];
+            ends[of[k]]++;
+        }
+
+        // Gather the intervals of each group contiguously
+        size_t next = 0;
+        for (size_t g = 0; g < nout; g++) {
+            if (of[heads[g]] < 0) continue;
+            starts[g] = next;
+            next += ends[g];
+            ends[g] = starts[g];
+        }
+        for (size_t k = offsets[s]; k < offsets[s + 1]; k++) {
+            if (of[k] >= 0) fa_symtab_range(symtab, builder->edges[order[k]].sym, &ranges[ends[of[k]]++]);
+        }
+
+        // fa_trans_create prepends, so create the transitions backwards
+        for (size_t g = nout; g-- > 0 && ok;) {
+            const fa_index_edge *edge = &builder->edges[order[heads[g]]];
+            fa_state *src = automaton->states[s], *dest = automaton->states[edge->dest];
+            if (of[heads[g]] < 0 || ends[g] - starts[g] == 1) {
+                ok = fa_trans_create(src, dest, symtab->symbols[edge->sym]) == FA_SUCCESS;
+                continue;
+            }
+            char *label = fa_range_label(ranges + starts[g], ends[g] - starts[g]);
+            ok = label && fa_trans_create(src, dest, label) == FA_SUCCESS;
+            free(label);
+        }
+        for (size_t k = offsets[s]; k < offsets[s + 1]; k++) group[builder->edges[order[k]].dest] = -1;
+    }
+
+    free(offsets);
+    free(order);
+    free(group);
+    free(heads);
+    free(of);
+    free(starts);
+    free(ends);
+    free(ranges);
+    return ok;
+}
+
+fa_auto* fa_builder_emit(const fa_builder *builder, const fa_symtab *symtab,
+                         const Set *alphabet, fa_builder_label_fn label,
+                         void *label_ctx) {
+    if (!builder || !symtab) return NULL;
+
+    size_t n = builder->nstates;
+    fa_auto *automaton = fa_auto_create((int)(n ? n : 1));
+    if (!automaton) return NULL;
+
+    if (alphabet) {
+        for (size_t i = 0; i < alphabet->length; i++) {
+            const char *symbol = *(const char* const*)alphabet->members[i];
+            if (symbol && !fa_builder_insert_symbol(automaton->alphabet, symbol)) goto fail;
+        }
+    } else if (symtab->symbolic) {
+        // Characters and minterms go back into a single label
+        fa_range *ranges = malloc((symtab->count ? symtab->count : 1) * sizeof(fa_range));
+        if (!ranges) goto fail;
+        size_t count = 0;
+        bool ok = true;
+        for (size_t i = 0; i < symtab->count && ok; i++) {
+            if ((int)i == symtab->eps) continue;
+            if (fa_symtab_range(symtab, (int)i, &ranges[count])) count++;
+            else ok = fa_builder_insert_symbol(automaton->alphabet, symtab->symbols[i]);
+        }
+        char *label = ok && count ? fa_range_label(ranges, count) : NULL;
+        if (count && ok) ok = label && fa_builder_insert_symbol(automaton->alphabet, label);
+        free(label);
+        free(ranges);
+        if (!ok) goto fail;
+    } else {
+        for (size_t i = 0; i < symtab->count; i++) {
+            if ((int)i == symtab->eps) continue;
+            if (!fa_builder_insert_symbol(automaton->alphabet, symtab->symbols[i])) goto fail;
+        }
+    }
+
+    char buf[32];
+    for (size_t i = 0; i < n; i++) {
+        char *custom = label ? label(label_ctx, (int)i) : NULL;
+        if (!custom) snprintf(buf, sizeof(buf), "q%zu", i);
+
+        fa_state *state = fa_state_create(custom ? custom : buf,
+                                          (builder->flags[i] & FA_INDEX_START) != 0,
+                                          (builder->flags[i] & FA_INDEX_ACCEPT) != 0);
+        free(custom);
+        if (!state) goto fail;
+        automaton->states[i] = state;
+        automaton->nstates++;
+    }
+
+    if (symtab->symbolic) {
+        if (!fa_builder_emit_ranges(builder, symtab, automaton)) goto fail;
+        return automaton;
+    }
+
+    // fa_trans_create prepends, so walk the edges backwards to keep the
+    // caller's per-state order in the transition lists
+    for (size_t i = builder->nedges; i-- > 0;) {
+        const fa_index_edge *edge = &builder->edges[i];
+        if (fa_trans_create(automaton->states[edge->src], automaton->states[edge->dest],
+                            symtab->symbols[edge->sym]) != FA_SUCCESS) {
+            goto fail;
+        }
+    }
+
+    return automaton;
+
+fail:
+    fa_auto_destroy(automaton);
+    return NULL;
+}
@@ -1,14 +1,131 @@
 #include "../include/fa/fa_operations.h"
+#include "../include/fa/fa_index.h"
 #include "../include/fa_error.h"
 #include "../include/hash/hash_table.h"
+#include "../include/parallel/fa_parallel.h"
 #include "../include/common.h"
+#include "../include/set/bitset.h"
 #include "fa_error.h"
 #include <stdlib.h>
 #include <string.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include <stdatomic.h>
+#include <time.h>
+
+
+
+
+// ============================================================================
+// Resource budgets
+// ============================================================================
+
+/*
+ * A meter tracks one budgeted call. Builders charge it as they create
+ * states and transitions; the counters are atomic because parallel subset
+ * construction charges from several workers. The clock and the progress
+ * callback are only consulted every METER_CHECK_EVERY charges. Once a
+ * limit trips, the reason sticks and every later charge fails, so the
+ * operation unwinds through its ordinary out-of-memory paths. A NULL
+ * meter charges nothing and never fails.
+ */
+#define METER_CHECK_EVERY 1024
+
+typedef struct op_meter {
+    fa_budget *budget;
+    double start;
+    atomic_size_t states;
+    atomic_size_t transitions;
+    atomic_size_t bytes;
+    atomic_uint ticks;
+    atomic_int reason;                  // fa_budget_reason
+    atomic_flag reporting;              // held while the callback runs
+} op_meter;
+
+double fa_budget_now(void) {
+    struct timespec ts;
+#ifdef CLOCK_MONOTONIC
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+#else
+    timespec_get(&ts, TIME_UTC);
+#endif
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+/* A meter for `budget`, or NULL (unmetered) when there is none. */
+static op_meter* meter_begin(op_meter *meter, fa_budget *budget) {
+    if (!budget) return NULL;
+
+    meter->budget = budget;
+    meter->start = fa_budget_now();
+    atomic_init(&meter->states, 0);
+    atomic_init(&meter->transitions, 0);
+    atomic_init(&meter->bytes, 0);
+    atomic_init(&meter->ticks, 0);
+    atomic_init(&meter->reason, FA_BUDGET_OK);
+    atomic_flag_clear(&meter->reporting);
+    memset(&budget->stats, 0, sizeof(fa_budget_stats));
+    return meter;
+}
+
+static void meter_snapshot(op_meter *meter, fa_budget_stats *stats) {
+    stats->states = atomic_load_explicit(&meter->states, memory_order_relaxed);
+    stats->transitions = atomic_load_explicit(&meter->transitions, memory_order_relaxed);
+    stats->bytes = atomic_load_explicit(&meter->bytes, memory_order_relaxed);
+    stats->elapsed = fa_budget_now() - meter->start;
+    stats->reason = (fa_budget_reason)atomic_load(&meter->reason);
+}
+
+static bool meter_stop(op_meter *meter, fa_budget_reason reason) {
+    int expected = FA_BUDGET_OK;
+    atomic_compare_exchange_strong(&meter->reason, &expected, (int)reason);
+    return false;
+}
+
+static bool meter_ok(op_meter *meter) {
+    return !meter || atomic_load_explicit(&meter->reason, memory_order_relaxed) == FA_BUDGET_OK;
+}
+
+/* Accounts for new work; false once the budget is exhausted. */
+static bool meter_charge(op_meter *meter, size_t states, size_t transitions, size_t bytes) {
+    if (!meter) return true;
+    if (!meter_ok(meter)) return false;
+
+    const fa_budget *budget = meter->budget;
+    size_t total_states = atomic_fetch_add_explicit(&meter->states, states, memory_order_relaxed) + states;
+    size_t total_bytes = atomic_fetch_add_explicit(&meter->bytes, bytes, memory_order_relaxed) + bytes;
+    atomic_fetch_add_explicit(&meter->transitions, transitions, memory_order_relaxed);
+
+    if (budget->max_states && total_states > budget->max_states) return meter_stop(meter, FA_BUDGET_STATES);
+    if (budget->max_bytes && total_bytes > budget->max_bytes) return meter_stop(meter, FA_BUDGET_BYTES);
+    if (atomic_fetch_add_explicit(&meter->ticks, 1, memory_order_relaxed) % METER_CHECK_EVERY) return true;
+
+    if (budget->deadline > 0 && fa_budget_now() >= budget->deadline) {
+        return meter_stop(meter, FA_BUDGET_DEADLINE);
+    }
+    if (budget->progress && !atomic_flag_test_and_set(&meter->reporting)) {
+        fa_budget_stats stats;
+        meter_snapshot(meter, &stats);
+        bool go_on = budget->progress(budget->progress_ctx, &stats);
+        atomic_flag_clear(&meter->reporting);
+        if (!go_on) return meter_stop(meter, FA_BUDGET_CANCELLED);
+    }
+    return true;
+}
 
+/*
+ * Publishes the final stats; a tripped budget overrides `status`, since
+ * the failure it caused surfaces as an ordinary allocation failure.
+ */
+static fa_error_t meter_end(op_meter *meter, fa_error_t status) {
+    if (!meter) return status;
+    meter_snapshot(meter, &meter->budget->stats);
+    return meter->budget->stats.reason != FA_BUDGET_OK ? FA_ERR_BUDGET_EXCEEDED : status;
+}
 
+static fa_auto* det_run(const fa_auto *a, fa_determinize_algorithm algorithm, op_meter *meter);
 
 
 static int partition_get_num_states(const int partition[], const int length) {
@@ -196,595 +313,4101 @@ fa_stack* fa_stack_from_null_terminated(fa_auto* first, ...) {
     return stack;
 }
 
-static fa_auto* compose_single_result(const fa_auto* a, const fa_auto* b,
-                                     fa_operation_flags flags) {
-    fa_operation_results* results = fa_auto_compose(a, b, flags);
-    if (!results || !results->success) {
-        if (results) fa_operation_results_destroy(results);
-        return NULL;
-    }
-    
-    
-    fa_auto* result = NULL;
-    
-    // Return the first non-NULL result based on flag order
-    if (flags & FA_OP_UNION && results->union_result) {
-        result = results->union_result;
-        
-        results->union_result = NULL;
-    } else if (flags & FA_OP_INTERSECTION && results->intersection_result) {
-        result = results->intersection_result;
-        results->intersection_result = NULL;
-    } else if (flags & FA_OP_DIFFERENCE && results->difference_result) {
-        result = results->difference_result;
-        results->difference_result = NULL;
-    } else if (flags & FA_OP_CONCATENATION && results->concatenation_result) {
-        result = results->concatenation_result;
-        results->concatenation_result = NULL;
-    }
-    
-    fa_operation_results_destroy(results);
-    return result;
+/* The binary operation a reduction applies, picked by the priority of the result fields. */
+static fa_operation_flags compose_binary_op(fa_operation_flags flags) {
+    if (flags & FA_OP_UNION) return FA_OP_UNION;
+    if (flags & FA_OP_INTERSECTION) return FA_OP_INTERSECTION;
+    if (flags & FA_OP_DIFFERENCE) return FA_OP_DIFFERENCE;
+    if (flags & FA_OP_SYMMETRIC_DIFF) return FA_OP_SYMMETRIC_DIFF;
+    if (flags & FA_OP_CONCATENATION) return FA_OP_CONCATENATION;
+    return FA_OP_UNION;
 }
 
 
 
-
-
 // INDIVIDUAL BINARY OPERATIONS
 
-fa_auto* fa_auto_union(const fa_auto* a1, const fa_auto* a2){
-    if (!a1 || !a2) return NULL;
-
-    const int offset = 2;
-    fa_auto* automaton = fa_auto_create(a1->capacity + a2->capacity + offset);
-    automaton->alphabet = set_union(a1->alphabet, a2->alphabet);
+/* `a` itself, or in *owned a copy of it with its implicit sink made explicit. */
+static const fa_auto* sink_explicit(const fa_auto *a, fa_auto **owned) {
+    *owned = NULL;
+    if (!a || !a->sink_accepts) return a;
+    *owned = fa_auto_materialize_sink(a);
+    return *owned;
+}
 
-    for (int i = 0; i < a1->capacity; i++) {
-        automaton->states[i] = fa_state_create(a1->states[i]->label, false, false);
-        automaton->nstates++;
+/*
+ * A symbol table for indexing two operands together. Both are registered
+ * before either is indexed, so that they agree on the interval minterms.
+ */
+static fa_symtab* symtab_shared(const fa_auto *a1, const fa_auto *a2) {
+    fa_symtab *symtab = fa_symtab_create();
+    if (symtab && (!fa_symtab_register(symtab, a1) || !fa_symtab_register(symtab, a2))) {
+        fa_symtab_destroy(symtab);
+        return NULL;
     }
+    return symtab;
+}
 
-    const int last_idx = a1->capacity;
-    for (int i = 0; i < a2->capacity; i++) {
-        automaton->states[last_idx + i] = fa_state_create(a2->states[i]->label, false, false);
-        automaton->nstates++;
+/*
+ * Union and concatenation copy both operands into one builder: dense ids
+ * replace the label lookups, so each is linear in the size of the inputs.
+ */
+static int splice_copy(fa_builder *builder, const fa_index *index, uint8_t keep) {
+    int base = (int)builder->nstates;
+    for (size_t s = 0; s < index->nstates; s++) {
+        if (fa_builder_add_state(builder, index->flags[s] & keep) < 0) return -1;
     }
-
-
-
-
-    //adding a1 transitions
-    for (int i = 0; i < a1->capacity; i++) {
-        fa_trans* transition = a1->states[i]->trans;
-        while (transition) {
-            for (int j = 0; j < a1->capacity; j++) {
-                if (strcmp(automaton->states[j]->label, transition->dest->label) == 0) {
-                    fa_trans_create(automaton->states[i], automaton->states[j], transition->symbol);
-                }
+    for (size_t s = 0; s < index->nstates; s++) {
+        for (size_t e = index->offsets[s]; e < index->offsets[s + 1]; e++) {
+            if (!fa_builder_add_edge(builder, base + (int)s, index->syms[e], base + index->dests[e])) {
+                return -1;
             }
-            transition = transition->next;
         }
     }
+    return base;
+}
 
+static fa_auto* splice_build(const fa_auto *a1, const fa_auto *a2, bool concat) {
+    if (!a1 || !a2) return NULL;
 
+    fa_auto *owned1, *owned2;
+    a1 = sink_explicit(a1, &owned1);
+    a2 = sink_explicit(a2, &owned2);
+    if (!a1 || !a2) {
+        fa_auto_destroy(owned1);
+        fa_auto_destroy(owned2);
+        return NULL;
+    }
 
-    fa_state *new_origin = fa_state_create("S", true, false);
-    fa_state *new_destination = fa_state_create("D", false, true);
-
-    automaton->states[a1->capacity + a2->capacity] = new_origin;
-    automaton->states[a1->capacity + a2->capacity + 1] = new_destination;
-    automaton->nstates += offset;
-
-
-    //adding a2 transitions
-    for (int i = 0; i < a2->capacity; i++) {
-        fa_trans* transition = a2->states[i]->trans;
-        while (transition) {
-            for (int j = 0; j < a2->capacity; j++) {
-                if (strcmp(automaton->states[last_idx + j]->label, transition->dest->label) == 0) {
-                    fa_trans_create(automaton->states[last_idx + i], automaton->states[last_idx + j], transition->symbol);
+    fa_symtab *symtab = symtab_shared(a1, a2);
+    fa_index *a = symtab ? fa_index_build(a1, symtab) : NULL;
+    fa_index *b = a ? fa_index_build(a2, symtab) : NULL;
+    Set *alphabet = b ? set_union(a1->alphabet, a2->alphabet) : NULL;
+    int eps = alphabet ? fa_symtab_intern(symtab, FA_EPS_SYMBOL) : -1;
+    fa_auto *result = NULL;
+    fa_builder builder;
+    bool built = false;
+
+    if (eps < 0 || !fa_builder_init(&builder, a->nstates + b->nstates + 2, a->nedges + b->nedges + 4)) {
+        goto cleanup;
+    }
+    built = true;
+
+    if (concat) {
+        // Starts of a1 and accepts of a2 survive; a1's accepts lead into a2's starts
+        int base_a = splice_copy(&builder, a, FA_INDEX_START);
+        int base_b = base_a < 0 ? -1 : splice_copy(&builder, b, FA_INDEX_ACCEPT);
+        if (base_b < 0) goto cleanup;
+        for (size_t p = 0; p < a->nstates; p++) {
+            if (!(a->flags[p] & FA_INDEX_ACCEPT)) continue;
+            for (size_t q = 0; q < b->nstates; q++) {
+                if ((b->flags[q] & FA_INDEX_START) &&
+                    !fa_builder_add_edge(&builder, base_a + (int)p, eps, base_b + (int)q)) {
+                    goto cleanup;
                 }
             }
-            transition = transition->next;
-        }
-    }
-
-    const int a1_a2_size = a1->capacity + a2->capacity;
-    for (int i = 0; i < a1->capacity; i++) {
-        if (a1->states[i]->is_start) {
-            fa_trans_create(automaton->states[a1_a2_size], automaton->states[i], FA_EPS_SYMBOL);
         }
-        if (a1->states[i]->is_accept) {
-            fa_trans_create(automaton->states[i], automaton->states[a1_a2_size + 1], FA_EPS_SYMBOL);
+    } else {
+        // A fresh start and a fresh accept state wrap both operands
+        int base_a = splice_copy(&builder, a, 0);
+        int base_b = base_a < 0 ? -1 : splice_copy(&builder, b, 0);
+        int start = base_b < 0 ? -1 : fa_builder_add_state(&builder, FA_INDEX_START);
+        int accept = start < 0 ? -1 : fa_builder_add_state(&builder, FA_INDEX_ACCEPT);
+        if (accept < 0) goto cleanup;
+        const fa_index *sides[2] = { a, b };
+        int bases[2] = { base_a, base_b };
+        for (int k = 0; k < 2; k++) {
+            for (size_t s = 0; s < sides[k]->nstates; s++) {
+                uint8_t flags = sides[k]->flags[s];
+                if ((flags & FA_INDEX_START) &&
+                    !fa_builder_add_edge(&builder, start, eps, bases[k] + (int)s)) goto cleanup;
+                if ((flags & FA_INDEX_ACCEPT) &&
+                    !fa_builder_add_edge(&builder, bases[k] + (int)s, eps, accept)) goto cleanup;
+            }
         }
     }
 
+    result = fa_builder_emit(&builder, symtab, alphabet, NULL, NULL);
 
-    for (int i = 0; i < a2->capacity; i++) {
-        if (a2->states[i]->is_start) {
-            fa_trans_create(automaton->states[a1_a2_size], automaton->states[last_idx + i], FA_EPS_SYMBOL);
-        }
-        if (a2->states[i]->is_accept) {
-            fa_trans_create(automaton->states[last_idx + i], automaton->states[a1_a2_size + 1], FA_EPS_SYMBOL);
-        }
-    }
+cleanup:
+    if (built) fa_builder_free(&builder);
+    if (alphabet) set_destroy(alphabet);
+    fa_index_destroy(a);
+    fa_index_destroy(b);
+    fa_symtab_destroy(symtab);
+    fa_auto_destroy(owned1);
+    fa_auto_destroy(owned2);
+    return result;
+}
 
-    
-    fa_auto_rename_states(automaton);
-    return automaton;
+fa_auto* fa_auto_union(const fa_auto* a1, const fa_auto* a2){
+    return splice_build(a1, a2, false);
 }
 
 
-fa_auto* fa_auto_product(const fa_auto* a1, const fa_auto* a2){
-    if (!a1 || !a2) return NULL;
+// ============================================================================
+// Product construction
+// ============================================================================
+
+/*
+ * Pairs (p, q) are explored from the start pairs with a worklist, so only
+ * reachable pairs are ever created. Either component may be "sink" (-1)
+ * when that side has no move; this is how complements of partial DFAs are
+ * handled without completing them. The explored graph does not depend on
+ * the operation, only the accept marking does.
+ */
+
+#define PRODUCT_SINK (-1)
+
+typedef enum {
+    PRODUCT_INTERSECTION,
+    PRODUCT_DIFFERENCE,             // A - B
+    PRODUCT_SYMMETRIC_DIFF,
+    PRODUCT_UNION,
+} product_kind;
+
+typedef struct pair_table {
+    uint64_t *keys;                 // 0 marks an empty slot
+    int *ids;
+    size_t nslots;
+    size_t count;
+} pair_table;
+
+typedef struct product_graph {
+    size_t npairs;
+    size_t capacity;
+    int *left;                      // component ids per pair, PRODUCT_SINK if none
+    int *right;
+    int *parent;                    // BFS tree, for witness words
+    int *via;
+    fa_index_edge *edges;
+    size_t nedges;
+    size_t edge_capacity;
+    int witness;                    // first pair accepted by stop_on, or -1
+} product_graph;
+
+
+static uint64_t pair_key(int p, int q) {
+    // +1 keeps sink pairs distinct from the empty-slot marker
+    return ((uint64_t)(uint32_t)(p + 1) << 32) | (uint32_t)(q + 1);
+}
 
-    // Initialisation de l'automate produit
-    fa_auto* automaton = fa_auto_create(a1->capacity * a2->capacity);
-    if (!automaton) return NULL;
+static size_t pair_hash(uint64_t key) {
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    key *= 0xc4ceb9fe1a85ec53ULL;
+    key ^= key >> 33;
+    return (size_t)key;
+}
+
+static bool pair_table_init(pair_table *table, size_t hint) {
+    table->nslots = 64;
+    while (table->nslots < hint * 2) table->nslots <<= 1;
+    table->count = 0;
+    table->keys = calloc(table->nslots, sizeof(uint64_t));
+    table->ids = malloc(table->nslots * sizeof(int));
+    return table->keys && table->ids;
+}
 
-    automaton->alphabet = set_intersection(a1->alphabet, a2->alphabet);
+static void pair_table_free(pair_table *table) {
+    free(table->keys);
+    free(table->ids);
+}
 
-    // Allocation mémoire pour la table des états
-    fa_state*** state_automaton = malloc(sizeof(fa_state**) * a1->capacity);
-    if (!state_automaton) {
-        free(automaton->alphabet);
-        free(automaton);
-        return NULL;
+static bool pair_table_grow(pair_table *table) {
+    size_t nslots = table->nslots * 2;
+    uint64_t *keys = calloc(nslots, sizeof(uint64_t));
+    int *ids = malloc(nslots * sizeof(int));
+    if (!keys || !ids) {
+        free(keys);
+        free(ids);
+        return false;
     }
 
-    for (int i = 0; i < a1->capacity; i++) {
-        state_automaton[i] = malloc(sizeof(fa_state*) * a2->capacity);
-        if (!state_automaton[i]) {
-            for (int k = 0; k < i; k++) free(state_automaton[k]);
-            free(state_automaton);
-            return NULL;
-        }
+    for (size_t i = 0; i < table->nslots; i++) {
+        if (!table->keys[i]) continue;
+        size_t h = pair_hash(table->keys[i]) & (nslots - 1);
+        while (keys[h]) h = (h + 1) & (nslots - 1);
+        keys[h] = table->keys[i];
+        ids[h] = table->ids[i];
     }
 
-    // Création des états de l'automate produit
-    for (int i = 0; i < a1->capacity; i++) {
-        for (int j = 0; j < a2->capacity; j++) {
-            char* name_state;
-            snprintf(name_state, sizeof(name_state), "%s%s", a1->states[i]->label, a2->states[j]->label);
+    free(table->keys);
+    free(table->ids);
+    table->keys = keys;
+    table->ids = ids;
+    table->nslots = nslots;
+    return true;
+}
 
-            int is_starting_state = (a1->states[i]->is_start && a2->states[j]->is_start);
-            int is_ending_state = (a1->states[i]->is_accept && a2->states[j]->is_accept);
+/*
+ * Looks up `key`; if absent, inserts it with id `fresh`. Returns the id, or
+ * -1 on allocation failure. `*inserted` tells the two cases apart.
+ */
+static int pair_table_intern(pair_table *table, uint64_t key, int fresh, bool *inserted) {
+    *inserted = false;
+    if ((table->count + 1) * 2 > table->nslots && !pair_table_grow(table)) return -1;
+
+    size_t mask = table->nslots - 1;
+    size_t h = pair_hash(key) & mask;
+    while (table->keys[h]) {
+        if (table->keys[h] == key) return table->ids[h];
+        h = (h + 1) & mask;
+    }
 
-            state_automaton[i][j] = fa_state_create(name_state, is_starting_state, is_ending_state);
-            automaton->states[i * a2->capacity + j] = state_automaton[i][j];
-        }
+    table->keys[h] = key;
+    table->ids[h] = fresh;
+    table->count++;
+    *inserted = true;
+    return fresh;
+}
+
+static void product_graph_free(product_graph *graph) {
+    free(graph->left);
+    free(graph->right);
+    free(graph->parent);
+    free(graph->via);
+    free(graph->edges);
+}
+
+static bool product_accepts(product_kind kind, bool in_a, bool in_b) {
+    switch (kind) {
+        case PRODUCT_INTERSECTION:   return in_a && in_b;
+        case PRODUCT_DIFFERENCE:     return in_a && !in_b;
+        case PRODUCT_SYMMETRIC_DIFF: return in_a != in_b;
+        case PRODUCT_UNION:          return in_a || in_b;
     }
+    return false;
+}
 
-    // Création des transitions
-    for (int i = 0; i < a1->capacity; i++) {
-        for (int j = 0; j < a2->capacity; j++) {
-            fa_state* state1 = a1->states[i];
-            fa_state* state2 = a2->states[j];
+typedef struct product_walk {
+    const fa_index *a;
+    const fa_index *b;
+    pair_table table;
+    int stop_on;                    // product_kind to stop at, or -1
+    op_meter *meter;
+} product_walk;
+
+static int product_visit(product_graph *graph, product_walk *walk, int p, int q,
+                         int parent, int via) {
+    bool inserted;
+    int id = pair_table_intern(&walk->table, pair_key(p, q), (int)graph->npairs, &inserted);
+    if (id < 0 || !inserted) return id;
+    if (!meter_charge(walk->meter, 1, 0, 4 * sizeof(int) + 2 * (sizeof(uint64_t) + sizeof(int)))) {
+        return -1;
+    }
 
-            fa_trans* transition_node1 = state1->trans;
-            while (transition_node1) {
-                fa_trans* transition_node2 = state2->trans;
-                while (transition_node2) {
-                    if (strcmp(transition_node1->symbol, transition_node2->symbol) == 0) {
-                        int new_index1_dest = fa_state_index(a1, transition_node1->dest);
-                        int new_index2_dest = fa_state_index(a2, transition_node2->dest);
+    if (graph->npairs >= graph->capacity) {
+        size_t new_capacity = graph->capacity ? graph->capacity * 2 : 64;
+        int **arrays[] = { &graph->left, &graph->right, &graph->parent, &graph->via };
+        for (size_t i = 0; i < sizeof(arrays) / sizeof(arrays[0]); i++) {
+            int *grown = realloc(*arrays[i], new_capacity * sizeof(int));
+            if (!grown) return -1;
+            *arrays[i] = grown;
+        }
+        graph->capacity = new_capacity;
+    }
 
-                        int new_index1_prev = fa_state_index(a1, transition_node1->src);
-                        int new_index2_prev = fa_state_index(a2, transition_node2->src);
+    graph->left[graph->npairs] = p;
+    graph->right[graph->npairs] = q;
+    graph->parent[graph->npairs] = parent;
+    graph->via[graph->npairs] = via;
+    graph->npairs++;
 
-                        if (new_index1_dest == -1 || new_index2_dest == -1 || new_index1_prev == -1 || new_index2_prev == -1) {
-                            return NULL;
-                        }
+    if (walk->stop_on >= 0 && graph->witness < 0) {
+        bool in_a = p >= 0 ? (walk->a->flags[p] & FA_INDEX_ACCEPT) != 0 : walk->a->sink_accepts;
+        bool in_b = q >= 0 ? (walk->b->flags[q] & FA_INDEX_ACCEPT) != 0 : walk->b->sink_accepts;
+        if (product_accepts((product_kind)walk->stop_on, in_a, in_b)) graph->witness = id;
+    }
+    return id;
+}
 
-                        int new_index_prev = new_index1_prev * a2->capacity + new_index2_prev;
-                        int new_index_dest = new_index1_dest * a2->capacity + new_index2_dest;
+static bool product_edge(product_graph *graph, product_walk *walk, int src, int sym,
+                         int p, int q) {
+    int via = sym == walk->a->symtab->eps ? -1 : sym;
+    int dest = product_visit(graph, walk, p, q, src, via);
+    if (dest < 0 || !meter_charge(walk->meter, 0, 1, sizeof(fa_index_edge))) return false;
+
+    if (graph->nedges >= graph->edge_capacity) {
+        size_t new_capacity = graph->edge_capacity ? graph->edge_capacity * 2 : 256;
+        fa_index_edge *edges = realloc(graph->edges, new_capacity * sizeof(fa_index_edge));
+        if (!edges) return false;
+        graph->edges = edges;
+        graph->edge_capacity = new_capacity;
+    }
 
-                        fa_trans* new_transition_node = malloc(sizeof(fa_trans));
-                        if (!new_transition_node) {
-                            return NULL;
-                        }
+    graph->edges[graph->nedges].src = src;
+    graph->edges[graph->nedges].sym = sym;
+    graph->edges[graph->nedges].dest = dest;
+    graph->nedges++;
+    return true;
+}
 
-                        strcpy(new_transition_node->symbol, transition_node1->symbol);
-                        new_transition_node->src = automaton->states[new_index_prev];
-                        new_transition_node->dest = automaton->states[new_index_dest];
+/*
+ * Explores the reachable pair graph of two indexes sharing a symbol table.
+ * `left_sink` / `right_sink` allow that side to fall into the sink when it
+ * has no move on a symbol the other side can read; they must only be set
+ * for deterministic sides. The sink accepts on a side whose index has
+ * sink_accepts, and the pair of both sinks is never created: it is the
+ * implicit sink of the product. Pairs are expanded in id order, which is BFS.
+ * With `stop_on` >= 0 the walk stops at the first pair accepted by that
+ * product_kind and leaves its id in graph->witness. Pairs and edges are
+ * charged to `meter`, which may be NULL.
+ */
+static bool product_explore(const fa_index *a, const fa_index *b,
+                            bool left_sink, bool right_sink, int stop_on,
+                            op_meter *meter, product_graph *graph) {
+    memset(graph, 0, sizeof(product_graph));
+    graph->witness = -1;
+
+    product_walk walk = { .a = a, .b = b, .stop_on = stop_on, .meter = meter };
+    if (!pair_table_init(&walk.table, a->nstates + b->nstates)) {
+        pair_table_free(&walk.table);
+        return false;
+    }
 
-                        // Vérification de cycle
-                        fa_trans* temp = automaton->states[i * a2->capacity + j]->trans;
-                        while (temp) {
-                            if (temp == new_transition_node) {
-                                free(new_transition_node);
-                                return NULL;
-                            }
-                            temp = temp->next;
-                        }
+    int eps = a->symtab->eps;
+    bool ok = true;
 
-                        // Ajout de la transition
-                        new_transition_node->next = automaton->states[i * a2->capacity + j]->trans;
-                        automaton->states[i * a2->capacity + j]->trans = new_transition_node;
+    for (size_t p = 0; p < a->nstates && ok; p++) {
+        if (!(a->flags[p] & FA_INDEX_START)) continue;
+        for (size_t q = 0; q < b->nstates && ok; q++) {
+            if (b->flags[q] & FA_INDEX_START) ok = product_visit(graph, &walk, (int)p, (int)q, -1, -1) >= 0;
+        }
+    }
 
+    for (size_t id = 0; id < graph->npairs && ok && graph->witness < 0; id++) {
+        int p = graph->left[id], q = graph->right[id];
+        size_t ea = p >= 0 ? a->offsets[p] : 0, enda = p >= 0 ? a->offsets[p + 1] : 0;
+        size_t eb = q >= 0 ? b->offsets[q] : 0, endb = q >= 0 ? b->offsets[q + 1] : 0;
+
+        // Merge the two symbol-sorted edge runs
+        while (ok && (ea < enda || eb < endb)) {
+            int sa = ea < enda ? a->syms[ea] : INT_MAX;
+            int sb = eb < endb ? b->syms[eb] : INT_MAX;
+            int sym = sa < sb ? sa : sb;
+
+            size_t ra = ea, rb = eb;
+            while (ra < enda && a->syms[ra] == sym) ra++;
+            while (rb < endb && b->syms[rb] == sym) rb++;
+
+            if (sym == eps) {
+                // ε moves one side and leaves the other in place
+                for (size_t i = ea; i < ra && ok; i++) ok = product_edge(graph, &walk, (int)id, sym, a->dests[i], q);
+                for (size_t j = eb; j < rb && ok; j++) ok = product_edge(graph, &walk, (int)id, sym, p, b->dests[j]);
+            } else if (ea < ra && eb < rb) {
+                for (size_t i = ea; i < ra && ok; i++) {
+                    for (size_t j = eb; j < rb && ok; j++) {
+                        ok = product_edge(graph, &walk, (int)id, sym, a->dests[i], b->dests[j]);
                     }
-                    transition_node2 = transition_node2->next;
                 }
-                transition_node1 = transition_node1->next;
+            } else if (ea < ra && right_sink) {
+                for (size_t i = ea; i < ra && ok; i++) ok = product_edge(graph, &walk, (int)id, sym, a->dests[i], PRODUCT_SINK);
+            } else if (eb < rb && left_sink) {
+                for (size_t j = eb; j < rb && ok; j++) ok = product_edge(graph, &walk, (int)id, sym, PRODUCT_SINK, b->dests[j]);
             }
+
+            ea = ra;
+            eb = rb;
         }
     }
 
+    pair_table_free(&walk.table);
+    if (!ok) product_graph_free(graph);
+    return ok;
+}
+
+static fa_auto* product_emit(const product_graph *graph, const fa_index *a, const fa_index *b,
+                             product_kind kind, const Set *alphabet) {
+    fa_builder builder = { .nstates = graph->npairs, .state_capacity = graph->npairs,
+                           .flags = malloc(graph->npairs ? graph->npairs : 1),
+                           .nedges = graph->nedges, .edge_capacity = graph->nedges,
+                           .edges = graph->edges };
+    if (!builder.flags) return NULL;
+
+    for (size_t i = 0; i < graph->npairs; i++) {
+        int p = graph->left[i], q = graph->right[i];
+        bool start = p >= 0 && q >= 0 && (a->flags[p] & FA_INDEX_START) && (b->flags[q] & FA_INDEX_START);
+        bool in_a = p >= 0 ? (a->flags[p] & FA_INDEX_ACCEPT) != 0 : a->sink_accepts;
+        bool in_b = q >= 0 ? (b->flags[q] & FA_INDEX_ACCEPT) != 0 : b->sink_accepts;
+
+        builder.flags[i] = (start ? FA_INDEX_START : 0) |
+                           (product_accepts(kind, in_a, in_b) ? FA_INDEX_ACCEPT : 0);
+    }
+
+    fa_auto *automaton = fa_builder_emit(&builder, a->symtab, alphabet, NULL, NULL);
+    free(builder.flags);
     return automaton;
 }
 
+/*
+ * Operations that complement a side need that side deterministic; NFAs are
+ * determinized first. Intersection works on NFAs directly. The explored
+ * graph only depends on which sides may fall into the sink, so several
+ * kinds share one exploration and differ only in their accept marking;
+ * out[k] receives the result for kinds[k]. A side with an implicit
+ * accepting sink (a complement) can always fall into it, and the result
+ * keeps an implicit sink whenever the kind accepts the pair of sinks.
+ */
+static bool product_build_many(const fa_auto *a1, const fa_auto *a2,
+                               const product_kind *kinds, size_t nkinds, op_meter *meter,
+                               fa_auto **out) {
+    for (size_t k = 0; k < nkinds; k++) out[k] = NULL;
+    if (!a1 || !a2) return false;
+
+    bool need_dfa_a = false, need_dfa_b = false;
+    for (size_t k = 0; k < nkinds; k++) {
+        need_dfa_a |= kinds[k] == PRODUCT_SYMMETRIC_DIFF || kinds[k] == PRODUCT_UNION;
+        need_dfa_b |= kinds[k] != PRODUCT_INTERSECTION;
+    }
 
-fa_auto* fa_auto_concat(const fa_auto* a1, const fa_auto* a2){
-    if(!a1 || !a2) return NULL;
+    fa_symtab *symtab = symtab_shared(a1, a2);
+    fa_auto *det_a = NULL, *det_b = NULL;
+    fa_index *a = NULL, *b = NULL;
+    bool ok = false;
+    product_graph graph;
 
-    const int offset = 2;
-    fa_auto* automaton = fa_auto_create(a1->capacity + a2->capacity);
-    automaton->alphabet = set_union(a1->alphabet, a2->alphabet);
+    if (!symtab) return false;
 
-    for (int i = 0; i < a1->capacity; i++) {
-        automaton->states[i] = fa_state_create(a1->states[i]->label, a1->states[i]->is_start, false);
-        automaton->nstates++;
+    a = fa_index_build(a1, symtab);
+    if (a && need_dfa_a && !fa_index_is_deterministic(a)) {
+        fa_index_destroy(a);
+        a = NULL;
+        det_a = det_run(a1, FA_DETERMINIZE_DEFAULT, meter);
+        if (det_a) a = fa_index_build(det_a, symtab);
     }
 
-    const int last_idx = a1->capacity;
-    for (int i = 0; i < a2->capacity; i++) {
-        automaton->states[last_idx + i] = fa_state_create(a2->states[i]->label, false, a2->states[i]->is_accept);
-        automaton->nstates++;
+    b = fa_index_build(a2, symtab);
+    if (b && need_dfa_b && !fa_index_is_deterministic(b)) {
+        fa_index_destroy(b);
+        b = NULL;
+        det_b = det_run(a2, FA_DETERMINIZE_DEFAULT, meter);
+        if (det_b) b = fa_index_build(det_b, symtab);
     }
 
+    if (!a || !b) goto cleanup;
 
-    //adding a1 transitions
-    for (int i = 0; i < a1->capacity; i++) {
-        fa_trans* transition = a1->states[i]->trans;
-        while (transition) {
-            for (int j = 0; j < a1->capacity; j++) {
-                if (strcmp(automaton->states[j]->label, transition->dest->label) == 0) {
-                    fa_trans_create(automaton->states[i], automaton->states[j], transition->symbol);
-                }
+    if (product_explore(a, b, need_dfa_a || a->sink_accepts, need_dfa_b || b->sink_accepts, -1, meter, &graph)) {
+        ok = true;
+        for (size_t k = 0; k < nkinds && ok; k++) {
+            Set *alphabet;
+            switch (kinds[k]) {
+                case PRODUCT_INTERSECTION: alphabet = set_intersection(a1->alphabet, a2->alphabet); break;
+                case PRODUCT_DIFFERENCE:   alphabet = set_union(a1->alphabet, NULL); break;
+                default:                   alphabet = set_union(a1->alphabet, a2->alphabet); break;
             }
+            out[k] = alphabet ? product_emit(&graph, a, b, kinds[k], alphabet) : NULL;
+            ok = out[k] != NULL;
+            if (ok) out[k]->sink_accepts = product_accepts(kinds[k], a->sink_accepts, b->sink_accepts);
+            // Pairs where one side is stuck past its last accepting state are dead weight
+            if (ok && kinds[k] == PRODUCT_INTERSECTION) ok = fa_auto_trim(out[k]) == FA_SUCCESS;
+            if (alphabet) set_destroy(alphabet);
+        }
+        product_graph_free(&graph);
+    }
 
-            transition = transition->next;
+    if (!ok) {
+        for (size_t k = 0; k < nkinds; k++) {
+            fa_auto_destroy(out[k]);
+            out[k] = NULL;
         }
     }
 
+cleanup:
+    fa_index_destroy(a);
+    fa_index_destroy(b);
+    if (det_a) fa_auto_destroy(det_a);
+    if (det_b) fa_auto_destroy(det_b);
+    fa_symtab_destroy(symtab);
+    return ok;
+}
+
+static fa_auto* product_build(const fa_auto *a1, const fa_auto *a2, product_kind kind,
+                              op_meter *meter) {
+    fa_auto *result;
+    product_build_many(a1, a2, &kind, 1, meter, &result);
+    return result;
+}
 
-    //adding a2 transitions
-    for (int i = 0; i < a2->capacity; i++) {
-        fa_trans* transition = a2->states[i]->trans;
-        while (transition) {
 
-            for (int j = 0; j < a2->capacity; j++) {
-                if (strcmp(automaton->states[last_idx + j]->label, transition->dest->label) == 0) {
-                    fa_trans_create(automaton->states[last_idx + i], automaton->states[last_idx + j], transition->symbol);
-                }
-            }
-            transition = transition->next;
-        }
-    }
+fa_auto* fa_auto_product(const fa_auto* a1, const fa_auto* a2){
+    return product_build(a1, a2, PRODUCT_INTERSECTION, NULL);
+}
 
-    // adding epsilon transitions
-     for (int i = 0; i < a1->capacity; i++) {
-         if (a1->states[i]->is_accept) {
-             for (int j = 0; j < a2->capacity; j++) {
-                 if (a2->states[j]->is_start) {
-                     fa_trans_create(automaton->states[i], automaton->states[last_idx + j], FA_EPS_SYMBOL);
-                 }
-             }
-         }
-    }
+fa_auto* fa_auto_product_budget(const fa_auto* a1, const fa_auto* a2,
+                                fa_budget* budget, fa_error_t* error){
+    op_meter storage;
+    op_meter *meter = meter_begin(&storage, budget);
+    fa_auto *result = product_build(a1, a2, PRODUCT_INTERSECTION, meter);
+    fa_error_t status = meter_end(meter, result ? FA_SUCCESS :
+                                  a1 && a2 ? FA_ERR_OUT_OF_MEMORY : FA_ERR_NULL_ARGUMENT);
+    if (error) *error = status;
+    return result;
+}
 
-    fa_auto_rename_states(automaton);
 
-    return automaton;
+fa_auto* fa_auto_concat(const fa_auto* a1, const fa_auto* a2){
+    return splice_build(a1, a2, true);
 }
 
 
 
 fa_auto* fa_auto_difference(const fa_auto* a, const fa_auto* b){
-    //TODO: Misssing Implementation
-    return NULL;
+    return product_build(a, b, PRODUCT_DIFFERENCE, NULL);
 }
 fa_auto* fa_auto_symmetric_difference(const fa_auto* a, const fa_auto* b){
-    //TODO: Misssing Implementation
-    return NULL;
+    return product_build(a, b, PRODUCT_SYMMETRIC_DIFF, NULL);
+}
+
+static fa_auto* compose_single_result(const fa_auto* a, const fa_auto* b,
+                                     fa_operation_flags flags, op_meter *meter) {
+    switch (compose_binary_op(flags)) {
+        case FA_OP_INTERSECTION:   return product_build(a, b, PRODUCT_INTERSECTION, meter);
+        case FA_OP_DIFFERENCE:     return product_build(a, b, PRODUCT_DIFFERENCE, meter);
+        case FA_OP_SYMMETRIC_DIFF: return product_build(a, b, PRODUCT_SYMMETRIC_DIFF, meter);
+        case FA_OP_CONCATENATION:  return fa_auto_concat(a, b);
+        default:                   return fa_auto_union(a, b);
+    }
 }
 
 // UNARY OPERATIONS
+/*
+ * Star wraps a flag-less copy between a fresh start and a fresh accept
+ * state (linked by ε for the empty word); plus keeps the copy's flags. Both
+ * loop every accepting state back to every start state.
+ */
 fa_auto* fa_auto_kleene(fa_auto* automaton, fa_kleene_type type){
-     if (!automaton) {
+    if (!automaton) {
         return NULL;
     }
 
-    fa_auto* new_aut = NULL;
-
-    if (type & FA_KLEENE_STAR) {
-        const int offset = 2;
-        new_aut = fa_auto_create(automaton->capacity + offset);
-        new_aut->alphabet = automaton->alphabet;
-
-        fa_state *new_origin = fa_state_create("S", true, false);
-        fa_state *new_destination = fa_state_create("D", false, true);
-
-        for (int i = 0; i < automaton->capacity; i++) {
-            new_aut->states[i] = automaton->states[i];
-        }
+    bool star = (type & FA_KLEENE_STAR) != 0;
+    fa_auto *owned;
+    const fa_auto *source = sink_explicit(automaton, &owned);
+    fa_symtab *symtab = source ? fa_symtab_create() : NULL;
+    fa_index *index = symtab ? fa_index_build(source, symtab) : NULL;
+    int eps = index ? fa_symtab_intern(symtab, FA_EPS_SYMBOL) : -1;
+    fa_auto *result = NULL;
+    fa_builder builder;
+    bool built = false;
+
+    if (eps < 0 || !fa_builder_init(&builder, index->nstates + 2, index->nedges + index->nstates + 1)) {
+        goto cleanup;
+    }
+    built = true;
 
-        new_aut->states[automaton->capacity] = new_origin;
-        new_aut->states[automaton->capacity + 1] = new_destination;
+    if (splice_copy(&builder, index, star ? 0 : FA_INDEX_START | FA_INDEX_ACCEPT) < 0) goto cleanup;
 
-        for (int i = 0; i < automaton->capacity; i++) {
-            for (int j = 0; j < automaton->capacity; j++) {
-                if (automaton->states[i]->is_start && automaton->states[j]->is_accept) {
-                    fa_trans_create(automaton->states[j], automaton->states[i], "eps");
-                }
+    for (size_t p = 0; p < index->nstates; p++) {
+        if (!(index->flags[p] & FA_INDEX_ACCEPT)) continue;
+        for (size_t q = 0; q < index->nstates; q++) {
+            if ((index->flags[q] & FA_INDEX_START) && !fa_builder_add_edge(&builder, (int)p, eps, (int)q)) {
+                goto cleanup;
             }
         }
+    }
 
-
-        for (int i = 0; i < automaton->capacity; i++) {
-            if (automaton->states[i]->is_start) {
-                fa_trans_create(automaton->states[automaton->capacity], automaton->states[i], "eps");
+    if (star) {
+        int start = fa_builder_add_state(&builder, FA_INDEX_START);
+        int accept = start < 0 ? -1 : fa_builder_add_state(&builder, FA_INDEX_ACCEPT);
+        if (accept < 0 || !fa_builder_add_edge(&builder, start, eps, accept)) goto cleanup;
+        for (size_t s = 0; s < index->nstates; s++) {
+            if ((index->flags[s] & FA_INDEX_START) && !fa_builder_add_edge(&builder, start, eps, (int)s)) {
+                goto cleanup;
             }
-
-            if (automaton->states[i]->is_accept) {
-                fa_trans_create(automaton->states[i], automaton->states[automaton->capacity + 1], "eps");
+            if ((index->flags[s] & FA_INDEX_ACCEPT) && !fa_builder_add_edge(&builder, (int)s, eps, accept)) {
+                goto cleanup;
             }
         }
+    }
 
-        fa_trans_create(automaton->states[automaton->capacity], automaton->states[automaton->capacity + 1], "eps");
+    result = fa_builder_emit(&builder, symtab, automaton->alphabet, NULL, NULL);
+
+cleanup:
+    if (built) fa_builder_free(&builder);
+    fa_index_destroy(index);
+    fa_symtab_destroy(symtab);
+    fa_auto_destroy(owned);
+    return result;
+}
 
 
-        for (int i = 0; i < automaton->capacity; i++) {
-            automaton->states[i]->is_accept = false;
-            automaton->states[i]->is_start = false;
-        }
 
+fa_auto* fa_auto_minimize_table(const fa_auto *automaton){
+    //TODO: Misssing Implementation
+    return NULL;
+}
+/* det(rev(det(rev(A)))): every subset the second pass builds is a distinct residual. */
+static fa_auto* brzozowski_run(const fa_auto *automaton, op_meter *meter) {
+    if (!automaton) return NULL;
+
+    fa_auto *result = NULL;
+    fa_auto *reversed = fa_auto_reverse(automaton);
+    fa_auto *det = reversed ? det_run(reversed, FA_DETERMINIZE_DEFAULT, meter) : NULL;
+    fa_auto_destroy(reversed);
+    reversed = det ? fa_auto_reverse(det) : NULL;
+    if (reversed) result = det_run(reversed, FA_DETERMINIZE_DEFAULT, meter);
+    fa_auto_destroy(det);
+    fa_auto_destroy(reversed);
+    return result;
+}
 
+fa_auto* fa_auto_minimize_brzozowski(const fa_auto *automaton){
+    return brzozowski_run(automaton, NULL);
+}
 
+// ============================================================================
+// Trim
+// ============================================================================
+
+/*
+ * Forward pass from the start states, then a backward pass over the
+ * reversed view from the reachable states that accept (all of them when
+ * an implicit accepting sink is there to fall into). Useful states end
+ * with mark 3; `mark` must be zeroed, `stack` holds nstates ids.
+ */
+static void trim_mark(const fa_index *index, const fa_index_reverse *reverse,
+                      bool sink_accepts, uint8_t *mark, int *stack) {
+    size_t n = index->nstates, top = 0;
+
+    // Forward: bit 1
+    for (size_t s = 0; s < n; s++) {
+        if (index->flags[s] & FA_INDEX_START) {
+            mark[s] = 1;
+            stack[top++] = (int)s;
+        }
     }
-    
-    
-    if(type & FA_KLEENE_PLUS){
-        new_aut = fa_auto_create(automaton->capacity);
-        new_aut->alphabet = automaton->alphabet;
-        for (int i = 0; i < automaton->capacity; i++) {
-            new_aut->states[i] = automaton->states[i];
+    while (top) {
+        int s = stack[--top];
+        for (size_t e = index->offsets[s]; e < index->offsets[s + 1]; e++) {
+            int d = index->dests[e];
+            if (!mark[d]) {
+                mark[d] = 1;
+                stack[top++] = d;
+            }
         }
+    }
 
-        for (int i = 0; i < automaton->capacity; i++) {
-            for (int j = 0; j < automaton->capacity; j++) {
-                if (automaton->states[i]->is_start && automaton->states[j]->is_accept) {
-                    fa_trans_create(automaton->states[j], automaton->states[i], "eps");
-                }
+    // Backward: bit 2
+    for (size_t s = 0; s < n; s++) {
+        if (mark[s] && (sink_accepts || (index->flags[s] & FA_INDEX_ACCEPT))) {
+            mark[s] |= 2;
+            stack[top++] = (int)s;
+        }
+    }
+    while (top) {
+        int s = stack[--top];
+        for (size_t e = reverse->offsets[s]; e < reverse->offsets[s + 1]; e++) {
+            int q = reverse->srcs[e];
+            if (mark[q] == 1) {
+                mark[q] |= 2;
+                stack[top++] = q;
             }
         }
-
     }
-
-    return new_aut;
 }
 
+/*
+ * The useful states are marked by trim_mark; everything else is freed and
+ * the state array is compacted in place. Start states are always kept so
+ * an empty language still has one. With an implicit accepting sink a state
+ * with nowhere to go still accepts through the sink, so only unreachable
+ * states are removed.
+ */
+fa_error_t fa_auto_trim(fa_auto* automaton){
+    if (!automaton) return FA_ERR_NULL_ARGUMENT;
+
+    fa_index *index = fa_index_build(automaton, NULL);
+    fa_index_reverse *reverse = index ? fa_index_reverse_build(index) : NULL;
+    size_t n = index ? index->nstates : 0;
+    uint8_t *mark = calloc(n ? n : 1, 1);
+    int *stack = malloc((n ? n : 1) * sizeof(int));
+    fa_error_t status = FA_ERR_OUT_OF_MEMORY;
+
+    if (!reverse || !mark || !stack) goto cleanup;
+
+    trim_mark(index, reverse, automaton->sink_accepts, mark, stack);
+    for (size_t s = 0; s < n; s++) {
+        mark[s] = mark[s] == 3 || (index->flags[s] & FA_INDEX_START);
+    }
 
+    // Unlink transitions into dropped states before freeing them
+    for (size_t s = 0; s < n; s++) {
+        if (!mark[s]) continue;
+        fa_state *state = index->states[s];
+        fa_trans **link = &state->trans;
+        while (*link) {
+            fa_trans *t = *link;
+            if (mark[fa_index_state_id(index, t->dest)]) {
+                link = &t->next;
+                continue;
+            }
+            *link = t->next;
+            free(t->symbol);
+            free(t);
+            state->ntrans--;
+        }
+    }
 
-fa_auto* fa_auto_minimize_hopcroft(const fa_auto *automaton){
-    //TODO: Misssing Implementation
-    return NULL;
-}
-fa_auto* fa_auto_minimize_table(const fa_auto *automaton){
-    //TODO: Misssing Implementation
-    return NULL;
-}
-fa_auto* fa_auto_minimize_brzozowski(const fa_auto *automaton){
-    //TODO: Misssing Implementation
-    return NULL;
+    // Index ids follow the non-NULL entries of the state array
+    size_t kept = 0, id = 0;
+    for (size_t i = 0; i < automaton->capacity; i++) {
+        fa_state *state = automaton->states[i];
+        automaton->states[i] = NULL;
+        if (!state) continue;
+        if (mark[id++]) automaton->states[kept++] = state;
+        else fa_state_destroy(state);
+    }
+    automaton->nstates = kept;
+    status = FA_SUCCESS;
+
+cleanup:
+    free(mark);
+    free(stack);
+    fa_index_reverse_destroy(reverse);
+    fa_index_destroy(index);
+    return status;
 }
 
-fa_auto* fa_auto_complement(const fa_auto* a){
-    //TODO: Misssing Implementation
-    return NULL;
-}
-fa_auto* fa_auto_reverse(const fa_auto* a){
-    //TODO: Misssing Implementation
-    return NULL;
-}
 
-fa_auto* fa_auto_minimize_moore(const fa_auto *automaton){
-    const int N = automaton->capacity;
-    int partition[N], new_partition[N];
+// ============================================================================
+// NFA reduction
+// ============================================================================
+
+/*
+ * Simulation preorders are kept as bit matrices: row p holds the states
+ * that simulate p. Forward, q simulates p when q accepts if p does and
+ * every a-edge of p is matched by an a-edge of q into a state simulating
+ * its target; backward simulation is the same relation over reversed
+ * edges with start states in place of accepting ones. Rows only shrink:
+ * when the row of v loses states, every a-predecessor p of v intersects
+ * its row with Pre_a(row v) and is queued again if it changed.
+ *
+ * Mutually simulating states accept (forward) or are reached by (backward)
+ * the same words and are merged. Among the a-edges of a class, one whose
+ * target is strictly simulated by another target is redundant: the words
+ * it leads to are read through the other one as well. Start classes are
+ * pruned the same way.
+ */
+
+typedef struct red_csr {
+    const size_t *offsets;
+    const int *syms;            // sorted within each run
+    const int *adj;
+} red_csr;
+
+typedef struct red_labels {
+    const fa_index *index;
+    const int *rep;
+} red_labels;
+
+static int red_compare_edges(const void *x, const void *y) {
+    const int *a = x, *b = y;
+    if (a[0] != b[0]) return a[0] < b[0] ? -1 : 1;
+    return (a[1] > b[1]) - (a[1] < b[1]);
+}
 
+static char* red_label(void *arg, int id) {
+    const red_labels *labels = arg;
+    const char *label = labels->index->states[labels->rep[id]]->label;
+    return label ? strdup(label) : NULL;
+}
 
-    for (int i = 0; i < N; i++) {
-        partition[i] = automaton->states[i]->is_accept;
+/* First edge of `state` in `csr` with symbol `sym` or greater. */
+static size_t red_run(const red_csr *csr, int state, int sym) {
+    size_t lo = csr->offsets[state], hi = csr->offsets[state + 1];
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (csr->syms[mid] < sym) lo = mid + 1;
+        else hi = mid;
     }
+    return lo;
+}
 
-    int changed;
-    do {
-        changed = 0;
-
+/*
+ * Greatest simulation along the edges whose reversal is `pred`, or NULL on
+ * allocation failure.
+ */
+static uint64_t* red_simulate(size_t n, const uint8_t *flags, uint8_t final,
+                              const red_csr *pred) {
+    size_t words = (n + 63) / 64;
+    uint64_t *rel = malloc((n ? n * words : 1) * sizeof(uint64_t));
+    uint64_t *finals = calloc(words ? words : 1, sizeof(uint64_t));
+    uint64_t *pre = malloc((words ? words : 1) * sizeof(uint64_t));
+    int *queue = malloc((n ? n : 1) * sizeof(int));
+    bool *queued = malloc(n ? n : 1);
+
+    if (!rel || !finals || !pre || !queue || !queued) {
+        free(rel);
+        rel = NULL;
+        goto cleanup;
+    }
 
-        for (int i = 0; i < N; i++) {
-            new_partition[i] = partition[i];
+    for (size_t s = 0; s < n; s++) {
+        if (flags[s] & final) bitset_words_add(finals, s);
+    }
+    for (size_t p = 0; p < n; p++) {
+        uint64_t *row = rel + p * words;
+        if (flags[p] & final) {
+            memcpy(row, finals, words * sizeof(uint64_t));
+        } else {
+            memset(row, 0xff, words * sizeof(uint64_t));
+            if (n % 64) row[words - 1] = (1ULL << (n % 64)) - 1;
         }
+        queue[p] = (int)p;
+        queued[p] = true;
+    }
 
-        int next_group = 2;
-        for (int i = 0; i < N; i++) {
-            for (int j = i + 1; j < N; j++) {
-                if (partition[i] == partition[j]) {
-                    int equivalent = 1;
-
-                    // Check transitions
-                    for (const fa_trans *t1 = automaton->states[i]->trans; t1 != NULL; t1 = t1->next) {
-                        int found_match = 0;
-                        for (const fa_trans *t2 = automaton->states[j]->trans; t2 != NULL; t2 = t2->next) {
-                            if (strcmp(t1->symbol, t2->symbol) == 0) {
-                                int idx_1 = fa_state_index(automaton, t1->dest);
-                                int idx_2 = fa_state_index(automaton, t2->dest);
-
-                                if (partition[idx_1] != partition[idx_2]) {
-                                    equivalent = 0;
-                                }
-                                found_match = 1;
-                                break;
-                            }
-                        }
-                        if (!found_match) {
-                            equivalent = 0;
-                        }
-                    }
+    size_t head = 0, count = n;
+    while (count) {
+        int v = queue[head];
+        head = (head + 1) % n;
+        count--;
+        queued[v] = false;
+
+        const uint64_t *row_v = rel + (size_t)v * words;
+        size_t e = pred->offsets[v], end = pred->offsets[v + 1];
+        while (e < end) {
+            int a = pred->syms[e];
+
+            // pre = states with an a-successor that simulates v
+            memset(pre, 0, words * sizeof(uint64_t));
+            for (size_t b = bitset_words_next(row_v, words, 0); b != BITSET_END;
+                 b = bitset_words_next(row_v, words, b + 1)) {
+                int q = (int)b;
+                for (size_t i = red_run(pred, q, a); i < pred->offsets[q + 1] && pred->syms[i] == a; i++) {
+                    bitset_words_add(pre, (size_t)pred->adj[i]);
+                }
+            }
 
-                    if (!equivalent) {
-                        new_partition[j] = N + next_group;
-                        changed = 1;
-                    }
+            for (; e < end && pred->syms[e] == a; e++) {
+                int p = pred->adj[e];
+                bool changed = bitset_words_and(rel + (size_t)p * words, pre, words);
+                if (changed && !queued[p]) {
+                    queue[(head + count++) % n] = p;
+                    queued[p] = true;
                 }
             }
-            next_group++;
         }
+    }
 
+cleanup:
+    free(finals);
+    free(pre);
+    free(queue);
+    free(queued);
+    return rel;
+}
 
-        for (int i = 0; i < N; i++) {
-            partition[i] = new_partition[i];
+/*
+ * Merges mutually simulating states and drops dominated edges and start
+ * flags, in the direction of `succ`. Sets *reduced if anything went.
+ */
+static fa_auto* red_quotient(const fa_auto *work, const fa_index *index, const uint64_t *rel,
+                             const red_csr *succ, bool backward, bool *reduced) {
+    size_t n = index->nstates, words = (n + 63) / 64;
+    uint8_t initial = backward ? FA_INDEX_ACCEPT : FA_INDEX_START;
+    int *cls = malloc((n ? n : 1) * sizeof(int));
+    int *rep = malloc((n ? n : 1) * sizeof(int));
+    int *members = malloc((n ? n : 1) * sizeof(int));
+    size_t *first = calloc(n + 1, sizeof(size_t));
+    uint8_t *cflags = calloc(n ? n : 1, 1);
+    int *edges = NULL;
+    bool *dropped = NULL;
+    size_t capacity = 0, nclass = 0, nemitted = 0;
+    fa_auto *result = NULL;
+    fa_builder builder;
+    bool built = false;
+
+    if (!cls || !rep || !members || !first || !cflags) goto cleanup;
+
+    for (size_t p = 0; p < n; p++) cls[p] = -1;
+    for (size_t p = 0; p < n; p++) {
+        if (cls[p] >= 0) continue;
+        const uint64_t *row = rel + p * words;
+        rep[nclass] = (int)p;
+        for (size_t q = p; q < n; q++) {
+            if (bitset_words_contains(row, q) && cls[q] < 0 && bitset_words_contains(rel + q * words, p)) cls[q] = (int)nclass;
         }
+        nclass++;
+    }
 
-    } while (changed);
+    // Members grouped by class
+    for (size_t p = 0; p < n; p++) first[cls[p] + 1]++;
+    for (size_t c = 0; c < nclass; c++) first[c + 1] += first[c];
+    for (size_t p = 0; p < n; p++) members[first[cls[p]]++] = (int)p;
+    for (size_t c = nclass; c > 0; c--) first[c] = first[c - 1];
+    first[0] = 0;
+
+    // Class y strictly simulates class x (classes are distinct)
+    #define RED_SIMULATES(x, y) bitset_words_contains(rel + (size_t)rep[x] * words, (size_t)rep[y])
+
+    for (size_t p = 0; p < n; p++) cflags[cls[p]] |= index->flags[p];
+    for (size_t x = 0; x < nclass; x++) {
+        if (!(cflags[x] & initial)) continue;
+        for (size_t y = 0; y < nclass; y++) {
+            if (y != x && (cflags[y] & initial) && RED_SIMULATES(x, y)) {
+                cflags[x] &= (uint8_t)~initial;
+                *reduced = true;
+                break;
+            }
+        }
+    }
 
+    if (!fa_builder_init(&builder, nclass, index->nedges)) goto cleanup;
+    built = true;
+    for (size_t c = 0; c < nclass; c++) {
+        if (fa_builder_add_state(&builder, cflags[c]) < 0) goto cleanup;
+    }
+
+    for (size_t x = 0; x < nclass; x++) {
+        size_t nedges = 0;
+        for (size_t i = first[x]; i < first[x + 1]; i++) {
+            int p = members[i];
+            size_t degree = succ->offsets[p + 1] - succ->offsets[p];
+            if (nedges + degree > capacity) {
+                size_t grown_capacity = (nedges + degree) * 2;
+                int *grown = realloc(edges, grown_capacity * 2 * sizeof(int));
+                bool *grown_dropped = realloc(dropped, grown_capacity * sizeof(bool));
+                if (grown) edges = grown;
+                if (grown_dropped) dropped = grown_dropped;
+                if (!grown || !grown_dropped) goto cleanup;
+                capacity = grown_capacity;
+            }
+            for (size_t e = succ->offsets[p]; e < succ->offsets[p + 1]; e++) {
+                edges[2 * nedges] = succ->syms[e];
+                edges[2 * nedges + 1] = cls[succ->adj[e]];
+                nedges++;
+            }
+        }
+        if (nedges > 1) qsort(edges, nedges, 2 * sizeof(int), red_compare_edges);
+
+        size_t unique = 0;
+        for (size_t i = 0; i < nedges; i++) {
+            if (unique && edges[2 * unique - 2] == edges[2 * i] &&
+                edges[2 * unique - 1] == edges[2 * i + 1]) {
+                continue;
+            }
+            edges[2 * unique] = edges[2 * i];
+            edges[2 * unique + 1] = edges[2 * i + 1];
+            dropped[unique++] = false;
+        }
+
+        for (size_t begin = 0, end; begin < unique; begin = end) {
+            for (end = begin; end < unique && edges[2 * end] == edges[2 * begin]; end++);
+            for (size_t i = begin; i < end; i++) {
+                for (size_t j = begin; j < end && !dropped[i]; j++) {
+                    dropped[i] = j != i && !dropped[j] && RED_SIMULATES(edges[2 * i + 1], edges[2 * j + 1]);
+                }
+            }
+            for (size_t i = begin; i < end; i++) {
+                if (dropped[i]) continue;
+                int sym = edges[2 * i], t = edges[2 * i + 1];
+                bool ok = backward ? fa_builder_add_edge(&builder, t, sym, (int)x)
+                                   : fa_builder_add_edge(&builder, (int)x, sym, t);
+                if (!ok) goto cleanup;
+                nemitted++;
+            }
+        }
+    }
+    #undef RED_SIMULATES
+
+    if (nclass < n || nemitted < index->nedges) *reduced = true;
+    red_labels labels = { index, rep };
+    result = fa_builder_emit(&builder, index->symtab, work->alphabet, red_label, &labels);
+
+cleanup:
+    if (built) fa_builder_free(&builder);
+    free(cls);
+    free(rep);
+    free(members);
+    free(first);
+    free(cflags);
+    free(edges);
+    free(dropped);
+    return result;
+}
+
+/* One forward or backward quotient-and-prune pass over `work`. */
+static fa_auto* red_pass(const fa_auto *work, bool backward, bool *reduced) {
+    fa_index *index = fa_index_build(work, NULL);
+    fa_index_reverse *reverse = index ? fa_index_reverse_build(index) : NULL;
+    int *rsyms = reverse ? malloc((index->nedges ? index->nedges : 1) * sizeof(int)) : NULL;
+    uint64_t *rel = NULL;
+    fa_auto *result = NULL;
+
+    if (!rsyms) goto cleanup;
+    for (size_t i = 0; i < index->nedges; i++) rsyms[i] = index->syms[reverse->edges[i]];
+
+    red_csr forward = { index->offsets, index->syms, index->dests };
+    red_csr reversed = { reverse->offsets, rsyms, reverse->srcs };
+    const red_csr *succ = backward ? &reversed : &forward;
+    const red_csr *pred = backward ? &forward : &reversed;
+
+    rel = red_simulate(index->nstates, index->flags,
+                       backward ? FA_INDEX_START : FA_INDEX_ACCEPT, pred);
+    if (rel) result = red_quotient(work, index, rel, succ, backward, reduced);
+    if (result && fa_auto_trim(result) != FA_SUCCESS) {
+        fa_auto_destroy(result);
+        result = NULL;
+    }
+
+cleanup:
+    free(rel);
+    free(rsyms);
+    fa_index_reverse_destroy(reverse);
+    fa_index_destroy(index);
+    return result;
+}
+
+/*
+ * ε-edges are removed first (simulation over ε-paths is not a preorder on
+ * single steps), then forward and backward passes alternate until one of
+ * each leaves the automaton unchanged: each pass can expose merges the
+ * other could not see.
+ */
+fa_auto* fa_auto_reduce_nfa(const fa_auto* a){
+    if (!a) return NULL;
+
+    fa_auto *work = fa_auto_materialize_sink(a);
+    if (!work) return NULL;
+    fa_auto_remove_epsilon(work);
+    if (fa_auto_trim(work) != FA_SUCCESS) {
+        fa_auto_destroy(work);
+        return NULL;
+    }
+
+    bool backward = false;
+    for (int idle = 0; idle < 2; backward = !backward) {
+        bool reduced = false;
+        fa_auto *next = red_pass(work, backward, &reduced);
+        fa_auto_destroy(work);
+        if (!next) return NULL;
+        work = next;
+        idle = reduced ? 0 : idle + 1;
+    }
+    return work;
+}
+
+
+// ============================================================================
+// Language size
+// ============================================================================
+
+/*
+ * Counts are 128-bit and saturate: SIZE_COUNT_MAX stands for "at least
+ * 2^128 - 1" and absorbs every sum and every product with a non-zero
+ * factor, so a clamped intermediate only taints what it contributes to.
+ */
+typedef unsigned __int128 size_count;
+#define SIZE_COUNT_MAX (~(size_count)0)
+
+static inline size_count size_add(size_count x, size_count y) {
+    size_count r = x + y;
+    return r < x ? SIZE_COUNT_MAX : r;
+}
+
+static inline size_count size_mul(size_count x, size_count y) {
+    size_count r;
+    if (!x || !y) return 0;
+    return __builtin_mul_overflow(x, y, &r) ? SIZE_COUNT_MAX : r;
+}
+
+/*
+ * Useful states (mark 3) of `index`, or NULL on allocation failure.
+ */
+static uint8_t* size_useful(const fa_index *index) {
+    size_t n = index->nstates;
+    fa_index_reverse *reverse = fa_index_reverse_build(index);
+    uint8_t *mark = calloc(n ? n : 1, 1);
+    int *stack = malloc((n ? n : 1) * sizeof(int));
+
+    if (reverse && mark && stack) {
+        trim_mark(index, reverse, false, mark, stack);
+    } else {
+        free(mark);
+        mark = NULL;
+    }
+    free(stack);
+    fa_index_reverse_destroy(reverse);
+    return mark;
+}
+
+/*
+ * Iterative Tarjan over the useful subgraph. comp[s] receives the
+ * component of useful state s (-1 for the others); components are
+ * numbered in reverse topological order. Returns false on allocation
+ * failure.
+ */
+static bool size_components(const fa_index *index, const uint8_t *mark, int *comp) {
+    size_t n = index->nstates;
+    size_t cap = n ? n : 1;
+    int *num = malloc(cap * sizeof(int));
+    int *low = malloc(cap * sizeof(int));
+    int *scc = malloc(cap * sizeof(int));
+    int *call = malloc(cap * sizeof(int));
+    size_t *next = malloc(cap * sizeof(size_t));
+    bool ok = num && low && scc && call && next;
+
+    if (!ok) goto cleanup;
+
+    for (size_t s = 0; s < n; s++) num[s] = comp[s] = -1;
+
+    int counter = 0, ncomp = 0;
+    size_t sp = 0, cp = 0;
+    for (size_t root = 0; root < n; root++) {
+        if (mark[root] != 3 || num[root] >= 0) continue;
+
+        num[root] = low[root] = counter++;
+        next[root] = index->offsets[root];
+        scc[sp++] = call[cp++] = (int)root;
+        while (cp) {
+            int v = call[cp - 1];
+            if (next[v] < index->offsets[v + 1]) {
+                int w = index->dests[next[v]++];
+                if (mark[w] != 3) continue;
+                if (num[w] < 0) {
+                    num[w] = low[w] = counter++;
+                    next[w] = index->offsets[w];
+                    scc[sp++] = call[cp++] = w;
+                } else if (comp[w] < 0 && num[w] < low[v]) {
+                    low[v] = num[w];        // w is still on the component stack
+                }
+                continue;
+            }
+            if (--cp && low[v] < low[call[cp - 1]]) low[call[cp - 1]] = low[v];
+            if (low[v] == num[v]) {
+                int w;
+                do {
+                    w = scc[--sp];
+                    comp[w] = ncomp;
+                } while (w != v);
+                ncomp++;
+            }
+        }
+    }
+
+cleanup:
+    free(num);
+    free(low);
+    free(scc);
+    free(call);
+    free(next);
+    return ok;
+}
+
+/* A cycle of useful states reads a symbol iff a non-ε edge stays in one component. */
+static bool size_cyclic(const fa_index *index, const int *comp) {
+    for (size_t s = 0; s < index->nstates; s++) {
+        if (comp[s] < 0) continue;
+        for (size_t e = index->offsets[s]; e < index->offsets[s + 1]; e++) {
+            if (comp[index->dests[e]] == comp[s] && index->syms[e] != index->symtab->eps) return true;
+        }
+    }
+    return false;
+}
+
+bool fa_auto_is_infinite(const fa_auto* a){
+    if (!a) return false;
+
+    fa_auto *owned;
+    const fa_auto *source = sink_explicit(a, &owned);
+    fa_index *index = source ? fa_index_build(source, NULL) : NULL;
+    uint8_t *mark = index ? size_useful(index) : NULL;
+    int *comp = mark ? malloc((index->nstates ? index->nstates : 1) * sizeof(int)) : NULL;
+    bool infinite = comp && size_components(index, mark, comp) && size_cyclic(index, comp);
+
+    free(comp);
+    free(mark);
+    fa_index_destroy(index);
+    fa_auto_destroy(owned);
+    return infinite;
+}
+
+/* Words one edge stands for: a minterm reads any of its characters. */
+static size_count size_width(const fa_index *index, size_t e) {
+    fa_range range;
+    if (!index->symtab->symbolic || !fa_symtab_range(index->symtab, index->syms[e], &range)) return 1;
+    return (size_count)(range.hi - range.lo) + 1;
+}
+
+/* Accepting-path counts after 0..max_len steps, one vector at a time. */
+static size_count size_count_dp(const fa_index *index, const int *ids, int n,
+                                const bool *accept, int start, uint64_t max_len,
+                                size_count *cur, size_count *next) {
+    size_count total = 0;
+
+    memset(cur, 0, (size_t)n * sizeof(size_count));
+    cur[ids[start]] = 1;
+    for (uint64_t k = 0;; k++) {
+        for (int s = 0; s < n; s++) {
+            if (accept[s]) total = size_add(total, cur[s]);
+        }
+        if (k == max_len || total == SIZE_COUNT_MAX) break;
+
+        memset(next, 0, (size_t)n * sizeof(size_count));
+        for (size_t s = 0; s < index->nstates; s++) {
+            if (ids[s] < 0 || !cur[ids[s]]) continue;
+            for (size_t e = index->offsets[s]; e < index->offsets[s + 1]; e++) {
+                int d = ids[index->dests[e]];
+                if (d >= 0) next[d] = size_add(next[d], size_mul(cur[ids[s]], size_width(index, e)));
+            }
+        }
+        size_count *swap = cur;
+        cur = next;
+        next = swap;
+    }
+    return total;
+}
+
+/* r = x * y for m x m matrices (r distinct from both). */
+static void size_matmul(size_count *r, const size_count *x, const size_count *y, int m) {
+    memset(r, 0, (size_t)m * m * sizeof(size_count));
+    for (int i = 0; i < m; i++) {
+        for (int k = 0; k < m; k++) {
+            size_count f = x[(size_t)i * m + k];
+            if (!f) continue;
+            for (int j = 0; j < m; j++) {
+                size_count p = size_mul(f, y[(size_t)k * m + j]);
+                if (p) r[(size_t)i * m + j] = size_add(r[(size_t)i * m + j], p);
+            }
+        }
+    }
+}
+
+/* r = v * x for a row vector v (r distinct from v). */
+static void size_vecmul(size_count *r, const size_count *v, const size_count *x, int m) {
+    memset(r, 0, (size_t)m * sizeof(size_count));
+    for (int k = 0; k < m; k++) {
+        if (!v[k]) continue;
+        for (int j = 0; j < m; j++) {
+            size_count p = size_mul(v[k], x[(size_t)k * m + j]);
+            if (p) r[j] = size_add(r[j], p);
+        }
+    }
+}
+
+/*
+ * The transition-count matrix is extended with an accumulator row/column:
+ * [v | t] * [[M, acc], [0, 1]] = [vM | t + v.acc], so after max_len + 1
+ * steps from [e_start | 0] the last entry is the count of accepted words
+ * of length <= max_len. A^(max_len + 1) is applied by repeated squaring.
+ */
+static bool size_count_matrix(const fa_index *index, const int *ids, int n,
+                              const bool *accept, int start, uint64_t max_len,
+                              size_count *total) {
+    int m = n + 1;
+    size_t cells = (size_t)m * m;
+    size_count *power = calloc(cells, sizeof(size_count));
+    size_count *scratch = malloc(cells * sizeof(size_count));
+    size_count *vec = calloc((size_t)m, sizeof(size_count));
+    size_count *tmp = malloc((size_t)m * sizeof(size_count));
+    bool ok = false;
+
+    if (!power || !scratch || !vec || !tmp) goto cleanup;
+
+    for (size_t s = 0; s < index->nstates; s++) {
+        if (ids[s] < 0) continue;
+        for (size_t e = index->offsets[s]; e < index->offsets[s + 1]; e++) {
+            int d = ids[index->dests[e]];
+            if (d >= 0) power[(size_t)ids[s] * m + d] += size_width(index, e);
+        }
+        if (accept[ids[s]]) power[(size_t)ids[s] * m + n] = 1;
+    }
+    power[cells - 1] = 1;
+    vec[ids[start]] = 1;
+
+    // max_len + 1 steps without overflowing the exponent: one step apart
+    size_vecmul(tmp, vec, power, m);
+    memcpy(vec, tmp, (size_t)m * sizeof(size_count));
+    for (uint64_t e = max_len; e; e >>= 1) {
+        if (e & 1) {
+            size_vecmul(tmp, vec, power, m);
+            memcpy(vec, tmp, (size_t)m * sizeof(size_count));
+        }
+        if (e > 1) {
+            size_matmul(scratch, power, power, m);
+            size_count *swap = power;
+            power = scratch;
+            scratch = swap;
+        }
+    }
+    *total = vec[n];
+    ok = true;
+
+cleanup:
+    free(power);
+    free(scratch);
+    free(vec);
+    free(tmp);
+    return ok;
+}
+
+/*
+ * Acyclic case, one pass in reverse topological order (the component ids):
+ * the number of accepted words and the length of the longest one read
+ * from each state. Returns 1 with *total set when no word exceeds max_len,
+ * 0 when the bound cuts some words off, -1 on allocation failure.
+ */
+static int size_count_dag(const fa_index *index, const int *comp, int n, int start,
+                          uint64_t max_len, size_count *total) {
+    int *order = malloc((size_t)n * sizeof(int));
+    uint64_t *longest = malloc((size_t)n * sizeof(uint64_t));
+    size_count *paths = malloc((size_t)n * sizeof(size_count));
+    int result = -1;
+
+    if (!order || !longest || !paths) goto cleanup;
+
+    for (size_t s = 0; s < index->nstates; s++) {
+        if (comp[s] >= 0) order[comp[s]] = (int)s;
+    }
+    for (int c = 0; c < n; c++) {
+        int s = order[c];
+        size_count p = (index->flags[s] & FA_INDEX_ACCEPT) ? 1 : 0;
+        uint64_t len = 0;
+        for (size_t e = index->offsets[s]; e < index->offsets[s + 1]; e++) {
+            int d = comp[index->dests[e]];
+            if (d < 0) continue;
+            p = size_add(p, size_mul(paths[d], size_width(index, e)));
+            if (longest[d] + 1 > len) len = longest[d] + 1;
+        }
+        paths[c] = p;
+        longest[c] = len;
+    }
+    result = longest[comp[start]] <= max_len;
+    if (result) *total = paths[comp[start]];
+
+cleanup:
+    free(order);
+    free(longest);
+    free(paths);
+    return result;
+}
+
+/*
+ * Words and accepting paths are in one-to-one correspondence in a DFA, so
+ * an NFA is determinized first; states that are not useful are left out.
+ * A finite language is counted in one topological pass unless max_len
+ * cuts it short. Otherwise the per-length vector DP costs O(max_len * m)
+ * and the matrix power O(n^3 log max_len); the cheaper one is run.
+ */
+fa_error_t fa_auto_count_words(const fa_auto* a, uint64_t max_len, fa_word_count* count){
+    if (!a || !count) return FA_ERR_NULL_ARGUMENT;
+
+    fa_auto *owned, *det = NULL;
+    const fa_auto *source = sink_explicit(a, &owned);
+    fa_index *index = source ? fa_index_build(source, NULL) : NULL;
+    uint8_t *mark = NULL;
+    int *ids = NULL, *comp = NULL;
+    bool *accept = NULL;
+    size_count *cur = NULL, *next = NULL;
+    fa_error_t status = FA_ERR_OUT_OF_MEMORY;
+
+    if (index && !fa_index_is_deterministic(index)) {
+        fa_index_destroy(index);
+        det = fa_auto_determinize(source, FA_DETERMINIZE_DEFAULT);
+        index = det ? fa_index_build(det, NULL) : NULL;
+    }
+    if (!index || !(mark = size_useful(index))) goto cleanup;
+
+    size_t nstates = index->nstates;
+    int n = 0, start = -1;
+    ids = malloc((nstates ? nstates : 1) * sizeof(int));
+    comp = malloc((nstates ? nstates : 1) * sizeof(int));
+    accept = malloc((nstates ? nstates : 1) * sizeof(bool));
+    if (!ids || !comp || !accept) goto cleanup;
+    for (size_t s = 0; s < nstates; s++) {
+        ids[s] = mark[s] == 3 ? n++ : -1;
+        if (ids[s] < 0) continue;
+        accept[ids[s]] = index->flags[s] & FA_INDEX_ACCEPT;
+        if (index->flags[s] & FA_INDEX_START) start = (int)s;
+    }
+
+    size_count total = 0;
+    if (start >= 0) {
+        if (!size_components(index, mark, comp)) goto cleanup;
+        bool cyclic = size_cyclic(index, comp);
+        int done = cyclic ? 0 : size_count_dag(index, comp, n, start, max_len, &total);
+        if (done < 0) goto cleanup;
+
+        size_t edges = 0;
+        for (size_t s = 0; s < nstates && !done; s++) {
+            if (ids[s] >= 0) edges += index->offsets[s + 1] - index->offsets[s];
+        }
+        double bits = 1;
+        for (uint64_t e = max_len; e > 1; e >>= 1) bits++;
+        double dp_cost = ((double)max_len + 1) * ((double)edges + n);
+        double matrix_cost = (double)(n + 1) * (n + 1) * (n + 1) * bits;
+
+        if (!done && cyclic && matrix_cost < dp_cost) {
+            if (!size_count_matrix(index, ids, n, accept, start, max_len, &total)) goto cleanup;
+        } else if (!done) {
+            cur = malloc((size_t)n * sizeof(size_count));
+            next = malloc((size_t)n * sizeof(size_count));
+            if (!cur || !next) goto cleanup;
+            total = size_count_dp(index, ids, n, accept, start, max_len, cur, next);
+        }
+    }
+
+    count->low = (uint64_t)total;
+    count->high = (uint64_t)(total >> 64);
+    count->saturated = total == SIZE_COUNT_MAX;
+    status = FA_SUCCESS;
+
+cleanup:
+    free(cur);
+    free(next);
+    free(ids);
+    free(comp);
+    free(accept);
+    free(mark);
+    fa_index_destroy(index);
+    fa_auto_destroy(det);
+    fa_auto_destroy(owned);
+    return status;
+}
+
+
+// ============================================================================
+// Sampling
+// ============================================================================
+
+/*
+ * Words of one length are drawn from a table of per-state path counts:
+ * counts[r * n + s] is the number of accepted words of length r read from
+ * useful state s of the DFA. A draw walks `length` steps from the start,
+ * taking each edge with probability proportional to the count behind it,
+ * which makes every word of L(a) ∩ Σ^length equally likely; with exact
+ * counts that is one random index, unranked edge by edge.
+ *
+ * A minterm edge counts once per character it reads, and a draw landing
+ * on it picks one of them the same way.
+ *
+ * Counts are exact 128-bit integers while they fit. Beyond that the table
+ * holds doubles rescaled level by level to a maximum of 1, so long words
+ * over large alphabets stay drawable, uniformly up to double rounding.
+ */
+struct fa_word_sampler {
+    int n;                      // useful states, start is 0
+    size_t length;
+    bool exact;
+    size_t *offsets;            // n + 1, edges to useful states only
+    int *dests;
+    const char **text;          // symbol of each edge
+    size_t *text_len;
+    fa_range *range;            // characters of a minterm edge, lo > hi otherwise
+    size_count *counts;         // exact: (length + 1) * n
+    double *weights;            // otherwise: same layout, one scale per level
+    fa_symtab *symtab;
+};
+
+static inline uint64_t sample_next(uint64_t *rng) {
+    // splitmix64
+    uint64_t z = (*rng += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+/* Uniform in [0, bound) for bound > 0, without modulo bias. */
+static size_count sample_below(uint64_t *rng, size_count bound) {
+    if (bound <= UINT64_MAX) {
+        // Multiply-shift with rejection of the biased low range
+        uint64_t b = (uint64_t)bound;
+        size_count m = (size_count)sample_next(rng) * b;
+        if ((uint64_t)m < b) {
+            uint64_t threshold = -b % b;
+            while ((uint64_t)m < threshold) m = (size_count)sample_next(rng) * b;
+        }
+        return m >> 64;
+    }
+
+    size_count mask = ~(size_count)0 >> __builtin_clzll((uint64_t)((bound - 1) >> 64));
+    for (;;) {
+        size_count x = ((size_count)sample_next(rng) << 64) | sample_next(rng);
+        if ((x &= mask) < bound) return x;
+    }
+}
+
+static inline size_count sampler_width(const fa_word_sampler *sampler, size_t e) {
+    const fa_range *range = &sampler->range[e];
+    return range->lo > range->hi ? 1 : (size_count)(range->hi - range->lo) + 1;
+}
+
+static bool sampler_fill(fa_word_sampler *sampler, const fa_index *index, const int *ids) {
+    int n = sampler->n;
+    size_t cells = (sampler->length + 1) * (size_t)n;
+
+    if (!(sampler->counts = malloc(cells * sizeof(size_count)))) return false;
+    for (size_t s = 0; s < index->nstates; s++) {
+        if (ids[s] >= 0) sampler->counts[ids[s]] = (index->flags[s] & FA_INDEX_ACCEPT) ? 1 : 0;
+    }
+
+    for (size_t r = 1; r <= sampler->length; r++) {
+        const size_count *below = sampler->counts + (r - 1) * n;
+        size_count *level = sampler->counts + r * n;
+        for (int s = 0; s < n; s++) {
+            size_count sum = 0;
+            for (size_t e = sampler->offsets[s]; e < sampler->offsets[s + 1]; e++) {
+                sum = size_add(sum, size_mul(below[sampler->dests[e]], sampler_width(sampler, e)));
+            }
+            level[s] = sum;
+        }
+    }
+    // A draw only visits counts bounded by the start's, so clamped entries
+    // elsewhere are harmless
+    sampler->exact = !n || sampler->counts[sampler->length * n] != SIZE_COUNT_MAX;
+    if (sampler->exact) return true;
+
+    free(sampler->counts);
+    sampler->counts = NULL;
+    if (!(sampler->weights = malloc(cells * sizeof(double)))) return false;
+    for (size_t s = 0; s < index->nstates; s++) {
+        if (ids[s] >= 0) sampler->weights[ids[s]] = (index->flags[s] & FA_INDEX_ACCEPT) ? 1.0 : 0.0;
+    }
+    for (size_t r = 1; r <= sampler->length; r++) {
+        const double *below = sampler->weights + (r - 1) * n;
+        double *level = sampler->weights + r * n;
+        double max = 0;
+        for (int s = 0; s < n; s++) {
+            double sum = 0;
+            for (size_t e = sampler->offsets[s]; e < sampler->offsets[s + 1]; e++) {
+                sum += (double)below[sampler->dests[e]] * (double)sampler_width(sampler, e);
+            }
+            level[s] = sum;
+            if (sum > max) max = sum;
+        }
+        for (int s = 0; s < n && max > 0; s++) level[s] /= max;
+    }
+    return true;
+}
+
+fa_word_sampler* fa_word_sampler_create(const fa_auto* a, size_t length, fa_error_t* error){
+    fa_error_t status = FA_ERR_NULL_ARGUMENT;
+    fa_word_sampler *sampler = NULL;
+    fa_auto *owned = NULL, *det = NULL;
+    fa_index *index = NULL;
+    uint8_t *mark = NULL;
+    int *ids = NULL;
+
+    if (!a) goto done;
+
+    status = FA_ERR_OUT_OF_MEMORY;
+    if (length >= SIZE_MAX / sizeof(size_count)) goto done;
+    const fa_auto *source = sink_explicit(a, &owned);
+    if (!source || !(index = fa_index_build(source, NULL))) goto done;
+    if (!fa_index_is_deterministic(index)) {
+        fa_index_destroy(index);
+        index = NULL;
+        if (!(det = fa_auto_determinize(source, FA_DETERMINIZE_DEFAULT))) goto done;
+        if (!(index = fa_index_build(det, NULL))) goto done;
+    }
+    if (!(mark = size_useful(index))) goto done;
+
+    size_t nstates = index->nstates;
+    if (!(ids = malloc((nstates ? nstates : 1) * sizeof(int)))) goto done;
+    if (!(sampler = calloc(1, sizeof(*sampler)))) goto done;
+
+    // The start state takes id 0 (a DFA has at most one)
+    int n = 0;
+    for (size_t s = 0; s < nstates; s++) {
+        ids[s] = -1;
+        if (mark[s] == 3 && (index->flags[s] & FA_INDEX_START)) ids[s] = n++;
+    }
+    for (size_t s = 0; s < nstates; s++) {
+        if (mark[s] == 3 && ids[s] < 0) ids[s] = n++;
+    }
+    sampler->n = n;
+    sampler->length = length;
+
+    // Edges renumbered by state id; the index owns the symbol strings
+    size_t m = 0;
+    int *state_of = malloc((n ? n : 1) * sizeof(int));
+    sampler->offsets = calloc((size_t)n + 1, sizeof(size_t));
+    if (!state_of || !sampler->offsets) {
+        free(state_of);
+        goto done;
+    }
+    for (size_t s = 0; s < nstates; s++) {
+        if (ids[s] >= 0) state_of[ids[s]] = (int)s;
+    }
+    for (int id = 0; id < n; id++) {
+        int s = state_of[id];
+        for (size_t e = index->offsets[s]; e < index->offsets[s + 1]; e++) {
+            if (ids[index->dests[e]] >= 0) m++;
+        }
+        sampler->offsets[id + 1] = m;
+    }
+    sampler->dests = malloc((m ? m : 1) * sizeof(int));
+    sampler->text = malloc((m ? m : 1) * sizeof(const char*));
+    sampler->text_len = malloc((m ? m : 1) * sizeof(size_t));
+    sampler->range = malloc((m ? m : 1) * sizeof(fa_range));
+    if (!sampler->dests || !sampler->text || !sampler->text_len || !sampler->range) {
+        free(state_of);
+        goto done;
+    }
+    m = 0;
+    for (int id = 0; id < n; id++) {
+        int s = state_of[id];
+        for (size_t e = index->offsets[s]; e < index->offsets[s + 1]; e++) {
+            int d = ids[index->dests[e]];
+            if (d < 0) continue;
+            sampler->dests[m] = d;
+            sampler->text[m] = index->symtab->symbols[index->syms[e]];
+            sampler->text_len[m] = strlen(sampler->text[m]);
+            sampler->range[m].lo = 1;
+            sampler->range[m].hi = 0;
+            if (index->symtab->symbolic) fa_symtab_range(index->symtab, index->syms[e], &sampler->range[m]);
+            m++;
+        }
+    }
+    free(state_of);
+
+    if (!sampler_fill(sampler, index, ids)) goto done;
+
+    // Keep the symbol strings alive past the index
+    sampler->symtab = index->symtab;
+    index->owns_symtab = false;
+    status = FA_SUCCESS;
+
+done:
+    if (status != FA_SUCCESS) {
+        fa_word_sampler_destroy(sampler);
+        sampler = NULL;
+    }
+    free(ids);
+    free(mark);
+    fa_index_destroy(index);
+    fa_auto_destroy(det);
+    fa_auto_destroy(owned);
+    if (error) *error = status;
+    return sampler;
+}
+
+void fa_word_sampler_destroy(fa_word_sampler* sampler){
+    if (!sampler) return;
+
+    free(sampler->offsets);
+    free(sampler->dests);
+    free(sampler->text);
+    free(sampler->text_len);
+    free(sampler->range);
+    free(sampler->counts);
+    free(sampler->weights);
+    fa_symtab_destroy(sampler->symtab);
+    free(sampler);
+}
+
+void fa_word_sampler_count(const fa_word_sampler* sampler, fa_word_count* count){
+    if (!sampler || !count) return;
+
+    size_count total = 0;
+    if (sampler->n && sampler->exact) {
+        total = sampler->counts[sampler->length * sampler->n];
+    } else if (sampler->n) {
+        total = SIZE_COUNT_MAX;
+    }
+    count->low = (uint64_t)total;
+    count->high = (uint64_t)(total >> 64);
+    count->saturated = total == SIZE_COUNT_MAX;
+}
+
+/* Edge taken from state s with r symbols left, in the rescaled table. */
+static size_t sampler_pick_scaled(const fa_word_sampler *sampler, uint64_t *rng, int s, size_t r) {
+    const double *below = sampler->weights + (r - 1) * sampler->n;
+    size_t e = sampler->offsets[s], end = sampler->offsets[s + 1];
+    double sum = 0;
+    for (size_t i = e; i < end; i++) sum += below[sampler->dests[i]] * (double)sampler_width(sampler, i);
+
+    double x = (double)(sample_next(rng) >> 11) * 0x1.0p-53 * sum;
+    // Zero-weight edges are skipped even when rounding lands on them
+    size_t pick = e;
+    for (; e < end; e++) {
+        double w = below[sampler->dests[e]] * (double)sampler_width(sampler, e);
+        if (w <= 0) continue;
+        pick = e;
+        if (x < w) break;
+        x -= w;
+    }
+    return pick;
+}
+
+fa_error_t fa_word_sampler_draw(const fa_word_sampler* sampler, uint64_t* rng,
+                                char* buffer, size_t size, size_t* written){
+    if (!sampler || !rng || !buffer) return FA_ERR_NULL_ARGUMENT;
+
+    // Locals: stores through `buffer` could alias every field
+    const int n = sampler->n;
+    const bool exact = sampler->exact;
+    const size_t *offsets = sampler->offsets;
+    const int *dests = sampler->dests;
+    const char *const *text = sampler->text;
+    const size_t *text_len = sampler->text_len;
+    const fa_range *range = sampler->range;
+    const size_count *counts = sampler->counts;
+    size_t len = 0;
+
+    bool empty = !n || (exact ? !counts[sampler->length * n]
+                              : !(sampler->weights[sampler->length * n] > 0));
+    if (empty) return FA_ERR_INVALID_OPERATION;
+
+    // Exact draws unrank one uniform index: each step keeps the offset
+    // within the subtree of the edge it lands in
+    size_count x = exact ? sample_below(rng, counts[sampler->length * n]) : 0;
+    int s = 0;
+    for (size_t r = sampler->length; r > 0; r--) {
+        size_t e;
+        uint32_t cp = 0;
+        if (exact) {
+            const size_count *below = counts + (r - 1) * n;
+            size_t end = offsets[s + 1] - 1;
+            for (e = offsets[s]; e < end; e++) {
+                size_count w = size_mul(below[dests[e]], sampler_width(sampler, e));
+                if (x < w) break;
+                x -= w;
+            }
+            // The offset within a minterm edge is a character, then a subtree
+            if (range[e].lo <= range[e].hi) {
+                cp = range[e].lo + (uint32_t)(x / below[dests[e]]);
+                x %= below[dests[e]];
+            }
+        } else {
+            e = sampler_pick_scaled(sampler, rng, s, r);
+            if (range[e].lo <= range[e].hi) {
+                cp = range[e].lo + (uint32_t)sample_below(rng, sampler_width(sampler, e));
+            }
+        }
+
+        if (range[e].lo <= range[e].hi) {
+            char utf8[4];
+            size_t k = fa_range_encode(cp, utf8);
+            if (len + k >= size) return FA_ERR_BUFFER_TOO_SMALL;
+            memcpy(buffer + len, utf8, k);
+            len += k;
+            s = dests[e];
+            continue;
+        }
+
+        size_t k = text_len[e];
+        if (len + k >= size) return FA_ERR_BUFFER_TOO_SMALL;
+        if (k == 1) buffer[len] = text[e][0];
+        else memcpy(buffer + len, text[e], k);
+        len += k;
+        s = dests[e];
+    }
+
+    if (len >= size) return FA_ERR_BUFFER_TOO_SMALL;
+    buffer[len] = '\0';
+    if (written) *written = len;
+    return FA_SUCCESS;
+}
+
+
+// ============================================================================
+// Complement
+// ============================================================================
+
+/*
+ * Complementing a DFA only flips its accepting states: the sink a complete
+ * DFA would need is left implicit (fa_auto.sink_accepts), so the result is
+ * no larger than the input however big the alphabet is. Products,
+ * determinization and Hopcroft minimization read the flag directly; other
+ * operations and the exporters work on fa_auto_materialize_sink's copy.
+ */
+static fa_auto* complement_run(const fa_auto *a, op_meter *meter) {
+    if (!a) return NULL;
+
+    fa_auto *dfa = NULL;
+    fa_index *index = fa_index_build(a, NULL);
+    if (index && !fa_index_is_deterministic(index)) {
+        fa_index_destroy(index);
+        index = NULL;
+        dfa = det_run(a, FA_DETERMINIZE_DEFAULT, meter);
+        if (dfa) index = fa_index_build(dfa, NULL);
+    }
+
+    fa_auto *result = NULL;
+    fa_builder builder;
+    bool built = index && fa_builder_init(&builder, index->nstates + 1, index->nedges);
+    if (!built) goto cleanup;
+
+    bool has_start = false;
+    for (size_t s = 0; s < index->nstates; s++) has_start |= (index->flags[s] & FA_INDEX_START) != 0;
+
+    bool sink_accepts = !index->sink_accepts;
+    if (!has_start) {
+        // Nothing is accepted, so everything is: one accepting start whose moves all hit the sink
+        if (fa_builder_add_state(&builder, FA_INDEX_START | FA_INDEX_ACCEPT) < 0) goto cleanup;
+        sink_accepts = true;
+    } else {
+        if (splice_copy(&builder, index, FA_INDEX_START) < 0) goto cleanup;
+        for (size_t s = 0; s < index->nstates; s++) {
+            if (!(index->flags[s] & FA_INDEX_ACCEPT)) builder.flags[s] |= FA_INDEX_ACCEPT;
+        }
+    }
+
+    result = fa_builder_emit(&builder, index->symtab, a->alphabet, NULL, NULL);
+    if (result) result->sink_accepts = sink_accepts;
+
+cleanup:
+    if (built) fa_builder_free(&builder);
+    fa_index_destroy(index);
+    fa_auto_destroy(dfa);
+    return result;
+}
+
+fa_auto* fa_auto_complement(const fa_auto* a){
+    return complement_run(a, NULL);
+}
+
+fa_auto* fa_auto_materialize_sink(const fa_auto* a){
+    if (!a) return NULL;
+
+    fa_index *index = fa_index_build(a, NULL);
+    int *symbols = NULL;
+    size_t nsymbols = 0;
+    fa_auto *result = NULL;
+    fa_builder builder;
+    bool built = false;
+
+    if (!index) return NULL;
+
+    if (!fa_index_alphabet(index, a, &symbols, &nsymbols)) goto cleanup;
+
+    built = fa_builder_init(&builder, index->nstates + 1, index->nedges + nsymbols);
+    if (!built || splice_copy(&builder, index, FA_INDEX_START | FA_INDEX_ACCEPT) < 0) goto cleanup;
+
+    int sink = -1;
+    for (size_t s = 0; s < index->nstates && a->sink_accepts; s++) {
+        size_t e = index->offsets[s], end = index->offsets[s + 1];
+        for (size_t i = 0; i < nsymbols; i++) {
+            while (e < end && index->syms[e] < symbols[i]) e++;
+            if (e < end && index->syms[e] == symbols[i]) continue;
+            if (sink < 0 && (sink = fa_builder_add_state(&builder, FA_INDEX_ACCEPT)) < 0) goto cleanup;
+            if (!fa_builder_add_edge(&builder, (int)s, symbols[i], sink)) goto cleanup;
+        }
+    }
+    for (size_t i = 0; i < nsymbols && sink >= 0; i++) {
+        if (!fa_builder_add_edge(&builder, sink, symbols[i], sink)) goto cleanup;
+    }
+
+    result = fa_builder_emit(&builder, index->symtab, a->alphabet, NULL, NULL);
+
+cleanup:
+    if (built) fa_builder_free(&builder);
+    free(symbols);
+    fa_index_destroy(index);
+    return result;
+}
+/*
+ * Start and accepting states swap roles and every edge is read from the
+ * reversed view, so the result is built in O(n + m) from integer ids. An
+ * implicit sink is made explicit first: reversed, it would be a start
+ * state reached by nothing.
+ */
+fa_auto* fa_auto_reverse(const fa_auto* a){
+    if (!a) return NULL;
+
+    fa_auto *owned;
+    const fa_auto *source = sink_explicit(a, &owned);
+    fa_index *index = source ? fa_index_build(source, NULL) : NULL;
+    fa_index_reverse *reverse = index ? fa_index_reverse_build(index) : NULL;
+    fa_auto *result = NULL;
+    fa_builder builder;
+    bool built = reverse && fa_builder_init(&builder, index->nstates, index->nedges);
+
+    if (!built) goto cleanup;
+
+    for (size_t s = 0; s < index->nstates; s++) {
+        uint8_t flags = index->flags[s];
+        if (fa_builder_add_state(&builder, ((flags & FA_INDEX_ACCEPT) ? FA_INDEX_START : 0) |
+                                           ((flags & FA_INDEX_START) ? FA_INDEX_ACCEPT : 0)) < 0) {
+            goto cleanup;
+        }
+    }
+    for (size_t s = 0; s < index->nstates; s++) {
+        for (size_t i = reverse->offsets[s]; i < reverse->offsets[s + 1]; i++) {
+            if (!fa_builder_add_edge(&builder, (int)s, index->syms[reverse->edges[i]], reverse->srcs[i])) {
+                goto cleanup;
+            }
+        }
+    }
+
+    result = fa_builder_emit(&builder, index->symtab, source->alphabet, NULL, NULL);
+
+cleanup:
+    if (built) fa_builder_free(&builder);
+    fa_index_reverse_destroy(reverse);
+    fa_index_destroy(index);
+    fa_auto_destroy(owned);
+    return result;
+}
+
+fa_auto* fa_auto_minimize_moore(const fa_auto *automaton){
+    if (!automaton) return NULL;
+
+    if (automaton->sink_accepts) {
+        // Refinement below only sees stored transitions
+        fa_auto *complete = fa_auto_materialize_sink(automaton);
+        fa_auto *result = complete ? fa_auto_minimize_moore(complete) : NULL;
+        fa_auto_destroy(complete);
+        return result;
+    }
+
+    const int N = automaton->capacity;
+    int partition[N], new_partition[N];
+
+
+    for (int i = 0; i < N; i++) {
+        partition[i] = automaton->states[i]->is_accept;
+    }
+
+    int changed;
+    do {
+        changed = 0;
+
+
+        for (int i = 0; i < N; i++) {
+            new_partition[i] = partition[i];
+        }
+
+        int next_group = 2;
+        for (int i = 0; i < N; i++) {
+            for (int j = i + 1; j < N; j++) {
+                if (partition[i] == partition[j]) {
+                    int equivalent = 1;
+
+                    // Check transitions
+                    for (const fa_trans *t1 = automaton->states[i]->trans; t1 != NULL; t1 = t1->next) {
+                        int found_match = 0;
+                        for (const fa_trans *t2 = automaton->states[j]->trans; t2 != NULL; t2 = t2->next) {
+                            if (strcmp(t1->symbol, t2->symbol) == 0) {
+                                int idx_1 = fa_state_index(automaton, t1->dest);
+                                int idx_2 = fa_state_index(automaton, t2->dest);
+
+                                if (partition[idx_1] != partition[idx_2]) {
+                                    equivalent = 0;
+                                }
+                                found_match = 1;
+                                break;
+                            }
+                        }
+                        if (!found_match) {
+                            equivalent = 0;
+                        }
+                    }
+
+                    if (!equivalent) {
+                        new_partition[j] = N + next_group;
+                        changed = 1;
+                    }
+                }
+            }
+            next_group++;
+        }
+
+
+        for (int i = 0; i < N; i++) {
+            partition[i] = new_partition[i];
+        }
+
+    } while (changed);
+
+
+    fa_auto* minimized_dfa = generate_minimized_DFA(automaton, partition, N);
+    return minimized_dfa;
+}
+
+
+/*
+ * Hopcroft's algorithm determinizes an NFA first; under a meter that
+ * happens here so the subset construction is charged.
+ */
+static fa_auto* hopcroft_run(const fa_auto *automaton, op_meter *meter) {
+    if (!meter || fa_auto_is_deterministic(automaton)) return fa_auto_minimize_hopcroft(automaton);
+
+    fa_auto *dfa = det_run(automaton, FA_DETERMINIZE_DEFAULT, meter);
+    fa_auto *minimal = dfa ? fa_auto_minimize_hopcroft(dfa) : NULL;
+    fa_auto_destroy(dfa);
+    return minimal;
+}
+
+static fa_auto* minimize_run(const fa_auto *automaton, fa_minimize_algorithm algorithm,
+                             op_meter *meter) {
+    if (!automaton) return NULL;
+    
+    // // Check if automaton is deterministic
+    // if (!fa_auto_is_deterministic(automaton)) {
+        
+    //     return NULL;
+    // }
+    
+    // Select algorithm based on flags
+    if (FA_MINIMIZE_USES_ALGO(algorithm, FA_MINIMIZE_HOPCROFT)) {
+        return hopcroft_run(automaton, meter);
+    }
+    else if (FA_MINIMIZE_USES_ALGO(algorithm, FA_MINIMIZE_MOORE)) {
+        return fa_auto_minimize_moore(automaton);
+    }
+    else if (FA_MINIMIZE_USES_ALGO(algorithm, FA_MINIMIZE_TABLE)) {
+        return fa_auto_minimize_table(automaton);
+    }
+    else if (FA_MINIMIZE_USES_ALGO(algorithm, FA_MINIMIZE_BRZOZOWSKI)) {
+        return brzozowski_run(automaton, meter);
+    }
+    
+    // Default to Hopcroft if no algorithm specified
+    return hopcroft_run(automaton, meter);
+}
+
+fa_auto* fa_auto_minimize(const fa_auto* automaton, fa_minimize_algorithm algorithm) {
+    return minimize_run(automaton, algorithm, NULL);
+}
+
+fa_auto* fa_auto_minimize_budget(const fa_auto* a, fa_minimize_algorithm algorithm,
+                                 fa_budget* budget, fa_error_t* error){
+    op_meter storage;
+    op_meter *meter = meter_begin(&storage, budget);
+    fa_auto *minimal = minimize_run(a, algorithm, meter);
+    fa_error_t status = meter_end(meter, minimal ? FA_SUCCESS : a ? FA_ERR_OUT_OF_MEMORY : FA_ERR_NULL_ARGUMENT);
+    if (error) *error = status;
+    return minimal;
+}
+
+
+// ============================================================================
+// Subset construction
+// ============================================================================
+
+/*
+ * DFA states are ε-closed sets of NFA state ids, kept as sorted int arrays.
+ * Sets are interned in a sharded hash table: each shard has its own lock and
+ * arena, and ids come from one atomic counter, so several workers can expand
+ * a BFS frontier at once. The sequential modes run the same code with a
+ * single worker.
+ */
+
+#define DET_SHARDS 64
+#define DET_ARENA_BLOCK 4096
+#define DET_PARALLEL_MIN_FRONTIER 64
+#define DET_PARALLEL_GRAIN 4
+
+typedef struct det_arena_block {
+    struct det_arena_block *next;
+    size_t used;
+    size_t capacity;
+    int data[];
+} det_arena_block;
+
+typedef struct det_entry {
+    uint64_t hash;
+    const int *members;
+    int size;
+    int id;                             // -1 marks an empty slot
+} det_entry;
+
+typedef struct det_shard {
+    fa_mutex lock;
+    det_entry *entries;
+    size_t nslots;
+    size_t count;
+    det_arena_block *arena;
+} det_shard;
+
+typedef struct det_subset {
+    int id;
+    int size;
+    const int *members;
+    bool accept;
+} det_subset;
+
+typedef struct det_worker {
+    int *stamp;                         // per NFA state, == gen when marked
+    int gen;
+    int *sym_head;                      // per symbol, head of its dest list
+    int *touched;                       // symbols seen in the current subset
+    size_t ntouched;
+    int *pair_next;
+    int *pair_dest;
+    size_t npairs;
+    size_t pair_capacity;
+    int *scratch;                       // subset being built
+    int *stack;                         // ε-closure DFS stack
+    det_subset *found;                  // subsets discovered in this level
+    size_t nfound;
+    size_t found_capacity;
+    fa_index_edge *edges;
+    size_t nedges;
+    size_t edge_capacity;
+    bool failed;
+} det_worker;
+
+typedef struct det_context {
+    const fa_index *index;
+    det_shard shards[DET_SHARDS];
+    atomic_int next_id;
+    const det_subset *frontier;
+    det_worker *workers;
+    size_t nworkers;
+    op_meter *meter;
+} det_context;
+
+
+static uint64_t det_hash(const int *members, int size) {
+    uint64_t h = 0x9e3779b97f4a7c15ULL ^ (uint64_t)size;
+    for (int i = 0; i < size; i++) {
+        h ^= (uint64_t)(uint32_t)members[i];
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 32;
+    }
+    return h;
+}
+
+static int det_compare_ints(const void *a, const void *b) {
+    int x = *(const int*)a, y = *(const int*)b;
+    return (x > y) - (x < y);
+}
+
+static void det_sort(int *v, int n) {
+    if (n < 16) {
+        for (int i = 1; i < n; i++) {
+            int x = v[i], j = i;
+            while (j > 0 && v[j - 1] > x) { v[j] = v[j - 1]; j--; }
+            v[j] = x;
+        }
+    } else {
+        qsort(v, n, sizeof(int), det_compare_ints);
+    }
+}
+
+static int* det_arena_alloc(det_arena_block **arena, int size) {
+    det_arena_block *block = *arena;
+    if (!block || block->used + (size_t)size > block->capacity) {
+        size_t capacity = (size_t)size > DET_ARENA_BLOCK ? (size_t)size : DET_ARENA_BLOCK;
+        block = malloc(sizeof(det_arena_block) + capacity * sizeof(int));
+        if (!block) return NULL;
+        block->next = *arena;
+        block->used = 0;
+        block->capacity = capacity;
+        *arena = block;
+    }
+    int *out = block->data + block->used;
+    block->used += (size_t)size;
+    return out;
+}
+
+static bool det_shard_grow(det_shard *shard) {
+    size_t nslots = shard->nslots ? shard->nslots * 2 : 64;
+    det_entry *entries = malloc(nslots * sizeof(det_entry));
+    if (!entries) return false;
+
+    for (size_t i = 0; i < nslots; i++) entries[i].id = -1;
+    for (size_t i = 0; i < shard->nslots; i++) {
+        if (shard->entries[i].id < 0) continue;
+        size_t h = (size_t)shard->entries[i].hash & (nslots - 1);
+        while (entries[h].id >= 0) h = (h + 1) & (nslots - 1);
+        entries[h] = shard->entries[i];
+    }
+
+    free(shard->entries);
+    shard->entries = entries;
+    shard->nslots = nslots;
+    return true;
+}
+
+/*
+ * Returns the DFA id of a subset, interning it if new. New subsets are
+ * appended to the worker's `found` list so they get expanded next level.
+ */
+static int det_intern(det_context *ctx, det_worker *w, const int *members,
+                      int size, bool accept) {
+    uint64_t hash = det_hash(members, size);
+    det_shard *shard = &ctx->shards[hash >> 58];   // top 6 bits pick the shard
+
+    fa_mutex_lock(&shard->lock);
+
+    if ((shard->count + 1) * 2 > shard->nslots && !det_shard_grow(shard)) {
+        fa_mutex_unlock(&shard->lock);
+        return -1;
+    }
+
+    size_t mask = shard->nslots - 1;
+    size_t h = (size_t)hash & mask;
+    while (shard->entries[h].id >= 0) {
+        const det_entry *e = &shard->entries[h];
+        if (e->hash == hash && e->size == size &&
+            memcmp(e->members, members, (size_t)size * sizeof(int)) == 0) {
+            int id = e->id;
+            fa_mutex_unlock(&shard->lock);
+            return id;
+        }
+        h = (h + 1) & mask;
+    }
+
+    int *copy = det_arena_alloc(&shard->arena, size > 0 ? size : 1);
+    if (!copy) {
+        fa_mutex_unlock(&shard->lock);
+        return -1;
+    }
+    memcpy(copy, members, (size_t)size * sizeof(int));
+
+    int id = atomic_fetch_add(&ctx->next_id, 1);
+    shard->entries[h].hash = hash;
+    shard->entries[h].members = copy;
+    shard->entries[h].size = size;
+    shard->entries[h].id = id;
+    shard->count++;
+
+    fa_mutex_unlock(&shard->lock);
+
+    size_t bytes = (size_t)size * sizeof(int) + 2 * sizeof(det_entry) + 3 * sizeof(det_subset);
+    if (!meter_charge(ctx->meter, 1, 0, bytes)) return -1;
+
+    if (w->nfound >= w->found_capacity) {
+        size_t new_capacity = w->found_capacity ? w->found_capacity * 2 : 64;
+        det_subset *found = realloc(w->found, new_capacity * sizeof(det_subset));
+        if (!found) return -1;
+        w->found = found;
+        w->found_capacity = new_capacity;
+    }
+    w->found[w->nfound].id = id;
+    w->found[w->nfound].size = size;
+    w->found[w->nfound].members = copy;
+    w->found[w->nfound].accept = accept;
+    w->nfound++;
+
+    return id;
+}
+
+static void det_next_gen(det_worker *w, size_t nstates) {
+    if (++w->gen == INT_MAX) {
+        memset(w->stamp, 0, nstates * sizeof(int));
+        w->gen = 1;
+    }
+}
+
+/*
+ * Adds `state` and everything ε-reachable from it to w->scratch, skipping
+ * states already stamped with the current generation.
+ */
+static int det_close(const fa_index *index, det_worker *w, int state, int size) {
+    int eps = index->symtab->eps;
+    if (w->stamp[state] == w->gen) return size;
+
+    w->stamp[state] = w->gen;
+    w->scratch[size++] = state;
+    if (eps < 0) return size;
+
+    int top = 0;
+    w->stack[top++] = state;
+    while (top > 0) {
+        int s = w->stack[--top];
+        for (size_t e = index->offsets[s]; e < index->offsets[s + 1]; e++) {
+            if (index->syms[e] < eps) continue;
+            if (index->syms[e] > eps) break;
+            int d = index->dests[e];
+            if (w->stamp[d] == w->gen) continue;
+            w->stamp[d] = w->gen;
+            w->scratch[size++] = d;
+            w->stack[top++] = d;
+        }
+    }
+    return size;
+}
+
+static bool det_is_accepting(const fa_index *index, const int *members, int size) {
+    for (int i = 0; i < size; i++) {
+        if (index->flags[members[i]] & FA_INDEX_ACCEPT) return true;
+    }
+    return false;
+}
+
+static bool det_add_edge(det_worker *w, int src, int sym, int dest) {
+    if (w->nedges >= w->edge_capacity) {
+        size_t new_capacity = w->edge_capacity ? w->edge_capacity * 2 : 256;
+        fa_index_edge *edges = realloc(w->edges, new_capacity * sizeof(fa_index_edge));
+        if (!edges) return false;
+        w->edges = edges;
+        w->edge_capacity = new_capacity;
+    }
+    w->edges[w->nedges].src = src;
+    w->edges[w->nedges].sym = sym;
+    w->edges[w->nedges].dest = dest;
+    w->nedges++;
+    return true;
+}
+
+static bool det_expand(det_context *ctx, det_worker *w, const det_subset *subset) {
+    const fa_index *index = ctx->index;
+    int eps = index->symtab->eps;
+
+    // Bucket every non-ε move of the subset by symbol
+    w->ntouched = 0;
+    w->npairs = 0;
+    for (int i = 0; i < subset->size; i++) {
+        int s = subset->members[i];
+        for (size_t e = index->offsets[s]; e < index->offsets[s + 1]; e++) {
+            int sym = index->syms[e];
+            if (sym == eps) continue;
+
+            if (w->npairs >= w->pair_capacity) {
+                size_t new_capacity = w->pair_capacity ? w->pair_capacity * 2 : 256;
+                int *next = realloc(w->pair_next, new_capacity * sizeof(int));
+                if (!next) return false;
+                w->pair_next = next;
+                int *dest = realloc(w->pair_dest, new_capacity * sizeof(int));
+                if (!dest) return false;
+                w->pair_dest = dest;
+                w->pair_capacity = new_capacity;
+            }
+
+            if (w->sym_head[sym] < 0) w->touched[w->ntouched++] = sym;
+            w->pair_dest[w->npairs] = index->dests[e];
+            w->pair_next[w->npairs] = w->sym_head[sym];
+            w->sym_head[sym] = (int)w->npairs++;
+        }
+    }
+
+    det_sort(w->touched, (int)w->ntouched);
+
+    for (size_t t = 0; t < w->ntouched; t++) {
+        int sym = w->touched[t];
+        int size = 0;
+
+        det_next_gen(w, index->nstates);
+        for (int p = w->sym_head[sym]; p >= 0; p = w->pair_next[p]) {
+            size = det_close(index, w, w->pair_dest[p], size);
+        }
+        w->sym_head[sym] = -1;
+
+        det_sort(w->scratch, size);
+        int dest = det_intern(ctx, w, w->scratch, size,
+                              det_is_accepting(index, w->scratch, size));
+        if (dest < 0 || !det_add_edge(w, subset->id, sym, dest) ||
+            !meter_charge(ctx->meter, 0, 1, sizeof(fa_index_edge))) {
+            // Leave sym_head clean for the caller even on failure
+            for (size_t r = t + 1; r < w->ntouched; r++) w->sym_head[w->touched[r]] = -1;
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static void det_expand_range(void *arg, size_t worker, size_t begin, size_t end) {
+    det_context *ctx = arg;
+    det_worker *w = &ctx->workers[worker];
+
+    for (size_t i = begin; i < end && !w->failed; i++) {
+        if (!det_expand(ctx, w, &ctx->frontier[i])) w->failed = true;
+    }
+}
+
+static bool det_worker_init(det_worker *w, const fa_index *index) {
+    size_t n = index->nstates ? index->nstates : 1;
+    size_t k = index->symtab->count ? index->symtab->count : 1;
+
+    memset(w, 0, sizeof(det_worker));
+    w->stamp = calloc(n, sizeof(int));
+    w->sym_head = malloc(k * sizeof(int));
+    w->touched = malloc(k * sizeof(int));
+    w->scratch = malloc(n * sizeof(int));
+    w->stack = malloc(n * sizeof(int));
+    if (!w->stamp || !w->sym_head || !w->touched || !w->scratch || !w->stack) return false;
+
+    memset(w->sym_head, -1, k * sizeof(int));
+    return true;
+}
+
+static void det_worker_free(det_worker *w) {
+    free(w->stamp);
+    free(w->sym_head);
+    free(w->touched);
+    free(w->pair_next);
+    free(w->pair_dest);
+    free(w->scratch);
+    free(w->stack);
+    free(w->found);
+    free(w->edges);
+}
+
+typedef struct det_label_ctx {
+    const fa_index *index;
+    const det_subset *subsets;
+    fa_determinize_algorithm algorithm;
+} det_label_ctx;
+
+static char* det_label(void *arg, int id) {
+    const det_label_ctx *ctx = arg;
+    const det_subset *subset = &ctx->subsets[id];
+    bool orig = ctx->algorithm & FA_DETERMINIZE_NAMES_ORIG;
+    char buf[32];
+
+    if (ctx->algorithm & FA_DETERMINIZE_NAMES_SIMPLE) {
+        snprintf(buf, sizeof(buf), "S%d", id);
+        return strdup(buf);
+    }
+    if (!orig && !(ctx->algorithm & FA_DETERMINIZE_NAMES_BITSET)) return NULL;
+
+    size_t length = 3;
+    for (int i = 0; i < subset->size; i++) {
+        length += (orig ? strlen(ctx->index->states[subset->members[i]]->label)
+                        : (size_t)snprintf(buf, sizeof(buf), "%d", subset->members[i])) + 1;
+    }
+
+    char *label = malloc(length);
+    if (!label) return NULL;
+
+    size_t pos = 0;
+    if (!orig) label[pos++] = '{';
+    for (int i = 0; i < subset->size; i++) {
+        if (i > 0) label[pos++] = orig ? '+' : ',';
+        if (orig) {
+            const char *name = ctx->index->states[subset->members[i]]->label;
+            size_t len = strlen(name);
+            memcpy(label + pos, name, len);
+            pos += len;
+        } else {
+            pos += (size_t)snprintf(label + pos, length - pos, "%d", subset->members[i]);
+        }
+    }
+    if (!orig) label[pos++] = '}';
+    if (orig && subset->size == 0) label[pos++] = '-';
+    label[pos] = '\0';
+    return label;
+}
+
+/*
+ * Worker interleaving makes parallel ids arbitrary. Renumbering in BFS order
+ * (successors by symbol id) gives the exact numbering of the sequential run.
+ */
+static bool det_canonicalize(fa_index_edge *edges, size_t nedges, det_subset *subsets,
+                             size_t n) {
+    size_t *offsets = calloc(n + 1, sizeof(size_t));
+    fa_index_edge *sorted = malloc((nedges ? nedges : 1) * sizeof(fa_index_edge));
+    int *perm = malloc(n * sizeof(int));
+    int *queue = malloc(n * sizeof(int));
+    det_subset *renamed = malloc(n * sizeof(det_subset));
+    bool ok = offsets && sorted && perm && queue && renamed;
+
+    if (ok) {
+        // Stable counting sort by source keeps each source's symbol order
+        for (size_t i = 0; i < nedges; i++) offsets[edges[i].src + 1]++;
+        for (size_t i = 0; i < n; i++) offsets[i + 1] += offsets[i];
+        for (size_t i = 0; i < nedges; i++) sorted[offsets[edges[i].src]++] = edges[i];
+        for (size_t i = n; i > 0; i--) offsets[i] = offsets[i - 1];
+        offsets[0] = 0;
+
+        for (size_t i = 0; i < n; i++) perm[i] = -1;
+        size_t head = 0, tail = 0;
+        perm[0] = 0;
+        queue[tail++] = 0;
+        while (head < tail) {
+            int s = queue[head++];
+            for (size_t e = offsets[s]; e < offsets[s + 1]; e++) {
+                int d = sorted[e].dest;
+                if (perm[d] < 0) {
+                    perm[d] = (int)tail;
+                    queue[tail++] = d;
+                }
+            }
+        }
+
+        // queue[] lists old ids in new order, so this emits edges grouped
+        // by new source id
+        size_t k = 0;
+        for (size_t i = 0; i < tail; i++) {
+            int s = queue[i];
+            for (size_t e = offsets[s]; e < offsets[s + 1]; e++) {
+                edges[k].src = (int)i;
+                edges[k].sym = sorted[e].sym;
+                edges[k].dest = perm[sorted[e].dest];
+                k++;
+            }
+            renamed[i] = subsets[s];
+            renamed[i].id = (int)i;
+        }
+        memcpy(subsets, renamed, n * sizeof(det_subset));
+    }
+
+    free(offsets);
+    free(sorted);
+    free(perm);
+    free(queue);
+    free(renamed);
+    return ok;
+}
+
+static fa_auto* det_run(const fa_auto *a, fa_determinize_algorithm algorithm, op_meter *meter) {
+    if (!a) return NULL;
+
+    fa_index *index = fa_index_build(a, NULL);
+    if (!index) return NULL;
+
+    size_t nworkers = 1;
+    if ((algorithm & FA_DETERMINIZE_ALGO_MASK) == FA_DETERMINIZE_BFS) {
+        nworkers = fa_parallel_workers();
+    }
+
+    fa_auto *dfa = NULL;
+    det_subset *subsets = NULL;
+    det_subset *frontier = NULL;
+    fa_index_edge *edges = NULL;
+    size_t nsubsets = 0, subset_capacity = 0;
+    size_t nfrontier = 0, frontier_capacity = 0;
+    size_t nedges = 0;
+    bool ok = false;
+
+    det_context ctx;
+    ctx.index = index;
+    ctx.nworkers = nworkers;
+    ctx.meter = meter;
+    atomic_init(&ctx.next_id, 0);
+    memset(ctx.shards, 0, sizeof(ctx.shards));
+    for (size_t i = 0; i < DET_SHARDS; i++) fa_mutex_init(&ctx.shards[i].lock);
+
+    ctx.workers = calloc(nworkers, sizeof(det_worker));
+    if (!ctx.workers) goto cleanup;
+    for (size_t i = 0; i < nworkers; i++) {
+        if (!det_worker_init(&ctx.workers[i], index)) goto cleanup;
+    }
+
+    // The start subset is the ε-closure of every start state
+    det_worker *w0 = &ctx.workers[0];
+    int size = 0;
+    det_next_gen(w0, index->nstates);
+    for (size_t s = 0; s < index->nstates; s++) {
+        if (index->flags[s] & FA_INDEX_START) size = det_close(index, w0, (int)s, size);
+    }
+    det_sort(w0->scratch, size);
+    if (det_intern(&ctx, w0, w0->scratch, size,
+                   det_is_accepting(index, w0->scratch, size)) < 0) {
+        goto cleanup;
+    }
+
+    for (;;) {
+        // Gather the subsets discovered by the last level into the frontier
+        nfrontier = 0;
+        for (size_t i = 0; i < nworkers; i++) {
+            det_worker *w = &ctx.workers[i];
+            if (w->failed) goto cleanup;
+
+            size_t need_frontier = nfrontier + w->nfound;
+            if (need_frontier > frontier_capacity) {
+                size_t new_capacity = need_frontier * 2;
+                det_subset *grown = realloc(frontier, new_capacity * sizeof(det_subset));
+                if (!grown) goto cleanup;
+                frontier = grown;
+                frontier_capacity = new_capacity;
+            }
+            if (w->nfound) memcpy(frontier + nfrontier, w->found, w->nfound * sizeof(det_subset));
+            nfrontier += w->nfound;
+            w->nfound = 0;
+        }
+        if (nfrontier == 0) break;
+
+        size_t total = (size_t)atomic_load(&ctx.next_id);
+        if (total > subset_capacity) {
+            size_t new_capacity = total * 2;
+            det_subset *grown = realloc(subsets, new_capacity * sizeof(det_subset));
+            if (!grown) goto cleanup;
+            subsets = grown;
+            subset_capacity = new_capacity;
+        }
+        for (size_t i = 0; i < nfrontier; i++) subsets[frontier[i].id] = frontier[i];
+        nsubsets = total;
+
+        ctx.frontier = frontier;
+        size_t level_workers = nfrontier >= DET_PARALLEL_MIN_FRONTIER ? nworkers : 1;
+        fa_parallel_for(nfrontier, level_workers, DET_PARALLEL_GRAIN, det_expand_range, &ctx);
+    }
+
+    for (size_t i = 0; i < nworkers; i++) nedges += ctx.workers[i].nedges;
+    edges = malloc((nedges ? nedges : 1) * sizeof(fa_index_edge));
+    if (!edges) goto cleanup;
+
+    nedges = 0;
+    for (size_t i = 0; i < nworkers; i++) {
+        if (ctx.workers[i].nedges == 0) continue;
+        memcpy(edges + nedges, ctx.workers[i].edges,
+               ctx.workers[i].nedges * sizeof(fa_index_edge));
+        nedges += ctx.workers[i].nedges;
+    }
+
+    if (nworkers > 1 && !det_canonicalize(edges, nedges, subsets, nsubsets)) goto cleanup;
+
+    fa_builder builder = { .nstates = nsubsets, .state_capacity = nsubsets,
+                           .flags = malloc(nsubsets), .nedges = nedges,
+                           .edge_capacity = nedges, .edges = edges };
+    if (!builder.flags) goto cleanup;
+    for (size_t i = 0; i < nsubsets; i++) {
+        builder.flags[i] = (i == 0 ? FA_INDEX_START : 0) |
+                           (subsets[i].accept ? FA_INDEX_ACCEPT : 0);
+    }
+
+    det_label_ctx label_ctx = { index, subsets, algorithm };
+    dfa = fa_builder_emit(&builder, index->symtab, a->alphabet, det_label, &label_ctx);
+    free(builder.flags);
+    ok = dfa != NULL;
+    if (ok) dfa->sink_accepts = a->sink_accepts;
+
+cleanup:
+    if (ctx.workers) {
+        for (size_t i = 0; i < nworkers; i++) det_worker_free(&ctx.workers[i]);
+        free(ctx.workers);
+    }
+    for (size_t i = 0; i < DET_SHARDS; i++) {
+        det_arena_block *block = ctx.shards[i].arena;
+        while (block) {
+            det_arena_block *next = block->next;
+            free(block);
+            block = next;
+        }
+        free(ctx.shards[i].entries);
+        fa_mutex_destroy(&ctx.shards[i].lock);
+    }
+    free(subsets);
+    free(frontier);
+    free(edges);
+    fa_index_destroy(index);
+
+    if (ok && (algorithm & FA_DETERMINIZE_MINIMIZE)) {
+        fa_auto *minimized = minimize_run(dfa, FA_MINIMIZE_DEFAULT, meter);
+        if (minimized || !meter_ok(meter)) {
+            fa_auto_destroy(dfa);
+            dfa = minimized;
+        }
+    }
+    return dfa;
+}
+
+fa_auto* fa_auto_determinize(const fa_auto* a, fa_determinize_algorithm algorithm){
+    return det_run(a, algorithm, NULL);
+}
+
+fa_auto* fa_auto_determinize_budget(const fa_auto* a, fa_determinize_algorithm algorithm,
+                                    fa_budget* budget, fa_error_t* error){
+    op_meter storage;
+    op_meter *meter = meter_begin(&storage, budget);
+    fa_auto *dfa = det_run(a, algorithm, meter);
+    fa_error_t status = meter_end(meter, dfa ? FA_SUCCESS : a ? FA_ERR_OUT_OF_MEMORY : FA_ERR_NULL_ARGUMENT);
+    if (error) *error = status;
+    return dfa;
+}
+
+
+// ============================================================================
+// Inclusion checks
+// ============================================================================
+
+/*
+ * The inclusion and equivalence checks compare each state set they reach
+ * against many others, so they keep their sets as bit rows of one bit per
+ * state, allocated zeroed from an arena: ⊆, ∪ and the acceptance test
+ * then run on whole words.
+ */
+
+typedef struct row_arena_block {
+    struct row_arena_block *next;
+    size_t used;
+    size_t capacity;
+    uint64_t data[];
+} row_arena_block;
+
+#define ROW_ARENA_BLOCK 4096
+
+/* Returns a zeroed row of `words` words, or NULL on allocation failure. */
+static uint64_t* row_alloc(row_arena_block **arena, size_t words) {
+    row_arena_block *block = *arena;
+    if (!block || block->used + words > block->capacity) {
+        size_t capacity = words > ROW_ARENA_BLOCK ? words : ROW_ARENA_BLOCK;
+        block = malloc(sizeof(row_arena_block) + capacity * sizeof(uint64_t));
+        if (!block) return NULL;
+        block->next = *arena;
+        block->used = 0;
+        block->capacity = capacity;
+        *arena = block;
+    }
+    uint64_t *row = block->data + block->used;
+    block->used += words;
+    memset(row, 0, words * sizeof(uint64_t));
+    return row;
+}
+
+static void row_arena_free(row_arena_block *arena) {
+    while (arena) {
+        row_arena_block *next = arena->next;
+        free(arena);
+        arena = next;
+    }
+}
+
+/*
+ * Adds `state` and everything ε-reachable from it in `index` to `row`, as
+ * bits base + id. `stack` needs room for every state of `index`.
+ */
+static void row_close(const fa_index *index, size_t base, uint64_t *row, int *stack, int state) {
+    int eps = index->symtab->eps;
+    if (bitset_words_contains(row, base + (size_t)state)) return;
+    bitset_words_add(row, base + (size_t)state);
+    if (eps < 0) return;
+
+    int top = 0;
+    stack[top++] = state;
+    while (top > 0) {
+        int s = stack[--top];
+        for (size_t e = index->offsets[s]; e < index->offsets[s + 1]; e++) {
+            if (index->syms[e] < eps) continue;
+            if (index->syms[e] > eps) break;
+            int d = index->dests[e];
+            if (bitset_words_contains(row, base + (size_t)d)) continue;
+            bitset_words_add(row, base + (size_t)d);
+            stack[top++] = d;
+        }
+    }
+}
+
+/* Sets the bits base + id of the accepting states of `index`. */
+static void row_add_finals(const fa_index *index, size_t base, uint64_t *row) {
+    for (size_t s = 0; s < index->nstates; s++) {
+        if (index->flags[s] & FA_INDEX_ACCEPT) bitset_words_add(row, base + s);
+    }
+}
+
+
+/*
+ * L(A) ⊆ L(B) is decided without complementing B. The search walks nodes
+ * (p, S) where p is a state of A and S the ε-closed set of B states reached
+ * by the same word; a node is a counterexample when p accepts and S does
+ * not. A node (p, S) is subsumed by any (p, S') with S' ⊆ S, because every
+ * word failing from (p, S) also fails from (p, S'), so each p only keeps an
+ * antichain of ⊆-minimal sets. Nodes are expanded breadth-first and the walk
+ * stops at the first counterexample, so the reported word stays short.
+ */
+
+typedef struct incl_node {
+    int p;                              // state of A
+    const uint64_t *set;                // ε-closed states of B, one bit each
+    int next;                           // next live node for the same p
+    bool dead;                          // subsumed before being expanded
+} incl_node;
+
+typedef struct incl_search {
+    const fa_index *a;                  // NULL stands for a one-state Σ* automaton
+    const fa_index *b;
+    size_t words;                       // row length for the states of B
+    uint64_t *finals;                   // accepting states of B
+    incl_node *nodes;
+    int *parent;
+    int *via;                           // symbol read from the parent, -1 for ε
+    size_t nnodes;
+    size_t capacity;
+    int *heads;                         // per state of A, antichain list head
+    row_arena_block *arena;
+    int *stack;                         // ε-closure DFS stack
+    int found;                          // counterexample node, or -1
+} incl_search;
+
+
+/* The text a witness spells for one symbol: a minterm reads as its first character. */
+static char* witness_symbol(const fa_symtab *symtab, int id) {
+    fa_range range;
+    if (!fa_symtab_range(symtab, id, &range) || range.lo == range.hi) return strdup(symtab->symbols[id]);
+    range.hi = range.lo;
+    return fa_range_label(&range, 1);
+}
+
+/*
+ * Rebuilds the word leading to `node` by following BFS parents. ε steps
+ * (negative `via`) contribute nothing. Returns a malloc'd string.
+ */
+static char* witness_word(const fa_symtab *symtab, const int *parent, const int *via, int node) {
+    size_t len = 0, steps = 0;
+    for (int n = node; n >= 0; n = parent[n]) {
+        if (via[n] >= 0) steps++;
+    }
+
+    char **texts = malloc((steps ? steps : 1) * sizeof(char*));
+    if (!texts) return NULL;
+    size_t k = steps;
+    for (int n = node; n >= 0; n = parent[n]) {
+        if (via[n] < 0) continue;
+        texts[--k] = witness_symbol(symtab, via[n]);
+        if (!texts[k]) break;
+        len += strlen(texts[k]);
+    }
+
+    char *word = k == 0 ? malloc(len + 1) : NULL;
+    if (word) {
+        size_t pos = 0;
+        for (size_t i = 0; i < steps; i++) {
+            size_t size = strlen(texts[i]);
+            memcpy(word + pos, texts[i], size);
+            pos += size;
+        }
+        word[pos] = '\0';
+    }
+    for (size_t i = k; i < steps; i++) free(texts[i]);
+    free(texts);
+    return word;
+}
+
+static bool incl_accepts_a(const incl_search *search, int p) {
+    return !search->a || (search->a->flags[p] & FA_INDEX_ACCEPT);
+}
+
+/*
+ * Adds node (p, set) unless an existing node for p subsumes it; nodes it
+ * subsumes are dropped from the antichain. `set` must already live in the
+ * search arena. Returns false on allocation failure only.
+ */
+static bool incl_push(incl_search *search, int p, const uint64_t *set, int parent, int via) {
+    int *link = &search->heads[p];
+    while (*link >= 0) {
+        incl_node *other = &search->nodes[*link];
+        if (bitset_words_is_subset(other->set, set, search->words)) return true;
+        if (bitset_words_is_subset(set, other->set, search->words)) {
+            other->dead = true;
+            *link = other->next;
+        } else {
+            link = &other->next;
+        }
+    }
+
+    if (search->nnodes >= search->capacity) {
+        size_t new_capacity = search->capacity ? search->capacity * 2 : 64;
+        incl_node *nodes = realloc(search->nodes, new_capacity * sizeof(incl_node));
+        if (!nodes) return false;
+        search->nodes = nodes;
+        int **arrays[] = { &search->parent, &search->via };
+        for (size_t i = 0; i < sizeof(arrays) / sizeof(arrays[0]); i++) {
+            int *grown = realloc(*arrays[i], new_capacity * sizeof(int));
+            if (!grown) return false;
+            *arrays[i] = grown;
+        }
+        search->capacity = new_capacity;
+    }
+
+    int id = (int)search->nnodes++;
+    search->nodes[id].p = p;
+    search->nodes[id].set = set;
+    search->nodes[id].next = search->heads[p];
+    search->nodes[id].dead = false;
+    search->parent[id] = parent;
+    search->via[id] = via;
+    search->heads[p] = id;
+
+    if (search->found < 0 && incl_accepts_a(search, p) &&
+        !bitset_words_intersects(set, search->finals, search->words)) {
+        search->found = id;
+    }
+    return true;
+}
+
+/*
+ * Computes the ε-closed successor of `set` in B on `sym` into a new arena
+ * row. Returns NULL on allocation failure.
+ */
+static const uint64_t* incl_post(incl_search *search, const uint64_t *set, int sym) {
+    const fa_index *b = search->b;
+    uint64_t *next = row_alloc(&search->arena, search->words);
+    if (!next) return NULL;
+
+    for (size_t s = bitset_words_next(set, search->words, 0); s != BITSET_END;
+         s = bitset_words_next(set, search->words, s + 1)) {
+        for (size_t e = b->offsets[s]; e < b->offsets[s + 1]; e++) {
+            if (b->syms[e] < sym) continue;
+            if (b->syms[e] > sym) break;
+            row_close(b, 0, next, search->stack, b->dests[e]);
+        }
+    }
+    return next;
+}
+
+static bool incl_expand(incl_search *search, int id) {
+    const fa_index *a = search->a;
+    int eps = search->b->symtab->eps;
+    int p = search->nodes[id].p;
+
+    if (!a) {
+        // Σ*: one accepting state looping on every symbol
+        for (size_t sym = 0; sym < search->b->symtab->count && search->found < 0; sym++) {
+            if ((int)sym == eps) continue;
+            const uint64_t *set = incl_post(search, search->nodes[id].set, (int)sym);
+            if (!set || !incl_push(search, 0, set, id, (int)sym)) return false;
+        }
+        return true;
+    }
+
+    size_t e = a->offsets[p], end = a->offsets[p + 1];
+    while (e < end && search->found < 0) {
+        int sym = a->syms[e];
+        size_t run = e;
+        while (run < end && a->syms[run] == sym) run++;
+
+        const uint64_t *set = search->nodes[id].set;
+        int via = -1;
+        if (sym != eps) {
+            // B has to read the symbol too; an ε move of A leaves S alone
+            set = incl_post(search, set, sym);
+            if (!set) return false;
+            via = sym;
+        }
+
+        for (size_t i = e; i < run && search->found < 0; i++) {
+            if (!incl_push(search, a->dests[i], set, id, via)) return false;
+        }
+        e = run;
+    }
+    return true;
+}
+
+/*
+ * Runs the antichain search for L(a) ⊆ L(b), with a == NULL meaning Σ* over
+ * the shared symbol table. Returns 1 if included, 0 if not, -1 on failure.
+ */
+static int incl_run(const fa_index *a, const fa_index *b, char **counterexample) {
+    incl_search search;
+    memset(&search, 0, sizeof(incl_search));
+    search.a = a;
+    search.b = b;
+    search.found = -1;
+
+    int result = -1;
+    size_t na = a ? a->nstates : 1;
+    search.words = BITSET_WORDS(b->nstates) ? BITSET_WORDS(b->nstates) : 1;
+    search.heads = malloc((na ? na : 1) * sizeof(int));
+    search.stack = malloc((b->nstates ? b->nstates : 1) * sizeof(int));
+    search.finals = row_alloc(&search.arena, search.words);
+    uint64_t *start = row_alloc(&search.arena, search.words);
+    if (!search.heads || !search.stack || !search.finals || !start) goto cleanup;
+    memset(search.heads, -1, (na ? na : 1) * sizeof(int));
+
+    row_add_finals(b, 0, search.finals);
+    for (size_t s = 0; s < b->nstates; s++) {
+        if (b->flags[s] & FA_INDEX_START) row_close(b, 0, start, search.stack, (int)s);
+    }
+
+    for (size_t p = 0; p < na && search.found < 0; p++) {
+        if (a && !(a->flags[p] & FA_INDEX_START)) continue;
+        if (!incl_push(&search, (int)p, start, -1, -1)) goto cleanup;
+    }
+
+    for (size_t id = 0; id < search.nnodes && search.found < 0; id++) {
+        if (search.nodes[id].dead) continue;
+        if (!incl_expand(&search, (int)id)) goto cleanup;
+    }
+
+    if (search.found < 0) {
+        result = 1;
+    } else {
+        if (counterexample) {
+            *counterexample = witness_word(b->symtab, search.parent, search.via, search.found);
+            if (!*counterexample) goto cleanup;
+        }
+        result = 0;
+    }
+
+cleanup:
+    row_arena_free(search.arena);
+    free(search.stack);
+    free(search.nodes);
+    free(search.parent);
+    free(search.via);
+    free(search.heads);
+    return result;
+}
+
+
+bool fa_auto_is_subset(const fa_auto* a, const fa_auto* b, char** counterexample) {
+    if (counterexample) *counterexample = NULL;
+    if (!a || !b) return false;
+
+    fa_auto *owned_a, *owned_b;
+    a = sink_explicit(a, &owned_a);
+    b = sink_explicit(b, &owned_b);
+    fa_symtab *symtab = a && b ? symtab_shared(a, b) : NULL;
+    fa_index *ia = symtab ? fa_index_build(a, symtab) : NULL;
+    fa_index *ib = symtab ? fa_index_build(b, symtab) : NULL;
+
+    int result = ia && ib ? incl_run(ia, ib, counterexample) : -1;
+
+    fa_index_destroy(ia);
+    fa_index_destroy(ib);
+    fa_symtab_destroy(symtab);
+    fa_auto_destroy(owned_a);
+    fa_auto_destroy(owned_b);
+    return result == 1;
+}
+
+bool fa_auto_is_universal(const fa_auto* a, char** counterexample) {
+    if (counterexample) *counterexample = NULL;
+    if (!a) return false;
+
+    fa_auto *owned;
+    a = sink_explicit(a, &owned);
+    fa_index *index = a ? fa_index_build(a, NULL) : NULL;
+
+    int result = index ? incl_run(NULL, index, counterexample) : -1;
+    fa_index_destroy(index);
+    fa_auto_destroy(owned);
+    return result == 1;
+}
+
+/*
+ * A side with an implicit accepting sink (such as the complement in the
+ * usual A ∩ ¬B check) is walked as is; only when both sides have one is
+ * the first made explicit, since the pair of sinks is never explored.
+ */
+bool fa_auto_is_empty_intersection(const fa_auto* a, const fa_auto* b, char** witness) {
+    if (witness) *witness = NULL;
+    if (!a || !b) return false;
+
+    fa_auto *owned = NULL;
+    if (a->sink_accepts && b->sink_accepts) {
+        a = sink_explicit(a, &owned);
+        if (!a) return false;
+    }
+
+    fa_symtab *symtab = symtab_shared(a, b);
+    fa_index *ia = symtab ? fa_index_build(a, symtab) : NULL;
+    fa_index *ib = symtab ? fa_index_build(b, symtab) : NULL;
+
+    bool empty = false;
+    product_graph graph;
+    if (ia && ib && product_explore(ia, ib, ia->sink_accepts, ib->sink_accepts, PRODUCT_INTERSECTION, NULL, &graph)) {
+        if (graph.witness < 0) {
+            empty = true;
+        } else if (witness) {
+            *witness = witness_word(symtab, graph.parent, graph.via, graph.witness);
+        }
+        product_graph_free(&graph);
+    }
+
+    fa_index_destroy(ia);
+    fa_index_destroy(ib);
+    fa_symtab_destroy(symtab);
+    fa_auto_destroy(owned);
+    return empty;
+}
+
+
+// ============================================================================
+// Equivalence
+// ============================================================================
+
+/*
+ * Language equivalence without minimizing either side. For two DFAs this is
+ * Hopcroft–Karp: pairs of states are merged in a union-find over the
+ * disjoint union of both automata (plus one shared sink), and a pair whose
+ * states already share a class is skipped. Otherwise pairs of ε-closed state
+ * sets are compared, and a pair is skipped when it already follows from the
+ * processed pairs by congruence closure (bisimulation up to congruence),
+ * which typically visits far fewer pairs than determinizing. Both walks are
+ * breadth-first and stop at the first pair that disagrees on acceptance.
+ */
+
+typedef struct eq_trail {
+    void *items;                        // one pair per node, `item_size` bytes each
+    size_t item_size;
+    int *parent;
+    int *via;                           // symbol read from the parent
+    size_t count;
+    size_t capacity;
+} eq_trail;
+
+/* Appends a node and returns its pair slot, or NULL on allocation failure. */
+static void* eq_trail_push(eq_trail *trail, int parent, int via) {
+    if (trail->count >= trail->capacity) {
+        size_t new_capacity = trail->capacity ? trail->capacity * 2 : 64;
+        void *items = realloc(trail->items, new_capacity * trail->item_size);
+        if (!items) return NULL;
+        trail->items = items;
+        int **arrays[] = { &trail->parent, &trail->via };
+        for (size_t i = 0; i < sizeof(arrays) / sizeof(arrays[0]); i++) {
+            int *grown = realloc(*arrays[i], new_capacity * sizeof(int));
+            if (!grown) return NULL;
+            *arrays[i] = grown;
+        }
+        trail->capacity = new_capacity;
+    }
+    trail->parent[trail->count] = parent;
+    trail->via[trail->count] = via;
+    return (char*)trail->items + trail->item_size * trail->count++;
+}
+
+static void eq_trail_free(eq_trail *trail) {
+    free(trail->items);
+    free(trail->parent);
+    free(trail->via);
+}
+
+static int eq_find(int *uf, int x) {
+    while (uf[x] != x) {
+        uf[x] = uf[uf[x]];
+        x = uf[x];
+    }
+    return x;
+}
+
+
+typedef struct eq_dfa_pair {
+    int p;                              // state of A, PRODUCT_SINK if none
+    int q;                              // state of B, PRODUCT_SINK if none
+} eq_dfa_pair;
+
+static bool eq_dfa_push(eq_trail *trail, int p, int q, int parent, int via) {
+    eq_dfa_pair *pair = eq_trail_push(trail, parent, via);
+    if (!pair) return false;
+    pair->p = p;
+    pair->q = q;
+    return true;
+}
+
+/* Returns 1 if equivalent, 0 if not (with `*found` set), -1 on failure. */
+static int eq_dfa(const fa_index *a, const fa_index *b, eq_trail *trail, int *found) {
+    size_t sink = a->nstates + b->nstates;
+    int *uf = malloc((sink + 1) * sizeof(int));
+    int result = -1;
+    if (!uf) return -1;
+    for (size_t i = 0; i <= sink; i++) uf[i] = (int)i;
+
+    int p0 = PRODUCT_SINK, q0 = PRODUCT_SINK;
+    for (size_t s = 0; s < a->nstates; s++) if (a->flags[s] & FA_INDEX_START) p0 = (int)s;
+    for (size_t s = 0; s < b->nstates; s++) if (b->flags[s] & FA_INDEX_START) q0 = (int)s;
+    if (!eq_dfa_push(trail, p0, q0, -1, -1)) goto cleanup;
+
+    for (size_t id = 0; id < trail->count; id++) {
+        const eq_dfa_pair *pair = (const eq_dfa_pair*)trail->items + id;
+        int p = pair->p, q = pair->q;
+        bool in_a = p >= 0 && (a->flags[p] & FA_INDEX_ACCEPT);
+        bool in_b = q >= 0 && (b->flags[q] & FA_INDEX_ACCEPT);
+        if (in_a != in_b) {
+            *found = (int)id;
+            result = 0;
+            goto cleanup;
+        }
+
+        int rp = eq_find(uf, p >= 0 ? p : (int)sink);
+        int rq = eq_find(uf, q >= 0 ? (int)a->nstates + q : (int)sink);
+        if (rp == rq) continue;
+        uf[rp] = rq;
+
+        size_t ea = p >= 0 ? a->offsets[p] : 0, enda = p >= 0 ? a->offsets[p + 1] : 0;
+        size_t eb = q >= 0 ? b->offsets[q] : 0, endb = q >= 0 ? b->offsets[q + 1] : 0;
+        while (ea < enda || eb < endb) {
+            int sa = ea < enda ? a->syms[ea] : INT_MAX;
+            int sb = eb < endb ? b->syms[eb] : INT_MAX;
+            int sym = sa < sb ? sa : sb;
+            int dp = sa == sym ? a->dests[ea++] : PRODUCT_SINK;
+            int dq = sb == sym ? b->dests[eb++] : PRODUCT_SINK;
+            if (!eq_dfa_push(trail, dp, dq, (int)id, sym)) goto cleanup;
+        }
+    }
+    result = 1;
+
+cleanup:
+    free(uf);
+    return result;
+}
+
+
+typedef struct eq_set_pair {
+    const uint64_t *x;                  // ε-closed rows over the disjoint union
+    const uint64_t *y;
+} eq_set_pair;
+
+typedef struct eq_nfa {
+    const fa_index *a;
+    const fa_index *b;
+    size_t n;                           // A states first, then B states
+    size_t words;                       // row length for the disjoint union
+    eq_trail *trail;
+    int *related;                       // processed pairs, in order
+    size_t nrelated;
+    size_t related_capacity;
+    int *slots;                         // hash of processed pairs, -1 empty
+    size_t nslots;
+    row_arena_block *arena;
+    uint64_t *finals;                   // accepting states of both sides
+    uint64_t *closure;                  // congruence closure scratch row
+    uint64_t *moves;                    // symbols readable from the current pair
+    size_t move_words;
+    int *stack;
+} eq_nfa;
+
+static const fa_index* eq_side(const eq_nfa *s, int g, int *local) {
+    if ((size_t)g < s->a->nstates) {
+        *local = g;
+        return s->a;
+    }
+    *local = g - (int)s->a->nstates;
+    return s->b;
+}
+
+/* Adds the ε-closure of union state `g` to `row`. */
+static void eq_close(eq_nfa *s, uint64_t *row, int g) {
+    int local;
+    const fa_index *index = eq_side(s, g, &local);
+    row_close(index, (size_t)(g - local), row, s->stack, local);
+}
+
+static const uint64_t* eq_post(eq_nfa *s, const uint64_t *set, int sym) {
+    uint64_t *next = row_alloc(&s->arena, s->words);
+    if (!next) return NULL;
+    for (size_t g = bitset_words_next(set, s->words, 0); g != BITSET_END;
+         g = bitset_words_next(set, s->words, g + 1)) {
+        int local;
+        const fa_index *index = eq_side(s, (int)g, &local);
+        int base = (int)g - local;
+        for (size_t e = index->offsets[local]; e < index->offsets[local + 1]; e++) {
+            if (index->syms[e] < sym) continue;
+            if (index->syms[e] > sym) break;
+            eq_close(s, next, base + index->dests[e]);
+        }
+    }
+    return next;
+}
+
+/*
+ * Tells whether `to` is contained in the congruence closure of `from`
+ * under the processed pairs: saturates `from` with every related set whose
+ * partner it already contains.
+ */
+static bool eq_covers(eq_nfa *s, const uint64_t *from, const uint64_t *to) {
+    uint64_t *closure = s->closure;
+    memcpy(closure, from, s->words * sizeof(uint64_t));
+
+    bool changed = true;
+    while (changed && !bitset_words_is_subset(to, closure, s->words)) {
+        changed = false;
+        for (size_t r = 0; r < s->nrelated; r++) {
+            const eq_set_pair *pair = (const eq_set_pair*)s->trail->items + s->related[r];
+            bool has_x = bitset_words_is_subset(pair->x, closure, s->words);
+            bool has_y = bitset_words_is_subset(pair->y, closure, s->words);
+            if (has_x == has_y) continue;
+            bitset_words_or(closure, has_x ? pair->y : pair->x, s->words);
+            changed = true;
+        }
+    }
+    return bitset_words_is_subset(to, closure, s->words);
+}
+
+static bool eq_nfa_push(eq_trail *trail, const uint64_t *x, const uint64_t *y,
+                        int parent, int via) {
+    eq_set_pair *pair = eq_trail_push(trail, parent, via);
+    if (!pair) return false;
+    pair->x = x;
+    pair->y = y;
+    return true;
+}
+
+static size_t eq_pair_hash(const eq_nfa *s, const eq_set_pair *pair) {
+    return (size_t)(bitset_words_hash(pair->x, s->words) * 31 ^
+                    bitset_words_hash(pair->y, s->words));
+}
+
+static bool eq_pair_equal(const eq_nfa *s, const eq_set_pair *u, const eq_set_pair *v) {
+    return bitset_words_equal(u->x, v->x, s->words) && bitset_words_equal(u->y, v->y, s->words);
+}
+
+/* Tells whether the exact same pair was already processed. */
+static bool eq_seen(const eq_nfa *s, const eq_set_pair *pair) {
+    if (!s->nslots) return false;
+    const eq_set_pair *items = s->trail->items;
+    size_t mask = s->nslots - 1;
+    for (size_t h = eq_pair_hash(s, pair) & mask; s->slots[h] >= 0; h = (h + 1) & mask) {
+        if (eq_pair_equal(s, &items[s->slots[h]], pair)) return true;
+    }
+    return false;
+}
+
+static bool eq_relate(eq_nfa *s, int id) {
+    const eq_set_pair *items = s->trail->items;
+
+    if ((s->nrelated + 1) * 2 > s->nslots) {
+        size_t nslots = s->nslots ? s->nslots * 2 : 64;
+        int *slots = malloc(nslots * sizeof(int));
+        if (!slots) return false;
+        memset(slots, -1, nslots * sizeof(int));
+        for (size_t r = 0; r < s->nrelated; r++) {
+            size_t h = eq_pair_hash(s, &items[s->related[r]]) & (nslots - 1);
+            while (slots[h] >= 0) h = (h + 1) & (nslots - 1);
+            slots[h] = s->related[r];
+        }
+        free(s->slots);
+        s->slots = slots;
+        s->nslots = nslots;
+    }
+
+    if (s->nrelated >= s->related_capacity) {
+        size_t new_capacity = s->related_capacity ? s->related_capacity * 2 : 64;
+        int *related = realloc(s->related, new_capacity * sizeof(int));
+        if (!related) return false;
+        s->related = related;
+        s->related_capacity = new_capacity;
+    }
+
+    size_t h = eq_pair_hash(s, &items[id]) & (s->nslots - 1);
+    while (s->slots[h] >= 0) h = (h + 1) & (s->nslots - 1);
+    s->slots[h] = id;
+    s->related[s->nrelated++] = id;
+    return true;
+}
+
+/* Sets the bit of every non-ε symbol some state of `set` can read. */
+static void eq_moves(eq_nfa *s, const uint64_t *set) {
+    int eps = s->a->symtab->eps;
+    for (size_t g = bitset_words_next(set, s->words, 0); g != BITSET_END;
+         g = bitset_words_next(set, s->words, g + 1)) {
+        int local;
+        const fa_index *index = eq_side(s, (int)g, &local);
+        for (size_t e = index->offsets[local]; e < index->offsets[local + 1]; e++) {
+            if (index->syms[e] != eps) bitset_words_add(s->moves, (size_t)index->syms[e]);
+        }
+    }
+}
 
-    fa_auto* minimized_dfa = generate_minimized_DFA(automaton, partition, N);
-    return minimized_dfa;
+static int eq_nfa_run(eq_nfa *s, int *found) {
+    eq_trail *trail = s->trail;
+
+    uint64_t *x = row_alloc(&s->arena, s->words);
+    uint64_t *y = row_alloc(&s->arena, s->words);
+    if (!x || !y) return -1;
+    for (size_t i = 0; i < s->a->nstates; i++) {
+        if (s->a->flags[i] & FA_INDEX_START) eq_close(s, x, (int)i);
+    }
+    for (size_t i = 0; i < s->b->nstates; i++) {
+        if (s->b->flags[i] & FA_INDEX_START) eq_close(s, y, (int)(s->a->nstates + i));
+    }
+    if (!eq_nfa_push(trail, x, y, -1, -1)) return -1;
+
+    for (size_t id = 0; id < trail->count; id++) {
+        eq_set_pair pair = ((const eq_set_pair*)trail->items)[id];
+        if (bitset_words_intersects(pair.x, s->finals, s->words) !=
+            bitset_words_intersects(pair.y, s->finals, s->words)) {
+            *found = (int)id;
+            return 0;
+        }
+
+        if (eq_seen(s, &pair)) continue;
+        if (eq_covers(s, pair.x, pair.y) && eq_covers(s, pair.y, pair.x)) continue;
+        if (!eq_relate(s, (int)id)) return -1;
+
+        // Symbols readable from either side, visited in symbol order
+        memset(s->moves, 0, s->move_words * sizeof(uint64_t));
+        eq_moves(s, pair.x);
+        eq_moves(s, pair.y);
+        for (size_t sym = bitset_words_next(s->moves, s->move_words, 0); sym != BITSET_END;
+             sym = bitset_words_next(s->moves, s->move_words, sym + 1)) {
+            const uint64_t *dx = eq_post(s, pair.x, (int)sym);
+            const uint64_t *dy = dx ? eq_post(s, pair.y, (int)sym) : NULL;
+            if (!dy || !eq_nfa_push(trail, dx, dy, (int)id, (int)sym)) return -1;
+        }
+    }
+    return 1;
 }
 
+static int eq_nfa_check(const fa_index *a, const fa_index *b, eq_trail *trail, int *found) {
+    eq_nfa s;
+    memset(&s, 0, sizeof(eq_nfa));
+    s.a = a;
+    s.b = b;
+    s.n = a->nstates + b->nstates;
+    s.words = BITSET_WORDS(s.n) ? BITSET_WORDS(s.n) : 1;
+    s.move_words = BITSET_WORDS(a->symtab->count) ? BITSET_WORDS(a->symtab->count) : 1;
+    s.trail = trail;
+
+    s.stack = malloc((s.n ? s.n : 1) * sizeof(int));
+    s.finals = row_alloc(&s.arena, s.words);
+    s.closure = row_alloc(&s.arena, s.words);
+    s.moves = row_alloc(&s.arena, s.move_words);
+
+    int result = -1;
+    if (s.stack && s.finals && s.closure && s.moves) {
+        row_add_finals(a, 0, s.finals);
+        row_add_finals(b, a->nstates, s.finals);
+        result = eq_nfa_run(&s, found);
+    }
 
-fa_auto* fa_auto_minimize(const fa_auto* automaton, fa_minimize_algorithm algorithm) {
-    if (!automaton) return NULL;
-    
-    // // Check if automaton is deterministic
-    // if (!fa_auto_is_deterministic(automaton)) {
-        
-    //     return NULL;
-    // }
-    
-    // Select algorithm based on flags
-    if (FA_MINIMIZE_USES_ALGO(algorithm, FA_MINIMIZE_HOPCROFT)) {
-        return fa_auto_minimize_hopcroft(automaton);
+    row_arena_free(s.arena);
+    free(s.related);
+    free(s.slots);
+    free(s.stack);
+    return result;
+}
+
+
+bool fa_auto_equivalent(const fa_auto* a, const fa_auto* b, char** counterexample) {
+    if (counterexample) *counterexample = NULL;
+    if (!a || !b) return false;
+
+    fa_auto *owned_a, *owned_b;
+    a = sink_explicit(a, &owned_a);
+    b = sink_explicit(b, &owned_b);
+    fa_symtab *symtab = a && b ? symtab_shared(a, b) : NULL;
+    fa_index *ia = symtab ? fa_index_build(a, symtab) : NULL;
+    fa_index *ib = symtab ? fa_index_build(b, symtab) : NULL;
+
+    eq_trail trail = { 0 };
+    int found = -1;
+    int result = -1;
+    if (ia && ib) {
+        if (fa_index_is_deterministic(ia) && fa_index_is_deterministic(ib)) {
+            trail.item_size = sizeof(eq_dfa_pair);
+            result = eq_dfa(ia, ib, &trail, &found);
+        } else {
+            trail.item_size = sizeof(eq_set_pair);
+            result = eq_nfa_check(ia, ib, &trail, &found);
+        }
     }
-    else if (FA_MINIMIZE_USES_ALGO(algorithm, FA_MINIMIZE_MOORE)) {
-        return fa_auto_minimize_moore(automaton);
+
+    if (result == 0 && counterexample) {
+        *counterexample = witness_word(symtab, trail.parent, trail.via, found);
     }
-    else if (FA_MINIMIZE_USES_ALGO(algorithm, FA_MINIMIZE_TABLE)) {
-        return fa_auto_minimize_table(automaton);
+
+    eq_trail_free(&trail);
+    fa_index_destroy(ia);
+    fa_index_destroy(ib);
+    fa_symtab_destroy(symtab);
+    fa_auto_destroy(owned_a);
+    fa_auto_destroy(owned_b);
+    return result == 1;
+}
+
+
+// ============================================================================
+// Fingerprints
+// ============================================================================
+
+/*
+ * Canonical hash of a DFA. States get numbers in the order a BFS from the
+ * start first reaches them, reading each state's moves in a fixed order:
+ * character moves by first code point, then opaque symbols by their bytes.
+ * Adjacent character moves to the same state are merged first, so a state
+ * hashes the same however its moves are split into symbols. Edges are put
+ * in that order once for the whole automaton by two counting sorts, which
+ * keeps the walk linear after ranking the symbols. The accepting sink and
+ * every state whose language is Σ* walk as one extra state, so a DFA
+ * hashes the same with the sink implicit or materialized.
+ */
+
+typedef struct fp_digest {
+    uint64_t h[2];
+} fp_digest;
+
+static void fp_digest_bytes(fp_digest *d, const void *data, size_t length) {
+    const unsigned char *p = data;
+    for (size_t i = 0; i < length; i++) {
+        // same two lanes as the regex cache key
+        d->h[0] = (d->h[0] ^ p[i]) * 0x100000001b3ULL;
+        d->h[1] = (d->h[1] + p[i] + 1) * 0x9e3779b97f4a7c15ULL;
+        d->h[1] ^= d->h[1] >> 31;
     }
-    else if (FA_MINIMIZE_USES_ALGO(algorithm, FA_MINIMIZE_BRZOZOWSKI)) {
-        return fa_auto_minimize_brzozowski(automaton);
+}
+
+static void fp_digest_u64(fp_digest *d, uint64_t value) {
+    unsigned char bytes[8];
+    for (int i = 0; i < 8; i++) bytes[i] = (unsigned char)(value >> (8 * i));
+    fp_digest_bytes(d, bytes, sizeof(bytes));
+}
+
+static void fp_digest_text(fp_digest *d, const char *text) {
+    size_t length = strlen(text);
+    fp_digest_u64(d, length);
+    fp_digest_bytes(d, text, length);
+}
+
+typedef struct fp_symbol {
+    int id;
+    bool ranged;
+    fa_range range;
+    const char *text;
+} fp_symbol;
+
+static int fp_symbol_compare(const void *a, const void *b) {
+    const fp_symbol *x = a, *y = b;
+    if (x->ranged != y->ranged) return x->ranged ? -1 : 1;
+    if (x->ranged) return x->range.lo < y->range.lo ? -1 : x->range.lo > y->range.lo;
+    return strcmp(x->text, y->text);
+}
+
+/* Character run pending in fp_walk, flushed once it cannot grow. */
+typedef struct fp_run {
+    bool open;
+    fa_range range;
+    int dest;
+} fp_run;
+
+typedef struct fp_walk {
+    const fp_symbol *symbols;           // rank -> symbol
+    int *canon;                         // state -> BFS number, -1 if unseen
+    int *queue;
+    size_t nqueue;
+    fp_digest digest;
+} fp_walk;
+
+static int fp_number(fp_walk *w, int state) {
+    if (w->canon[state] < 0) {
+        w->canon[state] = (int)w->nqueue;
+        w->queue[w->nqueue++] = state;
     }
-    
-    // Default to Hopcroft if no algorithm specified
-    return fa_auto_minimize_hopcroft(automaton);
+    return w->canon[state];
 }
 
+static void fp_flush(fp_walk *w, fp_run *run) {
+    if (!run->open) return;
+    fp_digest_u64(&w->digest, 'R');
+    fp_digest_u64(&w->digest, run->range.lo);
+    fp_digest_u64(&w->digest, run->range.hi);
+    fp_digest_u64(&w->digest, (uint64_t)fp_number(w, run->dest));
+    run->open = false;
+}
 
-fa_auto* fa_auto_determinize(const fa_auto* a, fa_determinize_algorithm algorithm){
-    // fa_auto *dfa = fa_auto_create(0);
-	// int k =0;
-	// SetControl *setcontrol = malloc(sizeof(SetControl));
-    // // Initialisation de l'AFD
-
-    // dfa->number_of_states = 0;
-    // setcontrol->set_count = 0;
-    // memcpy(dfa->alphabet, afn->alphabet, sizeof(afn->alphabet));
-    // dfa->alphabet = afn->alphabet;
-
-    // // Création de l'état initial de l'AFD
-    // StateSet *initial_set = create_state_set();
-    // for (int i = 0; i < afn->number_of_states; i++) {
-    //     if (afn->states[i]->is_starting_state && !afn->states[i]->is_ending_state ) {
-    //         add_to_state_set(initial_set, afn->states[i]);
-    //        // break;
-    //     }
-    //     if (afn->states[i]->is_starting_state && afn->states[i]->is_ending_state ) {
-    //         add_to_state_set(initial_set, afn->states[i]);
-    //         k = 1;
-    //        // break;
-    //     }
+/* Hashes the move of the state being walked on `symbol` to `dest`. */
+static void fp_move(fp_walk *w, fp_run *run, const fp_symbol *symbol, int dest) {
+    if (symbol->ranged) {
+        if (run->open && run->dest == dest && symbol->range.lo == run->range.hi + 1) {
+            run->range.hi = symbol->range.hi;
+            return;
+        }
+        fp_flush(w, run);
+        run->open = true;
+        run->range = symbol->range;
+        run->dest = dest;
+    } else {
+        fp_flush(w, run);
+        fp_digest_u64(&w->digest, 'S');
+        fp_digest_text(&w->digest, symbol->text);
+        fp_digest_u64(&w->digest, (uint64_t)fp_number(w, dest));
+    }
+}
 
-    // }
-    // generate_set_name(initial_set);
-    // setcontrol->state_sets[setcontrol->set_count++] = initial_set;
+fa_error_t fa_auto_fingerprint(const fa_auto* dfa, uint64_t fingerprint[2]) {
+    if (!dfa || !fingerprint) return FA_ERR_NULL_ARGUMENT;
 
-    // // Créer l'état AFD correspondant
-    // State *initial_afd_state = init_state(initial_set->name, true, false);
-    // if (k) {
-    //     initial_afd_state->is_ending_state = 1;
-    // }
-    // dfa->states[dfa->number_of_states++] = initial_afd_state;
-
-    // // Pour chaque état de l'AFD
-    // for (int i = 0; i < setcontrol->set_count; i++) {
-    //     StateSet *current_set = setcontrol->state_sets[i];
-    //     State *current_afd_state = dfa->states[i];
-
-    //     // Pour chaque symbole de l'alphabet
-    //     for (int j = 0; j < dfa->alphabet->length; j++) {
-    //         StateSet *new_set = create_state_set();
-
-    //         // Pour chaque état AFN dans l'ensemble courant
-    //         for (int k = 0; k < current_set->count; k++) {
-    //             State *afn_state = current_set->states[k];
-
-    //             // Trouver toutes les transitions avec ce symbole
-    //             for (TransitionNode *t = afn_state->transition; t != NULL; t = t->next) {
-    //                 if (strcmp(t->input_symbol, dfa->alphabet->members[j]) == 0) {
-    //                     if (!state_set_contains(new_set, t->destination_state)) {
-    //                         add_to_state_set(new_set, t->destination_state);
-    //                     }
-    //                 }
-    //             }
-    //         }
-
-    //         if (new_set->count > 0) {
-    //             generate_set_name(new_set);
-
-    //             // Vérifier si cet ensemble existe déjà
-    //             bool set_exists = false;
-    //             State *target_state = NULL;
-    //             for (int m = 0; m < setcontrol->set_count; m++) {
-    //                 if (strcmp(setcontrol->state_sets[m]->name, new_set->name) == 0) {
-    //                     set_exists = true;
-    //                     target_state = dfa->states[m];
-    //                     break;
-    //                 }
-    //             }
-
-    //             if (!set_exists) {
-    //                 // Créer un nouvel état AFD
-    //                 bool is_final = false;
-    //                 for (int n = 0; n < new_set->count; n++) {
-    //                     if (new_set->states[n]->is_ending_state) {
-    //                         is_final = true;
-    //                         break;
-    //                     }
-    //                 }
-
-    //                 State *new_afd_state = init_state(new_set->name, false, is_final);
-
-    //                 setcontrol->state_sets[setcontrol->set_count] = new_set;
-    //                 dfa->states[dfa->number_of_states] = new_afd_state;
-    //                 target_state = new_afd_state;
-
-    //                 setcontrol->set_count++;
-    //                 dfa->number_of_states++;
-    //             }
-
-    //             // Ajouter la transition
-    //             add_transition(current_afd_state, dfa->alphabet->members[j], target_state);
-    //         } else {
-    //             free(new_set);
-    //         }
-    //     }
-    // }
-    // return rename_states_and_transitions_ret(dfa);
+    fa_index *index = fa_index_build(dfa, NULL);
+    if (!index) return FA_ERR_OUT_OF_MEMORY;
+    if (!fa_index_is_deterministic(index)) {
+        fa_index_destroy(index);
+        return FA_ERR_NOT_DETERMINISTIC;
+    }
+
+    size_t n = index->nstates, m = index->nedges;
+    size_t k = index->symtab->count;
+    int *sigma = NULL;
+    size_t nsigma = 0;
+    fp_symbol *symbols = malloc((k ? k : 1) * sizeof(fp_symbol));
+    int *rank = malloc((k ? k : 1) * sizeof(int));
+    bool *in_sigma = calloc(k ? k : 1, sizeof(bool));
+    size_t *count = calloc(k + 1, sizeof(size_t));
+    size_t *by_rank = malloc((m ? m : 1) * sizeof(size_t));
+    size_t *edges = malloc((m ? m : 1) * sizeof(size_t));
+    size_t *fill = malloc((n ? n : 1) * sizeof(size_t));
+    int *srcs = malloc((m ? m : 1) * sizeof(int));
+    bool *live = malloc((n ? n : 1) * sizeof(bool));
+    bool *universal = malloc((n ? n : 1) * sizeof(bool));
+    int *canon = malloc((n + 1) * sizeof(int));
+    int *queue = malloc((n + 1) * sizeof(int));
+    fa_index_reverse *reverse = fa_index_reverse_build(index);
+    fa_error_t result = FA_ERR_OUT_OF_MEMORY;
+    if (!symbols || !rank || !in_sigma || !count || !by_rank || !edges || !fill || !srcs ||
+        !live || !universal || !canon || !queue || !reverse ||
+        !fa_index_alphabet(index, dfa, &sigma, &nsigma)) {
+        goto cleanup;
+    }
+    for (size_t i = 0; i < nsigma; i++) in_sigma[sigma[i]] = true;
+
+    // rank symbols: character intervals by first code point, then text
+    size_t nsymbols = 0;
+    for (size_t id = 0; id < k; id++) {
+        if ((int)id == index->symtab->eps) continue;
+        fp_symbol *symbol = &symbols[nsymbols++];
+        symbol->id = (int)id;
+        symbol->ranged = fa_symtab_range(index->symtab, (int)id, &symbol->range);
+        symbol->text = index->symtab->symbols[id];
+    }
+    qsort(symbols, nsymbols, sizeof(fp_symbol), fp_symbol_compare);
+    for (size_t r = 0; r < nsymbols; r++) rank[symbols[r].id] = (int)r;
+
+    // edges by rank, then stably by source
+    for (size_t s = 0; s < n; s++) {
+        for (size_t e = index->offsets[s]; e < index->offsets[s + 1]; e++) srcs[e] = (int)s;
+    }
+    for (size_t e = 0; e < m; e++) count[rank[index->syms[e]] + 1]++;
+    for (size_t r = 0; r < k; r++) count[r + 1] += count[r];
+    for (size_t e = 0; e < m; e++) by_rank[count[rank[index->syms[e]]]++] = e;
+    memcpy(fill, index->offsets, n * sizeof(size_t));
+    for (size_t i = 0; i < m; i++) edges[fill[srcs[by_rank[i]]]++] = by_rank[i];
+
+    // states that cannot accept are left out; a missing move reaches the
+    // accepting sink when there is one
+    size_t ntop = 0;
+    for (size_t s = 0; s < n; s++) {
+        size_t moves = 0;
+        for (size_t e = index->offsets[s]; e < index->offsets[s + 1]; e++) {
+            moves += in_sigma[index->syms[e]];
+        }
+        universal[s] = index->sink_accepts || moves == nsigma;
+        live[s] = (index->flags[s] & FA_INDEX_ACCEPT) || (index->sink_accepts && moves < nsigma);
+        if (live[s]) queue[ntop++] = (int)s;
+    }
+    while (ntop > 0) {
+        int s = queue[--ntop];
+        for (size_t i = reverse->offsets[s]; i < reverse->offsets[s + 1]; i++) {
+            int src = reverse->srcs[i];
+            if (!live[src]) {
+                live[src] = true;
+                queue[ntop++] = src;
+            }
+        }
+    }
+
+    // States accepting all of Σ* are one with the sink: an accepting state
+    // with a move on each alphabet symbol (or the rest to the sink) and no
+    // other live move, all to such states
+    for (size_t s = 0; s < n; s++) {
+        universal[s] = universal[s] && (index->flags[s] & FA_INDEX_ACCEPT);
+        for (size_t e = index->offsets[s]; universal[s] && e < index->offsets[s + 1]; e++) {
+            if (!in_sigma[index->syms[e]] && live[index->dests[e]]) universal[s] = false;
+        }
+        if (!universal[s]) queue[ntop++] = (int)s;
+    }
+    while (ntop > 0) {
+        int s = queue[--ntop];
+        for (size_t i = reverse->offsets[s]; i < reverse->offsets[s + 1]; i++) {
+            int src = reverse->srcs[i];
+            if (universal[src] && in_sigma[index->syms[reverse->edges[i]]]) {
+                universal[src] = false;
+                queue[ntop++] = src;
+            }
+        }
+    }
+
+    // the sink, or the states merged into it, walk as state n
+    fp_walk w = { 0 };
+    w.symbols = symbols;
+    w.canon = canon;
+    w.queue = queue;
+    w.digest = (fp_digest){ { 0xcbf29ce484222325ULL, 0x6a09e667f3bcc909ULL } };
+    for (size_t s = 0; s <= n; s++) canon[s] = -1;
+    for (size_t s = 0; s < n; s++) {
+        if ((index->flags[s] & FA_INDEX_START) && live[s]) {
+            fp_number(&w, universal[s] ? (int)n : (int)s);
+        }
+    }
+
+    for (size_t head = 0; head < w.nqueue; head++) {
+        int s = queue[head];
+        bool sink = (size_t)s == n;
+        fp_digest_u64(&w.digest, 'Q');
+        fp_digest_u64(&w.digest, sink || (index->flags[s] & FA_INDEX_ACCEPT) != 0);
+        fp_run run = { 0 };
+        size_t i = sink ? 0 : index->offsets[s], end = sink ? 0 : index->offsets[s + 1];
+        for (size_t r = 0; r < nsymbols; r++) {
+            // only the sink and missing moves into it need every rank
+            if (!sink && !index->sink_accepts) {
+                if (i == end) break;
+                r = (size_t)rank[index->syms[edges[i]]];
+            }
+            const fp_symbol *symbol = &symbols[r];
+            int dest;
+            if (i < end && (size_t)rank[index->syms[edges[i]]] == r) {
+                dest = index->dests[edges[i++]];
+                if (!live[dest]) continue;
+                if (universal[dest]) dest = (int)n;
+            } else if ((sink || index->sink_accepts) && in_sigma[symbol->id]) {
+                dest = (int)n;
+            } else {
+                continue;
+            }
+            fp_move(&w, &run, symbol, dest);
+        }
+        fp_flush(&w, &run);
+    }
+
+    fp_digest_u64(&w.digest, 'E');
+    fp_digest_u64(&w.digest, w.nqueue);
+
+    fingerprint[0] = w.digest.h[0];
+    fingerprint[1] = w.digest.h[1];
+    result = FA_SUCCESS;
+
+cleanup:
+    fa_index_reverse_destroy(reverse);
+    free(sigma);
+    free(symbols);
+    free(rank);
+    free(in_sigma);
+    free(count);
+    free(by_rank);
+    free(edges);
+    free(fill);
+    free(srcs);
+    free(live);
+    free(universal);
+    free(canon);
+    free(queue);
+    fa_index_destroy(index);
+    return result;
+}
+
+
+// ============================================================================
+// Hopcroft minimization
+// ============================================================================
+
+/*
+ * Hopcroft's algorithm on the trimmed, partial DFA, in the formulation of
+ * Valmari and Lehtinen: states of a block are contiguous in `elems` and
+ * marking moves a state into the marked prefix of its block, so a block is
+ * split in time proportional to its marked part. A split always gives the
+ * new id to the smaller half, which makes "every block id not yet
+ * processed" the waiting set of Hopcroft's algorithm.
+ *
+ * Missing transitions are handled without a sink: dead states are trimmed
+ * first, and the partition is split once by the domain of every symbol
+ * (the predecessors of the whole state set), which is the splitter a
+ * complete DFA gets for free.
+ */
+typedef struct hop_partition {
+    int *elems;                 // states grouped by block
+    int *loc;                   // state -> position in elems
+    int *block;                 // state -> block id
+    int *first;                 // block -> first position
+    int *end;                   // block -> one past its last position
+    int *mid;                   // block -> end of the marked prefix
+    size_t nblocks;
+    int *touched;               // blocks with a marked state
+    size_t ntouched;
+} hop_partition;
+
+typedef struct hop_pred {
+    int sym;
+    int src;
+} hop_pred;
+
+static void hop_mark(hop_partition *p, int s) {
+    int b = p->block[s];
+    int i = p->loc[s];
+    if (i < p->mid[b]) return;
+
+    int j = p->mid[b]++;
+    int other = p->elems[j];
+    p->elems[j] = s;
+    p->loc[s] = j;
+    p->elems[i] = other;
+    p->loc[other] = i;
+    if (j == p->first[b]) p->touched[p->ntouched++] = b;
+}
+
+static void hop_split(hop_partition *p) {
+    for (size_t t = 0; t < p->ntouched; t++) {
+        int b = p->touched[t];
+        int m = p->mid[b];
+        p->mid[b] = p->first[b];
+        if (m == p->end[b]) continue;
+
+        int nb = (int)p->nblocks++;
+        if (m - p->first[b] <= p->end[b] - m) {
+            p->first[nb] = p->first[b];
+            p->end[nb] = m;
+            p->first[b] = m;
+        } else {
+            p->first[nb] = m;
+            p->end[nb] = p->end[b];
+            p->end[b] = m;
+        }
+        p->mid[nb] = p->first[nb];
+        p->mid[b] = p->first[b];
+        for (int i = p->first[nb]; i < p->end[nb]; i++) p->block[p->elems[i]] = nb;
+    }
+    p->ntouched = 0;
+}
+
+static int hop_compare_preds(const void *x, const void *y) {
+    const hop_pred *a = x, *b = y;
+    return (a->sym > b->sym) - (a->sym < b->sym);
+}
+
+/* Ranks symbol ids by symbol text so the output does not depend on interning order. */
+static int *hop_symbol_ranks(const fa_symtab *symtab) {
+    size_t n = symtab->count;
+    int *order = malloc((n ? n : 1) * sizeof(int));
+    int *rank = malloc((n ? n : 1) * sizeof(int));
+    if (!order || !rank) {
+        free(order);
+        free(rank);
+        return NULL;
+    }
+    for (size_t i = 0; i < n; i++) order[i] = (int)i;
+    // Insertion sort: alphabets are small
+    for (size_t i = 1; i < n; i++) {
+        int id = order[i];
+        size_t j = i;
+        while (j > 0 && strcmp(symtab->symbols[order[j - 1]], symtab->symbols[id]) > 0) {
+            order[j] = order[j - 1];
+            j--;
+        }
+        order[j] = id;
+    }
+    for (size_t i = 0; i < n; i++) rank[order[i]] = (int)i;
+    free(order);
+    return rank;
+}
+
+/*
+ * Returns a row of the states reachable from the start (forward) that can
+ * also reach an accept state (backward), or NULL on allocation failure.
+ */
+static uint64_t* hop_useful_states(const fa_index *index, int start) {
+    size_t n = index->nstates;
+    size_t words = BITSET_WORDS(n) ? BITSET_WORDS(n) : 1;
+    uint64_t *forward = calloc(words, sizeof(uint64_t));
+    uint64_t *useful = calloc(words, sizeof(uint64_t));
+    int *stack = malloc((n ? n : 1) * sizeof(int));
+    fa_index_reverse *reverse = fa_index_reverse_build(index);
+    if (!forward || !useful || !stack || !reverse) goto fail;
+
+    size_t top = 0;
+    bitset_words_add(forward, (size_t)start);
+    stack[top++] = start;
+    while (top) {
+        int s = stack[--top];
+        for (size_t e = index->offsets[s]; e < index->offsets[s + 1]; e++) {
+            int d = index->dests[e];
+            if (!bitset_words_contains(forward, (size_t)d)) {
+                bitset_words_add(forward, (size_t)d);
+                stack[top++] = d;
+            }
+        }
+    }
+
+    // Backward over the reversed edges, from the accept states
+    for (size_t s = 0; s < n; s++) {
+        if (index->flags[s] & FA_INDEX_ACCEPT) {
+            bitset_words_add(useful, s);
+            stack[top++] = (int)s;
+        }
+    }
+    while (top) {
+        int s = stack[--top];
+        for (size_t e = reverse->offsets[s]; e < reverse->offsets[s + 1]; e++) {
+            int q = reverse->srcs[e];
+            if (!bitset_words_contains(useful, (size_t)q)) {
+                bitset_words_add(useful, (size_t)q);
+                stack[top++] = q;
+            }
+        }
+    }
+
+    bitset_words_and(useful, forward, words);
+    free(forward);
+    free(stack);
+    fa_index_reverse_destroy(reverse);
+    return useful;
+
+fail:
+    free(forward);
+    free(useful);
+    free(stack);
+    fa_index_reverse_destroy(reverse);
+    return NULL;
+}
+
+fa_auto* fa_auto_minimize_hopcroft(const fa_auto *automaton){
+    if (!automaton) return NULL;
+
+    if (automaton->sink_accepts) {
+        // Trimming would drop states that only accept through the implicit
+        // sink; minimize the complement, whose sink rejects, and flip it back
+        fa_auto *flipped = fa_auto_complement(automaton);
+        fa_auto *minimal = flipped ? fa_auto_minimize_hopcroft(flipped) : NULL;
+        fa_auto *result = minimal ? fa_auto_complement(minimal) : NULL;
+        fa_auto_destroy(flipped);
+        fa_auto_destroy(minimal);
+        return result;
+    }
+
+    fa_index *index = fa_index_build(automaton, NULL);
+    if (!index) return NULL;
+
+    if (!fa_index_is_deterministic(index)) {
+        fa_index_destroy(index);
+        fa_auto *dfa = fa_auto_determinize(automaton, FA_DETERMINIZE_DEFAULT);
+        fa_auto *minimal = dfa ? fa_auto_minimize_hopcroft(dfa) : NULL;
+        fa_auto_destroy(dfa);
+        return minimal;
+    }
+
+    size_t n = index->nstates;
+    int start = -1;
+    for (size_t s = 0; s < n; s++) {
+        if (index->flags[s] & FA_INDEX_START) start = (int)s;
+    }
+
+    hop_partition p = { 0 };
+    uint64_t *useful = NULL;
+    int *rank = NULL, *by_rank = NULL, *block_id = NULL, *queue = NULL;
+    size_t *inv_off = NULL;
+    hop_pred *inv = NULL, *buf = NULL;
+    fa_builder builder;
+    bool built = fa_builder_init(&builder, 16, 32);
+    fa_auto *result = NULL;
+
+    if (!built) goto cleanup;
+    useful = start >= 0 ? hop_useful_states(index, start) : NULL;
+    if (start < 0 || !useful || !bitset_words_contains(useful, (size_t)start)) {
+        // Empty language: a single rejecting start state
+        if (start >= 0 && !useful) goto cleanup;
+        if (fa_builder_add_state(&builder, FA_INDEX_START) < 0) goto cleanup;
+        result = fa_builder_emit(&builder, index->symtab, automaton->alphabet, NULL, NULL);
+        goto cleanup;
+    }
+
+    size_t nn = n ? n : 1;
+    p.elems = malloc(nn * sizeof(int));
+    p.loc = malloc(nn * sizeof(int));
+    p.block = malloc(nn * sizeof(int));
+    p.first = malloc(nn * sizeof(int));
+    p.end = malloc(nn * sizeof(int));
+    p.mid = malloc(nn * sizeof(int));
+    p.touched = malloc(nn * sizeof(int));
+    inv_off = calloc(n + 1, sizeof(size_t));
+    inv = malloc((index->nedges ? index->nedges : 1) * sizeof(hop_pred));
+    buf = malloc((index->nedges ? index->nedges : 1) * sizeof(hop_pred));
+    rank = hop_symbol_ranks(index->symtab);
+    by_rank = malloc((index->symtab->count ? index->symtab->count : 1) * sizeof(int));
+    if (!by_rank || !p.elems || !p.loc || !p.block || !p.first || !p.end || !p.mid || !p.touched ||
+        !inv_off || !inv || !buf || !rank) {
+        goto cleanup;
+    }
+
+    for (size_t i = 0; i < index->symtab->count; i++) by_rank[rank[i]] = (int)i;
+
+    // One block with every useful state
+    int count = 0;
+    for (size_t s = 0; s < n; s++) {
+        p.block[s] = 0;
+        if (!bitset_words_contains(useful, s)) continue;
+        p.loc[s] = count;
+        p.elems[count++] = (int)s;
+    }
+    p.first[0] = p.mid[0] = 0;
+    p.end[0] = count;
+    p.nblocks = 1;
+
+    // Predecessors of each state restricted to useful edges
+    for (size_t s = 0; s < n; s++) {
+        if (!bitset_words_contains(useful, s)) continue;
+        for (size_t e = index->offsets[s]; e < index->offsets[s + 1]; e++) {
+            int d = index->dests[e];
+            if (bitset_words_contains(useful, (size_t)d)) inv_off[d + 1]++;
+        }
+    }
+    for (size_t s = 0; s < n; s++) inv_off[s + 1] += inv_off[s];
+    for (size_t s = 0; s < n; s++) {
+        if (!bitset_words_contains(useful, s)) continue;
+        for (size_t e = index->offsets[s]; e < index->offsets[s + 1]; e++) {
+            int d = index->dests[e];
+            if (!bitset_words_contains(useful, (size_t)d)) continue;
+            inv[inv_off[d]++] = (hop_pred){ index->syms[e], (int)s };
+        }
+    }
+    for (size_t s = n; s > 0; s--) inv_off[s] = inv_off[s - 1];
+    inv_off[0] = 0;
+
+    // Initial split by acceptance, then by the domain of every symbol
+    for (int i = 0; i < count; i++) {
+        if (index->flags[p.elems[i]] & FA_INDEX_ACCEPT) hop_mark(&p, p.elems[i]);
+    }
+    hop_split(&p);
+
+    size_t nbuf = 0;
+    for (size_t s = 0; s < n; s++) {
+        if (!bitset_words_contains(useful, s)) continue;
+        for (size_t e = inv_off[s]; e < inv_off[s + 1]; e++) buf[nbuf++] = inv[e];
+    }
+
+    // The first splitter is the whole state set, then every block but 0,
+    // which keeps the larger half of each split
+    for (size_t next = 1;; next++) {
+        if (nbuf > 1) qsort(buf, nbuf, sizeof(hop_pred), hop_compare_preds);
+        for (size_t i = 0; i < nbuf;) {
+            size_t j = i;
+            while (j < nbuf && buf[j].sym == buf[i].sym) hop_mark(&p, buf[j++].src);
+            hop_split(&p);
+            i = j;
+        }
+
+        if (next >= p.nblocks) break;
+        nbuf = 0;
+        for (int i = p.first[next]; i < p.end[next]; i++) {
+            int t = p.elems[i];
+            for (size_t e = inv_off[t]; e < inv_off[t + 1]; e++) buf[nbuf++] = inv[e];
+        }
+    }
+
+    // Emit the quotient in BFS order from the start block, symbols by text
+    block_id = malloc(p.nblocks * sizeof(int));
+    queue = malloc(p.nblocks * sizeof(int));
+    if (!block_id || !queue) goto cleanup;
+    for (size_t b = 0; b < p.nblocks; b++) block_id[b] = -1;
+
+    size_t head = 0, tail = 0;
+    int sb = p.block[start];
+    block_id[sb] = fa_builder_add_state(&builder, FA_INDEX_START | (index->flags[start] & FA_INDEX_ACCEPT));
+    if (block_id[sb] < 0) goto cleanup;
+    queue[tail++] = sb;
+
+    while (head < tail) {
+        int b = queue[head++];
+        int rep = p.elems[p.first[b]];
+
+        nbuf = 0;
+        for (size_t e = index->offsets[rep]; e < index->offsets[rep + 1]; e++) {
+            int d = index->dests[e];
+            if (bitset_words_contains(useful, (size_t)d)) buf[nbuf++] = (hop_pred){ rank[index->syms[e]], d };
+        }
+        if (nbuf > 1) qsort(buf, nbuf, sizeof(hop_pred), hop_compare_preds);
+
+        for (size_t i = 0; i < nbuf; i++) {
+            int db = p.block[buf[i].src];
+            if (block_id[db] < 0) {
+                int drep = p.elems[p.first[db]];
+                block_id[db] = fa_builder_add_state(&builder, index->flags[drep] & FA_INDEX_ACCEPT);
+                if (block_id[db] < 0) goto cleanup;
+                queue[tail++] = db;
+            }
+            if (!fa_builder_add_edge(&builder, block_id[b], by_rank[buf[i].sym], block_id[db])) goto cleanup;
+        }
+    }
+
+    result = fa_builder_emit(&builder, index->symtab, automaton->alphabet, NULL, NULL);
+
+cleanup:
+    if (built) fa_builder_free(&builder);
+    free(p.elems);
+    free(p.loc);
+    free(p.block);
+    free(p.first);
+    free(p.end);
+    free(p.mid);
+    free(p.touched);
+    free(useful);
+    free(rank);
+    free(by_rank);
+    free(inv_off);
+    free(inv);
+    free(buf);
+    free(block_id);
+    free(queue);
+    fa_index_destroy(index);
+    return result;
 }
 
+
 fa_auto* fa_auto_optimize(fa_auto* automaton, fa_minimize_algorithm min_algo, fa_determinize_algorithm det_algo){
     if (!automaton) {
         return NULL;
@@ -797,80 +4420,208 @@ fa_auto* fa_auto_optimize(fa_auto* automaton, fa_minimize_algorithm min_algo, fa
 }
 
 
+/* Operations requested after the meter runs out are skipped. */
+static fa_operation_results* compose_run(const fa_auto* a, const fa_auto* b,
+                                         fa_operation_flags flags, op_meter *meter) {
+    fa_operation_results* results = calloc(1, sizeof(fa_operation_results));
+    if (!results) {
+        return NULL;
+    }
+
+    results->success = true;
+    results->performed_ops = 0;
+
+    // Validate inputs for binary operations
+    if ((flags & FA_OP_ALL_BINARY) && (!a || !b)) {
+        strcpy(results->error_message, "Binary operations require both automata");
+        results->success = false;
+        return results;
+    }
+
+    // Validate for unary operations (only need A)
+    if ((flags & FA_OP_ALL_UNARY) && !a) {
+        strcpy(results->error_message, "Unary operations require at least one automaton");
+        results->success = false;
+        return results;
+    }
+
+    // Union, intersection, difference and symmetric difference all walk the
+    // same product graph; when more than one is asked for, explore it once
+    // and only re-mark the accepting pairs for each
+    static const struct {
+        fa_operation_flags op;
+        product_kind kind;
+    } product_ops[] = {
+        { FA_OP_UNION,          PRODUCT_UNION },
+        { FA_OP_INTERSECTION,   PRODUCT_INTERSECTION },
+        { FA_OP_DIFFERENCE,     PRODUCT_DIFFERENCE },
+        { FA_OP_SYMMETRIC_DIFF, PRODUCT_SYMMETRIC_DIFF },
+    };
+    fa_auto** product_slots[] = {
+        &results->union_result,
+        &results->intersection_result,
+        &results->difference_result,
+        &results->symmetric_difference_result,
+    };
+
+    product_kind kinds[4];
+    fa_auto* products[4];
+    size_t slots[4];
+    size_t nkinds = 0;
+    for (size_t i = 0; i < 4; i++) {
+        if (flags & product_ops[i].op) {
+            kinds[nkinds] = product_ops[i].kind;
+            slots[nkinds++] = i;
+        }
+    }
+
+    if (nkinds == 1) {
+        // A lone union does not need determinized operands
+        *product_slots[slots[0]] = compose_single_result(a, b, product_ops[slots[0]].op, meter);
+    } else if (nkinds > 1 && product_build_many(a, b, kinds, nkinds, meter, products)) {
+        for (size_t k = 0; k < nkinds; k++) *product_slots[slots[k]] = products[k];
+    }
+    for (size_t i = 0; i < 4; i++) {
+        if (*product_slots[i]) results->performed_ops |= product_ops[i].op;
+    }
+
+    if ((flags & FA_OP_CONCATENATION) && meter_ok(meter)) {
+        results->concatenation_result = fa_auto_concat(a, b);
+        if (results->concatenation_result) results->performed_ops |= FA_OP_CONCATENATION;
+    }
+
+    // Unary operations (only use A)
+    if ((flags & FA_OP_COMPLEMENT) && meter_ok(meter)) {
+        results->complement_result = complement_run(a, meter);
+        if (results->complement_result) results->performed_ops |= FA_OP_COMPLEMENT;
+    }
+
+    if ((flags & FA_OP_REVERSE) && meter_ok(meter)) {
+        results->reverse_result = fa_auto_reverse(a);
+        if (results->reverse_result) results->performed_ops |= FA_OP_REVERSE;
+    }
+
+    if ((flags & FA_OP_KLEENE_STAR) && meter_ok(meter)) {
+        results->kleene_star_result = fa_auto_kleene((fa_auto*)a, FA_KLEENE_STAR);
+        if (results->kleene_star_result) results->performed_ops |= FA_OP_KLEENE_STAR;
+    }
+
+    if ((flags & FA_OP_MINIMIZE) && meter_ok(meter)) {
+        results->minimized_result = minimize_run(a, FA_MINIMIZE_FAST, meter);
+        if (results->minimized_result) results->performed_ops |= FA_OP_MINIMIZE;
+    }
+
+    if ((flags & FA_OP_DETERMINIZE) && meter_ok(meter)) {
+        results->determinized_result = det_run(a, FA_DETERMINIZE_DEFAULT, meter);
+        if (results->determinized_result) results->performed_ops |= FA_OP_DETERMINIZE;
+    }
+
+    if (!meter_ok(meter)) {
+        strcpy(results->error_message, "Resource budget exceeded");
+        results->success = false;
+    }
+    return results;
+}
+
 fa_operation_results* fa_auto_compose(const fa_auto* a, const fa_auto* b, 
                                      fa_operation_flags flags) {
-    
-    // fa_operation_results* results = calloc(1, sizeof(fa_operation_results));
-    // if (!results) {
-    //     return NULL;
-    // }
-    
-    // results->success = true;
-    // results->performed_ops = 0;
-    
-    // // Validate inputs for binary operations
-    // if ((flags & FA_OP_ALL_BINARY) && (!a || !b)) {
-    //     strcpy(results->error_message, "Binary operations require both automata");
-    //     results->success = false;
-    //     return results;
-    // }
-    
-    // // Validate for unary operations (only need A)
-    // if ((flags & FA_OP_ALL_UNARY) && !a) {
-    //     strcpy(results->error_message, "Unary operations require at least one automaton");
-    //     results->success = false;
-    //     return results;
-    // }
-    
-    // // Execute requested operations
-    // if (flags & FA_OP_UNION) {
-    //     results->union_result = fa_auto_union(a, b);
-    //     if (results->union_result) results->performed_ops |= FA_OP_UNION;
-    // }
-    
-    // if (flags & FA_OP_INTERSECTION) {
-    //     results->intersection_result = fa_auto_intersection(a, b);
-    //     if (results->intersection_result) results->performed_ops |= FA_OP_INTERSECTION;
-    // }
-    
-    
-    
-    
-    // if (flags & FA_OP_CONCATENATION) {
-    //     results->concatenation_result = fa_auto_concatenation(a, b);
-    //     if (results->concatenation_result) results->performed_ops |= FA_OP_CONCATENATION;
-    // }
-    
-    // // Unary operations (only use A)
-    // if (flags & FA_OP_COMPLEMENT) {
-    //     results->complement_result = fa_auto_complement(a);
-    //     if (results->complement_result) results->performed_ops |= FA_OP_COMPLEMENT;
-    // }
-    
-    // if (flags & FA_OP_REVERSE) {
-    //     results->reverse_result = fa_auto_reverse(a);
-    //     if (results->reverse_result) results->performed_ops |= FA_OP_REVERSE;
-    // }
-    
+    return compose_run(a, b, flags, NULL);
+}
 
-    
-    // if (flags & FA_OP_MINIMIZE) {
-    //     results->minimized_result = fa_auto_minimize(a, FA_MINIMIZE_FAST);
-    //     if (results->minimized_result) results->performed_ops |= FA_OP_MINIMIZE;
-    // }
-    
-    // if (flags & FA_OP_DETERMINIZE) {
-    //     results->determinized_result = fa_auto_determinize(a);
-    //     if (results->determinized_result) results->performed_ops |= FA_OP_DETERMINIZE;
-    // }
-    
-    // return results;
+fa_operation_results* fa_auto_compose_budget(const fa_auto* a, const fa_auto* b,
+                                            fa_operation_flags flags, fa_budget* budget,
+                                            fa_error_t* error){
+    op_meter storage;
+    op_meter *meter = meter_begin(&storage, budget);
+    fa_operation_results *results = compose_run(a, b, flags, meter);
+    fa_error_t status = meter_end(meter, !results ? FA_ERR_OUT_OF_MEMORY :
+                                  results->success ? FA_SUCCESS : FA_ERR_NULL_ARGUMENT);
+    if (error) *error = status;
+    return results;
 }
 
 
 
-fa_operation_results* fa_auto_stack_compose(fa_stack* stack, 
-                                           fa_operation_flags flags, fa_composition_mode mode) {
+// ============================================================================
+// Stack reduction
+// ============================================================================
+
+/*
+ * Operands are combined pairwise, level by level: (x0 op x1), (x2 op x3), ...
+ * An odd operand out is carried to the next level unchanged. Adjacent pairs
+ * keep operand order, so any associative operation (union, intersection,
+ * symmetric difference, concatenation) accepts the same language as a
+ * sequential fold, while intermediates are copied O(log N) times instead of
+ * O(N). The pairs of a level are independent and can run on worker threads.
+ */
+typedef struct stack_level {
+    fa_auto **in;
+    fa_auto **out;
+    fa_operation_flags op;
+    op_meter *meter;
+    atomic_bool failed;
+} stack_level;
+
+static void stack_level_pairs(void *arg, size_t worker, size_t begin, size_t end) {
+    stack_level *level = arg;
+    (void)worker;
+
+    for (size_t i = begin; i < end; i++) {
+        fa_auto *a = level->in[2 * i];
+        fa_auto *b = level->in[2 * i + 1];
+        fa_auto *result = NULL;
+        if (!atomic_load_explicit(&level->failed, memory_order_relaxed)) {
+            result = compose_single_result(a, b, level->op, level->meter);
+            if (!result) atomic_store_explicit(&level->failed, true, memory_order_relaxed);
+        }
+        fa_auto_destroy(a);
+        fa_auto_destroy(b);
+        level->out[i] = result;
+    }
+}
+
+/* Reduces items[0..count) with `op`, consuming every operand. */
+static fa_auto* stack_reduce(fa_auto **items, size_t count, fa_operation_flags op,
+                             size_t nworkers, op_meter *meter) {
+    fa_auto **scratch = count > 1 ? malloc((count / 2 + 1) * sizeof(fa_auto*)) : NULL;
+    if (count > 1 && !scratch) {
+        for (size_t i = 0; i < count; i++) fa_auto_destroy(items[i]);
+        return NULL;
+    }
+
+    stack_level level;
+    level.in = items;
+    level.out = scratch;
+    level.op = op;
+    level.meter = meter;
+    atomic_init(&level.failed, false);
+
+    while (count > 1) {
+        size_t npairs = count / 2;
+        // Small chunks balance the few, large pairs near the root
+        size_t grain = npairs / (nworkers * 8) + 1;
+        fa_parallel_for(npairs, nworkers, grain, stack_level_pairs, &level);
+        if (count & 1) level.out[npairs] = level.in[count - 1];
+        count = npairs + (count & 1);
+
+        fa_auto **swap = level.in;
+        level.in = level.out;
+        level.out = swap;
+
+        if (atomic_load(&level.failed)) {
+            for (size_t i = 0; i < count; i++) fa_auto_destroy(level.in[i]);
+            free(scratch);
+            return NULL;
+        }
+    }
+
+    fa_auto *result = level.in[0];
+    free(scratch);
+    return result;
+}
+
+static fa_operation_results* stack_compose_run(fa_stack* stack, fa_operation_flags flags,
+                                               fa_composition_mode mode, op_meter *meter) {
     if (!stack || fa_stack_is_empty(stack)) {
         return NULL;
     }
@@ -878,39 +4629,45 @@ fa_operation_results* fa_auto_stack_compose(fa_stack* stack,
     // For single automaton, apply unary operations
     if (fa_stack_size(stack) == 1) {
         fa_auto* single = fa_stack_peek(stack);
-        return fa_auto_compose(single, NULL, flags & FA_OP_ALL_UNARY);
+        return compose_run(single, NULL, flags & FA_OP_ALL_UNARY, meter);
     }
-    
-    // Reduce stack by repeatedly composing top two automata
-    while (fa_stack_size(stack) > 1) {
-        fa_auto* b = fa_stack_pop(stack);
-        fa_auto* a = fa_stack_pop(stack);
-        
-        if (!a || !b) {
-            if (a) fa_stack_push(stack, a);
-            if (b) fa_auto_destroy(b);
-            continue;
-        }
-        
-        // Compose a and b, get single result for binary operation
-        fa_auto* result = compose_single_result(a, b, flags);
-        
-        // Clean up inputs
-        fa_auto_destroy(a);
-        fa_auto_destroy(b);
-        
-        // Push result back onto stack
-        if (result) {
-            fa_stack_push(stack, result);
-        } else {
-            // Composition failed, cleanup and return NULL
-            fa_stack_clear(stack);
-            return NULL;
+
+    // The bottom of the stack is the first operand
+    fa_auto** items = malloc((size_t)fa_stack_size(stack) * sizeof(fa_auto*));
+    if (!items) return NULL;
+    size_t count = 0;
+    for (int i = 0; i <= stack->top; i++) {
+        if (stack->items[i]) items[count++] = stack->items[i];
+    }
+    fa_stack_clear(stack);
+
+    fa_operation_flags op = compose_binary_op(flags);
+    size_t nworkers = (mode & FA_OP_PARALLEL) ? fa_parallel_workers() : 1;
+    fa_auto* final_result = NULL;
+
+    if (count == 0) {
+        // Only NULL entries; nothing to compose
+    } else if (op != FA_OP_DIFFERENCE) {
+        final_result = stack_reduce(items, count, op, nworkers, meter);
+    } else if (mode & FA_OP_RIGHT_ASSOCIATIVE) {
+        // x0 - (x1 - (x2 - ...)) does not regroup; fold from the right
+        final_result = items[count - 1];
+        for (size_t i = count - 1; i-- > 0;) {
+            fa_auto* next = final_result ? product_build(items[i], final_result, PRODUCT_DIFFERENCE, meter) : NULL;
+            fa_auto_destroy(items[i]);
+            fa_auto_destroy(final_result);
+            final_result = next;
         }
+    } else if (count == 1) {
+        final_result = items[0];
+    } else {
+        // ((x0 - x1) - x2) - ... = x0 - (x1 ∪ x2 ∪ ...)
+        fa_auto* rest = stack_reduce(items + 1, count - 1, FA_OP_UNION, nworkers, meter);
+        if (rest) final_result = product_build(items[0], rest, PRODUCT_DIFFERENCE, meter);
+        fa_auto_destroy(items[0]);
+        fa_auto_destroy(rest);
     }
-    
-    // Final result is on stack
-    fa_auto* final_result = fa_stack_pop(stack);
+    free(items);
     if (!final_result) return NULL;
     
     // Create operation results containing just the final automaton
@@ -921,25 +4678,37 @@ fa_operation_results* fa_auto_stack_compose(fa_stack* stack,
     }
     
     results->success = true;
-    results->performed_ops = flags;
+    results->performed_ops = op;
     
     // Store in appropriate field based on operation type
-    if (flags & FA_OP_UNION) {
-        results->union_result = final_result;
-    } else if (flags & FA_OP_INTERSECTION) {
-        results->intersection_result = final_result;
-    } else if (flags & FA_OP_DIFFERENCE) {
-        results->difference_result = final_result;
-    } else if (flags & FA_OP_CONCATENATION) {
-        results->concatenation_result = final_result;
-    } else {
-        // Default to union if no specific binary operation
-        results->union_result = final_result;
+    switch (op) {
+        case FA_OP_INTERSECTION:   results->intersection_result = final_result; break;
+        case FA_OP_DIFFERENCE:     results->difference_result = final_result; break;
+        case FA_OP_SYMMETRIC_DIFF: results->symmetric_difference_result = final_result; break;
+        case FA_OP_CONCATENATION:  results->concatenation_result = final_result; break;
+        default:                   results->union_result = final_result; break;
     }
     
     return results;
 }
 
+fa_operation_results* fa_auto_stack_compose(fa_stack* stack, 
+                                           fa_operation_flags flags, fa_composition_mode mode) {
+    return stack_compose_run(stack, flags, mode, NULL);
+}
+
+fa_operation_results* fa_auto_stack_compose_budget(fa_stack* stack, fa_operation_flags flags,
+                                                  fa_composition_mode mode, fa_budget* budget,
+                                                  fa_error_t* error){
+    op_meter storage;
+    op_meter *meter = meter_begin(&storage, budget);
+    fa_operation_results *results = stack_compose_run(stack, flags, mode, meter);
+    fa_error_t status = meter_end(meter, results ? FA_SUCCESS :
+                                  stack ? FA_ERR_OUT_OF_MEMORY : FA_ERR_NULL_ARGUMENT);
+    if (error) *error = status;
+    return results;
+}
+
 
 fa_operation_results* fa_auto_ncompose(fa_operation_flags flags,
                                        fa_composition_mode mode, 
@@ -1,4 +1,5 @@
 #include "../../include/io/fa_auto_io.h"
+#include "../../include/fa/fa_operations.h"
 #include "../../include/fa_utils.h"
 #include <stdlib.h>
 #include <stdio.h>
@@ -51,6 +52,15 @@ fa_error_t fa_auto_export_dot_stream(const fa_auto* automaton, FILE* stream, con
         return FA_ERR_NULL_ARGUMENT;
     }
 
+    // A complement is exported with its implicit sink as a real state
+    if (automaton->sink_accepts) {
+        fa_auto* complete = fa_auto_materialize_sink(automaton);
+        if (!complete) return FA_ERR_OUT_OF_MEMORY;
+        fa_error_t result = fa_auto_export_dot_stream(complete, stream, style);
+        fa_auto_destroy(complete);
+        return result;
+    }
+
     fa_styles_dot_style_t default_style = FA_STYLES_DEFAULT_DOT_STYLE;
     const fa_styles_dot_style_t* cfg = style ? style : &default_style;
 
@@ -349,6 +359,15 @@ fa_error_t fa_auto_export_json_stream(const fa_auto* automaton, FILE* stream) {
         return FA_ERR_NULL_ARGUMENT;
     }
 
+    // A complement is exported with its implicit sink as a real state
+    if (automaton->sink_accepts) {
+        fa_auto* complete = fa_auto_materialize_sink(automaton);
+        if (!complete) return FA_ERR_OUT_OF_MEMORY;
+        fa_error_t result = fa_auto_export_json_stream(complete, stream);
+        fa_auto_destroy(complete);
+        return result;
+    }
+
     
     // Helper to write comma except for first item
     bool first_state = true;
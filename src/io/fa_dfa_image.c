@@ -0,0 +1,393 @@
+#include "../../include/io/fa_dfa_image.h"
+#include "../../include/fa/fa_index.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#ifdef FA_HAVE_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#define DFA_IMAGE_MAGIC "FADFAIMG"
+#define DFA_IMAGE_BYTE_ORDER 0x01020304u
+#define DFA_IMAGE_NONE UINT32_MAX
+#define DFA_IMAGE_SINK_ACCEPTS 0x1u  // a missing move accepts (complemented DFA)
+
+/*
+ * File layout, every array in native byte order:
+ *
+ *   dfa_image_header
+ *   uint32_t sym_offsets[nsymbols + 1]     into blob
+ *   char     blob[blob_size]               NUL-terminated symbols, padded to 4
+ *   uint32_t bytemap[256]                  byte -> single-byte symbol (or ASCII minterm) id or NONE
+ *   uint32_t state_offsets[nstates + 1]    CSR edge ranges
+ *   uint32_t edge_syms[nedges]             strictly increasing within a state
+ *   uint32_t edge_dests[nedges]
+ *   uint8_t  accept[nstates]
+ */
+typedef struct dfa_image_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint64_t tag[2];
+    uint32_t nstates;
+    uint32_t nsymbols;
+    uint32_t nedges;
+    uint32_t start;                     // DFA_IMAGE_NONE if there is no start state
+    uint32_t blob_size;
+    uint32_t flags;                     // DFA_IMAGE_SINK_ACCEPTS
+    uint32_t reserved[2];
+} dfa_image_header;
+
+struct fa_dfa_image {
+    unsigned char *data;
+    size_t size;
+    bool mapped;                        // data comes from mmap rather than malloc
+    const dfa_image_header *header;
+    const uint32_t *sym_offsets;
+    const char *blob;
+    const uint32_t *bytemap;
+    const uint32_t *state_offsets;
+    const uint32_t *edge_syms;
+    const uint32_t *edge_dests;
+    const uint8_t *accept;
+};
+
+
+/* Total file size for the given counts, or 0 if it does not fit. */
+static size_t dfa_image_size(uint64_t nstates, uint64_t nsymbols, uint64_t nedges, uint64_t blob_size) {
+    uint64_t size = sizeof(dfa_image_header)
+                  + 4 * (nsymbols + 1) + blob_size + 4 * 256
+                  + 4 * (nstates + 1) + 8 * nedges + nstates;
+    return size <= SIZE_MAX ? (size_t)size : 0;
+}
+
+/* Points the image's arrays into `data` and checks every invariant matching relies on. */
+static bool dfa_image_attach(fa_dfa_image *image) {
+    if (image->size < sizeof(dfa_image_header)) return false;
+
+    const dfa_image_header *h = (const dfa_image_header*)image->data;
+    if (memcmp(h->magic, DFA_IMAGE_MAGIC, sizeof(h->magic)) != 0 ||
+        h->version != FA_DFA_IMAGE_VERSION || h->byte_order != DFA_IMAGE_BYTE_ORDER ||
+        h->blob_size % 4 != 0 || (h->flags & ~DFA_IMAGE_SINK_ACCEPTS) != 0 ||
+        dfa_image_size(h->nstates, h->nsymbols, h->nedges, h->blob_size) != image->size) {
+        return false;
+    }
+
+    const unsigned char *p = image->data + sizeof(dfa_image_header);
+    image->header = h;
+    image->sym_offsets = (const uint32_t*)p;
+    p += 4 * ((size_t)h->nsymbols + 1);
+    image->blob = (const char*)p;
+    p += h->blob_size;
+    image->bytemap = (const uint32_t*)p;
+    p += 4 * 256;
+    image->state_offsets = (const uint32_t*)p;
+    p += 4 * ((size_t)h->nstates + 1);
+    image->edge_syms = (const uint32_t*)p;
+    p += 4 * (size_t)h->nedges;
+    image->edge_dests = (const uint32_t*)p;
+    p += 4 * (size_t)h->nedges;
+    image->accept = p;
+
+    if (image->sym_offsets[0] != 0) return false;
+    for (uint32_t i = 0; i < h->nsymbols; i++) {
+        uint32_t begin = image->sym_offsets[i], end = image->sym_offsets[i + 1];
+        if (end <= begin || end > h->blob_size || image->blob[end - 1] != '\0') return false;
+    }
+    for (int c = 0; c < 256; c++) {
+        if (image->bytemap[c] != DFA_IMAGE_NONE && image->bytemap[c] >= h->nsymbols) return false;
+    }
+
+    if (image->state_offsets[0] != 0 || image->state_offsets[h->nstates] != h->nedges) return false;
+    for (uint32_t s = 0; s < h->nstates; s++) {
+        uint32_t begin = image->state_offsets[s], end = image->state_offsets[s + 1];
+        if (end < begin || end > h->nedges || image->accept[s] > 1) return false;
+        for (uint32_t e = begin; e < end; e++) {
+            if (image->edge_syms[e] >= h->nsymbols || image->edge_dests[e] >= h->nstates) return false;
+            if (e > begin && image->edge_syms[e] <= image->edge_syms[e - 1]) return false;
+        }
+    }
+    return h->start == DFA_IMAGE_NONE || h->start < h->nstates;
+}
+
+
+fa_dfa_image* fa_dfa_image_create(const fa_auto* dfa, const uint64_t tag[2], fa_error_t* error) {
+    if (error) *error = FA_SUCCESS;
+    if (!dfa) {
+        if (error) *error = FA_ERR_NULL_ARGUMENT;
+        return NULL;
+    }
+
+    fa_index *index = fa_index_build(dfa, NULL);
+    if (!index) {
+        if (error) *error = FA_ERR_OUT_OF_MEMORY;
+        return NULL;
+    }
+    if (!fa_index_is_deterministic(index)) {
+        if (error) *error = FA_ERR_NOT_DETERMINISTIC;
+        fa_index_destroy(index);
+        return NULL;
+    }
+
+    const fa_symtab *symtab = index->symtab;
+    uint64_t blob_size = 0;
+    for (size_t i = 0; i < symtab->count; i++) blob_size += strlen(symtab->symbols[i]) + 1;
+    blob_size = (blob_size + 3) & ~(uint64_t)3;
+
+    size_t size = 0;
+    if (index->nstates < DFA_IMAGE_NONE && symtab->count < DFA_IMAGE_NONE &&
+        index->nedges < DFA_IMAGE_NONE && blob_size < DFA_IMAGE_NONE) {
+        size = dfa_image_size(index->nstates, symtab->count, index->nedges, blob_size);
+    }
+
+    fa_dfa_image *image = calloc(1, sizeof(fa_dfa_image));
+    unsigned char *data = size ? calloc(1, size) : NULL;
+    if (!image || !data) {
+        if (error) *error = size ? FA_ERR_OUT_OF_MEMORY : FA_ERR_INVALID_ARGUMENT;
+        free(image);
+        free(data);
+        fa_index_destroy(index);
+        return NULL;
+    }
+
+    dfa_image_header *h = (dfa_image_header*)data;
+    memcpy(h->magic, DFA_IMAGE_MAGIC, sizeof(h->magic));
+    h->version = FA_DFA_IMAGE_VERSION;
+    h->byte_order = DFA_IMAGE_BYTE_ORDER;
+    if (tag) {
+        h->tag[0] = tag[0];
+        h->tag[1] = tag[1];
+    }
+    h->nstates = (uint32_t)index->nstates;
+    h->nsymbols = (uint32_t)symtab->count;
+    h->nedges = (uint32_t)index->nedges;
+    h->blob_size = (uint32_t)blob_size;
+    h->flags = index->sink_accepts ? DFA_IMAGE_SINK_ACCEPTS : 0;
+    h->start = DFA_IMAGE_NONE;
+
+    unsigned char *p = data + sizeof(dfa_image_header);
+    uint32_t *sym_offsets = (uint32_t*)p;
+    p += 4 * (symtab->count + 1);
+    char *blob = (char*)p;
+    p += blob_size;
+    uint32_t *bytemap = (uint32_t*)p;
+    p += 4 * 256;
+    uint32_t *state_offsets = (uint32_t*)p;
+    p += 4 * (index->nstates + 1);
+    uint32_t *edge_syms = (uint32_t*)p;
+    p += 4 * index->nedges;
+    uint32_t *edge_dests = (uint32_t*)p;
+    p += 4 * index->nedges;
+    uint8_t *accept = p;
+
+    uint32_t used = 0;
+    for (int c = 0; c < 256; c++) bytemap[c] = DFA_IMAGE_NONE;
+    for (size_t i = 0; i < symtab->count; i++) {
+        size_t length = strlen(symtab->symbols[i]);
+        sym_offsets[i] = used;
+        memcpy(blob + used, symtab->symbols[i], length + 1);
+        used += (uint32_t)(length + 1);
+        if (length == 1) bytemap[(unsigned char)symtab->symbols[i][0]] = (uint32_t)i;
+
+        // Minterms of interval labels read their ASCII characters
+        fa_range range;
+        if (length > 1 && fa_symtab_range(symtab, (int)i, &range)) {
+            for (uint32_t c = range.lo; c <= range.hi && c < 0x80; c++) bytemap[c] = (uint32_t)i;
+        }
+    }
+    sym_offsets[symtab->count] = used;
+
+    // fa_index keeps each state's edges sorted by symbol id already
+    for (size_t s = 0; s < index->nstates; s++) {
+        state_offsets[s] = (uint32_t)index->offsets[s];
+        accept[s] = (index->flags[s] & FA_INDEX_ACCEPT) != 0;
+        if (index->flags[s] & FA_INDEX_START) h->start = (uint32_t)s;
+    }
+    state_offsets[index->nstates] = (uint32_t)index->nedges;
+    for (size_t e = 0; e < index->nedges; e++) {
+        edge_syms[e] = (uint32_t)index->syms[e];
+        edge_dests[e] = (uint32_t)index->dests[e];
+    }
+    fa_index_destroy(index);
+
+    image->data = data;
+    image->size = size;
+    if (!dfa_image_attach(image)) {
+        if (error) *error = FA_ERR_INTERNAL;
+        fa_dfa_image_close(image);
+        return NULL;
+    }
+    return image;
+}
+
+fa_error_t fa_dfa_image_save(const fa_dfa_image* image, const char* path) {
+    if (!image || !path) return FA_ERR_NULL_ARGUMENT;
+
+    FILE *file = fopen(path, "wb");
+    if (!file) return FA_ERR_IO_FILE_OPEN;
+
+    bool ok = fwrite(image->data, 1, image->size, file) == image->size;
+    ok = fclose(file) == 0 && ok;
+    if (!ok) {
+        remove(path);
+        return FA_ERR_IO_WRITE_FAILED;
+    }
+    return FA_SUCCESS;
+}
+
+fa_dfa_image* fa_dfa_image_load(const char* path, fa_error_t* error) {
+    if (error) *error = FA_SUCCESS;
+    if (!path) {
+        if (error) *error = FA_ERR_NULL_ARGUMENT;
+        return NULL;
+    }
+
+    fa_dfa_image *image = calloc(1, sizeof(fa_dfa_image));
+    if (!image) {
+        if (error) *error = FA_ERR_OUT_OF_MEMORY;
+        return NULL;
+    }
+
+#ifdef FA_HAVE_MMAP
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        if (error) *error = errno == ENOENT ? FA_ERR_IO_FILE_NOT_FOUND : FA_ERR_IO_FILE_OPEN;
+        free(image);
+        return NULL;
+    }
+
+    struct stat st;
+    void *data = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    if (data == MAP_FAILED) {
+        if (error) *error = FA_ERR_IO_READ_FAILED;
+        free(image);
+        return NULL;
+    }
+    image->data = data;
+    image->size = (size_t)st.st_size;
+    image->mapped = true;
+#else
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        if (error) *error = errno == ENOENT ? FA_ERR_IO_FILE_NOT_FOUND : FA_ERR_IO_FILE_OPEN;
+        free(image);
+        return NULL;
+    }
+
+    long length = -1;
+    if (fseek(file, 0, SEEK_END) == 0) length = ftell(file);
+    rewind(file);
+    image->data = length > 0 ? malloc((size_t)length) : NULL;
+    image->size = length > 0 ? (size_t)length : 0;
+    bool ok = image->data && fread(image->data, 1, image->size, file) == image->size;
+    fclose(file);
+    if (!ok) {
+        if (error) *error = FA_ERR_IO_READ_FAILED;
+        fa_dfa_image_close(image);
+        return NULL;
+    }
+#endif
+
+    if (!dfa_image_attach(image)) {
+        if (error) *error = FA_ERR_IO_INVALID_FORMAT;
+        fa_dfa_image_close(image);
+        return NULL;
+    }
+    return image;
+}
+
+void fa_dfa_image_close(fa_dfa_image* image) {
+    if (!image) return;
+#ifdef FA_HAVE_MMAP
+    if (image->mapped) {
+        munmap(image->data, image->size);
+        free(image);
+        return;
+    }
+#endif
+    free(image->data);
+    free(image);
+}
+
+bool fa_dfa_image_matches(const fa_dfa_image* image, const char* word) {
+    if (!image || !word || image->header->start == DFA_IMAGE_NONE) return false;
+
+    uint32_t state = image->header->start;
+    for (const unsigned char *p = (const unsigned char*)word; *p; p++) {
+        uint32_t sym = image->bytemap[*p];
+        if (sym == DFA_IMAGE_NONE) return false;
+
+        uint32_t lo = image->state_offsets[state], hi = image->state_offsets[state + 1];
+        while (lo < hi) {
+            uint32_t mid = lo + (hi - lo) / 2;
+            if (image->edge_syms[mid] < sym) lo = mid + 1;
+            else hi = mid;
+        }
+        if (lo == image->state_offsets[state + 1] || image->edge_syms[lo] != sym) {
+            // The implicit sink accepts the rest if it is all alphabet symbols
+            if (!(image->header->flags & DFA_IMAGE_SINK_ACCEPTS)) return false;
+            while (*++p) {
+                if (image->bytemap[*p] == DFA_IMAGE_NONE) return false;
+            }
+            return true;
+        }
+        state = image->edge_dests[lo];
+    }
+    return image->accept[state] != 0;
+}
+
+size_t fa_dfa_image_nstates(const fa_dfa_image* image) {
+    return image ? image->header->nstates : 0;
+}
+
+void fa_dfa_image_tag(const fa_dfa_image* image, uint64_t tag[2]) {
+    if (!image || !tag) return;
+    tag[0] = image->header->tag[0];
+    tag[1] = image->header->tag[1];
+}
+
+fa_auto* fa_dfa_image_to_auto(const fa_dfa_image* image) {
+    if (!image) return NULL;
+
+    const dfa_image_header *h = image->header;
+    fa_symtab *symtab = fa_symtab_create();
+    int *sym_ids = malloc(((size_t)h->nsymbols + 1) * sizeof(int));
+    fa_builder builder;
+    bool built = fa_builder_init(&builder, h->nstates, h->nedges);
+    fa_auto *automaton = NULL;
+
+    if (!symtab || !sym_ids || !built) goto cleanup;
+    for (uint32_t i = 0; i < h->nsymbols; i++) {
+        sym_ids[i] = fa_symtab_intern(symtab, image->blob + image->sym_offsets[i]);
+        if (sym_ids[i] < 0) goto cleanup;
+    }
+    for (uint32_t s = 0; s < h->nstates; s++) {
+        uint8_t flags = (image->accept[s] ? FA_INDEX_ACCEPT : 0) | (s == h->start ? FA_INDEX_START : 0);
+        if (fa_builder_add_state(&builder, flags) < 0) goto cleanup;
+    }
+    for (uint32_t s = 0; s < h->nstates; s++) {
+        for (uint32_t e = image->state_offsets[s]; e < image->state_offsets[s + 1]; e++) {
+            if (!fa_builder_add_edge(&builder, (int)s, sym_ids[image->edge_syms[e]],
+                                     (int)image->edge_dests[e])) {
+                goto cleanup;
+            }
+        }
+    }
+    automaton = fa_builder_emit(&builder, symtab, NULL, NULL, NULL);
+    if (automaton) automaton->sink_accepts = (h->flags & DFA_IMAGE_SINK_ACCEPTS) != 0;
+
+cleanup:
+    if (built) fa_builder_free(&builder);
+    free(sym_ids);
+    fa_symtab_destroy(symtab);
+    return automaton;
+}
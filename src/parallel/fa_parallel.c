@@ -0,0 +1,135 @@
+#include "../../include/parallel/fa_parallel.h"
+#include <stdlib.h>
+#include <stdatomic.h>
+
+#ifdef FA_HAVE_PTHREADS
+#include <unistd.h>
+#endif
+
+#define FA_PARALLEL_DEFAULT_GRAIN 16
+#define FA_PARALLEL_MAX_WORKERS 64
+
+
+bool fa_mutex_init(fa_mutex* mutex) {
+    if (!mutex) return false;
+#ifdef FA_HAVE_PTHREADS
+    return pthread_mutex_init(&mutex->handle, NULL) == 0;
+#else
+    mutex->unused = 0;
+    return true;
+#endif
+}
+
+void fa_mutex_lock(fa_mutex* mutex) {
+#ifdef FA_HAVE_PTHREADS
+    pthread_mutex_lock(&mutex->handle);
+#else
+    (void)mutex;
+#endif
+}
+
+void fa_mutex_unlock(fa_mutex* mutex) {
+#ifdef FA_HAVE_PTHREADS
+    pthread_mutex_unlock(&mutex->handle);
+#else
+    (void)mutex;
+#endif
+}
+
+void fa_mutex_destroy(fa_mutex* mutex) {
+#ifdef FA_HAVE_PTHREADS
+    if (mutex) pthread_mutex_destroy(&mutex->handle);
+#else
+    (void)mutex;
+#endif
+}
+
+
+size_t fa_parallel_workers(void) {
+#ifdef FA_HAVE_PTHREADS
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    if (n < 1) return 1;
+    if (n > FA_PARALLEL_MAX_WORKERS) return FA_PARALLEL_MAX_WORKERS;
+    return (size_t)n;
+#else
+    return 1;
+#endif
+}
+
+
+typedef struct {
+    fa_parallel_fn fn;
+    void* ctx;
+    size_t count;
+    size_t grain;
+    atomic_size_t next;
+} parallel_job;
+
+typedef struct {
+    parallel_job* job;
+    size_t worker;
+} parallel_worker;
+
+static void parallel_drain(parallel_job* job, size_t worker) {
+    for (;;) {
+        size_t begin = atomic_fetch_add(&job->next, job->grain);
+        if (begin >= job->count) break;
+
+        size_t end = begin + job->grain;
+        if (end > job->count) end = job->count;
+        job->fn(job->ctx, worker, begin, end);
+    }
+}
+
+#ifdef FA_HAVE_PTHREADS
+static void* parallel_thread_main(void* arg) {
+    parallel_worker* w = arg;
+    parallel_drain(w->job, w->worker);
+    return NULL;
+}
+#endif
+
+void fa_parallel_for(size_t count, size_t nworkers, size_t grain,
+                     fa_parallel_fn fn, void* ctx) {
+    if (!fn || count == 0) return;
+    if (grain == 0) grain = FA_PARALLEL_DEFAULT_GRAIN;
+
+    // No point in spawning more threads than there are chunks
+    size_t nchunks = (count + grain - 1) / grain;
+    if (nworkers > nchunks) nworkers = nchunks;
+    if (nworkers > FA_PARALLEL_MAX_WORKERS) nworkers = FA_PARALLEL_MAX_WORKERS;
+
+    parallel_job job;
+    job.fn = fn;
+    job.ctx = ctx;
+    job.count = count;
+    job.grain = grain;
+    atomic_init(&job.next, 0);
+
+#ifdef FA_HAVE_PTHREADS
+    if (nworkers > 1) {
+        pthread_t threads[FA_PARALLEL_MAX_WORKERS];
+        parallel_worker workers[FA_PARALLEL_MAX_WORKERS];
+        size_t spawned = 0;
+
+        // Worker 0 is the calling thread
+        for (size_t i = 1; i < nworkers; i++) {
+            workers[i].job = &job;
+            workers[i].worker = i;
+            if (pthread_create(&threads[i], NULL, parallel_thread_main, &workers[i]) != 0) {
+                break;
+            }
+            spawned = i;
+        }
+
+        parallel_drain(&job, 0);
+
+        for (size_t i = 1; i <= spawned; i++) {
+            pthread_join(threads[i], NULL);
+        }
+        return;
+    }
+#endif
+
+    parallel_drain(&job, 0);
+}
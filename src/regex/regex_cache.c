@@ -0,0 +1,395 @@
+#include "../../include/regex/regex_cache.h"
+#include "../../include/regex/regexpr.h"
+#include "../../include/fa/fa_operations.h"
+#include "../../include/parallel/fa_parallel.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdatomic.h>
+
+#ifdef FA_HAVE_MMAP
+#include <unistd.h>
+#endif
+
+/*
+ * Entries live in a fixed bucket array (chained through `chain`) and in a
+ * doubly linked LRU list, most recent first. Both are only touched under
+ * the cache mutex. The reference count is atomic so that releasing an
+ * entry never needs the cache: the cache itself owns one reference while
+ * the entry is resident, and whoever drops the last one frees it.
+ */
+struct fa_regex_entry {
+    atomic_size_t refs;
+    fa_auto *automaton;
+    uint64_t hash;
+    unsigned flags;
+    struct fa_regex_entry *chain;
+    struct fa_regex_entry *prev;
+    struct fa_regex_entry *next;
+    char pattern[];
+};
+
+struct fa_regex_cache {
+    fa_mutex lock;
+    fa_regex_entry **buckets;
+    size_t nbuckets;                    // power of two
+    fa_regex_entry *head;               // most recently used
+    fa_regex_entry *tail;               // next to evict
+    size_t size;
+    size_t capacity;
+    size_t hits;
+    size_t misses;
+    size_t evictions;
+};
+
+
+static uint64_t regex_cache_hash(const char *pattern, unsigned flags) {
+    uint64_t h = 0xcbf29ce484222325ULL ^ flags;
+    for (const unsigned char *p = (const unsigned char*)pattern; *p; p++) {
+        h = (h ^ *p) * 0x100000001b3ULL;
+    }
+    return h ^ (h >> 32);
+}
+
+static void regex_entry_unref(fa_regex_entry *entry) {
+    if (atomic_fetch_sub_explicit(&entry->refs, 1, memory_order_acq_rel) == 1) {
+        fa_auto_destroy(entry->automaton);
+        free(entry);
+    }
+}
+
+static fa_regex_entry* regex_cache_find(const fa_regex_cache *cache, const char *pattern,
+                                        unsigned flags, uint64_t hash) {
+    fa_regex_entry *entry = cache->buckets[hash & (cache->nbuckets - 1)];
+    while (entry) {
+        if (entry->hash == hash && entry->flags == flags && strcmp(entry->pattern, pattern) == 0) {
+            return entry;
+        }
+        entry = entry->chain;
+    }
+    return NULL;
+}
+
+static void regex_cache_unlink(fa_regex_cache *cache, fa_regex_entry *entry) {
+    if (entry->prev) entry->prev->next = entry->next;
+    else cache->head = entry->next;
+    if (entry->next) entry->next->prev = entry->prev;
+    else cache->tail = entry->prev;
+    entry->prev = entry->next = NULL;
+}
+
+static void regex_cache_push_front(fa_regex_cache *cache, fa_regex_entry *entry) {
+    entry->prev = NULL;
+    entry->next = cache->head;
+    if (cache->head) cache->head->prev = entry;
+    cache->head = entry;
+    if (!cache->tail) cache->tail = entry;
+}
+
+/* Detaches `entry` from the cache; the caller drops the cache's reference. */
+static void regex_cache_remove(fa_regex_cache *cache, fa_regex_entry *entry) {
+    fa_regex_entry **link = &cache->buckets[entry->hash & (cache->nbuckets - 1)];
+    while (*link != entry) link = &(*link)->chain;
+    *link = entry->chain;
+    regex_cache_unlink(cache, entry);
+    cache->size--;
+}
+
+static fa_auto* regex_cache_compile(const char *pattern, unsigned flags, fa_error_t *error) {
+    fa_auto *automaton = (flags & FA_REGEX_COMPILE_GLUSHKOV) ? fa_auto_from_regex_glushkov(pattern)
+                                                             : fa_auto_from_regex(pattern);
+    if (!automaton) {
+        // Tell a malformed pattern from an allocation failure
+        regex_ast *ast = regex_parse(pattern, REGEX_PARSE_DEFAULT, error);
+        if (ast && error) *error = FA_ERR_OUT_OF_MEMORY;
+        regex_ast_destroy(ast);
+        return NULL;
+    }
+
+    if (flags & FA_REGEX_COMPILE_DFA) {
+        fa_auto *dfa = fa_auto_determinize(automaton, FA_DETERMINIZE_DEFAULT);
+        fa_auto_destroy(automaton);
+        if (!dfa && error) *error = FA_ERR_OUT_OF_MEMORY;
+        automaton = dfa;
+    }
+    return automaton;
+}
+
+
+fa_regex_cache* fa_regex_cache_create(size_t capacity) {
+    if (capacity == 0) return NULL;
+
+    fa_regex_cache *cache = calloc(1, sizeof(fa_regex_cache));
+    if (!cache) return NULL;
+
+    cache->nbuckets = 16;
+    while (cache->nbuckets < capacity * 2) cache->nbuckets *= 2;
+    cache->buckets = calloc(cache->nbuckets, sizeof(fa_regex_entry*));
+    cache->capacity = capacity;
+
+    if (!cache->buckets || !fa_mutex_init(&cache->lock)) {
+        free(cache->buckets);
+        free(cache);
+        return NULL;
+    }
+    return cache;
+}
+
+void fa_regex_cache_clear(fa_regex_cache* cache) {
+    if (!cache) return;
+
+    fa_mutex_lock(&cache->lock);
+    fa_regex_entry *entry = cache->head;
+    cache->head = cache->tail = NULL;
+    memset(cache->buckets, 0, cache->nbuckets * sizeof(fa_regex_entry*));
+    cache->size = 0;
+    fa_mutex_unlock(&cache->lock);
+
+    while (entry) {
+        fa_regex_entry *next = entry->next;
+        regex_entry_unref(entry);
+        entry = next;
+    }
+}
+
+void fa_regex_cache_destroy(fa_regex_cache* cache) {
+    if (!cache) return;
+    fa_regex_cache_clear(cache);
+    fa_mutex_destroy(&cache->lock);
+    free(cache->buckets);
+    free(cache);
+}
+
+fa_regex_entry* fa_regex_cache_acquire(fa_regex_cache* cache, const char* pattern,
+                                       unsigned flags, fa_error_t* error) {
+    if (error) *error = FA_SUCCESS;
+    if (!cache || !pattern) {
+        if (error) *error = FA_ERR_NULL_ARGUMENT;
+        return NULL;
+    }
+
+    uint64_t hash = regex_cache_hash(pattern, flags);
+
+    fa_mutex_lock(&cache->lock);
+    fa_regex_entry *entry = regex_cache_find(cache, pattern, flags, hash);
+    if (entry) {
+        cache->hits++;
+        regex_cache_unlink(cache, entry);
+        regex_cache_push_front(cache, entry);
+        atomic_fetch_add_explicit(&entry->refs, 1, memory_order_relaxed);
+        fa_mutex_unlock(&cache->lock);
+        return entry;
+    }
+    cache->misses++;
+    fa_mutex_unlock(&cache->lock);
+
+    // Compile without holding the lock; a concurrent miss may race us
+    size_t length = strlen(pattern);
+    fa_regex_entry *fresh = malloc(sizeof(fa_regex_entry) + length + 1);
+    if (!fresh) {
+        if (error) *error = FA_ERR_OUT_OF_MEMORY;
+        return NULL;
+    }
+    fresh->automaton = regex_cache_compile(pattern, flags, error);
+    if (!fresh->automaton) {
+        free(fresh);
+        return NULL;
+    }
+    atomic_init(&fresh->refs, 2);       // the cache and the caller
+    fresh->hash = hash;
+    fresh->flags = flags;
+    fresh->prev = fresh->next = NULL;
+    memcpy(fresh->pattern, pattern, length + 1);
+
+    fa_regex_entry *evicted = NULL;
+    fa_mutex_lock(&cache->lock);
+    entry = regex_cache_find(cache, pattern, flags, hash);
+    if (entry) {
+        // Keep the entry that won the race so every caller shares it
+        regex_cache_unlink(cache, entry);
+        regex_cache_push_front(cache, entry);
+        atomic_fetch_add_explicit(&entry->refs, 1, memory_order_relaxed);
+    } else {
+        if (cache->size >= cache->capacity) {
+            evicted = cache->tail;
+            regex_cache_remove(cache, evicted);
+            cache->evictions++;
+        }
+        size_t bucket = hash & (cache->nbuckets - 1);
+        fresh->chain = cache->buckets[bucket];
+        cache->buckets[bucket] = fresh;
+        regex_cache_push_front(cache, fresh);
+        cache->size++;
+        entry = fresh;
+        fresh = NULL;
+    }
+    fa_mutex_unlock(&cache->lock);
+
+    if (evicted) regex_entry_unref(evicted);
+    if (fresh) {
+        fa_auto_destroy(fresh->automaton);
+        free(fresh);
+    }
+    return entry;
+}
+
+const fa_auto* fa_regex_entry_auto(const fa_regex_entry* entry) {
+    return entry ? entry->automaton : NULL;
+}
+
+void fa_regex_entry_release(fa_regex_entry* entry) {
+    if (entry) regex_entry_unref(entry);
+}
+
+void fa_regex_cache_get_stats(fa_regex_cache* cache, fa_regex_cache_stats* stats) {
+    if (!cache || !stats) return;
+    fa_mutex_lock(&cache->lock);
+    stats->hits = cache->hits;
+    stats->misses = cache->misses;
+    stats->evictions = cache->evictions;
+    stats->size = cache->size;
+    stats->capacity = cache->capacity;
+    fa_mutex_unlock(&cache->lock);
+}
+
+
+// ============================================================================
+// On-disk compile cache
+// ============================================================================
+
+typedef struct regex_digest {
+    uint64_t h[2];
+} regex_digest;
+
+static void regex_digest_bytes(regex_digest *d, const void *data, size_t length) {
+    const unsigned char *p = data;
+    for (size_t i = 0; i < length; i++) {
+        // FNV-1a and an independent multiply-xorshift lane
+        d->h[0] = (d->h[0] ^ p[i]) * 0x100000001b3ULL;
+        d->h[1] = (d->h[1] + p[i] + 1) * 0x9e3779b97f4a7c15ULL;
+        d->h[1] ^= d->h[1] >> 31;
+    }
+}
+
+static void regex_digest_u64(regex_digest *d, uint64_t value) {
+    unsigned char bytes[8];
+    for (int i = 0; i < 8; i++) bytes[i] = (unsigned char)(value >> (8 * i));
+    regex_digest_bytes(d, bytes, sizeof(bytes));
+}
+
+/* Builds "(p1)|(p2)|..." after checking that every pattern parses on its own. */
+static char* regex_join_patterns(const char* const* patterns, size_t npatterns, fa_error_t *error) {
+    size_t length = 1;
+    for (size_t i = 0; i < npatterns; i++) {
+        regex_ast *ast = regex_parse(patterns[i], REGEX_PARSE_DEFAULT, error);
+        if (!ast) return NULL;
+        regex_ast_destroy(ast);
+        length += strlen(patterns[i]) + 3;
+    }
+
+    char *joined = malloc(length);
+    if (!joined) {
+        if (error) *error = FA_ERR_OUT_OF_MEMORY;
+        return NULL;
+    }
+
+    char *out = joined;
+    for (size_t i = 0; i < npatterns; i++) {
+        size_t n = strlen(patterns[i]);
+        if (i) *out++ = '|';
+        *out++ = '(';
+        memcpy(out, patterns[i], n);
+        out += n;
+        *out++ = ')';
+    }
+    *out = '\0';
+    return joined;
+}
+
+/* Writes the image next to `path` and renames it into place; failures only lose the reuse. */
+static void regex_store_image(const fa_dfa_image *image, const char *path) {
+    static atomic_uint counter;
+    unsigned id = atomic_fetch_add(&counter, 1);
+    long pid = 0;
+#ifdef FA_HAVE_MMAP
+    pid = (long)getpid();
+#endif
+
+    size_t length = strlen(path) + 64;
+    char *tmp = malloc(length);
+    if (!tmp) return;
+    snprintf(tmp, length, "%s.%ld.%u.tmp", path, pid, id);
+    if (fa_dfa_image_save(image, tmp) != FA_SUCCESS || rename(tmp, path) != 0) remove(tmp);
+    free(tmp);
+}
+
+fa_dfa_image* fa_regex_compile_cached(const char* cache_dir, const char* const* patterns,
+                                      size_t npatterns, unsigned flags, fa_error_t* error) {
+    if (error) *error = FA_SUCCESS;
+    if (!cache_dir || !patterns) {
+        if (error) *error = FA_ERR_NULL_ARGUMENT;
+        return NULL;
+    }
+    if (npatterns == 0) {
+        if (error) *error = FA_ERR_INVALID_ARGUMENT;
+        return NULL;
+    }
+    for (size_t i = 0; i < npatterns; i++) {
+        if (!patterns[i]) {
+            if (error) *error = FA_ERR_NULL_ARGUMENT;
+            return NULL;
+        }
+    }
+
+    // Lengths are hashed too, so ("ab", "c") and ("a", "bc") differ
+    regex_digest digest = { { 0xcbf29ce484222325ULL, 0x6a09e667f3bcc909ULL } };
+    regex_digest_u64(&digest, FA_DFA_IMAGE_VERSION);
+    regex_digest_u64(&digest, flags);
+    regex_digest_u64(&digest, npatterns);
+    for (size_t i = 0; i < npatterns; i++) {
+        size_t n = strlen(patterns[i]);
+        regex_digest_u64(&digest, n);
+        regex_digest_bytes(&digest, patterns[i], n);
+    }
+
+    size_t length = strlen(cache_dir) + 48;
+    char *path = malloc(length);
+    if (!path) {
+        if (error) *error = FA_ERR_OUT_OF_MEMORY;
+        return NULL;
+    }
+    snprintf(path, length, "%s/%016llx%016llx.fadfa", cache_dir,
+             (unsigned long long)digest.h[0], (unsigned long long)digest.h[1]);
+
+    fa_dfa_image *image = fa_dfa_image_load(path, NULL);
+    if (image) {
+        uint64_t tag[2];
+        fa_dfa_image_tag(image, tag);
+        if (tag[0] == digest.h[0] && tag[1] == digest.h[1]) {
+            free(path);
+            return image;
+        }
+        fa_dfa_image_close(image);
+        image = NULL;
+    }
+
+    char *joined = regex_join_patterns(patterns, npatterns, error);
+    fa_auto *nfa = NULL, *dfa = NULL;
+    if (joined) {
+        nfa = (flags & FA_REGEX_COMPILE_GLUSHKOV) ? fa_auto_from_regex_glushkov(joined)
+                                                  : fa_auto_from_regex(joined);
+        dfa = nfa ? fa_auto_minimize_hopcroft(nfa) : NULL;
+        if (!dfa && error) *error = FA_ERR_OUT_OF_MEMORY;
+    }
+    if (dfa) {
+        image = fa_dfa_image_create(dfa, digest.h, error);
+        if (image) regex_store_image(image, path);
+    }
+
+    fa_auto_destroy(dfa);
+    fa_auto_destroy(nfa);
+    free(joined);
+    free(path);
+    return image;
+}
@@ -0,0 +1,624 @@
+#include "../../include/regex/regex_deriv.h"
+#include "../../include/fa/fa_index.h"
+#include "../../include/regex/regexpr.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+/*
+ * Terms are stored in one array and referred to by id; children live in a
+ * shared int pool. Every constructor goes through the smart constructors
+ * below, which apply the similarity rules
+ *
+ *   ∅·r = r·∅ = ∅      ε·r = r·ε = r      (r·s)·t = r·(s·t)
+ *   (r*)* = r*         ε* = ∅* = ε        !!r = r
+ *   r|∅ = r            r|!∅ = !∅          r&∅ = ∅      r&!∅ = r
+ *
+ * plus flattening, sorting and deduplication of `|` and `&`, and then
+ * hash-cons the result so structurally equal terms share an id. With these
+ * rules the derivatives of any term form a finite set.
+ *
+ * Anchors match ε only at some points of the word, so nullability is a
+ * mask of the points at which a term matches ε: inside the word, at its
+ * end, at its start, or at both (the empty word). A derivative is taken at
+ * the point before the byte, which is inside the word except for the first
+ * byte; the start of a regex with anchors is a DERIV_START term, whose
+ * derivatives use the start of the word instead.
+ */
+
+typedef enum {
+    DERIV_EMPTY,
+    DERIV_EPS,
+    DERIV_SET,                      // one byte out of a set
+    DERIV_CONCAT,
+    DERIV_STAR,
+    DERIV_NOT,
+    DERIV_ALT,
+    DERIV_AND,
+    DERIV_AT_START,                 // ^
+    DERIV_AT_END,                   // $
+    DERIV_START,                    // its kid, read from the start of the word
+} deriv_kind;
+
+#define DERIV_NULL_INSIDE   0x1
+#define DERIV_NULL_END      0x2
+#define DERIV_NULL_START    0x4
+#define DERIV_NULL_WHOLE    0x8
+#define DERIV_NULL_ANYWHERE 0xF
+
+typedef struct deriv_term {
+    deriv_kind kind;
+    uint8_t nullable;               // DERIV_NULL_* points matching ε
+    bool is_state;                  // reached by the lazy DFA
+    int ch;                         // DERIV_SET: index into regex_deriv.sets
+    size_t kids;                    // offset of the children in the pool
+    int nkids;
+    uint64_t hash;
+    int *delta;                     // per symbol class, -1 until computed
+} deriv_term;
+
+struct regex_deriv {
+    deriv_term *terms;
+    size_t nterms;
+    size_t capacity;
+    int *pool;
+    size_t npool;
+    size_t pool_capacity;
+    int *slots;                     // hash-consing table of term ids, -1 if empty
+    size_t nslots;
+    regex_class *sets;              // distinct byte sets of the regex
+    size_t nsets;
+    size_t sets_capacity;
+    uint8_t classes[256];           // byte -> class; class 0 is every byte in no set
+    unsigned char class_char[256];  // class -> a representative byte
+    int nclasses;
+    int empty;
+    int eps;
+    int full;                       // !∅
+    int root;
+    bool anchored;                  // the regex has `^` or `$`
+    size_t nstates;
+    bool failed;
+};
+
+
+static uint64_t deriv_hash(deriv_kind kind, int ch, const int *kids, int nkids) {
+    uint64_t h = 0xcbf29ce484222325ULL ^ ((uint64_t)kind << 32) ^ (uint32_t)ch;
+    h *= 0x100000001b3ULL;
+    for (int i = 0; i < nkids; i++) {
+        h ^= (uint32_t)kids[i];
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 29;
+    }
+    return h;
+}
+
+static bool deriv_grow_slots(regex_deriv *d) {
+    size_t nslots = d->nslots ? d->nslots * 2 : 256;
+    int *slots = malloc(nslots * sizeof(int));
+    if (!slots) return false;
+    memset(slots, -1, nslots * sizeof(int));
+
+    for (size_t i = 0; i < d->nterms; i++) {
+        size_t h = (size_t)d->terms[i].hash & (nslots - 1);
+        while (slots[h] >= 0) h = (h + 1) & (nslots - 1);
+        slots[h] = (int)i;
+    }
+
+    free(d->slots);
+    d->slots = slots;
+    d->nslots = nslots;
+    return true;
+}
+
+/* Returns the id of the term, creating it if needed; the empty term on failure. */
+static int deriv_intern(regex_deriv *d, deriv_kind kind, int ch, const int *kids, int nkids) {
+    if (d->failed) return d->empty;
+
+    uint64_t hash = deriv_hash(kind, ch, kids, nkids);
+    if ((d->nterms + 1) * 2 > d->nslots && !deriv_grow_slots(d)) goto fail;
+
+    size_t mask = d->nslots - 1;
+    size_t h = (size_t)hash & mask;
+    while (d->slots[h] >= 0) {
+        const deriv_term *t = &d->terms[d->slots[h]];
+        if (t->hash == hash && t->kind == kind && t->ch == ch && t->nkids == nkids &&
+            (nkids == 0 || memcmp(d->pool + t->kids, kids, (size_t)nkids * sizeof(int)) == 0)) {
+            return d->slots[h];
+        }
+        h = (h + 1) & mask;
+    }
+
+    if (d->nterms >= d->capacity) {
+        size_t new_capacity = d->capacity ? d->capacity * 2 : 64;
+        deriv_term *terms = realloc(d->terms, new_capacity * sizeof(deriv_term));
+        if (!terms) goto fail;
+        d->terms = terms;
+        d->capacity = new_capacity;
+    }
+    if (d->npool + (size_t)nkids > d->pool_capacity) {
+        size_t new_capacity = d->pool_capacity ? d->pool_capacity * 2 : 256;
+        while (new_capacity < d->npool + (size_t)nkids) new_capacity *= 2;
+        int *pool = realloc(d->pool, new_capacity * sizeof(int));
+        if (!pool) goto fail;
+        d->pool = pool;
+        d->pool_capacity = new_capacity;
+    }
+
+    uint8_t nullable;
+    switch (kind) {
+        case DERIV_EMPTY:
+        case DERIV_SET:      nullable = 0; break;
+        case DERIV_EPS:
+        case DERIV_STAR:     nullable = DERIV_NULL_ANYWHERE; break;
+        case DERIV_AT_START: nullable = DERIV_NULL_START | DERIV_NULL_WHOLE; break;
+        case DERIV_AT_END:   nullable = DERIV_NULL_END | DERIV_NULL_WHOLE; break;
+        case DERIV_NOT:      nullable = (uint8_t)(~d->terms[kids[0]].nullable & DERIV_NULL_ANYWHERE); break;
+        case DERIV_START:
+            // Accepting the empty word is the only test made at its end
+            nullable = (d->terms[kids[0]].nullable & DERIV_NULL_WHOLE) ? DERIV_NULL_ANYWHERE : 0;
+            break;
+        case DERIV_ALT:
+            nullable = 0;
+            for (int i = 0; i < nkids; i++) nullable |= d->terms[kids[i]].nullable;
+            break;
+        default:             // CONCAT and AND
+            nullable = DERIV_NULL_ANYWHERE;
+            for (int i = 0; i < nkids; i++) nullable &= d->terms[kids[i]].nullable;
+            break;
+    }
+
+    int id = (int)d->nterms++;
+    deriv_term *t = &d->terms[id];
+    t->kind = kind;
+    t->nullable = nullable;
+    t->is_state = false;
+    t->ch = ch;
+    t->kids = d->npool;
+    t->nkids = nkids;
+    t->hash = hash;
+    t->delta = NULL;
+    if (nkids) memcpy(d->pool + d->npool, kids, (size_t)nkids * sizeof(int));
+    d->npool += (size_t)nkids;
+    d->slots[h] = id;
+    return id;
+
+fail:
+    d->failed = true;
+    return d->empty;
+}
+
+static int deriv_kid(const regex_deriv *d, int term, int i) {
+    return d->pool[d->terms[term].kids + (size_t)i];
+}
+
+
+// ============================================================================
+// Smart constructors
+// ============================================================================
+
+static int deriv_concat(regex_deriv *d, int a, int b) {
+    if (a == d->empty || b == d->empty) return d->empty;
+    if (a == d->eps) return b;
+    if (b == d->eps) return a;
+
+    if (d->terms[a].kind == DERIV_CONCAT) {
+        int head = deriv_kid(d, a, 0), tail = deriv_kid(d, a, 1);
+        return deriv_concat(d, head, deriv_concat(d, tail, b));
+    }
+
+    int kids[2] = { a, b };
+    return deriv_intern(d, DERIV_CONCAT, 0, kids, 2);
+}
+
+static int deriv_star(regex_deriv *d, int a) {
+    if (a == d->empty || a == d->eps) return d->eps;
+    if (d->terms[a].kind == DERIV_STAR) return a;
+    return deriv_intern(d, DERIV_STAR, 0, &a, 1);
+}
+
+static int deriv_not(regex_deriv *d, int a) {
+    if (d->terms[a].kind == DERIV_NOT) return deriv_kid(d, a, 0);
+    return deriv_intern(d, DERIV_NOT, 0, &a, 1);
+}
+
+static int deriv_compare_ids(const void *x, const void *y) {
+    int a = *(const int*)x, b = *(const int*)y;
+    return (a > b) - (a < b);
+}
+
+/* Canonical n-ary `|` or `&` of `kids`. */
+static int deriv_nary(regex_deriv *d, deriv_kind kind, const int *kids, int nkids) {
+    int absorbing = kind == DERIV_ALT ? d->full : d->empty;
+    int neutral = kind == DERIV_ALT ? d->empty : d->full;
+
+    size_t total = 0;
+    for (int i = 0; i < nkids; i++) {
+        total += d->terms[kids[i]].kind == kind ? (size_t)d->terms[kids[i]].nkids : 1;
+    }
+
+    int *flat = malloc((total ? total : 1) * sizeof(int));
+    if (!flat) {
+        d->failed = true;
+        return d->empty;
+    }
+
+    int n = 0;
+    for (int i = 0; i < nkids; i++) {
+        const deriv_term *t = &d->terms[kids[i]];
+        if (t->kind == kind) {
+            memcpy(flat + n, d->pool + t->kids, (size_t)t->nkids * sizeof(int));
+            n += t->nkids;
+        } else {
+            flat[n++] = kids[i];
+        }
+    }
+
+    qsort(flat, (size_t)n, sizeof(int), deriv_compare_ids);
+    int unique = 0;
+    int result = -1;
+    for (int i = 0; i < n; i++) {
+        if (flat[i] == absorbing) {
+            result = absorbing;
+            break;
+        }
+        if (flat[i] == neutral || (unique && flat[unique - 1] == flat[i])) continue;
+        flat[unique++] = flat[i];
+    }
+
+    if (result < 0) {
+        if (unique == 0) result = neutral;
+        else if (unique == 1) result = flat[0];
+        else result = deriv_intern(d, kind, 0, flat, unique);
+    }
+    free(flat);
+    return result;
+}
+
+static int deriv_alt2(regex_deriv *d, int a, int b) {
+    int kids[2] = { a, b };
+    return deriv_nary(d, DERIV_ALT, kids, 2);
+}
+
+
+// ============================================================================
+// Derivatives
+// ============================================================================
+
+/*
+ * Derivative of `term` by any byte of class `cls`, read at the point `at`
+ * (DERIV_NULL_INSIDE or DERIV_NULL_START). Results inside the word are
+ * cached on the term, so the cache doubles as the transition table of the
+ * lazy DFA.
+ */
+static int deriv_step_at(regex_deriv *d, int term, int cls, uint8_t at) {
+    if (at == DERIV_NULL_INSIDE && d->terms[term].delta && d->terms[term].delta[cls] >= 0) {
+        return d->terms[term].delta[cls];
+    }
+
+    int result = d->empty;
+    switch (d->terms[term].kind) {
+        case DERIV_EMPTY:
+        case DERIV_EPS:
+        case DERIV_AT_START:
+        case DERIV_AT_END:
+            break;
+        case DERIV_START:
+            result = deriv_step_at(d, deriv_kid(d, term, 0), cls, DERIV_NULL_START);
+            break;
+        case DERIV_SET:
+            // Every byte of a class belongs to the same sets
+            if (regex_class_has(&d->sets[d->terms[term].ch], d->class_char[cls])) result = d->eps;
+            break;
+        case DERIV_CONCAT: {
+            int head = deriv_kid(d, term, 0), tail = deriv_kid(d, term, 1);
+            result = deriv_concat(d, deriv_step_at(d, head, cls, at), tail);
+            if (d->terms[head].nullable & at) result = deriv_alt2(d, result, deriv_step_at(d, tail, cls, at));
+            break;
+        }
+        case DERIV_STAR:
+            result = deriv_concat(d, deriv_step_at(d, deriv_kid(d, term, 0), cls, at), term);
+            break;
+        case DERIV_NOT:
+            result = deriv_not(d, deriv_step_at(d, deriv_kid(d, term, 0), cls, at));
+            break;
+        case DERIV_ALT:
+        case DERIV_AND: {
+            int nkids = d->terms[term].nkids;
+            int *parts = malloc((size_t)nkids * sizeof(int));
+            if (!parts) {
+                d->failed = true;
+                return d->empty;
+            }
+            for (int i = 0; i < nkids; i++) parts[i] = deriv_step_at(d, deriv_kid(d, term, i), cls, at);
+            result = deriv_nary(d, d->terms[term].kind, parts, nkids);
+            free(parts);
+            break;
+        }
+    }
+
+    if (d->failed) return d->empty;
+    if (at != DERIV_NULL_INSIDE) return result;
+    if (!d->terms[term].delta) {
+        int *delta = malloc((size_t)d->nclasses * sizeof(int));
+        if (!delta) {
+            d->failed = true;
+            return d->empty;
+        }
+        memset(delta, -1, (size_t)d->nclasses * sizeof(int));
+        d->terms[term].delta = delta;
+    }
+    d->terms[term].delta[cls] = result;
+    return result;
+}
+
+static int deriv_step(regex_deriv *d, int term, int cls) {
+    return deriv_step_at(d, term, cls, DERIV_NULL_INSIDE);
+}
+
+static void deriv_mark_state(regex_deriv *d, int term) {
+    if (d->terms[term].is_state) return;
+    d->terms[term].is_state = true;
+    d->nstates++;
+}
+
+
+// ============================================================================
+// Terms from the syntax tree
+// ============================================================================
+
+/* Returns the DERIV_SET term of `cls`, sharing one set index per distinct class. */
+static int deriv_set(regex_deriv *d, const regex_class *cls) {
+    size_t index = 0;
+    while (index < d->nsets && memcmp(&d->sets[index], cls, sizeof(regex_class)) != 0) index++;
+
+    if (index == d->nsets) {
+        if (d->nsets >= d->sets_capacity) {
+            size_t new_capacity = d->sets_capacity ? d->sets_capacity * 2 : 16;
+            regex_class *sets = realloc(d->sets, new_capacity * sizeof(regex_class));
+            if (!sets) {
+                d->failed = true;
+                return d->empty;
+            }
+            d->sets = sets;
+            d->sets_capacity = new_capacity;
+        }
+        d->sets[d->nsets++] = *cls;
+    }
+    return deriv_intern(d, DERIV_SET, (int)index, NULL, 0);
+}
+
+static int deriv_from_node(regex_deriv *d, const regex_node *node) {
+    if (d->failed) return d->empty;
+
+    switch (node->kind) {
+        case REGEX_EMPTY:
+            return d->eps;
+
+        case REGEX_ANCHOR_START:
+        case REGEX_ANCHOR_END:
+            d->anchored = true;
+            return deriv_intern(d, node->kind == REGEX_ANCHOR_START ? DERIV_AT_START : DERIV_AT_END,
+                                0, NULL, 0);
+
+        case REGEX_CHAR: {
+            regex_class single = { { 0 } };
+            regex_class_add(&single, node->ch);
+            return deriv_set(d, &single);
+        }
+
+        case REGEX_CLASS:
+            return deriv_set(d, node->cls);
+
+        case REGEX_CONCAT: {
+            // Built right to left so the concatenation is already right-nested
+            int term = d->eps;
+            for (size_t i = node->nkids; i > 0; i--) {
+                term = deriv_concat(d, deriv_from_node(d, node->kids[i - 1]), term);
+            }
+            return term;
+        }
+
+        case REGEX_ALT:
+        case REGEX_AND: {
+            int *kids = malloc(node->nkids * sizeof(int));
+            if (!kids) {
+                d->failed = true;
+                return d->empty;
+            }
+            for (size_t i = 0; i < node->nkids; i++) kids[i] = deriv_from_node(d, node->kids[i]);
+            int term = deriv_nary(d, node->kind == REGEX_ALT ? DERIV_ALT : DERIV_AND, kids, (int)node->nkids);
+            free(kids);
+            return term;
+        }
+
+        case REGEX_STAR:
+            return deriv_star(d, deriv_from_node(d, node->kids[0]));
+
+        case REGEX_PLUS: {
+            int term = deriv_from_node(d, node->kids[0]);
+            return deriv_concat(d, term, deriv_star(d, term));
+        }
+
+        case REGEX_QUESTION:
+            return deriv_alt2(d, deriv_from_node(d, node->kids[0]), d->eps);
+
+        case REGEX_NOT:
+            return deriv_not(d, deriv_from_node(d, node->kids[0]));
+
+        case REGEX_REPEAT: {
+            // x{m,n} = x...x (m times) · (x* or (ε|x(ε|x(...))) with n - m levels)
+            int term = deriv_from_node(d, node->kids[0]);
+            int tail = d->eps;
+            if (node->max == REGEX_UNBOUNDED) {
+                tail = deriv_star(d, term);
+            } else {
+                for (int i = node->min; i < node->max; i++) tail = deriv_alt2(d, d->eps, deriv_concat(d, term, tail));
+            }
+            for (int i = 0; i < node->min; i++) tail = deriv_concat(d, term, tail);
+            return tail;
+        }
+    }
+
+    d->failed = true;
+    return d->empty;
+}
+
+/*
+ * Splits the bytes into classes whose members belong to exactly the same
+ * sets, refining the partition one set at a time. No set contains '\0', so
+ * processing it first makes class 0 the bytes outside every set.
+ */
+static void deriv_build_classes(regex_deriv *d) {
+    memset(d->classes, 0, sizeof(d->classes));
+    d->nclasses = 1;
+
+    int split[256][2];
+    for (size_t s = 0; s < d->nsets; s++) {
+        memset(split, -1, sizeof(split));
+        int nclasses = 0;
+        for (int c = 0; c < 256; c++) {
+            int inside = regex_class_has(&d->sets[s], (unsigned char)c);
+            int *target = &split[d->classes[c]][inside];
+            if (*target < 0) *target = nclasses++;
+            d->classes[c] = (uint8_t)*target;
+        }
+        d->nclasses = nclasses;
+    }
+
+    for (int c = 255; c >= 0; c--) d->class_char[d->classes[c]] = (unsigned char)c;
+}
+
+
+// ============================================================================
+// Public API
+// ============================================================================
+
+regex_deriv* regex_deriv_create(const char* regex) {
+    regex_ast *ast = regex_parse(regex, REGEX_PARSE_BOOLEAN, NULL);
+    if (!ast) return NULL;
+    // A partial simplification on allocation failure is still equivalent
+    regex_simplify(ast);
+
+    regex_deriv *d = calloc(1, sizeof(regex_deriv));
+    if (!d) {
+        regex_ast_destroy(ast);
+        return NULL;
+    }
+
+    d->empty = deriv_intern(d, DERIV_EMPTY, 0, NULL, 0);
+    d->eps = deriv_intern(d, DERIV_EPS, 0, NULL, 0);
+    d->full = deriv_intern(d, DERIV_NOT, 0, &d->empty, 1);
+    d->root = deriv_from_node(d, ast->root);
+    // Only anchors tell the start of the word from the inside
+    if (d->anchored) d->root = deriv_intern(d, DERIV_START, 0, &d->root, 1);
+    regex_ast_destroy(ast);
+
+    if (d->failed) {
+        regex_deriv_destroy(d);
+        return NULL;
+    }
+
+    deriv_build_classes(d);
+    deriv_mark_state(d, d->root);
+    return d;
+}
+
+void regex_deriv_destroy(regex_deriv* deriv) {
+    if (!deriv) return;
+    for (size_t i = 0; i < deriv->nterms; i++) free(deriv->terms[i].delta);
+    free(deriv->terms);
+    free(deriv->pool);
+    free(deriv->slots);
+    free(deriv->sets);
+    free(deriv);
+}
+
+bool regex_deriv_matches(regex_deriv* deriv, const char* word) {
+    if (!deriv || !word) return false;
+
+    int state = deriv->root;
+    for (const unsigned char *p = (const unsigned char*)word; *p; p++) {
+        state = deriv_step(deriv, state, deriv->classes[*p]);
+        if (deriv->failed) return false;
+        deriv_mark_state(deriv, state);
+        if (state == deriv->empty) return false;
+        if (state == deriv->full) return true;
+    }
+    return deriv->terms[state].nullable & DERIV_NULL_END;
+}
+
+size_t regex_deriv_nstates(const regex_deriv* deriv) {
+    return deriv ? deriv->nstates : 0;
+}
+
+typedef struct deriv_export {
+    fa_builder builder;
+    int *state_of;                      // term id -> DFA state, -1 if unseen
+    size_t mapped;
+    int *terms;                         // DFA state -> term id
+} deriv_export;
+
+/* Returns the DFA state of `term`, adding it if new; -1 on failure. */
+static int deriv_export_state(regex_deriv *d, deriv_export *ex, int term, uint8_t flags) {
+    // Derivatives keep creating terms, so the map grows lazily
+    if ((size_t)term >= ex->mapped) {
+        int *grown = realloc(ex->state_of, d->capacity * sizeof(int));
+        if (!grown) return -1;
+        ex->state_of = grown;
+        for (size_t t = ex->mapped; t < d->capacity; t++) ex->state_of[t] = -1;
+        ex->mapped = d->capacity;
+    }
+    if (ex->state_of[term] >= 0) return ex->state_of[term];
+
+    if (d->terms[term].nullable & DERIV_NULL_END) flags |= FA_INDEX_ACCEPT;
+    int state = fa_builder_add_state(&ex->builder, flags);
+    if (state < 0) return -1;
+    int *grown = realloc(ex->terms, ex->builder.state_capacity * sizeof(int));
+    if (!grown) return -1;
+    ex->terms = grown;
+    ex->terms[state] = term;
+    ex->state_of[term] = state;
+    deriv_mark_state(d, term);
+    return state;
+}
+
+fa_auto* regex_deriv_to_auto(regex_deriv* deriv) {
+    if (!deriv) return NULL;
+
+    fa_symtab *symtab = fa_symtab_create();
+    int sym_of[256];
+    deriv_export ex = { .state_of = NULL, .mapped = 0, .terms = NULL };
+    bool built = fa_builder_init(&ex.builder, 16, 32);
+    fa_auto *automaton = NULL;
+
+    if (!symtab || !built) goto cleanup;
+    for (int c = 1; c < 256; c++) {
+        char sym[2] = { (char)c, '\0' };
+        sym_of[c] = deriv->classes[c] ? fa_symtab_intern(symtab, sym) : -1;
+        if (deriv->classes[c] && sym_of[c] < 0) goto cleanup;
+    }
+
+    if (deriv_export_state(deriv, &ex, deriv->root, FA_INDEX_START) < 0) goto cleanup;
+
+    for (size_t src = 0; src < ex.builder.nstates; src++) {
+        for (int c = 1; c < 256; c++) {
+            if (deriv->classes[c] == 0) continue;
+            int next = deriv_step(deriv, ex.terms[src], deriv->classes[c]);
+            if (deriv->failed) goto cleanup;
+            if (next == deriv->empty) continue;
+
+            int dest = deriv_export_state(deriv, &ex, next, 0);
+            if (dest < 0 || !fa_builder_add_edge(&ex.builder, (int)src, sym_of[c], dest)) goto cleanup;
+        }
+    }
+
+    automaton = fa_builder_emit(&ex.builder, symtab, NULL, NULL, NULL);
+
+cleanup:
+    if (built) fa_builder_free(&ex.builder);
+    free(ex.state_of);
+    free(ex.terms);
+    fa_symtab_destroy(symtab);
+    return automaton;
+}
@@ -0,0 +1,460 @@
+#include "../../include/regex/regexpr.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+/*
+ * Algebraic simplification of the AST, run between regex_parse and the
+ * automaton constructors. Every rewrite replaces a subtree by an equivalent
+ * one, so a pass interrupted by an allocation failure still leaves a
+ * correct tree. Rules, applied bottom-up:
+ *
+ *   concat    flatten, drop ε, x*x* = x*, x*x? = x?x* = x*, x*x+ = x+x* = x+
+ *   alt       flatten, factor common first factors (xy|xz = x(y|z)), which
+ *             turns a union of literals into a trie; merge single bytes and
+ *             classes into one class; ε|x = x? (or x when x is nullable)
+ *   and       flatten, drop duplicates
+ *   star      ε* = ε, (x*)* = (x+)* = (x?)* = x*
+ *   plus      (x*)+ = x*, (x+)+ = x+, (x?)+ = x*, x+ = x* for nullable x
+ *   question  x? = x for nullable x, (x+)? = x*
+ *   repeat    x{0,0} = ε, x{1,1} = x, x{0,} = x*, x{1,} = x+, x{0,1} = x?
+ *   not       !!x = x
+ *
+ * Each normalize_* function expects the kids of its node to be simplified
+ * already, which lets the factoring step rebuild nodes without walking the
+ * shared subtrees again.
+ */
+
+typedef struct simplify_ctx {
+    regex_ast *ast;
+    bool failed;
+} simplify_ctx;
+
+static regex_node* normalize_unary(simplify_ctx *ctx, regex_node *node);
+static regex_node* normalize_alt(simplify_ctx *ctx, regex_node **kids, size_t nkids);
+
+static regex_node* simplify_new(simplify_ctx *ctx, regex_kind kind, regex_node **kids, size_t nkids) {
+    regex_node *node = regex_ast_alloc(ctx->ast, sizeof(regex_node));
+    regex_node **copy = nkids ? regex_ast_alloc(ctx->ast, nkids * sizeof(regex_node*)) : NULL;
+    if (!node || (nkids && !copy)) {
+        ctx->failed = true;
+        return NULL;
+    }
+    if (nkids) memcpy(copy, kids, nkids * sizeof(regex_node*));
+    node->kind = kind;
+    node->kids = copy;
+    node->nkids = nkids;
+    return node;
+}
+
+static bool regex_node_anchored(const regex_node *node) {
+    if (node->kind == REGEX_ANCHOR_START || node->kind == REGEX_ANCHOR_END) return true;
+    for (size_t i = 0; i < node->nkids; i++) {
+        if (regex_node_anchored(node->kids[i])) return true;
+    }
+    return false;
+}
+
+/*
+ * Whether the node matches ε at every point of the word. Anchors match it
+ * only at some, so a node is never reported nullable because of one.
+ */
+static bool regex_node_nullable(const regex_node *node) {
+    switch (node->kind) {
+        case REGEX_CHAR:
+        case REGEX_CLASS:
+        case REGEX_ANCHOR_START:
+        case REGEX_ANCHOR_END:
+            return false;
+        case REGEX_PLUS:
+            return regex_node_nullable(node->kids[0]);
+        case REGEX_REPEAT:
+            return node->min == 0 || regex_node_nullable(node->kids[0]);
+        case REGEX_NOT:
+            // !x is nullable when x matches ε nowhere, which anchors hide
+            return !regex_node_nullable(node->kids[0]) && !regex_node_anchored(node->kids[0]);
+        case REGEX_ALT:
+            for (size_t i = 0; i < node->nkids; i++) {
+                if (regex_node_nullable(node->kids[i])) return true;
+            }
+            return false;
+        case REGEX_CONCAT:
+        case REGEX_AND:
+            for (size_t i = 0; i < node->nkids; i++) {
+                if (!regex_node_nullable(node->kids[i])) return false;
+            }
+            return true;
+        default:
+            // ε, star and question
+            return true;
+    }
+}
+
+static uint64_t regex_node_hash(const regex_node *node) {
+    uint64_t h = 0xcbf29ce484222325ULL ^ (uint64_t)node->kind;
+    h = (h ^ node->ch) * 0x100000001b3ULL;
+    h = (h ^ (uint32_t)node->min ^ ((uint64_t)(uint32_t)node->max << 32)) * 0x100000001b3ULL;
+    if (node->cls) {
+        for (int i = 0; i < 4; i++) h = (h ^ node->cls->bits[i]) * 0xff51afd7ed558ccdULL;
+    }
+    for (size_t i = 0; i < node->nkids; i++) {
+        h = (h ^ regex_node_hash(node->kids[i])) * 0xff51afd7ed558ccdULL;
+        h ^= h >> 29;
+    }
+    return h;
+}
+
+static bool regex_node_equal(const regex_node *a, const regex_node *b) {
+    if (a == b) return true;
+    if (a->kind != b->kind || a->ch != b->ch || a->min != b->min || a->max != b->max ||
+        a->nkids != b->nkids) {
+        return false;
+    }
+    if (a->kind == REGEX_CLASS && memcmp(a->cls, b->cls, sizeof(regex_class)) != 0) return false;
+    for (size_t i = 0; i < a->nkids; i++) {
+        if (!regex_node_equal(a->kids[i], b->kids[i])) return false;
+    }
+    return true;
+}
+
+
+// ============================================================================
+// Concatenation
+// ============================================================================
+
+/* Merges x∘ y∘ for the same x into one factor; NULL when the rules do not apply. */
+static regex_node* merge_repeats(regex_node *a, regex_node *b) {
+    bool a_loop = a->kind == REGEX_STAR || a->kind == REGEX_PLUS || a->kind == REGEX_QUESTION;
+    bool b_loop = b->kind == REGEX_STAR || b->kind == REGEX_PLUS || b->kind == REGEX_QUESTION;
+    if (!a_loop || !b_loop || (a->kind != REGEX_STAR && b->kind != REGEX_STAR)) return NULL;
+    if (!regex_node_equal(a->kids[0], b->kids[0])) return NULL;
+
+    if (a->kind == REGEX_PLUS) return a;
+    if (b->kind == REGEX_PLUS) return b;
+    return a->kind == REGEX_STAR ? a : b;
+}
+
+static regex_node* normalize_concat(simplify_ctx *ctx, regex_node **kids, size_t nkids) {
+    size_t total = 0;
+    for (size_t i = 0; i < nkids; i++) {
+        total += kids[i]->kind == REGEX_CONCAT ? kids[i]->nkids : 1;
+    }
+
+    regex_node **flat = malloc((total ? total : 1) * sizeof(regex_node*));
+    if (!flat) {
+        ctx->failed = true;
+        return NULL;
+    }
+
+    size_t n = 0;
+    for (size_t i = 0; i < nkids; i++) {
+        size_t count = kids[i]->kind == REGEX_CONCAT ? kids[i]->nkids : 1;
+        regex_node **parts = kids[i]->kind == REGEX_CONCAT ? kids[i]->kids : &kids[i];
+        for (size_t j = 0; j < count; j++) {
+            if (parts[j]->kind == REGEX_EMPTY) continue;
+            regex_node *merged = n ? merge_repeats(flat[n - 1], parts[j]) : NULL;
+            if (merged) flat[n - 1] = merged;
+            else flat[n++] = parts[j];
+        }
+    }
+
+    regex_node *result;
+    if (n == 0) result = simplify_new(ctx, REGEX_EMPTY, NULL, 0);
+    else if (n == 1) result = flat[0];
+    else result = simplify_new(ctx, REGEX_CONCAT, flat, n);
+    free(flat);
+    return result;
+}
+
+
+// ============================================================================
+// Alternation
+// ============================================================================
+
+/* Leading factor of an alternative and what follows it. */
+static regex_node* alt_head(regex_node *node) {
+    return node->kind == REGEX_CONCAT ? node->kids[0] : node;
+}
+
+static regex_node* alt_tail(simplify_ctx *ctx, regex_node *node) {
+    if (node->kind != REGEX_CONCAT) return simplify_new(ctx, REGEX_EMPTY, NULL, 0);
+    if (node->nkids == 2) return node->kids[1];
+    // The tail shares the kids array, which is never modified after this point
+    return simplify_new(ctx, REGEX_CONCAT, node->kids + 1, node->nkids - 1);
+}
+
+/*
+ * Groups alternatives by their leading factor, keeping the order of first
+ * occurrence, and rewrites each group x·y1 | x·y2 | ... as x·(y1|y2|...).
+ * Returns the number of alternatives left in `kids`.
+ */
+static size_t factor_prefixes(simplify_ctx *ctx, regex_node **kids, size_t nkids) {
+    size_t nslots = 16;
+    while (nslots < nkids * 2) nslots *= 2;
+
+    int *slots = malloc(nslots * sizeof(int));          // slot -> leader alternative
+    int *group = malloc(nkids * sizeof(int));           // alternative -> leader
+    int *size = calloc(nkids, sizeof(int));             // leader -> group size
+    uint64_t *hashes = malloc(nkids * sizeof(uint64_t));
+    if (!slots || !group || !size || !hashes) {
+        ctx->failed = true;
+        free(slots);
+        free(group);
+        free(size);
+        free(hashes);
+        return nkids;
+    }
+    memset(slots, -1, nslots * sizeof(int));
+
+    bool shared = false;
+    for (size_t i = 0; i < nkids; i++) {
+        regex_node *head = alt_head(kids[i]);
+        hashes[i] = regex_node_hash(head);
+        size_t h = (size_t)hashes[i] & (nslots - 1);
+        while (slots[h] >= 0 &&
+               (hashes[slots[h]] != hashes[i] || !regex_node_equal(alt_head(kids[slots[h]]), head))) {
+            h = (h + 1) & (nslots - 1);
+        }
+        if (slots[h] < 0) slots[h] = (int)i;
+        group[i] = slots[h];
+        shared = shared || size[group[i]] > 0;
+        size[group[i]]++;
+    }
+
+    size_t out = nkids;
+    regex_node **tails = shared ? malloc(nkids * sizeof(regex_node*)) : NULL;
+    if (shared && !tails) ctx->failed = true;
+
+    if (tails) {
+        out = 0;
+        for (size_t i = 0; i < nkids; i++) {
+            if (group[i] != (int)i) continue;
+            if (size[i] == 1) {
+                kids[out++] = kids[i];
+                continue;
+            }
+
+            size_t ntails = 0;
+            for (size_t j = i; j < nkids; j++) {
+                if (group[j] != (int)i) continue;
+                tails[ntails] = alt_tail(ctx, kids[j]);
+                if (!tails[ntails]) break;
+                ntails++;
+            }
+
+            regex_node *rest = ntails == (size_t)size[i] ? normalize_alt(ctx, tails, ntails) : NULL;
+            regex_node *parts[2] = { alt_head(kids[i]), rest };
+            regex_node *factored = rest ? normalize_concat(ctx, parts, 2) : NULL;
+            if (!factored) {
+                // Keep the group unfactored, it is still equivalent
+                for (size_t j = i; j < nkids; j++) {
+                    if (group[j] == (int)i) kids[out++] = kids[j];
+                }
+                continue;
+            }
+            kids[out++] = factored;
+        }
+    }
+
+    free(tails);
+    free(slots);
+    free(group);
+    free(size);
+    free(hashes);
+    return out;
+}
+
+/* Replaces every single-byte alternative by one class at the first one's position. */
+static size_t merge_classes(simplify_ctx *ctx, regex_node **kids, size_t nkids) {
+    regex_class merged = { { 0 } };
+    size_t first = nkids, count = 0;
+
+    for (size_t i = 0; i < nkids; i++) {
+        if (kids[i]->kind == REGEX_CHAR) regex_class_add(&merged, kids[i]->ch);
+        else if (kids[i]->kind == REGEX_CLASS) {
+            for (int w = 0; w < 4; w++) merged.bits[w] |= kids[i]->cls->bits[w];
+        } else continue;
+        if (first == nkids) first = i;
+        count++;
+    }
+    if (count < 2) return nkids;
+
+    regex_node *node = simplify_new(ctx, REGEX_CLASS, NULL, 0);
+    regex_class *cls = regex_ast_alloc(ctx->ast, sizeof(regex_class));
+    if (!node || !cls) {
+        ctx->failed = true;
+        return nkids;
+    }
+    *cls = merged;
+    node->cls = cls;
+
+    size_t out = 0;
+    for (size_t i = 0; i < nkids; i++) {
+        if (i == first) kids[out++] = node;
+        else if (kids[i]->kind != REGEX_CHAR && kids[i]->kind != REGEX_CLASS) kids[out++] = kids[i];
+    }
+    return out;
+}
+
+static regex_node* normalize_alt(simplify_ctx *ctx, regex_node **kids, size_t nkids) {
+    size_t total = 0;
+    for (size_t i = 0; i < nkids; i++) {
+        total += kids[i]->kind == REGEX_ALT ? kids[i]->nkids : 1;
+    }
+
+    regex_node **flat = malloc((total ? total : 1) * sizeof(regex_node*));
+    if (!flat) {
+        ctx->failed = true;
+        return NULL;
+    }
+
+    size_t n = 0;
+    bool has_eps = false;
+    for (size_t i = 0; i < nkids; i++) {
+        size_t count = kids[i]->kind == REGEX_ALT ? kids[i]->nkids : 1;
+        regex_node **parts = kids[i]->kind == REGEX_ALT ? kids[i]->kids : &kids[i];
+        for (size_t j = 0; j < count; j++) {
+            if (parts[j]->kind == REGEX_EMPTY) has_eps = true;
+            else flat[n++] = parts[j];
+        }
+    }
+
+    if (n > 1) n = factor_prefixes(ctx, flat, n);
+    if (n > 1) n = merge_classes(ctx, flat, n);
+
+    regex_node *result;
+    if (n == 0) result = simplify_new(ctx, REGEX_EMPTY, NULL, 0);
+    else if (n == 1) result = flat[0];
+    else result = simplify_new(ctx, REGEX_ALT, flat, n);
+    free(flat);
+
+    if (result && has_eps && !regex_node_nullable(result)) {
+        regex_node *optional = simplify_new(ctx, REGEX_QUESTION, &result, 1);
+        if (optional) result = normalize_unary(ctx, optional);
+    }
+    return result;
+}
+
+
+// ============================================================================
+// Intersection and unary operators
+// ============================================================================
+
+static regex_node* normalize_and(simplify_ctx *ctx, regex_node *node) {
+    size_t total = 0;
+    for (size_t i = 0; i < node->nkids; i++) {
+        total += node->kids[i]->kind == REGEX_AND ? node->kids[i]->nkids : 1;
+    }
+
+    regex_node **flat = malloc(total * sizeof(regex_node*));
+    if (!flat) {
+        ctx->failed = true;
+        return node;
+    }
+
+    size_t n = 0;
+    for (size_t i = 0; i < node->nkids; i++) {
+        regex_node *kid = node->kids[i];
+        size_t count = kid->kind == REGEX_AND ? kid->nkids : 1;
+        regex_node **parts = kid->kind == REGEX_AND ? kid->kids : &node->kids[i];
+        for (size_t j = 0; j < count; j++) {
+            bool seen = false;
+            for (size_t k = 0; k < n && !seen; k++) seen = regex_node_equal(flat[k], parts[j]);
+            if (!seen) flat[n++] = parts[j];
+        }
+    }
+
+    regex_node *result = n == 1 ? flat[0] : simplify_new(ctx, REGEX_AND, flat, n);
+    free(flat);
+    return result ? result : node;
+}
+
+static regex_node* normalize_unary(simplify_ctx *ctx, regex_node *node) {
+    regex_node *kid = node->kids[0];
+
+    switch (node->kind) {
+        case REGEX_STAR:
+            if (kid->kind == REGEX_EMPTY) return kid;
+            if (kid->kind == REGEX_STAR || kid->kind == REGEX_PLUS || kid->kind == REGEX_QUESTION) {
+                node->kids[0] = kid->kids[0];
+            }
+            return node;
+
+        case REGEX_PLUS:
+            if (kid->kind == REGEX_EMPTY || kid->kind == REGEX_STAR || kid->kind == REGEX_PLUS) return kid;
+            if (kid->kind == REGEX_QUESTION) {
+                node->kind = REGEX_STAR;
+                node->kids[0] = kid->kids[0];
+            } else if (regex_node_nullable(kid)) {
+                node->kind = REGEX_STAR;
+            }
+            return node;
+
+        case REGEX_QUESTION:
+            if (regex_node_nullable(kid)) return kid;
+            if (kid->kind == REGEX_PLUS) {
+                node->kind = REGEX_STAR;
+                node->kids[0] = kid->kids[0];
+            }
+            return node;
+
+        case REGEX_NOT:
+            return kid->kind == REGEX_NOT ? kid->kids[0] : node;
+
+        case REGEX_REPEAT:
+            if (kid->kind == REGEX_EMPTY || node->max == 0) return simplify_new(ctx, REGEX_EMPTY, NULL, 0);
+            if (node->min == 1 && node->max == 1) return kid;
+            if (node->min > 1) return node;
+
+            if (node->max == REGEX_UNBOUNDED) node->kind = node->min == 0 ? REGEX_STAR : REGEX_PLUS;
+            else if (node->min == 0 && node->max == 1) node->kind = REGEX_QUESTION;
+            else return node;
+            node->min = node->max = 0;
+            return normalize_unary(ctx, node);
+
+        default:
+            return node;
+    }
+}
+
+static regex_node* simplify_node(simplify_ctx *ctx, regex_node *node) {
+    if (!node) return NULL;
+
+    // Kids are replaced one at a time by equivalent subtrees
+    for (size_t i = 0; i < node->nkids; i++) {
+        regex_node *kid = simplify_node(ctx, node->kids[i]);
+        if (kid) node->kids[i] = kid;
+    }
+
+    regex_node *result;
+    switch (node->kind) {
+        case REGEX_CONCAT:
+            result = normalize_concat(ctx, node->kids, node->nkids);
+            break;
+        case REGEX_ALT:
+            result = normalize_alt(ctx, node->kids, node->nkids);
+            break;
+        case REGEX_AND:
+            result = normalize_and(ctx, node);
+            break;
+        case REGEX_STAR:
+        case REGEX_PLUS:
+        case REGEX_QUESTION:
+        case REGEX_REPEAT:
+        case REGEX_NOT:
+            result = normalize_unary(ctx, node);
+            break;
+        default:
+            result = node;
+            break;
+    }
+    return result ? result : node;
+}
+
+fa_error_t regex_simplify(regex_ast* ast) {
+    if (!ast || !ast->root) return FA_ERR_NULL_ARGUMENT;
+
+    simplify_ctx ctx = { ast, false };
+    ast->root = simplify_node(&ctx, ast->root);
+    return ctx.failed ? FA_ERR_OUT_OF_MEMORY : FA_SUCCESS;
+}
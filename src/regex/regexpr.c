@@ -4,75 +4,539 @@
 #include <string.h>
 #include <ctype.h>
 
+#define REGEX_ARENA_BLOCK 8192
 
 
-int precedence(const char op) {
-    switch (op) {
-        case '*': case '+': case '?': return 3;
-        case '.': return 2;
-        case '|': return 1;
-        default: return 0;
+struct regex_arena_block {
+    struct regex_arena_block *next;
+    size_t used;
+    size_t capacity;
+    max_align_t data[];
+};
+
+void* regex_ast_alloc(regex_ast* ast, size_t size) {
+    // Keep every allocation aligned for any node type
+    size = (size + sizeof(max_align_t) - 1) / sizeof(max_align_t) * sizeof(max_align_t);
+    if (size == 0) size = sizeof(max_align_t);
+
+    regex_arena_block *block = ast->arena;
+    if (!block || block->used + size > block->capacity) {
+        size_t capacity = size > REGEX_ARENA_BLOCK ? size : REGEX_ARENA_BLOCK;
+        block = malloc(sizeof(regex_arena_block) + capacity);
+        if (!block) return NULL;
+        block->next = ast->arena;
+        block->used = 0;
+        block->capacity = capacity;
+        ast->arena = block;
+    }
+
+    void *out = (char*)block->data + block->used;
+    block->used += size;
+    memset(out, 0, size);
+    return out;
+}
+
+void regex_ast_destroy(regex_ast* ast) {
+    if (!ast) return;
+    regex_arena_block *block = ast->arena;
+    while (block) {
+        regex_arena_block *next = block->next;
+        free(block);
+        block = next;
+    }
+    free(ast);
+}
+
+
+// ============================================================================
+// Parser
+// ============================================================================
+
+/*
+ * Grammar, lowest precedence first:
+ *
+ *   alt     := and ('|' and)*
+ *   and     := concat ('&' concat)*          (REGEX_PARSE_BOOLEAN only)
+ *   concat  := unary*
+ *   unary   := '!' unary | repeat            ('!' with REGEX_PARSE_BOOLEAN only)
+ *   repeat  := atom ('*' | '+' | '?' | '{' m [',' [n]] '}')*
+ *   atom    := literal | escape | class | '.' | '^' | '$' | '(' alt ')'
+ */
+
+typedef struct regex_parser {
+    regex_ast *ast;
+    const char *p;
+    bool boolean;
+    fa_error_t error;
+    size_t depth;           // Groups and '!' currently open
+    size_t height;          // Height of the node parsed last
+    size_t size;            // Its size with every repeat expanded
+} regex_parser;
+
+/* Growable list of nodes used while collecting operands. */
+typedef struct regex_list {
+    regex_node **items;
+    size_t count;
+    size_t capacity;
+} regex_list;
+
+static bool regex_list_push(regex_list *list, regex_node *node) {
+    if (list->count >= list->capacity) {
+        size_t new_capacity = list->capacity ? list->capacity * 2 : 8;
+        regex_node **items = realloc(list->items, new_capacity * sizeof(regex_node*));
+        if (!items) return false;
+        list->items = items;
+        list->capacity = new_capacity;
+    }
+    list->items[list->count++] = node;
+    return true;
+}
+
+static regex_node* regex_fail(regex_parser *ps, fa_error_t error) {
+    if (ps->error == FA_SUCCESS) ps->error = error;
+    return NULL;
+}
+
+/*
+ * Records the shape of the node just parsed. Later passes recurse over the
+ * tree and copy repeated subtrees, so both are capped.
+ */
+static bool regex_shape(regex_parser *ps, size_t height, size_t size) {
+    if (height > REGEX_DEPTH_MAX || size > REGEX_SIZE_MAX) {
+        regex_fail(ps, FA_ERR_REGEX_TOO_COMPLEX);
+        return false;
+    }
+    ps->height = height;
+    ps->size = size;
+    return true;
+}
+
+/* Adds the shape of the operand just parsed to that of an n-ary node. */
+static bool regex_add_operand(regex_parser *ps, size_t *height, size_t *size) {
+    if (ps->height > *height) *height = ps->height;
+    *size += ps->size;
+    if (*size > REGEX_SIZE_MAX) {
+        regex_fail(ps, FA_ERR_REGEX_TOO_COMPLEX);
+        return false;
+    }
+    return true;
+}
+
+static regex_node* regex_new_node(regex_parser *ps, regex_kind kind) {
+    regex_node *node = regex_ast_alloc(ps->ast, sizeof(regex_node));
+    if (!node) return regex_fail(ps, FA_ERR_OUT_OF_MEMORY);
+    node->kind = kind;
+    return node;
+}
+
+static regex_node* regex_new_unary(regex_parser *ps, regex_kind kind, regex_node *kid) {
+    regex_node *node = regex_new_node(ps, kind);
+    if (!node) return NULL;
+    node->kids = regex_ast_alloc(ps->ast, sizeof(regex_node*));
+    if (!node->kids) return regex_fail(ps, FA_ERR_OUT_OF_MEMORY);
+    node->kids[0] = kid;
+    node->nkids = 1;
+    return node;
+}
+
+/* Turns a list of operands into a node; a single operand is returned as is. */
+static regex_node* regex_new_nary(regex_parser *ps, regex_kind kind, regex_list *list) {
+    if (list->count == 0) return regex_new_node(ps, REGEX_EMPTY);
+    if (list->count == 1) return list->items[0];
+
+    regex_node *node = regex_new_node(ps, kind);
+    if (!node) return NULL;
+    node->kids = regex_ast_alloc(ps->ast, list->count * sizeof(regex_node*));
+    if (!node->kids) return regex_fail(ps, FA_ERR_OUT_OF_MEMORY);
+    memcpy(node->kids, list->items, list->count * sizeof(regex_node*));
+    node->nkids = list->count;
+    return node;
+}
+
+static bool regex_is_meta(const regex_parser *ps, char c) {
+    if (ps->boolean && (c == '&' || c == '!')) return true;
+    return strchr("|*+?(){}[].^$\\", c) != NULL;
+}
+
+static void regex_class_add_range(regex_class *cls, unsigned char lo, unsigned char hi) {
+    for (unsigned c = lo; c <= hi; c++) regex_class_add(cls, (unsigned char)c);
+}
+
+static void regex_class_negate(regex_class *cls) {
+    for (int i = 0; i < 4; i++) cls->bits[i] = ~cls->bits[i];
+    cls->bits[0] &= ~1ULL;                  // '\0' never occurs in a word
+}
+
+static void regex_class_union(regex_class *cls, const regex_class *other) {
+    for (int i = 0; i < 4; i++) cls->bits[i] |= other->bits[i];
+}
+
+/* Fills `cls` for the shorthand class letter `c` (d, w, s and uppercase). */
+static bool regex_shorthand(char c, regex_class *cls) {
+    memset(cls, 0, sizeof(regex_class));
+    switch (tolower((unsigned char)c)) {
+        case 'd':
+            regex_class_add_range(cls, '0', '9');
+            break;
+        case 'w':
+            regex_class_add_range(cls, 'a', 'z');
+            regex_class_add_range(cls, 'A', 'Z');
+            regex_class_add_range(cls, '0', '9');
+            regex_class_add(cls, '_');
+            break;
+        case 's':
+            regex_class_add(cls, ' ');
+            regex_class_add_range(cls, '\t', '\r');
+            break;
+        default:
+            return false;
     }
+    if (isupper((unsigned char)c)) regex_class_negate(cls);
+    return true;
+}
+
+static int regex_hex(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
 }
 
+/*
+ * Parses the escape after a backslash. Single bytes are stored in `*ch`
+ * and 1 is returned; shorthand classes fill `cls` and return 2; errors
+ * return 0.
+ */
+static int regex_parse_escape(regex_parser *ps, unsigned char *ch, regex_class *cls) {
+    char c = *ps->p;
+    if (c == '\0') {
+        regex_fail(ps, FA_ERR_REGEX_TRAILING_BACKSLASH);
+        return 0;
+    }
+    ps->p++;
 
-void push(Stack *s, const char c) { s->data[++s->top] = c; }
-char pop(Stack *s) { return (s->top == -1) ? '\0' : s->data[s->top--]; }
-char peek(const Stack *s) { return (s->top == -1) ? '\0' : s->data[s->top]; }
-int is_stack_empty(const Stack *s) { return s->top == -1; }
+    switch (c) {
+        case 'n': *ch = '\n'; return 1;
+        case 't': *ch = '\t'; return 1;
+        case 'r': *ch = '\r'; return 1;
+        case 'f': *ch = '\f'; return 1;
+        case 'v': *ch = '\v'; return 1;
+        case 'x': {
+            int hi = regex_hex(ps->p[0]);
+            int lo = hi >= 0 ? regex_hex(ps->p[1]) : -1;
+            if (lo < 0 || (hi == 0 && lo == 0)) {
+                regex_fail(ps, FA_ERR_REGEX_INVALID_ESCAPE);
+                return 0;
+            }
+            ps->p += 2;
+            *ch = (unsigned char)(hi * 16 + lo);
+            return 1;
+        }
+        default:
+            break;
+    }
 
+    if (regex_shorthand(c, cls)) return 2;
+    if (isalnum((unsigned char)c)) {
+        regex_fail(ps, FA_ERR_REGEX_INVALID_ESCAPE);
+        return 0;
+    }
+    *ch = (unsigned char)c;
+    return 1;
+}
 
-int needs_concat(const char prev, const char curr) {
-    if (prev == '\0') return 0;
-    // Insert concatenation if:
-    // - prev is a letter or `)` and curr is a letter or `(` or `*`/`+`/`?`
-    if ((isalnum(prev) || prev == ')' || prev == '*' || prev == '+' || prev == '?') && (isalnum(curr) || curr == '(')){
-        return 1;
+/* Reads one class member byte; returns 0 on error, 1 for a byte, 2 for a shorthand. */
+static int regex_class_item(regex_parser *ps, unsigned char *ch, regex_class *shorthand) {
+    char c = *ps->p;
+    if (c == '\0') {
+        regex_fail(ps, FA_ERR_REGEX_UNEXPECTED_TOKEN);
+        return 0;
     }
-    return 0;
+    ps->p++;
+    if (c == '\\') return regex_parse_escape(ps, ch, shorthand);
+    *ch = (unsigned char)c;
+    return 1;
 }
 
-char* infix_to_postfix(const char *regex) {
-    Stack opStack;
-    opStack.top = -1;
+static regex_node* regex_parse_class(regex_parser *ps) {
+    regex_class *cls = regex_ast_alloc(ps->ast, sizeof(regex_class));
+    if (!cls) return regex_fail(ps, FA_ERR_OUT_OF_MEMORY);
+
+    bool negate = *ps->p == '^';
+    if (negate) ps->p++;
+
+    bool first = true;
+    while (*ps->p != ']' || first) {
+        unsigned char lo, hi;
+        regex_class shorthand;
+        int kind = regex_class_item(ps, &lo, &shorthand);
+        if (kind == 0) return NULL;
+        first = false;
+
+        if (kind == 2) {
+            regex_class_union(cls, &shorthand);
+            continue;
+        }
 
-    char *postfix = malloc(MAX_LEN * sizeof(char));
+        // A '-' right before ']' is a literal
+        if (ps->p[0] == '-' && ps->p[1] != ']' && ps->p[1] != '\0') {
+            ps->p++;
+            kind = regex_class_item(ps, &hi, &shorthand);
+            if (kind == 0) return NULL;
+            if (kind == 2 || hi < lo) return regex_fail(ps, FA_ERR_REGEX_INVALID_PATTERN);
+            regex_class_add_range(cls, lo, hi);
+        } else {
+            regex_class_add(cls, lo);
+        }
+    }
+    ps->p++;
+
+    if (negate) regex_class_negate(cls);
+
+    regex_node *node = regex_new_node(ps, REGEX_CLASS);
+    if (node) node->cls = cls;
+    return node;
+}
 
-    int j = 0;
-    char prev = '\0';
+static regex_node* regex_parse_alt(regex_parser *ps);
 
-    for (int i = 0; regex[i] != '\0'; i++) {
-        const char c = regex[i];
+static regex_node* regex_parse_atom(regex_parser *ps) {
+    char c = *ps->p;
 
-        // Insert explicit concatenation `·`
-        if (needs_concat(prev, c)) {
-            while (!is_stack_empty(&opStack) && precedence(peek(&opStack)) >= precedence('.'))
-                postfix[j++] = pop(&opStack);
-            push(&opStack, '.');
+    switch (c) {
+        case '(': {
+            ps->p++;
+            if (++ps->depth > REGEX_DEPTH_MAX) return regex_fail(ps, FA_ERR_REGEX_TOO_COMPLEX);
+            regex_node *inner = regex_parse_alt(ps);
+            ps->depth--;
+            if (!inner) return NULL;
+            if (*ps->p != ')') return regex_fail(ps, FA_ERR_REGEX_UNBALANCED_PARENTHESES);
+            ps->p++;
+            return inner;
         }
+        case '[':
+            ps->p++;
+            return regex_parse_class(ps);
+        case '.': {
+            ps->p++;
+            regex_class *cls = regex_ast_alloc(ps->ast, sizeof(regex_class));
+            if (!cls) return regex_fail(ps, FA_ERR_OUT_OF_MEMORY);
+            regex_class_add(cls, '\n');
+            regex_class_negate(cls);
+            regex_node *node = regex_new_node(ps, REGEX_CLASS);
+            if (node) node->cls = cls;
+            return node;
+        }
+        case '^':
+            ps->p++;
+            return regex_new_node(ps, REGEX_ANCHOR_START);
+        case '$':
+            ps->p++;
+            return regex_new_node(ps, REGEX_ANCHOR_END);
+        case '\\': {
+            ps->p++;
+            unsigned char ch;
+            regex_class shorthand;
+            int kind = regex_parse_escape(ps, &ch, &shorthand);
+            if (kind == 0) return NULL;
+
+            if (kind == 2) {
+                regex_class *cls = regex_ast_alloc(ps->ast, sizeof(regex_class));
+                if (!cls) return regex_fail(ps, FA_ERR_OUT_OF_MEMORY);
+                *cls = shorthand;
+                regex_node *node = regex_new_node(ps, REGEX_CLASS);
+                if (node) node->cls = cls;
+                return node;
+            }
+            regex_node *node = regex_new_node(ps, REGEX_CHAR);
+            if (node) node->ch = ch;
+            return node;
+        }
+        default:
+            break;
+    }
+
+    if (c == '\0' || regex_is_meta(ps, c)) {
+        return regex_fail(ps, c == ')' ? FA_ERR_REGEX_UNBALANCED_PARENTHESES
+                                       : FA_ERR_REGEX_UNEXPECTED_TOKEN);
+    }
 
-        if (isalnum(c)) {
-            postfix[j++] = c;
-        } else if (c == '(') {
-            push(&opStack, c);
-        } else if (c == ')') {
-            while (!is_stack_empty(&opStack) && peek(&opStack) != '(')
-                postfix[j++] = pop(&opStack);
-            pop(&opStack);
+    ps->p++;
+    regex_node *node = regex_new_node(ps, REGEX_CHAR);
+    if (node) node->ch = (unsigned char)c;
+    return node;
+}
+
+/* Reads a decimal bound; returns -1 if there is none. */
+static int regex_parse_bound(regex_parser *ps) {
+    if (!isdigit((unsigned char)*ps->p)) return -1;
+    long value = 0;
+    while (isdigit((unsigned char)*ps->p)) {
+        value = value * 10 + (*ps->p++ - '0');
+        if (value > REGEX_REPEAT_MAX) value = REGEX_REPEAT_MAX + 1;
+    }
+    return (int)value;
+}
+
+static regex_node* regex_parse_repeat(regex_parser *ps) {
+    regex_node *node = regex_parse_atom(ps);
+    // A group's shape was recorded by its regex_parse_alt
+    if (node && node->nkids == 0 && !regex_shape(ps, 1, 1)) return NULL;
+
+    while (node) {
+        char c = *ps->p;
+        if (c == '*' || c == '+' || c == '?') {
+            ps->p++;
+            regex_kind kind = c == '*' ? REGEX_STAR : c == '+' ? REGEX_PLUS : REGEX_QUESTION;
+            if (!regex_shape(ps, ps->height + 1, ps->size + 1)) return NULL;
+            node = regex_new_unary(ps, kind, node);
+        } else if (c == '{') {
+            ps->p++;
+            int min = regex_parse_bound(ps);
+            int max = min;
+            if (min < 0) return regex_fail(ps, FA_ERR_REGEX_INVALID_PATTERN);
+            if (*ps->p == ',') {
+                ps->p++;
+                max = regex_parse_bound(ps);
+                if (max < 0) max = REGEX_UNBOUNDED;
+            }
+            if (*ps->p != '}') return regex_fail(ps, FA_ERR_REGEX_UNEXPECTED_TOKEN);
+            ps->p++;
+            if (min > REGEX_REPEAT_MAX || max > REGEX_REPEAT_MAX ||
+                (max != REGEX_UNBOUNDED && max < min)) {
+                return regex_fail(ps, FA_ERR_REGEX_INVALID_PATTERN);
+            }
+            // Expanding {m,n} makes n copies, {m,} m + 1
+            size_t copies = (size_t)(max == REGEX_UNBOUNDED ? min + 1 : max);
+            if (copies == 0) copies = 1;
+            if (ps->size > REGEX_SIZE_MAX / copies) return regex_fail(ps, FA_ERR_REGEX_TOO_COMPLEX);
+            if (!regex_shape(ps, ps->height + 1, ps->size * copies)) return NULL;
+
+            node = regex_new_unary(ps, REGEX_REPEAT, node);
+            if (node) {
+                node->min = min;
+                node->max = max;
+            }
         } else {
-            while (!is_stack_empty(&opStack) && precedence(peek(&opStack)) >= precedence(c))
-                postfix[j++] = pop(&opStack);
-            push(&opStack, c);
+            break;
+        }
+    }
+    return node;
+}
+
+static regex_node* regex_parse_unary(regex_parser *ps) {
+    if (ps->boolean && *ps->p == '!') {
+        ps->p++;
+        if (++ps->depth > REGEX_DEPTH_MAX) return regex_fail(ps, FA_ERR_REGEX_TOO_COMPLEX);
+        regex_node *kid = regex_parse_unary(ps);
+        ps->depth--;
+        if (!kid || !regex_shape(ps, ps->height + 1, ps->size + 1)) return NULL;
+        return regex_new_unary(ps, REGEX_NOT, kid);
+    }
+    return regex_parse_repeat(ps);
+}
+
+static bool regex_ends_concat(const regex_parser *ps, char c) {
+    return c == '\0' || c == '|' || c == ')' || (ps->boolean && c == '&');
+}
+
+static regex_node* regex_parse_concat(regex_parser *ps) {
+    regex_list list = { NULL, 0, 0 };
+    regex_node *result = NULL;
+    size_t height = 0, size = 0;
+
+    while (!regex_ends_concat(ps, *ps->p)) {
+        regex_node *node = regex_parse_unary(ps);
+        if (!node) goto done;
+        if (!regex_list_push(&list, node)) {
+            regex_fail(ps, FA_ERR_OUT_OF_MEMORY);
+            goto done;
         }
+        if (!regex_add_operand(ps, &height, &size)) goto done;
+    }
+    // A single operand is returned as is, without a node above it
+    if (!regex_shape(ps, height + (list.count > 1), size ? size : 1)) goto done;
+    result = regex_new_nary(ps, REGEX_CONCAT, &list);
 
-        prev = c;
+done:
+    free(list.items);
+    return result;
+}
+
+static regex_node* regex_parse_and(regex_parser *ps) {
+    if (!ps->boolean) return regex_parse_concat(ps);
+
+    regex_list list = { NULL, 0, 0 };
+    regex_node *result = NULL;
+    size_t height = 0, size = 0;
+
+    for (;;) {
+        regex_node *node = regex_parse_concat(ps);
+        if (!node) goto done;
+        if (!regex_list_push(&list, node)) {
+            regex_fail(ps, FA_ERR_OUT_OF_MEMORY);
+            goto done;
+        }
+        if (!regex_add_operand(ps, &height, &size)) goto done;
+        if (*ps->p != '&') break;
+        ps->p++;
     }
+    if (!regex_shape(ps, height + (list.count > 1), size)) goto done;
+    result = regex_new_nary(ps, REGEX_AND, &list);
 
-    // remaining operators
-    while (!is_stack_empty(&opStack))
-        postfix[j++] = pop(&opStack);
+done:
+    free(list.items);
+    return result;
+}
 
-    postfix[j] = '\0';
+static regex_node* regex_parse_alt(regex_parser *ps) {
+    regex_list list = { NULL, 0, 0 };
+    regex_node *result = NULL;
+    size_t height = 0, size = 0;
 
-    return postfix;
-}
\ No newline at end of file
+    for (;;) {
+        regex_node *node = regex_parse_and(ps);
+        if (!node) goto done;
+        if (!regex_list_push(&list, node)) {
+            regex_fail(ps, FA_ERR_OUT_OF_MEMORY);
+            goto done;
+        }
+        if (!regex_add_operand(ps, &height, &size)) goto done;
+        if (*ps->p != '|') break;
+        ps->p++;
+    }
+    if (!regex_shape(ps, height + (list.count > 1), size)) goto done;
+    result = regex_new_nary(ps, REGEX_ALT, &list);
+
+done:
+    free(list.items);
+    return result;
+}
+
+regex_ast* regex_parse(const char* pattern, regex_parse_flags flags, fa_error_t* error) {
+    if (error) *error = FA_SUCCESS;
+    if (!pattern) {
+        if (error) *error = FA_ERR_NULL_ARGUMENT;
+        return NULL;
+    }
+
+    regex_ast *ast = calloc(1, sizeof(regex_ast));
+    if (!ast) {
+        if (error) *error = FA_ERR_OUT_OF_MEMORY;
+        return NULL;
+    }
+
+    regex_parser ps = { ast, pattern, (flags & REGEX_PARSE_BOOLEAN) != 0, FA_SUCCESS, 0, 0, 0 };
+    ast->root = regex_parse_alt(&ps);
+    if (ast->root && *ps.p != '\0') {
+        regex_fail(&ps, *ps.p == ')' ? FA_ERR_REGEX_UNBALANCED_PARENTHESES
+                                     : FA_ERR_REGEX_UNEXPECTED_TOKEN);
+    }
+
+    if (ps.error != FA_SUCCESS || !ast->root) {
+        if (error) *error = ps.error != FA_SUCCESS ? ps.error : FA_ERR_REGEX_INVALID_PATTERN;
+        regex_ast_destroy(ast);
+        return NULL;
+    }
+    return ast;
+}
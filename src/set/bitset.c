@@ -0,0 +1,242 @@
+#include "../../include/set/bitset.h"
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define BITSET_LANES 4
+typedef __m256i bitset_vec;
+#define BITSET_LOAD(p) _mm256_loadu_si256((const __m256i*)(p))
+#define BITSET_STORE(p, v) _mm256_storeu_si256((__m256i*)(p), (v))
+#define BITSET_OR(a, b) _mm256_or_si256((a), (b))
+#define BITSET_AND(a, b) _mm256_and_si256((a), (b))
+#define BITSET_ANDNOT(a, b) _mm256_andnot_si256((a), (b))   // ~a & b
+#define BITSET_XOR(a, b) _mm256_xor_si256((a), (b))
+#define BITSET_ZERO() _mm256_setzero_si256()
+#define BITSET_IS_ZERO(v) _mm256_testz_si256((v), (v))
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define BITSET_LANES 2
+typedef __m128i bitset_vec;
+#define BITSET_LOAD(p) _mm_loadu_si128((const __m128i*)(p))
+#define BITSET_STORE(p, v) _mm_storeu_si128((__m128i*)(p), (v))
+#define BITSET_OR(a, b) _mm_or_si128((a), (b))
+#define BITSET_AND(a, b) _mm_and_si128((a), (b))
+#define BITSET_ANDNOT(a, b) _mm_andnot_si128((a), (b))      // ~a & b
+#define BITSET_XOR(a, b) _mm_xor_si128((a), (b))
+#define BITSET_ZERO() _mm_setzero_si128()
+#define BITSET_IS_ZERO(v) (_mm_movemask_epi8(_mm_cmpeq_epi8((v), _mm_setzero_si128())) == 0xffff)
+#endif
+
+
+// ============================================================================
+// Word kernels
+// ============================================================================
+
+/*
+ * Each kernel runs whole vectors first and finishes the last words one at
+ * a time. The in-place ones OR together old ^ new to report a change
+ * without a second pass.
+ */
+
+#ifdef BITSET_LANES
+#define BITSET_KERNEL(name, vec_op, word_op)                                   \
+bool name(uint64_t* dst, const uint64_t* src, size_t nwords) {                 \
+    bitset_vec diff = BITSET_ZERO();                                           \
+    size_t w = 0;                                                              \
+    for (; w + BITSET_LANES <= nwords; w += BITSET_LANES) {                    \
+        bitset_vec a = BITSET_LOAD(dst + w), b = BITSET_LOAD(src + w);         \
+        bitset_vec x = vec_op;                                                 \
+        diff = BITSET_OR(diff, BITSET_XOR(a, x));                              \
+        BITSET_STORE(dst + w, x);                                              \
+    }                                                                          \
+    uint64_t changed = BITSET_IS_ZERO(diff) ? 0 : 1;                           \
+    for (; w < nwords; w++) {                                                  \
+        uint64_t a = dst[w], b = src[w], x = word_op;                          \
+        changed |= a ^ x;                                                      \
+        dst[w] = x;                                                            \
+    }                                                                          \
+    return changed != 0;                                                       \
+}
+#else
+#define BITSET_KERNEL(name, vec_op, word_op)                                   \
+bool name(uint64_t* dst, const uint64_t* src, size_t nwords) {                 \
+    uint64_t changed = 0;                                                      \
+    for (size_t w = 0; w < nwords; w++) {                                      \
+        uint64_t a = dst[w], b = src[w], x = word_op;                          \
+        changed |= a ^ x;                                                      \
+        dst[w] = x;                                                            \
+    }                                                                          \
+    return changed != 0;                                                       \
+}
+#endif
+
+BITSET_KERNEL(bitset_words_or, BITSET_OR(a, b), a | b)
+BITSET_KERNEL(bitset_words_and, BITSET_AND(a, b), a & b)
+BITSET_KERNEL(bitset_words_andnot, BITSET_ANDNOT(b, a), a & ~b)
+
+bool bitset_words_equal(const uint64_t* a, const uint64_t* b, size_t nwords) {
+    size_t w = 0;
+#ifdef BITSET_LANES
+    for (; w + BITSET_LANES <= nwords; w += BITSET_LANES) {
+        bitset_vec x = BITSET_XOR(BITSET_LOAD(a + w), BITSET_LOAD(b + w));
+        if (!BITSET_IS_ZERO(x)) return false;
+    }
+#endif
+    for (; w < nwords; w++) {
+        if (a[w] != b[w]) return false;
+    }
+    return true;
+}
+
+bool bitset_words_is_subset(const uint64_t* a, const uint64_t* b, size_t nwords) {
+    size_t w = 0;
+#ifdef BITSET_LANES
+    for (; w + BITSET_LANES <= nwords; w += BITSET_LANES) {
+        bitset_vec x = BITSET_ANDNOT(BITSET_LOAD(b + w), BITSET_LOAD(a + w));
+        if (!BITSET_IS_ZERO(x)) return false;
+    }
+#endif
+    for (; w < nwords; w++) {
+        if (a[w] & ~b[w]) return false;
+    }
+    return true;
+}
+
+bool bitset_words_intersects(const uint64_t* a, const uint64_t* b, size_t nwords) {
+    size_t w = 0;
+#ifdef BITSET_LANES
+    for (; w + BITSET_LANES <= nwords; w += BITSET_LANES) {
+        bitset_vec x = BITSET_AND(BITSET_LOAD(a + w), BITSET_LOAD(b + w));
+        if (!BITSET_IS_ZERO(x)) return true;
+    }
+#endif
+    for (; w < nwords; w++) {
+        if (a[w] & b[w]) return true;
+    }
+    return false;
+}
+
+bool bitset_words_is_empty(const uint64_t* words, size_t nwords) {
+    size_t w = 0;
+#ifdef BITSET_LANES
+    for (; w + BITSET_LANES <= nwords; w += BITSET_LANES) {
+        bitset_vec x = BITSET_LOAD(words + w);
+        if (!BITSET_IS_ZERO(x)) return false;
+    }
+#endif
+    for (; w < nwords; w++) {
+        if (words[w]) return false;
+    }
+    return true;
+}
+
+size_t bitset_words_count(const uint64_t* words, size_t nwords) {
+    // popcnt per word; four accumulators keep the adds independent
+    size_t c0 = 0, c1 = 0, c2 = 0, c3 = 0, w = 0;
+    for (; w + 4 <= nwords; w += 4) {
+        c0 += (size_t)__builtin_popcountll(words[w]);
+        c1 += (size_t)__builtin_popcountll(words[w + 1]);
+        c2 += (size_t)__builtin_popcountll(words[w + 2]);
+        c3 += (size_t)__builtin_popcountll(words[w + 3]);
+    }
+    for (; w < nwords; w++) c0 += (size_t)__builtin_popcountll(words[w]);
+    return c0 + c1 + c2 + c3;
+}
+
+uint64_t bitset_words_hash(const uint64_t* words, size_t nwords) {
+    uint64_t h = 0x9e3779b97f4a7c15ULL ^ nwords;
+    for (size_t w = 0; w < nwords; w++) {
+        h = (h ^ words[w]) * 0xff51afd7ed558ccdULL;
+        h ^= h >> 32;
+    }
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+size_t bitset_words_next(const uint64_t* words, size_t nwords, size_t from) {
+    size_t w = from / 64;
+    if (w >= nwords) return BITSET_END;
+    uint64_t word = words[w] & (~0ULL << (from % 64));
+    while (!word) {
+        if (++w >= nwords) return BITSET_END;
+        word = words[w];
+    }
+    return w * 64 + (size_t)__builtin_ctzll(word);
+}
+
+
+// ============================================================================
+// BitSet
+// ============================================================================
+
+BitSet* bitset_create(size_t nbits) {
+    BitSet* set = malloc(sizeof(BitSet));
+    if (!set) return NULL;
+
+    set->nbits = nbits;
+    set->nwords = BITSET_WORDS(nbits);
+    set->words = calloc(set->nwords ? set->nwords : 1, sizeof(uint64_t));
+    if (!set->words) {
+        free(set);
+        return NULL;
+    }
+    return set;
+}
+
+BitSet* bitset_copy(const BitSet* set) {
+    if (!set) return NULL;
+
+    BitSet* copy = bitset_create(set->nbits);
+    if (copy) memcpy(copy->words, set->words, set->nwords * sizeof(uint64_t));
+    return copy;
+}
+
+void bitset_destroy(BitSet* set) {
+    if (!set) return;
+
+    free(set->words);
+    free(set);
+}
+
+void bitset_clear(BitSet* set) {
+    memset(set->words, 0, set->nwords * sizeof(uint64_t));
+}
+
+void bitset_assign(BitSet* dst, const BitSet* src) {
+    memcpy(dst->words, src->words, dst->nwords * sizeof(uint64_t));
+}
+
+bool bitset_union(BitSet* dst, const BitSet* src) {
+    return bitset_words_or(dst->words, src->words, dst->nwords);
+}
+
+bool bitset_intersection(BitSet* dst, const BitSet* src) {
+    return bitset_words_and(dst->words, src->words, dst->nwords);
+}
+
+bool bitset_difference(BitSet* dst, const BitSet* src) {
+    return bitset_words_andnot(dst->words, src->words, dst->nwords);
+}
+
+bool bitset_is_equal(const BitSet* a, const BitSet* b) {
+    return a->nbits == b->nbits && bitset_words_equal(a->words, b->words, a->nwords);
+}
+
+bool bitset_is_empty(const BitSet* set) {
+    return bitset_words_is_empty(set->words, set->nwords);
+}
+
+size_t bitset_count(const BitSet* set) {
+    return bitset_words_count(set->words, set->nwords);
+}
+
+uint64_t bitset_hash(const BitSet* set) {
+    return bitset_words_hash(set->words, set->nwords);
+}
+
+size_t bitset_next(const BitSet* set, size_t from) {
+    return bitset_words_next(set->words, set->nwords, from);
+}
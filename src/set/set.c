@@ -2,10 +2,14 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
 #include <assert.h>
 
 #include "../../include/common.h"
 
+#define SET_EMPTY_SLOT SIZE_MAX
+#define SET_INITIAL_SLOTS 32
+
 
 Set* set_create(size_t element_size, SetCompareFunction compare, SetHashFunction hash) {
     return set_create_with_functions(element_size, compare, hash, 
@@ -35,11 +39,18 @@ Set* set_create_with_functions(size_t element_size,
     
     const size_t INITIAL_CAPACITY = 16;
     set->members = malloc(INITIAL_CAPACITY * sizeof(void*));
-    if (!set->members) {
+    set->hashes = malloc(INITIAL_CAPACITY * sizeof(size_t));
+    set->slots = malloc(SET_INITIAL_SLOTS * sizeof(size_t));
+    if (!set->members || !set->hashes || !set->slots) {
+        free(set->members);
+        free(set->hashes);
+        free(set->slots);
         free(set);
         return NULL;
     }
+    memset(set->slots, 0xff, SET_INITIAL_SLOTS * sizeof(size_t));
     
+    set->nslots = SET_INITIAL_SLOTS;
     set->length = 0;
     set->capacity = INITIAL_CAPACITY;
     set->element_size = element_size;
@@ -56,6 +67,8 @@ void set_destroy(Set* set) {
     
     set_clear(set);
     free(set->members);
+    free(set->hashes);
+    free(set->slots);
     free(set);
 }
 
@@ -68,18 +81,65 @@ void set_clear(Set* set) {
         }
     }
     set->length = 0;
+    memset(set->slots, 0xff, set->nslots * sizeof(size_t));
 }
 
 
-static int find_index(const Set* set, const void* element) {
-    if (!set || !element || set->length == 0) return -1;
-    
+// Spreads weak hashes (small ints, DJB2) over the low bits used as slot.
+static size_t set_slot(const Set* set, size_t hash) {
+    uint64_t h = hash;
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    return (size_t)h & (set->nslots - 1);
+}
+
+static void set_index_member(Set* set, size_t i) {
+    size_t mask = set->nslots - 1;
+    size_t h = set_slot(set, set->hashes[i]);
+    while (set->slots[h] != SET_EMPTY_SLOT) h = (h + 1) & mask;
+    set->slots[h] = i;
+}
+
+// Rebuilds the index with at least `nslots` slots (a power of two).
+static bool set_rebuild_index(Set* set, size_t nslots) {
+    if (nslots != set->nslots) {
+        size_t* slots = malloc(nslots * sizeof(size_t));
+        if (!slots) return false;
+        free(set->slots);
+        set->slots = slots;
+        set->nslots = nslots;
+    }
+    memset(set->slots, 0xff, set->nslots * sizeof(size_t));
     for (size_t i = 0; i < set->length; i++) {
-        if (set->members[i] && set->compare(set->members[i], element)) {
+        set_index_member(set, i);
+    }
+    return true;
+}
+
+// Keeps the index at most half full once it holds `count` members.
+static bool set_reserve_index(Set* set, size_t count) {
+    if (count * 2 <= set->nslots) return true;
+    size_t nslots = set->nslots;
+    while (count * 2 > nslots) nslots *= 2;
+    return set_rebuild_index(set, nslots);
+}
+
+static size_t find_index_hashed(const Set* set, const void* element, size_t hash) {
+    size_t mask = set->nslots - 1;
+    for (size_t h = set_slot(set, hash); set->slots[h] != SET_EMPTY_SLOT; h = (h + 1) & mask) {
+        size_t i = set->slots[h];
+        if (set->hashes[i] == hash && set->members[i] &&
+            set->compare(set->members[i], element)) {
             return i;
         }
     }
-    return -1;
+    return SET_EMPTY_SLOT;
+}
+
+static size_t find_index(const Set* set, const void* element) {
+    if (!set || !element || set->length == 0) return SET_EMPTY_SLOT;
+    return find_index_hashed(set, element, set->hash(element));
 }
 
 
@@ -87,19 +147,17 @@ bool set_insert(Set* set, const void* element) {
     if (!set || !element) return false;
     
     // Check if element already exists
-    if (set_contains(set, element)) {
+    size_t hash = set->hash(element);
+    if (set->length > 0 && find_index_hashed(set, element, hash) != SET_EMPTY_SLOT) {
         return false; 
     }
     
     
-    if (set->length >= set->capacity) {
-        size_t new_capacity = set->capacity * 2;
-        void** new_members = realloc(set->members, new_capacity * sizeof(void*));
-        if (!new_members) {
-            return false;
-        }
-        set->members = new_members;
-        set->capacity = new_capacity;
+    if (set->length >= set->capacity && !set_reserve(set, set->capacity * 2)) {
+        return false;
+    }
+    if (!set_reserve_index(set, set->length + 1)) {
+        return false;
     }
     
     // Allocate memory for the new element
@@ -117,8 +175,13 @@ bool set_insert(Set* set, const void* element) {
         free(new_element);
         new_element = copied_element;
     }
+    if (!new_element) {
+        return false;
+    }
     
     set->members[set->length] = new_element;
+    set->hashes[set->length] = hash;
+    set_index_member(set, set->length);
     set->length++;
     
     return true;
@@ -127,25 +190,28 @@ bool set_insert(Set* set, const void* element) {
 bool set_remove(Set* set, const void* element) {
     if (!set || !element) return false;
     
-    int index = find_index(set, element);
-    if (index < 0) return false;
+    size_t index = find_index(set, element);
+    if (index == SET_EMPTY_SLOT) return false;
     
     // Free the element
     set->free(set->members[index]);
     
-    // Shift elements to fill the gap
+    // Shift elements to fill the gap, keeping insertion order
     for (size_t i = index; i < set->length - 1; i++) {
         set->members[i] = set->members[i + 1];
+        set->hashes[i] = set->hashes[i + 1];
     }
     
     set->length--;
     set->members[set->length] = NULL; 
     
+    // Positions moved, so the index is rebuilt in place
+    set_rebuild_index(set, set->nslots);
     return true;
 }
 
 bool set_contains(const Set* set, const void* element) {
-    return find_index(set, element) >= 0;
+    return find_index(set, element) != SET_EMPTY_SLOT;
 }
 
 size_t set_size(const Set* set) {
@@ -179,6 +245,10 @@ Set* set_union(const Set* setA, const Set* setB) {
     );
     
     if (!new_set) return NULL;
+    if (!set_reserve(new_set, setA->length + setB->length)) {
+        set_destroy(new_set);
+        return NULL;
+    }
     
     // Copy all elements from setA
     for (size_t i = 0; i < setA->length; i++) {
@@ -370,15 +440,19 @@ Set* set_copy(const Set* set) {
 
 // Utility functions
 bool set_reserve(Set* set, size_t capacity) {
-    if (!set || capacity <= set->capacity) return false;
+    if (!set) return false;
+    if (capacity <= set->capacity) return true;
     
     void** new_members = realloc(set->members, capacity * sizeof(void*));
-    if (new_members) {
-        set->members = new_members;
-        set->capacity = capacity;
-    }
+    if (!new_members) return false;
+    set->members = new_members;
 
-    return true;
+    size_t* new_hashes = realloc(set->hashes, capacity * sizeof(size_t));
+    if (!new_hashes) return false;
+    set->hashes = new_hashes;
+
+    set->capacity = capacity;
+    return set_reserve_index(set, capacity);
 }
 
 double set_load_factor(const Set* set) {
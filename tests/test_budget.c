@@ -0,0 +1,137 @@
+#include "test_util.h"
+
+/*
+ * Budgeted operations: each limit stops an exponential construction with
+ * FA_ERR_BUDGET_EXCEEDED and the matching reason, an unlimited budget
+ * changes nothing, and the stats report the work done.
+ */
+
+// (a|b)*a(a|b){n} has 2^(n+1) reachable subsets
+static fa_auto* blowup(int n) {
+    char pattern[64];
+    snprintf(pattern, sizeof(pattern), "(a|b)*a(a|b){%d}", n);
+    return fa_auto_from_regex(pattern);
+}
+
+typedef struct {
+    int calls;
+    int stop_after;
+    size_t last_states;
+    bool monotonic;
+} progress_log;
+
+static bool on_progress(void* ctx, const fa_budget_stats* stats) {
+    progress_log* log = ctx;
+    if (stats->states < log->last_states) log->monotonic = false;
+    log->last_states = stats->states;
+    return ++log->calls < log->stop_after;
+}
+
+static void test_determinize_limits(void) {
+    static const fa_determinize_algorithm modes[] = { FA_DETERMINIZE_SUBSET, FA_DETERMINIZE_BFS };
+    fa_auto* nfa = blowup(12);
+    fa_error_t err;
+
+    for (size_t m = 0; m < 2; m++) {
+        fa_budget budget = { 0 };
+        budget.max_states = 500;
+        CHECK(fa_auto_determinize_budget(nfa, modes[m], &budget, &err) == NULL);
+        CHECK(err == FA_ERR_BUDGET_EXCEEDED && budget.stats.reason == FA_BUDGET_STATES);
+        CHECK(budget.stats.states > 500);
+
+        budget = (fa_budget){ 0 };
+        budget.max_bytes = 64 * 1024;
+        CHECK(fa_auto_determinize_budget(nfa, modes[m], &budget, &err) == NULL);
+        CHECK(err == FA_ERR_BUDGET_EXCEEDED && budget.stats.reason == FA_BUDGET_BYTES);
+        CHECK(budget.stats.bytes > 64 * 1024);
+
+        budget = (fa_budget){ 0 };
+        budget.deadline = fa_budget_now() - 1.0;
+        CHECK(fa_auto_determinize_budget(nfa, modes[m], &budget, &err) == NULL);
+        CHECK(err == FA_ERR_BUDGET_EXCEEDED && budget.stats.reason == FA_BUDGET_DEADLINE);
+
+        progress_log log = { 0, 3, 0, true };
+        budget = (fa_budget){ 0 };
+        budget.progress = on_progress;
+        budget.progress_ctx = &log;
+        CHECK(fa_auto_determinize_budget(nfa, modes[m], &budget, &err) == NULL);
+        CHECK(err == FA_ERR_BUDGET_EXCEEDED && budget.stats.reason == FA_BUDGET_CANCELLED);
+        CHECK(log.calls == 3 && log.monotonic);
+
+        // No limits: same DFA as the unbudgeted call, and the stats add up
+        budget = (fa_budget){ 0 };
+        fa_auto* dfa = fa_auto_determinize_budget(nfa, modes[m], &budget, &err);
+        fa_auto* plain = fa_auto_determinize(nfa, modes[m]);
+        CHECK(dfa && plain && err == FA_SUCCESS && dfa->nstates == plain->nstates);
+        CHECK(budget.stats.reason == FA_BUDGET_OK && budget.stats.states >= dfa->nstates &&
+              budget.stats.transitions > 0 && budget.stats.elapsed >= 0);
+        fa_auto_destroy(plain);
+        fa_auto_destroy(dfa);
+    }
+
+    // A NULL budget is no budget
+    fa_auto* dfa = fa_auto_determinize_budget(nfa, FA_DETERMINIZE_SUBSET, NULL, &err);
+    CHECK(dfa && err == FA_SUCCESS);
+    fa_auto_destroy(dfa);
+    CHECK(fa_auto_determinize_budget(NULL, FA_DETERMINIZE_SUBSET, NULL, &err) == NULL &&
+          err == FA_ERR_NULL_ARGUMENT);
+    fa_auto_destroy(nfa);
+}
+
+static void test_other_operations(void) {
+    fa_auto* x = blowup(8);
+    fa_auto* y = fa_auto_from_regex("(a|b|c)*b(a|b){6}");
+    fa_auto* dx = fa_auto_determinize(x, FA_DETERMINIZE_SUBSET);
+    fa_auto* dy = fa_auto_determinize(y, FA_DETERMINIZE_SUBSET);
+    fa_error_t err;
+
+    fa_budget budget = { 0 };
+    budget.max_states = 100;
+    CHECK(fa_auto_product_budget(dx, dy, &budget, &err) == NULL);
+    CHECK(err == FA_ERR_BUDGET_EXCEEDED && budget.stats.reason == FA_BUDGET_STATES);
+    budget.max_states = 0;
+    fa_auto* p = fa_auto_product_budget(dx, dy, &budget, &err);
+    CHECK(p && err == FA_SUCCESS && budget.stats.states >= p->nstates);
+    fa_auto_destroy(p);
+
+    // Brzozowski determinizes twice; both count against one budget
+    budget = (fa_budget){ 0 };
+    budget.max_states = 300;
+    CHECK(fa_auto_minimize_budget(x, FA_MINIMIZE_BRZOZOWSKI, &budget, &err) == NULL);
+    CHECK(err == FA_ERR_BUDGET_EXCEEDED);
+    budget.max_states = 0;
+    fa_auto* min = fa_auto_minimize_budget(x, FA_MINIMIZE_BRZOZOWSKI, &budget, &err);
+    CHECK(min && err == FA_SUCCESS && min->nstates == 512);
+    fa_auto_destroy(min);
+
+    budget = (fa_budget){ 0 };
+    budget.max_states = 50;
+    fa_operation_results* res = fa_auto_compose_budget(dx, dy, FA_OP_INTERSECTION | FA_OP_UNION,
+                                                       &budget, &err);
+    CHECK(err == FA_ERR_BUDGET_EXCEEDED && (!res || !res->success));
+    fa_operation_results_destroy(res);
+
+    // The stack is consumed even when the budget runs out
+    fa_stack* stack = fa_stack_create(4);
+    fa_stack_push(stack, fa_auto_materialize_sink(dx));
+    fa_stack_push(stack, fa_auto_materialize_sink(dy));
+    fa_stack_push(stack, fa_auto_materialize_sink(dx));
+    budget = (fa_budget){ 0 };
+    budget.max_states = 50;
+    res = fa_auto_stack_compose_budget(stack, FA_OP_INTERSECTION, FA_OP_LEFT_ASSOCIATIVE,
+                                       &budget, &err);
+    CHECK(err == FA_ERR_BUDGET_EXCEEDED && fa_stack_is_empty(stack));
+    fa_operation_results_destroy(res);
+    fa_stack_destroy(stack, true);
+
+    fa_auto_destroy(dy);
+    fa_auto_destroy(dx);
+    fa_auto_destroy(y);
+    fa_auto_destroy(x);
+}
+
+int main(void) {
+    test_determinize_limits();
+    test_other_operations();
+    return test_report("test_budget");
+}
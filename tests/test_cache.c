@@ -0,0 +1,327 @@
+#include "test_util.h"
+#include "io/fa_dfa_image.h"
+#include "regex/regex_cache.h"
+#include <dirent.h>
+#include <unistd.h>
+#ifdef FA_HAVE_PTHREADS
+#include <pthread.h>
+#endif
+
+/*
+ * Compiled-pattern caches and DFA images: the in-memory LRU cache under
+ * eviction and concurrent use, image round trips, every truncation and
+ * single-byte corruption of an image file, and the on-disk compile cache
+ * recovering from a damaged entry.
+ */
+
+#define LETTERS "abc"
+#define MAX_LEN 6
+
+typedef struct {
+    const fa_dfa_image* image;
+    const fa_auto* a;
+    int mismatches;
+} image_check;
+
+static bool image_word(void* ctx, const char* word) {
+    image_check* c = ctx;
+    if (fa_dfa_image_matches(c->image, word) != test_run(c->a, word) && c->mismatches++ == 0) {
+        fprintf(stderr, "  image differs on \"%s\"\n", word);
+    }
+    return c->mismatches == 0;
+}
+
+static bool image_agrees(const fa_dfa_image* image, const fa_auto* a) {
+    image_check c = { image, a, 0 };
+    test_each_word(LETTERS, MAX_LEN, image_word, &c);
+    return c.mismatches == 0;
+}
+
+static void test_regex_cache(void) {
+    fa_regex_cache* cache = fa_regex_cache_create(2);
+    fa_error_t err;
+    CHECK(fa_regex_cache_create(0) == NULL);
+
+    fa_regex_entry* e1 = fa_regex_cache_acquire(cache, "(a|b)*c", FA_REGEX_COMPILE_THOMPSON, &err);
+    fa_regex_entry* e2 = fa_regex_cache_acquire(cache, "(a|b)*c", FA_REGEX_COMPILE_THOMPSON, &err);
+    CHECK(e1 && e1 == e2 && err == FA_SUCCESS);
+    // The same pattern under other flags is another entry
+    fa_regex_entry* e3 = fa_regex_cache_acquire(cache, "(a|b)*c", FA_REGEX_COMPILE_DFA, &err);
+    CHECK(e3 && e3 != e1 && fa_auto_is_deterministic(fa_regex_entry_auto(e3)));
+    fa_auto* expected = fa_auto_from_regex("(a|b)*c");
+    CHECK(test_same_language(fa_regex_entry_auto(e1), expected, LETTERS, MAX_LEN, "cache"));
+    CHECK(test_same_language(fa_regex_entry_auto(e3), expected, LETTERS, MAX_LEN, "cache DFA"));
+
+    // A third pattern evicts the least recently used entry, which stays usable
+    fa_regex_entry* e4 = fa_regex_cache_acquire(cache, "abc", FA_REGEX_COMPILE_GLUSHKOV, &err);
+    fa_regex_cache_stats stats;
+    fa_regex_cache_get_stats(cache, &stats);
+    CHECK(e4 && stats.hits == 1 && stats.misses == 3 && stats.evictions == 1 && stats.size == 2);
+    CHECK(test_run(fa_regex_entry_auto(e1), "abc"));
+
+    CHECK(fa_regex_cache_acquire(cache, "(a", 0, &err) == NULL &&
+          err == FA_ERR_REGEX_UNBALANCED_PARENTHESES);
+    fa_regex_cache_get_stats(cache, &stats);
+    CHECK(stats.size == 2);
+
+    // Entries outlive the cache
+    fa_regex_cache_destroy(cache);
+    CHECK(test_run(fa_regex_entry_auto(e3), "abac"));
+    fa_regex_entry_release(e1);
+    fa_regex_entry_release(e2);
+    fa_regex_entry_release(e3);
+    fa_regex_entry_release(e4);
+    fa_auto_destroy(expected);
+}
+
+#ifdef FA_HAVE_PTHREADS
+typedef struct {
+    fa_regex_cache* cache;
+    int seed;
+    int failures;
+} cache_worker;
+
+static void* cache_thread(void* arg) {
+    static const char* patterns[] = { "a*", "(ab)*", "a|b|c", "[a-c]{2}", "c+a?" };
+    cache_worker* w = arg;
+    uint64_t rng = (uint64_t)w->seed;
+    for (int i = 0; i < 2000; i++) {
+        size_t k = test_below(&rng, 5);
+        fa_regex_entry* e = fa_regex_cache_acquire(w->cache, patterns[k], 0, NULL);
+        if (!e) {
+            w->failures++;
+            continue;
+        }
+        bool ok = test_run(fa_regex_entry_auto(e), k == 1 ? "abab" : k == 3 ? "ca" :
+                                                   k == 4 ? "cca" : "a");
+        if (!ok) w->failures++;
+        fa_regex_entry_release(e);
+    }
+    return NULL;
+}
+
+static void test_regex_cache_threads(void) {
+    // Fewer slots than patterns, so hits, misses and evictions interleave
+    fa_regex_cache* cache = fa_regex_cache_create(3);
+    pthread_t threads[4];
+    cache_worker workers[4];
+    for (int i = 0; i < 4; i++) {
+        workers[i] = (cache_worker){ cache, i + 1, 0 };
+        pthread_create(&threads[i], NULL, cache_thread, &workers[i]);
+    }
+    for (int i = 0; i < 4; i++) {
+        pthread_join(threads[i], NULL);
+        CHECK(workers[i].failures == 0);
+    }
+    fa_regex_cache_stats stats;
+    fa_regex_cache_get_stats(cache, &stats);
+    CHECK(stats.hits + stats.misses == 8000 && stats.size <= 3);
+    fa_regex_cache_destroy(cache);
+}
+#endif
+
+static void test_image_round_trip(const char* dir) {
+    char path[512];
+    snprintf(path, sizeof(path), "%s/round.fadfa", dir);
+    uint64_t tag[2] = { 0x1234, 0x5678 }, read_tag[2];
+    fa_error_t err;
+
+    uint64_t rng = 37;
+    for (int round = 0; round < 40; round++) {
+        fa_auto* nfa = test_random_nfa(&rng, 5, 3, 12, 10, 40);
+        fa_auto* dfa = fa_auto_minimize(nfa, FA_MINIMIZE_HOPCROFT);
+        fa_dfa_image* image = fa_dfa_image_create(dfa, tag, &err);
+        CHECK(image && err == FA_SUCCESS && image_agrees(image, dfa));
+        CHECK(image && fa_dfa_image_save(image, path) == FA_SUCCESS);
+        fa_dfa_image* loaded = fa_dfa_image_load(path, &err);
+        CHECK(loaded && err == FA_SUCCESS && image_agrees(loaded, dfa));
+        if (loaded) {
+            fa_dfa_image_tag(loaded, read_tag);
+            CHECK(read_tag[0] == tag[0] && read_tag[1] == tag[1]);
+            CHECK(fa_dfa_image_nstates(loaded) == fa_dfa_image_nstates(image));
+            fa_auto* back = fa_dfa_image_to_auto(loaded);
+            CHECK(test_same_language(back, dfa, LETTERS, MAX_LEN, "image to auto"));
+            fa_auto_destroy(back);
+        }
+        fa_dfa_image_close(loaded);
+        fa_dfa_image_close(image);
+        fa_auto_destroy(dfa);
+        fa_auto_destroy(nfa);
+    }
+
+    fa_auto* nfa = test_random_nfa(&rng, 4, 2, 10, 0, 50);
+    CHECK(fa_dfa_image_create(nfa, NULL, &err) == NULL || fa_auto_is_deterministic(nfa));
+    CHECK(fa_auto_is_deterministic(nfa) || err == FA_ERR_NOT_DETERMINISTIC);
+    fa_auto_destroy(nfa);
+    CHECK(fa_dfa_image_create(NULL, NULL, &err) == NULL && err == FA_ERR_NULL_ARGUMENT);
+
+    snprintf(path, sizeof(path), "%s/missing.fadfa", dir);
+    CHECK(fa_dfa_image_load(path, &err) == NULL && err == FA_ERR_IO_FILE_NOT_FOUND);
+}
+
+static unsigned char* read_file(const char* path, size_t* size) {
+    FILE* f = fopen(path, "rb");
+    if (!f) return NULL;
+    fseek(f, 0, SEEK_END);
+    long n = ftell(f);
+    rewind(f);
+    unsigned char* data = malloc(n > 0 ? (size_t)n : 1);
+    *size = data && n > 0 ? fread(data, 1, (size_t)n, f) : 0;
+    fclose(f);
+    return data;
+}
+
+static void write_file(const char* path, const unsigned char* data, size_t size) {
+    FILE* f = fopen(path, "wb");
+    if (!f) return;
+    fwrite(data, 1, size, f);
+    fclose(f);
+}
+
+static void test_image_corruption(const char* dir) {
+    char path[512], bad[512];
+    snprintf(path, sizeof(path), "%s/good.fadfa", dir);
+    snprintf(bad, sizeof(bad), "%s/bad.fadfa", dir);
+    fa_auto* nfa = fa_auto_from_regex("(a|b)*abb|c+");
+    fa_auto* dfa = fa_auto_minimize(nfa, FA_MINIMIZE_HOPCROFT);
+    fa_auto_destroy(nfa);
+    fa_dfa_image* image = fa_dfa_image_create(dfa, NULL, NULL);
+    CHECK(image && fa_dfa_image_save(image, path) == FA_SUCCESS);
+    fa_dfa_image_close(image);
+
+    size_t size = 0;
+    unsigned char* data = read_file(path, &size);
+    CHECK(data && size > 0);
+    if (!data) return;
+
+    // Every truncation is rejected
+    fa_error_t err;
+    for (size_t cut = 0; cut < size; cut++) {
+        write_file(bad, data, cut);
+        fa_dfa_image* loaded = fa_dfa_image_load(bad, &err);
+        CHECK_MSG(loaded == NULL && err != FA_SUCCESS, "truncated at %zu", cut);
+        fa_dfa_image_close(loaded);
+    }
+
+    // Every single-byte change is rejected or still safe to match with
+    static const char* words[] = { "", "abb", "babb", "ccc", "ab", "abc", "cab" };
+    for (size_t i = 0; i < size; i++) {
+        unsigned char saved = data[i];
+        for (int flip = 0; flip < 2; flip++) {
+            data[i] = flip ? (unsigned char)(saved ^ 0x80) : 0xFF;
+            if (data[i] == saved) continue;
+            write_file(bad, data, size);
+            fa_dfa_image* loaded = fa_dfa_image_load(bad, &err);
+            CHECK(loaded != NULL || err == FA_ERR_IO_INVALID_FORMAT);
+            if (loaded) {
+                for (size_t w = 0; w < sizeof(words) / sizeof(words[0]); w++) {
+                    (void)fa_dfa_image_matches(loaded, words[w]);
+                }
+                fa_auto_destroy(fa_dfa_image_to_auto(loaded));
+                fa_dfa_image_close(loaded);
+            }
+        }
+        data[i] = saved;
+    }
+    free(data);
+    remove(bad);
+    fa_auto_destroy(dfa);
+}
+
+static size_t count_images(const char* dir, char* last, size_t size) {
+    size_t n = 0;
+    DIR* d = opendir(dir);
+    if (!d) return 0;
+    for (struct dirent* e; (e = readdir(d)) != NULL; ) {
+        size_t len = strlen(e->d_name);
+        // Entries are named by their 32-digit hash
+        if (len == 38 && strcmp(e->d_name + 32, ".fadfa") == 0) {
+            snprintf(last, size, "%s/%s", dir, e->d_name);
+            n++;
+        }
+    }
+    closedir(d);
+    return n;
+}
+
+static void test_compile_cache(const char* dir) {
+    static const char* patterns[] = { "(a|b)*abb", "c+" };
+    fa_auto* expected = fa_auto_from_regex("(a|b)*abb|c+");
+    char entry[600];
+    fa_error_t err;
+
+    fa_dfa_image* first = fa_regex_compile_cached(dir, patterns, 2, 0, &err);
+    CHECK(first && err == FA_SUCCESS && image_agrees(first, expected));
+    CHECK(count_images(dir, entry, sizeof(entry)) == 1);
+    fa_dfa_image* again = fa_regex_compile_cached(dir, patterns, 2, 0, &err);
+    CHECK(again && image_agrees(again, expected));
+    CHECK(count_images(dir, entry, sizeof(entry)) == 1);
+    fa_dfa_image_close(again);
+
+    // Other flags, or the same text split differently, use another file
+    static const char* split[] = { "(a|b)*ab", "bc+" };
+    fa_dfa_image* other = fa_regex_compile_cached(dir, split, 2, 0, &err);
+    fa_dfa_image_close(other);
+    other = fa_regex_compile_cached(dir, patterns, 2, FA_REGEX_COMPILE_GLUSHKOV, &err);
+    CHECK(other && image_agrees(other, expected));
+    fa_dfa_image_close(other);
+    CHECK(count_images(dir, entry, sizeof(entry)) == 3);
+
+    // A damaged entry is recompiled and replaced
+    fa_dfa_image_close(first);
+    count_images(dir, entry, sizeof(entry));
+    write_file(entry, (const unsigned char*)"garbage", 7);
+    for (int i = 0; i < 3; i++) {
+        const char* const* list = i == 1 ? split : patterns;
+        unsigned flags = i == 2 ? FA_REGEX_COMPILE_GLUSHKOV : 0;
+        fa_dfa_image* img = fa_regex_compile_cached(dir, list, 2, flags, &err);
+        CHECK(img != NULL);
+        if (img && i != 1) CHECK(image_agrees(img, expected));
+        fa_dfa_image_close(img);
+    }
+    fa_dfa_image* reloaded = fa_dfa_image_load(entry, &err);
+    CHECK(reloaded != NULL && count_images(dir, entry, sizeof(entry)) == 3);
+    fa_dfa_image_close(reloaded);
+
+    CHECK(fa_regex_compile_cached(dir, patterns, 0, 0, &err) == NULL &&
+          err == FA_ERR_INVALID_ARGUMENT);
+    static const char* broken[] = { "(a" };
+    CHECK(fa_regex_compile_cached(dir, broken, 1, 0, &err) == NULL && err != FA_SUCCESS);
+    // An unwritable directory only costs the reuse
+    fa_dfa_image* nowhere = fa_regex_compile_cached("/nonexistent/fa", patterns, 2, 0, &err);
+    CHECK(nowhere && image_agrees(nowhere, expected));
+    fa_dfa_image_close(nowhere);
+    fa_auto_destroy(expected);
+}
+
+static void remove_dir(const char* dir) {
+    DIR* d = opendir(dir);
+    if (!d) return;
+    char path[600];
+    for (struct dirent* e; (e = readdir(d)) != NULL; ) {
+        if (e->d_name[0] == '.') continue;
+        snprintf(path, sizeof(path), "%s/%s", dir, e->d_name);
+        remove(path);
+    }
+    closedir(d);
+    rmdir(dir);
+}
+
+int main(void) {
+    char dir[] = "fa_test_cache_XXXXXX";
+    if (!mkdtemp(dir)) {
+        perror("mkdtemp");
+        return 1;
+    }
+    test_regex_cache();
+#ifdef FA_HAVE_PTHREADS
+    test_regex_cache_threads();
+#endif
+    test_image_round_trip(dir);
+    test_image_corruption(dir);
+    remove_dir(dir);
+    if (!mkdtemp(strcpy(dir, "fa_test_cache_XXXXXX"))) return 1;
+    test_compile_cache(dir);
+    remove_dir(dir);
+    return test_report("test_cache");
+}
@@ -0,0 +1,330 @@
+#include "test_util.h"
+
+/*
+ * Constructions checked against the reference simulation: subset
+ * construction in every mode, products and the other binary operations,
+ * ε-removal, reversal, trimming, NFA reduction, minimization and the
+ * compose entry points.
+ */
+
+#define LETTERS "abc"
+#define MAX_LEN 6
+
+typedef enum { OP_AND, OP_OR, OP_MINUS, OP_XOR, OP_CONCAT, OP_STAR, OP_REVERSE, OP_NOT } test_op;
+
+typedef struct {
+    const fa_auto* a;
+    const fa_auto* b;
+    const fa_auto* result;
+    test_op op;
+    const char* what;
+    int mismatches;
+} op_check;
+
+static bool expect_op(const op_check* check, const char* word);
+
+// Whether some split of `word` puts the prefix in A and the rest in B (or in A* for star)
+static bool expect_split(const op_check* check, const char* word, size_t len) {
+    char buf[32];
+    for (size_t cut = check->op == OP_STAR ? 1 : 0; cut <= len; cut++) {
+        memcpy(buf, word, cut);
+        buf[cut] = '\0';
+        if (!test_run(check->a, buf)) continue;
+        if (check->op == OP_STAR ? expect_op(check, word + cut) : test_run(check->b, word + cut)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool expect_op(const op_check* check, const char* word) {
+    size_t len = strlen(word);
+    char rev[32];
+    switch (check->op) {
+    case OP_AND: return test_run(check->a, word) && test_run(check->b, word);
+    case OP_OR: return test_run(check->a, word) || test_run(check->b, word);
+    case OP_MINUS: return test_run(check->a, word) && !test_run(check->b, word);
+    case OP_XOR: return test_run(check->a, word) != test_run(check->b, word);
+    case OP_CONCAT: return expect_split(check, word, len);
+    case OP_STAR: return len == 0 || expect_split(check, word, len);
+    case OP_NOT:
+        // relative to the alphabet of A
+        for (size_t i = 0; i < len; i++) {
+            if (!test_alphabet_reads(check->a, (unsigned char)word[i])) return false;
+        }
+        return !test_run(check->a, word);
+    case OP_REVERSE:
+        for (size_t i = 0; i < len; i++) rev[i] = word[len - 1 - i];
+        rev[len] = '\0';
+        return test_run(check->a, rev);
+    }
+    return false;
+}
+
+static bool check_word(void* ctx, const char* word) {
+    op_check* check = ctx;
+    if (test_run(check->result, word) != expect_op(check, word) && check->mismatches++ == 0) {
+        fprintf(stderr, "  %s: wrong answer on \"%s\"\n", check->what, word);
+    }
+    return check->mismatches == 0;
+}
+
+static void check_op(const fa_auto* a, const fa_auto* b, const fa_auto* result, test_op op,
+                     const char* what) {
+    CHECK_MSG(result != NULL, "%s returned NULL", what);
+    if (!result) return;
+    op_check check = { a, b, result, op, what, 0 };
+    test_each_word(LETTERS, op == OP_STAR ? 5 : MAX_LEN, check_word, &check);
+    CHECK_MSG(check.mismatches == 0, "%s", what);
+}
+
+static bool same_shape(const fa_auto* x, const fa_auto* y) {
+    if (x->nstates != y->nstates) return false;
+    for (size_t i = 0; i < x->nstates; i++) {
+        const fa_state* p = x->states[i];
+        const fa_state* q = y->states[i];
+        if (p->is_start != q->is_start || p->is_accept != q->is_accept || p->ntrans != q->ntrans) {
+            return false;
+        }
+        for (fa_trans *t = p->trans, *u = q->trans; t && u; t = t->next, u = u->next) {
+            if (strcmp(t->symbol, u->symbol) != 0) return false;
+            if (test_state_id(x, t->dest) != test_state_id(y, u->dest)) return false;
+        }
+    }
+    return true;
+}
+
+// (a|b)*a(a|b){n-1}: an `a` n letters from the end
+static fa_auto* nth_from_end(int n) {
+    static const char* ab[] = { "a", "b" };
+    fa_auto* a = fa_auto_create(n + 1);
+    set_insert(a->alphabet, &ab[0]);
+    set_insert(a->alphabet, &ab[1]);
+    for (int i = 0; i <= n; i++) {
+        char label[16];
+        snprintf(label, sizeof(label), "q%d", i);
+        a->states[a->nstates++] = fa_state_create(label, i == 0, i == n);
+    }
+    fa_trans_create(a->states[0], a->states[0], "a");
+    fa_trans_create(a->states[0], a->states[0], "b");
+    fa_trans_create(a->states[0], a->states[1], "a");
+    for (int i = 1; i < n; i++) {
+        fa_trans_create(a->states[i], a->states[i + 1], "a");
+        fa_trans_create(a->states[i], a->states[i + 1], "b");
+    }
+    return a;
+}
+
+static void test_determinize(void) {
+    static const fa_determinize_algorithm modes[] = {
+        FA_DETERMINIZE_SUBSET, FA_DETERMINIZE_LAZY, FA_DETERMINIZE_BFS,
+        FA_DETERMINIZE_DFS, FA_DETERMINIZE_INCREMENTAL,
+    };
+    uint64_t rng = 26;
+    for (int round = 0; round < 150; round++) {
+        int n = 2 + (int)test_below(&rng, 7);
+        fa_auto* nfa = test_random_nfa(&rng, n, 3, 3 * n, 20, 30);
+        fa_auto* subset = NULL;
+        for (size_t m = 0; m < sizeof(modes) / sizeof(modes[0]); m++) {
+            fa_auto* dfa = fa_auto_determinize(nfa, modes[m]);
+            CHECK(dfa && fa_auto_is_deterministic(dfa));
+            CHECK(test_same_language(nfa, dfa, LETTERS, MAX_LEN, "determinize"));
+            if (modes[m] == FA_DETERMINIZE_SUBSET) subset = dfa;
+            else {
+                // The parallel mode numbers its subsets like the sequential one
+                if (modes[m] == FA_DETERMINIZE_BFS) CHECK(dfa && subset && same_shape(dfa, subset));
+                fa_auto_destroy(dfa);
+            }
+        }
+        fa_auto_destroy(subset);
+        fa_auto_destroy(nfa);
+    }
+
+    // (a|b)*a(a|b){10} needs all 2^11 subsets: big enough for several workers
+    fa_auto* nfa = nth_from_end(11);
+    fa_auto* seq = fa_auto_determinize(nfa, FA_DETERMINIZE_SUBSET);
+    fa_auto* par = fa_auto_determinize(nfa, FA_DETERMINIZE_BFS);
+    CHECK(seq && par && seq->nstates >= 2048 && same_shape(seq, par));
+    CHECK(fa_auto_accepts(par, "abbbbbbbbbb") && !fa_auto_accepts(par, "abbbbbbbbbbb"));
+    fa_auto_destroy(par);
+    fa_auto_destroy(seq);
+    fa_auto_destroy(nfa);
+
+    CHECK(fa_auto_determinize(NULL, FA_DETERMINIZE_SUBSET) == NULL);
+}
+
+static void test_binary_operations(void) {
+    uint64_t rng = 27;
+    for (int round = 0; round < 120; round++) {
+        int n = 1 + (int)test_below(&rng, 5), m = 1 + (int)test_below(&rng, 5);
+        fa_auto* a = test_random_nfa(&rng, n, 2 + (int)test_below(&rng, 2), 3 * n, 15, 40);
+        fa_auto* b = test_random_nfa(&rng, m, 2 + (int)test_below(&rng, 2), 3 * m, 15, 40);
+
+        fa_auto* r = fa_auto_product(a, b);
+        check_op(a, b, r, OP_AND, "product");
+        fa_auto_destroy(r);
+        r = fa_auto_union(a, b);
+        check_op(a, b, r, OP_OR, "union");
+        fa_auto_destroy(r);
+        r = fa_auto_difference(a, b);
+        check_op(a, b, r, OP_MINUS, "difference");
+        fa_auto_destroy(r);
+        r = fa_auto_symmetric_difference(a, b);
+        check_op(a, b, r, OP_XOR, "symmetric difference");
+        fa_auto_destroy(r);
+        r = fa_auto_concat(a, b);
+        check_op(a, b, r, OP_CONCAT, "concat");
+        fa_auto_destroy(r);
+        r = fa_auto_complement(a);
+        check_op(a, NULL, r, OP_NOT, "complement");
+        // Materializing the implicit sink keeps the language
+        fa_auto* full = fa_auto_materialize_sink(r);
+        CHECK(r && full && !full->sink_accepts);
+        if (r && full) CHECK(test_same_language(r, full, LETTERS, MAX_LEN, "materialize sink"));
+        fa_auto_destroy(full);
+        fa_auto_destroy(r);
+        r = fa_auto_kleene(a, FA_KLEENE_STAR);
+        check_op(a, NULL, r, OP_STAR, "kleene star");
+        fa_auto_destroy(r);
+        r = fa_auto_reverse(a);
+        check_op(a, NULL, r, OP_REVERSE, "reverse");
+        fa_auto_destroy(r);
+
+        fa_auto_destroy(a);
+        fa_auto_destroy(b);
+    }
+}
+
+static void test_compose(void) {
+    uint64_t rng = 39;
+    for (int round = 0; round < 40; round++) {
+        fa_auto* a = test_random_nfa(&rng, 4, 2, 10, 10, 40);
+        fa_auto* b = test_random_nfa(&rng, 4, 2, 10, 10, 40);
+        fa_operation_results* res = fa_auto_compose(a, b, FA_OP_ALL_BINARY);
+        CHECK(res && res->success);
+        if (res) {
+            check_op(a, b, res->intersection_result, OP_AND, "compose intersection");
+            check_op(a, b, res->union_result, OP_OR, "compose union");
+            check_op(a, b, res->difference_result, OP_MINUS, "compose difference");
+            check_op(a, b, res->symmetric_difference_result, OP_XOR, "compose xor");
+            check_op(a, b, res->concatenation_result, OP_CONCAT, "compose concat");
+            fa_operation_results_destroy(res);
+        }
+        fa_auto_destroy(a);
+        fa_auto_destroy(b);
+    }
+}
+
+static void test_stack_compose(void) {
+    // A balanced fold (sequential and threaded) accepts what the sequential fold does
+    static const fa_composition_mode modes[] = { FA_OP_LEFT_ASSOCIATIVE, FA_OP_PARALLEL };
+    uint64_t rng = 38;
+    for (size_t m = 0; m < 2; m++) {
+        for (int round = 0; round < 10; round++) {
+            fa_auto* parts[6];
+            fa_stack* stack = fa_stack_create(6);
+            for (int i = 0; i < 6; i++) {
+                uint64_t seed = test_rand(&rng), again = seed;
+                parts[i] = test_random_nfa(&seed, 3, 2, 6, 10, 40);
+                fa_stack_push(stack, test_random_nfa(&again, 3, 2, 6, 10, 40));
+            }
+            fa_operation_results* res = fa_auto_stack_compose(stack, FA_OP_UNION, modes[m]);
+            CHECK(res && res->union_result && fa_stack_is_empty(stack));
+            fa_auto* expected = fa_auto_union(parts[0], parts[1]);
+            for (int i = 2; i < 6; i++) {
+                fa_auto* next = fa_auto_union(expected, parts[i]);
+                fa_auto_destroy(expected);
+                expected = next;
+            }
+            if (res) CHECK(test_same_language(res->union_result, expected, LETTERS, MAX_LEN,
+                                              "stack compose"));
+            fa_operation_results_destroy(res);
+            fa_auto_destroy(expected);
+            for (int i = 0; i < 6; i++) fa_auto_destroy(parts[i]);
+            fa_stack_destroy(stack, true);
+        }
+    }
+}
+
+static void test_epsilon_removal(void) {
+    uint64_t rng = 30;
+    for (int round = 0; round < 150; round++) {
+        int n = 2 + (int)test_below(&rng, 8);
+        // Many ε-edges so that ε-cycles (one SCC to condense) show up
+        uint64_t seed = test_rand(&rng), again = seed;
+        fa_auto* a = test_random_nfa(&seed, n, 2, 3 * n, 50, 25);
+        fa_auto* b = test_random_nfa(&again, n, 2, 3 * n, 50, 25);
+        fa_auto_remove_epsilon(b);
+        bool eps_free = true;
+        for (size_t s = 0; s < b->nstates; s++) {
+            for (fa_trans* t = b->states[s]->trans; t; t = t->next) {
+                eps_free &= strcmp(t->symbol, FA_EPS_SYMBOL) != 0;
+            }
+        }
+        CHECK(eps_free);
+        CHECK(test_same_language(a, b, LETTERS, MAX_LEN, "remove epsilon"));
+        fa_auto_destroy(b);
+        fa_auto_destroy(a);
+    }
+}
+
+static void test_trim_and_reduce(void) {
+    uint64_t rng = 42;
+    for (int round = 0; round < 150; round++) {
+        int n = 2 + (int)test_below(&rng, 8);
+        fa_auto* a = test_random_nfa(&rng, n, 2, 2 * n, 15, 20);
+
+        fa_auto* t = fa_auto_materialize_sink(a);
+        CHECK(fa_auto_trim(t) == FA_SUCCESS);
+        CHECK(t->nstates <= a->nstates);
+        CHECK(test_same_language(a, t, LETTERS, MAX_LEN, "trim"));
+        // Trimming is idempotent
+        size_t trimmed = t->nstates;
+        CHECK(fa_auto_trim(t) == FA_SUCCESS && t->nstates == trimmed);
+        fa_auto_destroy(t);
+
+        fa_auto* r = fa_auto_reduce_nfa(a);
+        CHECK(r != NULL);
+        if (r) {
+            fa_auto* eps_free = fa_auto_materialize_sink(a);
+            fa_auto_remove_epsilon(eps_free);
+            CHECK(r->nstates <= eps_free->nstates);
+            CHECK(test_same_language(a, r, LETTERS, MAX_LEN, "reduce_nfa"));
+            fa_auto_destroy(eps_free);
+        }
+        fa_auto_destroy(r);
+        fa_auto_destroy(a);
+    }
+    CHECK(fa_auto_trim(NULL) == FA_ERR_NULL_ARGUMENT);
+}
+
+static void test_minimize(void) {
+    uint64_t rng = 22;
+    for (int round = 0; round < 100; round++) {
+        int n = 2 + (int)test_below(&rng, 6);
+        fa_auto* a = test_random_nfa(&rng, n, 2, 3 * n, 10, 35);
+        fa_auto* hop = fa_auto_minimize(a, FA_MINIMIZE_HOPCROFT);
+        fa_auto* brz = fa_auto_minimize(a, FA_MINIMIZE_BRZOZOWSKI);
+        fa_auto* dfa = fa_auto_determinize(a, FA_DETERMINIZE_SUBSET);
+        CHECK(test_same_language(a, hop, LETTERS, MAX_LEN, "hopcroft"));
+        CHECK(test_same_language(a, brz, LETTERS, MAX_LEN, "brzozowski"));
+        // Minimal DFAs of one language have the same size (up to a dead state)
+        if (hop && brz) CHECK(hop->nstates == brz->nstates);
+        if (hop && dfa) CHECK(hop->nstates <= dfa->nstates);
+        fa_auto_destroy(dfa);
+        fa_auto_destroy(brz);
+        fa_auto_destroy(hop);
+        fa_auto_destroy(a);
+    }
+}
+
+int main(void) {
+    test_determinize();
+    test_binary_operations();
+    test_compose();
+    test_stack_compose();
+    test_epsilon_removal();
+    test_trim_and_reduce();
+    test_minimize();
+    return test_report("test_construct");
+}
@@ -0,0 +1,148 @@
+#include "test_util.h"
+
+/*
+ * Word counting, infiniteness and the uniform sampler, against
+ * enumeration of short words and a few languages with known counts.
+ */
+
+#define LETTERS "ab"
+#define MAX_LEN 8
+
+typedef struct {
+    const fa_auto* a;
+    uint64_t per_length[MAX_LEN + 1];
+} tally;
+
+static bool tally_word(void* ctx, const char* word) {
+    tally* t = ctx;
+    if (test_run(t->a, word)) t->per_length[strlen(word)]++;
+    return true;
+}
+
+static bool count_is(const fa_word_count* c, uint64_t high, uint64_t low) {
+    return c->high == high && c->low == low && !c->saturated;
+}
+
+static void test_count_random(void) {
+    uint64_t rng = 43;
+    for (int round = 0; round < 200; round++) {
+        int n = 1 + (int)test_below(&rng, 6);
+        fa_auto* a = test_random_nfa(&rng, n, 2, 2 * n + 1, 15, 40);
+        tally t = { a, { 0 } };
+        test_each_word(LETTERS, MAX_LEN, tally_word, &t);
+
+        uint64_t total = 0;
+        for (size_t len = 0; len <= MAX_LEN; len++) {
+            total += t.per_length[len];
+            fa_word_count c;
+            CHECK(fa_auto_count_words(a, len, &c) == FA_SUCCESS);
+            CHECK_MSG(count_is(&c, 0, total), "length %zu: %llu, expected %llu", len,
+                      (unsigned long long)c.low, (unsigned long long)total);
+
+            fa_error_t err;
+            fa_word_sampler* s = fa_word_sampler_create(a, len, &err);
+            CHECK(s && err == FA_SUCCESS);
+            if (!s) continue;
+            fa_word_sampler_count(s, &c);
+            CHECK(count_is(&c, 0, t.per_length[len]));
+            char word[32];
+            size_t written;
+            for (int k = 0; k < 5; k++) {
+                err = fa_word_sampler_draw(s, &rng, word, sizeof(word), &written);
+                if (t.per_length[len] == 0) {
+                    CHECK(err == FA_ERR_INVALID_OPERATION);
+                    break;
+                }
+                CHECK(err == FA_SUCCESS && written == len && test_run(a, word));
+            }
+            fa_word_sampler_destroy(s);
+        }
+
+        // With an m-state DFA, L is infinite iff it has a word of length m .. 2m - 1
+        fa_auto* dfa = fa_auto_determinize(a, FA_DETERMINIZE_SUBSET);
+        uint64_t m = dfa ? dfa->nstates : 0;
+        fa_word_count below, within;
+        fa_auto_count_words(a, m - 1, &below);
+        fa_auto_count_words(a, 2 * m - 1, &within);
+        bool grows = within.low != below.low || within.high != below.high;
+        CHECK(m > 0 && fa_auto_is_infinite(a) == grows);
+        fa_auto_destroy(dfa);
+        fa_auto_destroy(a);
+    }
+}
+
+static void test_count_known(void) {
+    fa_word_count c;
+    fa_auto* all = fa_auto_from_regex("(a|b)*");
+    // 2^0 + ... + 2^126 = 2^127 - 1 is exact; 2^0 + ... + 2^127 saturates
+    CHECK(fa_auto_count_words(all, 126, &c) == FA_SUCCESS &&
+          count_is(&c, UINT64_MAX >> 1, UINT64_MAX));
+    CHECK(fa_auto_count_words(all, 127, &c) == FA_SUCCESS && c.saturated &&
+          c.high == UINT64_MAX && c.low == UINT64_MAX);
+    CHECK(fa_auto_count_words(all, UINT64_MAX, &c) == FA_SUCCESS && c.saturated);
+    CHECK(fa_auto_is_infinite(all));
+
+    fa_auto* stars = fa_auto_from_regex("a*");
+    // UINT64_MAX + 1 words
+    CHECK(fa_auto_count_words(stars, UINT64_MAX, &c) == FA_SUCCESS && count_is(&c, 1, 0));
+
+    fa_auto* finite = fa_auto_from_regex("(a|b)(c|d)?");
+    CHECK(fa_auto_count_words(finite, UINT64_MAX, &c) == FA_SUCCESS && count_is(&c, 0, 6));
+    CHECK(!fa_auto_is_infinite(finite));
+
+    // An interval label counts once per code point
+    fa_auto* letters = fa_auto_from_regex("[a-z]{2}");
+    CHECK(fa_auto_count_words(letters, 2, &c) == FA_SUCCESS && count_is(&c, 0, 26 * 26));
+
+    // A useless loop does not make the language infinite
+    fa_auto* dead = fa_auto_from_regex("a");
+    fa_state* loop = fa_state_create("loop", false, false);
+    fa_state** grown = realloc(dead->states, (dead->nstates + 1) * sizeof(fa_state*));
+    if (grown) {
+        dead->states = grown;
+        dead->states[dead->nstates++] = loop;
+        dead->capacity = dead->nstates;
+        fa_trans_create(dead->states[0], loop, "a");
+        fa_trans_create(loop, loop, "a");
+        CHECK(!fa_auto_is_infinite(dead));
+    }
+
+    CHECK(fa_auto_count_words(NULL, 1, &c) == FA_ERR_NULL_ARGUMENT);
+    fa_auto_destroy(dead);
+    fa_auto_destroy(letters);
+    fa_auto_destroy(finite);
+    fa_auto_destroy(stars);
+    fa_auto_destroy(all);
+}
+
+static void test_sampler_uniform(void) {
+    // The 7 words of length 3, drawn 7000 times
+    fa_auto* a = fa_auto_from_regex("a(a|b)(a|b)|bbb|b(a|b)a");
+    fa_word_sampler* s = fa_word_sampler_create(a, 3, NULL);
+    fa_word_count c;
+    fa_word_sampler_count(s, &c);
+    CHECK(count_is(&c, 0, 7));
+    static const char* words[] = { "aaa", "aab", "aba", "abb", "bbb", "baa", "bba" };
+    int seen[7] = { 0 };
+    uint64_t rng = 44;
+    char buf[8];
+    for (int i = 0; i < 7000; i++) {
+        CHECK(fa_word_sampler_draw(s, &rng, buf, sizeof(buf), NULL) == FA_SUCCESS);
+        for (int k = 0; k < 7; k++) seen[k] += strcmp(buf, words[k]) == 0;
+    }
+    // Expect 1000 each; 5 standard deviations is about 150
+    for (int k = 0; k < 7; k++) {
+        CHECK_MSG(seen[k] > 850 && seen[k] < 1150, "%s: %d", words[k], seen[k]);
+    }
+
+    CHECK(fa_word_sampler_draw(s, &rng, buf, 3, NULL) == FA_ERR_BUFFER_TOO_SMALL);
+    fa_word_sampler_destroy(s);
+    fa_auto_destroy(a);
+}
+
+int main(void) {
+    test_count_random();
+    test_count_known();
+    test_sampler_uniform();
+    return test_report("test_count");
+}
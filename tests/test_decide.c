@@ -0,0 +1,179 @@
+#include "test_util.h"
+
+/*
+ * Inclusion, universality, empty intersection and equivalence against
+ * brute force over short words. A positive verdict must agree with the
+ * enumeration; a negative one must come with a word that the reference
+ * simulation confirms, and a short one whenever the enumeration found one.
+ */
+
+#define LETTERS "ab"
+#define MAX_LEN 10
+
+typedef struct {
+    const fa_auto* a;
+    const fa_auto* b;
+    bool (*bad)(const fa_auto* a, const fa_auto* b, const char* word);
+    bool found;
+} search;
+
+static bool find_word(void* ctx, const char* word) {
+    search* s = ctx;
+    s->found = s->bad(s->a, s->b, word);
+    return !s->found;
+}
+
+// Brute force: is there a short word on which `bad` holds?
+static bool exists_word(const fa_auto* a, const fa_auto* b,
+                        bool (*bad)(const fa_auto*, const fa_auto*, const char*)) {
+    search s = { a, b, bad, false };
+    test_each_word(LETTERS, MAX_LEN, find_word, &s);
+    return s.found;
+}
+
+static bool escapes(const fa_auto* a, const fa_auto* b, const char* word) {
+    return test_run(a, word) && !test_run(b, word);
+}
+
+static bool rejected(const fa_auto* a, const fa_auto* b, const char* word) {
+    (void)b;
+    return !test_run(a, word);
+}
+
+static bool shared(const fa_auto* a, const fa_auto* b, const char* word) {
+    return test_run(a, word) && test_run(b, word);
+}
+
+static bool differs(const fa_auto* a, const fa_auto* b, const char* word) {
+    return test_run(a, word) != test_run(b, word);
+}
+
+static void check_verdict(const char* what, bool holds, char* word, const fa_auto* a,
+                          const fa_auto* b,
+                          bool (*bad)(const fa_auto*, const fa_auto*, const char*)) {
+    bool brute = exists_word(a, b, bad);
+    // `holds` means no bad word exists (for intersection: no shared word)
+    CHECK_MSG(!(holds && brute), "%s: holds, but brute force found a word", what);
+    if (!holds) {
+        CHECK_MSG(word != NULL, "%s: no word reported", what);
+        if (word) {
+            CHECK_MSG(bad(a, b, word), "%s: reported word \"%s\" does not witness it", what, word);
+            CHECK_MSG(!brute || strlen(word) <= MAX_LEN, "%s: \"%s\" is not shortest", what, word);
+        }
+    } else {
+        CHECK_MSG(word == NULL, "%s: word reported on success", what);
+    }
+    free(word);
+}
+
+static void test_random_pairs(void) {
+    uint64_t rng = 28;
+    for (int round = 0; round < 400; round++) {
+        int n = 1 + (int)test_below(&rng, 4), m = 1 + (int)test_below(&rng, 4);
+        fa_auto* a = test_random_nfa(&rng, n, 2, 2 * n + 1, 15, 50);
+        fa_auto* b = test_random_nfa(&rng, m, 2, 3 * m + 1, 15, 60);
+        char* word = NULL;
+
+        bool sub = fa_auto_is_subset(a, b, &word);
+        check_verdict("is_subset", sub, word, a, b, escapes);
+        word = NULL;
+        bool uni = fa_auto_is_universal(b, &word);
+        check_verdict("is_universal", uni, word, b, NULL, rejected);
+        word = NULL;
+        bool empty = fa_auto_is_empty_intersection(a, b, &word);
+        check_verdict("is_empty_intersection", empty, word, a, b, shared);
+        word = NULL;
+        bool eq = fa_auto_equivalent(a, b, &word);
+        check_verdict("equivalent", eq, word, a, b, differs);
+
+        // Every automaton equals its determinized and minimized forms
+        fa_auto* dfa = fa_auto_determinize(a, FA_DETERMINIZE_SUBSET);
+        fa_auto* min = fa_auto_minimize(a, FA_MINIMIZE_HOPCROFT);
+        CHECK(fa_auto_equivalent(a, dfa, NULL) && fa_auto_equivalent(dfa, min, NULL));
+        CHECK(fa_auto_is_subset(a, dfa, NULL) && fa_auto_is_subset(min, a, NULL));
+        // DFA pairs take the union-find path
+        fa_auto* other = fa_auto_determinize(b, FA_DETERMINIZE_SUBSET);
+        word = NULL;
+        eq = fa_auto_equivalent(dfa, other, &word);
+        check_verdict("equivalent (DFA)", eq, word, dfa, other, differs);
+
+        fa_auto_destroy(other);
+        fa_auto_destroy(min);
+        fa_auto_destroy(dfa);
+        fa_auto_destroy(a);
+        fa_auto_destroy(b);
+    }
+}
+
+/*
+ * (a|b)* followed by one of `words`, then (a|b)* again if `tail`; the
+ * empty word makes the start accept.
+ */
+static fa_auto* after_any(const char* const* words, size_t count, bool tail) {
+    static const char* ab[] = { "a", "b" };
+    fa_auto* a = fa_auto_create(16);
+    set_insert(a->alphabet, &ab[0]);
+    set_insert(a->alphabet, &ab[1]);
+    fa_state* start = fa_state_create("q0", true, false);
+    a->states[a->nstates++] = start;
+    for (size_t w = 0; w < count; w++) {
+        fa_state* at = start;
+        for (const char* p = words[w]; *p; p++) {
+            char label[16];
+            snprintf(label, sizeof(label), "q%zu", a->nstates);
+            fa_state* next = fa_state_create(label, false, false);
+            a->states[a->nstates++] = next;
+            fa_trans_create(at, next, *p == 'a' ? ab[0] : ab[1]);
+            at = next;
+        }
+        at->is_accept = true;
+        if (tail) {
+            fa_trans_create(at, at, ab[0]);
+            fa_trans_create(at, at, ab[1]);
+        }
+    }
+    fa_trans_create(start, start, ab[0]);
+    fa_trans_create(start, start, ab[1]);
+    return a;
+}
+
+static void test_known_answers(void) {
+    static const char* abb[] = { "abb" };
+    static const char* abb_babb[] = { "abb", "babb" };
+    static const char* empty[] = { "" };
+    static const char* one_a[] = { "a" };
+    fa_auto* x = after_any(abb, 1, false);
+    fa_auto* y = after_any(abb_babb, 2, false);
+    fa_auto* all = after_any(empty, 1, false);
+    fa_auto* some = after_any(one_a, 1, true);
+    char* word = NULL;
+
+    CHECK(fa_auto_equivalent(x, y, NULL));
+    CHECK(fa_auto_is_universal(all, NULL));
+    CHECK(!fa_auto_is_universal(some, &word));
+    CHECK(word && !test_run(some, word) && strspn(word, "b") == strlen(word));
+    free(word);
+    word = NULL;
+    CHECK(!fa_auto_is_subset(all, x, &word));
+    // Breadth-first search reports a shortest counterexample
+    CHECK(word && strcmp(word, "") == 0);
+    free(word);
+    word = NULL;
+    CHECK(!fa_auto_is_empty_intersection(x, some, &word));
+    CHECK(word && strcmp(word, "abb") == 0);
+    free(word);
+
+    CHECK(!fa_auto_is_subset(NULL, x, NULL));
+    CHECK(!fa_auto_equivalent(x, NULL, NULL));
+
+    fa_auto_destroy(some);
+    fa_auto_destroy(all);
+    fa_auto_destroy(y);
+    fa_auto_destroy(x);
+}
+
+int main(void) {
+    test_random_pairs();
+    test_known_answers();
+    return test_report("test_decide");
+}
@@ -0,0 +1,207 @@
+#include "test_util.h"
+
+/*
+ * Fingerprints: invariant under state order, labels and symbol splitting,
+ * equal for minimal DFAs of one language, different otherwise.
+ */
+
+// Copy of `dfa` with states stored in a random order, relabelled, and moves reversed
+static fa_auto* shuffled(const fa_auto* dfa, uint64_t* rng) {
+    size_t n = dfa->nstates;
+    size_t* order = malloc((n ? n : 1) * sizeof(size_t));
+    for (size_t i = 0; i < n; i++) order[i] = i;
+    for (size_t i = n; i > 1; i--) {
+        size_t j = test_below(rng, i), t = order[i - 1];
+        order[i - 1] = order[j];
+        order[j] = t;
+    }
+    fa_auto* copy = fa_auto_create((int)n);
+    for (size_t i = 0; i < dfa->alphabet->length; i++) {
+        set_insert(copy->alphabet, dfa->alphabet->members[i]);
+    }
+    copy->sink_accepts = dfa->sink_accepts;
+    for (size_t i = 0; i < n; i++) {
+        const fa_state* s = dfa->states[order[i]];
+        char label[32];
+        snprintf(label, sizeof(label), "x%zu", test_rand(rng) % 100000);
+        copy->states[copy->nstates++] = fa_state_create(label, s->is_start, s->is_accept);
+    }
+    for (size_t i = 0; i < n; i++) {
+        const fa_state* s = dfa->states[order[i]];
+        // Prepending reverses the stored order of the moves
+        for (fa_trans* t = s->trans; t; t = t->next) {
+            size_t d = 0;
+            while (order[d] != test_state_id(dfa, t->dest)) d++;
+            fa_trans* u = malloc(sizeof(fa_trans));
+            u->symbol = strdup(t->symbol);
+            u->src = copy->states[i];
+            u->dest = copy->states[d];
+            u->next = copy->states[i]->trans;
+            copy->states[i]->trans = u;
+            copy->states[i]->ntrans++;
+        }
+    }
+    free(order);
+    return copy;
+}
+
+static bool fingerprint_of(const fa_auto* dfa, uint64_t fp[2]) {
+    return dfa && fa_auto_fingerprint(dfa, fp) == FA_SUCCESS;
+}
+
+static void test_invariance(void) {
+    uint64_t rng = 48;
+    for (int round = 0; round < 200; round++) {
+        int n = 2 + (int)test_below(&rng, 6);
+        fa_auto* nfa = test_random_nfa(&rng, n, 3, 3 * n, 10, 35);
+        fa_auto* min = fa_auto_minimize(nfa, FA_MINIMIZE_HOPCROFT);
+        fa_auto* copy = min ? shuffled(min, &rng) : NULL;
+        uint64_t a[2], b[2];
+        CHECK(fingerprint_of(min, a) && fingerprint_of(copy, b));
+        CHECK(a[0] == b[0] && a[1] == b[1]);
+
+        // Brzozowski's algorithm reaches the same minimal DFA
+        fa_auto* brz = fa_auto_minimize(nfa, FA_MINIMIZE_BRZOZOWSKI);
+        CHECK(fingerprint_of(brz, b) && a[0] == b[0] && a[1] == b[1]);
+        fa_auto_destroy(brz);
+
+        // Minimal DFAs hash alike exactly when their languages are equal
+        fa_auto* other_nfa = test_random_nfa(&rng, n, 3, 3 * n, 10, 35);
+        fa_auto* other = fa_auto_minimize(other_nfa, FA_MINIMIZE_HOPCROFT);
+        CHECK(fingerprint_of(other, b));
+        bool same_fp = a[0] == b[0] && a[1] == b[1];
+        CHECK(same_fp == fa_auto_equivalent(min, other, NULL));
+
+        fa_auto_destroy(other);
+        fa_auto_destroy(other_nfa);
+        fa_auto_destroy(copy);
+        fa_auto_destroy(min);
+        fa_auto_destroy(nfa);
+    }
+}
+
+static void test_symbol_splitting(void) {
+    // [a-c]x, (a|b|c)x and [a-b]x|cx all hash alike once minimized
+    static const char* patterns[] = { "[a-c]x", "(a|b|c)x", "[ab]x|cx", "(a|[bc])x" };
+    uint64_t first[2], fp[2];
+    for (size_t i = 0; i < sizeof(patterns) / sizeof(patterns[0]); i++) {
+        fa_auto* nfa = fa_auto_from_regex(patterns[i]);
+        fa_auto* min = fa_auto_minimize(nfa, FA_MINIMIZE_HOPCROFT);
+        CHECK_MSG(fingerprint_of(min, i ? fp : first), "/%s/", patterns[i]);
+        if (i) CHECK_MSG(fp[0] == first[0] && fp[1] == first[1], "/%s/", patterns[i]);
+        fa_auto_destroy(min);
+        fa_auto_destroy(nfa);
+    }
+
+    // A dead state does not count
+    fa_auto* nfa = fa_auto_from_regex("ab");
+    fa_auto* min = fa_auto_minimize(nfa, FA_MINIMIZE_HOPCROFT);
+    fa_auto* dead = fa_auto_materialize_sink(min);
+    fa_state** grown = realloc(dead->states, (dead->nstates + 1) * sizeof(fa_state*));
+    CHECK(grown != NULL);
+    if (grown) {
+        dead->states = grown;
+        fa_state* trap = fa_state_create("trap", false, false);
+        dead->states[dead->nstates++] = trap;
+        dead->capacity = dead->nstates;
+        fa_state* start = NULL;
+        for (size_t i = 0; i < min->nstates; i++) {
+            if (dead->states[i]->is_start) start = dead->states[i];
+        }
+        fa_trans_create(start, trap, "b");
+        fa_trans_create(trap, trap, "a");
+        CHECK(fingerprint_of(dead, fp) && fingerprint_of(min, first));
+        CHECK(fp[0] == first[0] && fp[1] == first[1]);
+    }
+    fa_auto_destroy(dead);
+    fa_auto_destroy(min);
+    fa_auto_destroy(nfa);
+}
+
+static bool same_fingerprint(const fa_auto* a, const fa_auto* b) {
+    uint64_t x[2], y[2];
+    return fingerprint_of(a, x) && fingerprint_of(b, y) && x[0] == y[0] && x[1] == y[1];
+}
+
+static void test_accepting_sink(void) {
+    // The implicit accepting sink hashes like the state it stands for
+    uint64_t rng = 148;
+    for (int round = 0; round < 200; round++) {
+        int n = 1 + (int)test_below(&rng, 5);
+        fa_auto* nfa = test_random_nfa(&rng, n, 3, 3 * n, 10, 35);
+        fa_auto* c = fa_auto_complement(nfa);
+        fa_auto* m = fa_auto_materialize_sink(c);
+        fa_auto* hop = fa_auto_minimize(c, FA_MINIMIZE_HOPCROFT);
+        fa_auto* hop_m = fa_auto_minimize(m, FA_MINIMIZE_HOPCROFT);
+        CHECK(c && c->sink_accepts && m && !m->sink_accepts);
+        CHECK(same_fingerprint(hop, hop_m));
+        fa_auto* copy = hop ? shuffled(hop, &rng) : NULL;
+        CHECK(same_fingerprint(copy, hop_m));
+
+        // Equal languages hash alike, whichever way the sink is stored
+        fa_auto* other_nfa = test_random_nfa(&rng, n, 3, 3 * n, 10, 35);
+        fa_auto* other_c = fa_auto_complement(other_nfa);
+        fa_auto* other = fa_auto_minimize(other_c, FA_MINIMIZE_HOPCROFT);
+        fa_auto* other_m = fa_auto_materialize_sink(other);
+        fa_auto* other_min = fa_auto_minimize(other_nfa, FA_MINIMIZE_HOPCROFT);
+        bool equal = fa_auto_equivalent(hop_m, other_m, NULL);
+        CHECK(same_fingerprint(hop, other) == equal);
+        CHECK(same_fingerprint(hop_m, other_m) == equal);
+        CHECK(same_fingerprint(hop, other_min) == fa_auto_equivalent(hop_m, other_min, NULL));
+
+        fa_auto_destroy(other_min);
+        fa_auto_destroy(other_m);
+        fa_auto_destroy(other);
+        fa_auto_destroy(other_c);
+        fa_auto_destroy(other_nfa);
+        fa_auto_destroy(copy);
+        fa_auto_destroy(hop_m);
+        fa_auto_destroy(hop);
+        fa_auto_destroy(m);
+        fa_auto_destroy(c);
+        fa_auto_destroy(nfa);
+    }
+
+    // Σ* as one explicit state, and as the sink behind a state that moves
+    // to it
+    fa_auto* all = fa_auto_from_regex("(a|b)*");
+    fa_auto* all_min = fa_auto_minimize(all, FA_MINIMIZE_HOPCROFT);
+    fa_auto* none = fa_auto_complement(all_min);
+    fa_auto* again = fa_auto_complement(none);
+    CHECK(same_fingerprint(again, all_min));
+    fa_auto* ab = fa_auto_from_regex("ab");
+    fa_auto* ab_min = fa_auto_minimize(ab, FA_MINIMIZE_HOPCROFT);
+    fa_auto* not_ab = fa_auto_complement(ab_min);
+    fa_auto* not_ab_m = fa_auto_materialize_sink(not_ab);
+    CHECK(same_fingerprint(not_ab, not_ab_m));
+    // The materialized sink is dead again after a second complement
+    fa_auto* back = fa_auto_complement(not_ab_m);
+    CHECK(same_fingerprint(back, ab_min));
+
+    fa_auto_destroy(back);
+    fa_auto_destroy(not_ab_m);
+    fa_auto_destroy(not_ab);
+    fa_auto_destroy(ab_min);
+    fa_auto_destroy(ab);
+    fa_auto_destroy(again);
+    fa_auto_destroy(none);
+    fa_auto_destroy(all_min);
+    fa_auto_destroy(all);
+}
+
+static void test_errors(void) {
+    uint64_t fp[2];
+    fa_auto* nfa = fa_auto_from_regex("a|ab");
+    CHECK(fa_auto_fingerprint(nfa, fp) == FA_ERR_NOT_DETERMINISTIC);
+    CHECK(fa_auto_fingerprint(NULL, fp) == FA_ERR_NULL_ARGUMENT);
+    CHECK(fa_auto_fingerprint(nfa, NULL) == FA_ERR_NULL_ARGUMENT);
+    fa_auto_destroy(nfa);
+}
+
+int main(void) {
+    test_invariance();
+    test_symbol_splitting();
+    test_accepting_sink();
+    test_errors();
+    return test_report("test_fingerprint");
+}
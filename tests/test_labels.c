@@ -0,0 +1,151 @@
+#include "test_util.h"
+
+/*
+ * Interval labels: the range helpers, and automata mixing overlapping
+ * labels with single characters run through the minterm-based operations
+ * and compared with the reference simulation, which reads labels through
+ * fa_range_contains.
+ */
+
+#define LETTERS "abcdef"
+#define MAX_LEN 4
+
+static const char* symbols[] = { "[a-c]", "[b-e]", "d", "[a-f]", "[ace]", "f", "[c-d]" };
+#define NSYMBOLS (sizeof(symbols) / sizeof(symbols[0]))
+
+static fa_auto* random_label_nfa(uint64_t* rng, int n, int ntrans) {
+    fa_auto* a = fa_auto_create(n);
+    for (size_t i = 0; i < NSYMBOLS; i++) set_insert(a->alphabet, &symbols[i]);
+    for (int i = 0; i < n; i++) {
+        char label[16];
+        snprintf(label, sizeof(label), "q%d", i);
+        a->states[a->nstates++] = fa_state_create(label, i == 0, test_below(rng, 100) < 40);
+    }
+    for (int j = 0; j < ntrans; j++) {
+        fa_state* src = a->states[test_below(rng, (size_t)n)];
+        fa_state* dest = a->states[test_below(rng, (size_t)n)];
+        const char* symbol = symbols[test_below(rng, NSYMBOLS)];
+        if (!fa_trans_exists(src, dest, symbol)) fa_trans_create(src, dest, symbol);
+    }
+    return a;
+}
+
+static void test_ranges(void) {
+    fa_range r[] = { { 'x', 'z' }, { 'a', 'c' }, { 'b', 'e' }, { 'f', 'f' } };
+    char* label = fa_range_label(r, 4);
+    // Sorted, and overlapping or adjacent ranges merged
+    CHECK(label && strcmp(label, "[a-fx-z]") == 0);
+    fa_range* parsed = NULL;
+    size_t count = 0;
+    CHECK(fa_range_parse(label, &parsed, &count) == FA_SUCCESS && count == 2 &&
+          parsed[0].lo == 'a' && parsed[0].hi == 'f' && parsed[1].lo == 'x' && parsed[1].hi == 'z');
+    free(parsed);
+    free(label);
+
+    fa_range one = { 'q', 'q' };
+    label = fa_range_label(&one, 1);
+    CHECK(label && strcmp(label, "q") == 0);
+    free(label);
+    fa_range bad = { 'z', 'a' };
+    CHECK(fa_range_label(&bad, 1) == NULL && fa_range_label(&one, 0) == NULL);
+    fa_range huge = { 0, FA_RANGE_MAX + 1 };
+    CHECK(fa_range_label(&huge, 1) == NULL);
+
+    CHECK(fa_range_contains("[a-f]", 'c') && !fa_range_contains("[a-f]", 'g'));
+    CHECK(fa_range_contains("x", 'x') && fa_range_contains("[\\x41]", 'A'));
+    CHECK(fa_range_contains("[\\u{3b1}-\\u{3c9}]", 0x3bb));
+    CHECK(fa_range_parse("abc", &parsed, &count) == FA_ERR_INVALID_ARGUMENT);
+    CHECK(fa_range_parse(FA_EPS_SYMBOL, &parsed, &count) == FA_ERR_INVALID_ARGUMENT);
+
+    // UTF-8 round trip over every boundary length
+    static const uint32_t cps[] = { 0x41, 0x7F, 0x80, 0x7FF, 0x800, 0xFFFF, 0x10000, FA_RANGE_MAX };
+    for (size_t i = 0; i < sizeof(cps) / sizeof(cps[0]); i++) {
+        char buf[5] = { 0 };
+        uint32_t back = 0;
+        size_t len = fa_range_encode(cps[i], buf);
+        CHECK(len >= 1 && len <= 4 && fa_range_decode(buf, &back) == len && back == cps[i]);
+    }
+    CHECK(fa_range_decode("\xC0\x80", &one.lo) == 0 && fa_range_decode("", &one.lo) == 0);
+}
+
+static void test_label_operations(void) {
+    uint64_t rng = 47;
+    for (int round = 0; round < 120; round++) {
+        int n = 2 + (int)test_below(&rng, 4);
+        fa_auto* a = random_label_nfa(&rng, n, 3 * n);
+        fa_auto* b = random_label_nfa(&rng, n, 3 * n);
+
+        fa_auto* dfa = fa_auto_determinize(a, FA_DETERMINIZE_SUBSET);
+        CHECK(dfa && fa_auto_is_deterministic(dfa));
+        CHECK(test_same_language(a, dfa, LETTERS, MAX_LEN, "labels: determinize"));
+        fa_auto* min = fa_auto_minimize(a, FA_MINIMIZE_HOPCROFT);
+        CHECK(test_same_language(a, min, LETTERS, MAX_LEN, "labels: minimize"));
+        CHECK(fa_auto_equivalent(a, min, NULL) && fa_auto_equivalent(dfa, min, NULL));
+
+        fa_auto* both = fa_auto_product(a, b);
+        fa_auto* left = fa_auto_difference(a, b);
+        fa_auto* back = fa_auto_union(both, left);
+        // (A ∩ B) ∪ (A - B) = A
+        CHECK(fa_auto_equivalent(back, a, NULL));
+        CHECK(test_same_language(a, back, LETTERS, MAX_LEN, "labels: product and difference"));
+        CHECK(fa_auto_is_subset(both, b, NULL) && fa_auto_is_empty_intersection(left, b, NULL));
+
+        fa_auto* rev = fa_auto_reverse(a);
+        fa_auto* rev2 = fa_auto_reverse(rev);
+        CHECK(test_same_language(a, rev2, LETTERS, MAX_LEN, "labels: reverse twice"));
+
+        fa_auto_destroy(rev2);
+        fa_auto_destroy(rev);
+        fa_auto_destroy(back);
+        fa_auto_destroy(left);
+        fa_auto_destroy(both);
+        fa_auto_destroy(min);
+        fa_auto_destroy(dfa);
+        fa_auto_destroy(b);
+        fa_auto_destroy(a);
+    }
+}
+
+static void test_wide_labels(void) {
+    // One edge for the whole code space, not one per code point
+    fa_auto* any = fa_auto_create(2);
+    const char* all = "[\\x00-\\u{10FFFF}]";
+    set_insert(any->alphabet, &all);
+    any->states[any->nstates++] = fa_state_create("s", true, false);
+    any->states[any->nstates++] = fa_state_create("t", false, true);
+    fa_trans_create(any->states[0], any->states[1], all);
+    fa_word_count c;
+    CHECK(fa_auto_count_words(any, 1, &c) == FA_SUCCESS && c.low == FA_RANGE_MAX + 1);
+    CHECK(fa_auto_accepts(any, "a") && fa_auto_accepts(any, "\xF4\x8F\xBF\xBF") &&
+          fa_auto_accepts(any, "\xCE\xBB") && !fa_auto_accepts(any, "ab"));
+
+    // Greek letters minus lambda
+    fa_auto* greek = fa_auto_create(2);
+    const char* alpha_omega = "[\\u{3b1}-\\u{3c9}]";
+    const char* lambda = "\xCE\xBB";
+    set_insert(greek->alphabet, &alpha_omega);
+    set_insert(greek->alphabet, &lambda);
+    greek->states[greek->nstates++] = fa_state_create("s", true, false);
+    greek->states[greek->nstates++] = fa_state_create("t", false, true);
+    fa_trans_create(greek->states[0], greek->states[1], lambda);
+    fa_auto* lam = fa_auto_materialize_sink(greek);
+    fa_trans_create(greek->states[0], greek->states[1], alpha_omega);
+    fa_auto* rest = fa_auto_difference(greek, lam);
+    CHECK(rest && fa_auto_accepts(rest, "\xCE\xB1") && !fa_auto_accepts(rest, lambda));
+    CHECK(rest && fa_auto_count_words(rest, 1, &c) == FA_SUCCESS && c.low == 24);
+    fa_auto* rdfa = fa_auto_minimize(rest, FA_MINIMIZE_HOPCROFT);
+    CHECK(rdfa && rdfa->nstates == 2 && fa_auto_accepts(rdfa, "\xCF\x89"));
+
+    fa_auto_destroy(rdfa);
+    fa_auto_destroy(rest);
+    fa_auto_destroy(lam);
+    fa_auto_destroy(greek);
+    fa_auto_destroy(any);
+}
+
+int main(void) {
+    test_ranges();
+    test_label_operations();
+    test_wide_labels();
+    return test_report("test_labels");
+}
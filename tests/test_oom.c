@@ -0,0 +1,174 @@
+#include "test_util.h"
+#include "io/fa_dfa_image.h"
+#include "regex/regexpr.h"
+
+/*
+ * Allocation failures: the program is linked with
+ * -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc, and each case is rerun
+ * with its k-th allocation failing, for every k the case performs. Every
+ * run must either succeed with the unfaulted result or report
+ * FA_ERR_OUT_OF_MEMORY, and must not crash.
+ */
+
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t count, size_t size);
+void* __real_realloc(void* ptr, size_t size);
+
+static unsigned long alloc_count;
+static unsigned long fail_at;           // 0: never fail
+static unsigned long measured;          // Allocations before the result was checked
+
+static bool alloc_fails(void) {
+    unsigned long n = __atomic_add_fetch(&alloc_count, 1, __ATOMIC_RELAXED);
+    return n == __atomic_load_n(&fail_at, __ATOMIC_RELAXED);
+}
+
+void* __wrap_malloc(size_t size) {
+    return alloc_fails() ? NULL : __real_malloc(size);
+}
+
+void* __wrap_calloc(size_t count, size_t size) {
+    return alloc_fails() ? NULL : __real_calloc(count, size);
+}
+
+void* __wrap_realloc(void* ptr, size_t size) {
+    return alloc_fails() ? NULL : __real_realloc(ptr, size);
+}
+
+// Checking a result allocates too; those allocations are not faulted
+static void stop_faults(void) {
+    measured = __atomic_load_n(&alloc_count, __ATOMIC_RELAXED);
+    __atomic_store_n(&fail_at, 0, __ATOMIC_RELAXED);
+}
+
+typedef enum { RUN_OK, RUN_OUT_OF_MEMORY, RUN_WRONG } run_outcome;
+
+typedef run_outcome (*oom_case)(void);
+
+static fa_auto* nfa;                    // (a|b)*a(a|b){4}c?
+static fa_auto* dfa;                    // Its minimal DFA
+static fa_auto* other;                  // A second DFA for binary operations
+
+static run_outcome reported(fa_error_t err) {
+    stop_faults();
+    return err == FA_ERR_OUT_OF_MEMORY ? RUN_OUT_OF_MEMORY : RUN_WRONG;
+}
+
+static run_outcome case_regex_parse(void) {
+    fa_error_t err;
+    regex_ast* ast = regex_parse("(ab|c)*[x-z]{2}d?|!(a&b)", REGEX_PARSE_BOOLEAN, &err);
+    if (!ast) return reported(err);
+    stop_faults();
+    regex_ast_destroy(ast);
+    return err == FA_SUCCESS ? RUN_OK : RUN_WRONG;
+}
+
+static run_outcome determinize_with(fa_determinize_algorithm algorithm) {
+    fa_error_t err;
+    fa_auto* d = fa_auto_determinize_budget(nfa, algorithm, NULL, &err);
+    if (!d) return reported(err);
+    stop_faults();
+    run_outcome r = fa_auto_equivalent(d, dfa, NULL) ? RUN_OK : RUN_WRONG;
+    fa_auto_destroy(d);
+    return r;
+}
+
+static run_outcome case_subset(void) {
+    return determinize_with(FA_DETERMINIZE_SUBSET);
+}
+
+static run_outcome case_bfs(void) {
+    return determinize_with(FA_DETERMINIZE_BFS);
+}
+
+static run_outcome case_product(void) {
+    fa_error_t err;
+    fa_auto* p = fa_auto_product_budget(dfa, other, NULL, &err);
+    if (!p) return reported(err);
+    stop_faults();
+    fa_auto_destroy(p);
+    return RUN_OK;
+}
+
+static run_outcome case_minimize(void) {
+    fa_error_t err;
+    fa_auto* m = fa_auto_minimize_budget(nfa, FA_MINIMIZE_HOPCROFT, NULL, &err);
+    if (!m) return reported(err);
+    stop_faults();
+    run_outcome r = m->nstates == dfa->nstates ? RUN_OK : RUN_WRONG;
+    fa_auto_destroy(m);
+    return r;
+}
+
+static run_outcome case_image(void) {
+    fa_error_t err;
+    fa_dfa_image* image = fa_dfa_image_create(dfa, NULL, &err);
+    if (!image) return reported(err);
+    stop_faults();
+    run_outcome r = fa_dfa_image_matches(image, "abbbbc") && !fa_dfa_image_matches(image, "bbbbb")
+                    ? RUN_OK : RUN_WRONG;
+    fa_dfa_image_close(image);
+    return r;
+}
+
+static run_outcome case_count(void) {
+    fa_word_count c;
+    fa_error_t err = fa_auto_count_words(nfa, 7, &c);
+    if (err != FA_SUCCESS) return reported(err);
+    stop_faults();
+    // Length k has 2^(k-1) words without the c and 2^(k-2) with it
+    return c.high == 0 && c.low == 16 + (32 + 16) + (64 + 32) ? RUN_OK : RUN_WRONG;
+}
+
+static uint64_t expected_fp[2];
+
+static run_outcome case_fingerprint(void) {
+    uint64_t fp[2];
+    fa_error_t err = fa_auto_fingerprint(dfa, fp);
+    if (err != FA_SUCCESS) return reported(err);
+    stop_faults();
+    return fp[0] == expected_fp[0] && fp[1] == expected_fp[1] ? RUN_OK : RUN_WRONG;
+}
+
+static void run_case(const char* name, oom_case run) {
+    __atomic_store_n(&fail_at, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&alloc_count, 0, __ATOMIC_RELAXED);
+    CHECK_MSG(run() == RUN_OK, "%s: unfaulted run failed", name);
+    unsigned long total = measured;
+    CHECK_MSG(total > 0, "%s: no allocations seen (is malloc wrapped?)", name);
+
+    unsigned long failures = 0;
+    for (unsigned long k = 1; k <= total; k++) {
+        __atomic_store_n(&alloc_count, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&fail_at, k, __ATOMIC_RELAXED);
+        run_outcome r = run();
+        CHECK_MSG(r != RUN_WRONG, "%s: allocation %lu of %lu failed: wrong result", name, k,
+                  total);
+        failures += r == RUN_OUT_OF_MEMORY;
+    }
+    __atomic_store_n(&fail_at, 0, __ATOMIC_RELAXED);
+    CHECK_MSG(failures > 0, "%s: no run reported FA_ERR_OUT_OF_MEMORY", name);
+}
+
+int main(void) {
+    nfa = fa_auto_from_regex("(a|b)*a(a|b){4}c?");
+    dfa = fa_auto_minimize(nfa, FA_MINIMIZE_HOPCROFT);
+    fa_auto* y = fa_auto_from_regex("(a|b)*b(a|b)b");
+    other = fa_auto_minimize(y, FA_MINIMIZE_HOPCROFT);
+    CHECK(dfa && other && fa_auto_fingerprint(dfa, expected_fp) == FA_SUCCESS);
+
+    run_case("regex_parse", case_regex_parse);
+    run_case("determinize subset", case_subset);
+    run_case("determinize bfs", case_bfs);
+    run_case("product", case_product);
+    run_case("minimize", case_minimize);
+    run_case("dfa image", case_image);
+    run_case("count", case_count);
+    run_case("fingerprint", case_fingerprint);
+
+    fa_auto_destroy(other);
+    fa_auto_destroy(y);
+    fa_auto_destroy(dfa);
+    fa_auto_destroy(nfa);
+    return test_report("test_oom");
+}
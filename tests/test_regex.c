@@ -0,0 +1,365 @@
+#include "test_util.h"
+#include "regex/regexpr.h"
+#include "regex/regex_deriv.h"
+
+/*
+ * The regex front ends checked against each other and against a direct
+ * interpreter of the syntax tree: Thompson and Glushkov automata, the
+ * derivative engine (lazily and as a whole automaton), and the tree before
+ * and after regex_simplify.
+ */
+
+#define LETTERS "abc"
+#define MAX_LEN 5
+
+// Bit i set: the node can stop at position i of the word
+typedef uint32_t ends_t;
+
+static ends_t ast_ends(const regex_node* node, const char* word, size_t len, ends_t from);
+
+static ends_t ast_star(const regex_node* kid, const char* word, size_t len, ends_t from) {
+    ends_t reach = from;
+    for (ends_t last = 0; reach != last; ) {
+        last = reach;
+        reach |= ast_ends(kid, word, len, reach);
+    }
+    return reach;
+}
+
+static ends_t ast_ends(const regex_node* node, const char* word, size_t len, ends_t from) {
+    ends_t out = 0, all = (ends_t)((2u << len) - 1);
+    switch (node->kind) {
+    case REGEX_EMPTY:
+        return from;
+    case REGEX_ANCHOR_START:
+        return from & 1;
+    case REGEX_ANCHOR_END:
+        return from & (ends_t)1 << len;
+    case REGEX_CHAR:
+    case REGEX_CLASS:
+        for (size_t i = 0; i < len; i++) {
+            unsigned char c = (unsigned char)word[i];
+            bool ok = node->kind == REGEX_CHAR ? c == node->ch : regex_class_has(node->cls, c);
+            if ((from >> i & 1) && ok) out |= (ends_t)1 << (i + 1);
+        }
+        return out;
+    case REGEX_CONCAT:
+        out = from;
+        for (size_t k = 0; k < node->nkids; k++) out = ast_ends(node->kids[k], word, len, out);
+        return out;
+    case REGEX_ALT:
+        for (size_t k = 0; k < node->nkids; k++) out |= ast_ends(node->kids[k], word, len, from);
+        return out;
+    case REGEX_AND:
+        out = all;
+        for (size_t k = 0; k < node->nkids; k++) out &= ast_ends(node->kids[k], word, len, from);
+        return out;
+    case REGEX_STAR:
+        return ast_star(node->kids[0], word, len, from);
+    case REGEX_PLUS:
+        return ast_star(node->kids[0], word, len, ast_ends(node->kids[0], word, len, from));
+    case REGEX_QUESTION:
+        return from | ast_ends(node->kids[0], word, len, from);
+    case REGEX_REPEAT:
+        out = from;
+        for (int i = 0; i < node->min; i++) out = ast_ends(node->kids[0], word, len, out);
+        if (node->max == REGEX_UNBOUNDED) return ast_star(node->kids[0], word, len, out);
+        for (int i = node->min; i < node->max; i++) out |= ast_ends(node->kids[0], word, len, out);
+        return out;
+    case REGEX_NOT:
+        // Complement per start position: the ends of every word not in the kid
+        for (size_t i = 0; i <= len; i++) {
+            if (!(from >> i & 1)) continue;
+            ends_t mine = ast_ends(node->kids[0], word, len, (ends_t)1 << i);
+            out |= ~mine & all & ~(((ends_t)1 << i) - 1);
+        }
+        return out;
+    }
+    return 0;
+}
+
+static bool ast_matches(const regex_ast* ast, const char* word) {
+    size_t len = strlen(word);
+    return ast_ends(ast->root, word, len, 1) >> len & 1;
+}
+
+// Random pattern over a, b, c; `boolean` adds & and !
+static void random_pattern(uint64_t* rng, int depth, bool boolean, char* out, size_t size) {
+    size_t used = strlen(out);
+    if (used + 40 >= size) return;
+    char* p = out + used;
+    int pick = depth <= 0 ? (int)test_below(rng, 3) : (int)test_below(rng, boolean ? 12 : 10);
+    switch (pick) {
+    case 0: sprintf(p, "%c", "abc"[test_below(rng, 3)]); break;
+    case 1: strcpy(p, test_below(rng, 2) ? "[ab]" : "[^a]"); break;
+    case 2: strcpy(p, test_below(rng, 2) ? "." : "b"); break;
+    case 3: case 4:
+        random_pattern(rng, depth - 1, boolean, out, size);
+        random_pattern(rng, depth - 1, boolean, out, size);
+        break;
+    case 5:
+        strcat(out, "(");
+        random_pattern(rng, depth - 1, boolean, out, size);
+        strcat(out, "|");
+        random_pattern(rng, depth - 1, boolean, out, size);
+        strcat(out, ")");
+        break;
+    case 6: case 7: {
+        static const char* postfix[] = { "*", "+", "?", "{2}", "{1,2}", "{0,}", "{2,3}" };
+        strcat(out, "(");
+        random_pattern(rng, depth - 1, boolean, out, size);
+        strcat(out, ")");
+        strcat(out, postfix[test_below(rng, 7)]);
+        break;
+    }
+    case 8: {
+        static const char* empty[] = { "()", "^", "$" };
+        strcpy(p, empty[test_below(rng, 3)]);
+        break;
+    }
+    case 9:
+        strcat(out, "(ab|ac|a)");
+        break;
+    case 10:
+        strcat(out, "(");
+        random_pattern(rng, depth - 1, boolean, out, size);
+        strcat(out, "&");
+        random_pattern(rng, depth - 1, boolean, out, size);
+        strcat(out, ")");
+        break;
+    default:
+        strcat(out, "!(");
+        random_pattern(rng, depth - 1, boolean, out, size);
+        strcat(out, ")");
+        break;
+    }
+}
+
+typedef struct {
+    const char* pattern;
+    regex_ast* raw;
+    regex_ast* simple;
+    fa_auto* thompson;
+    fa_auto* glushkov;
+    fa_auto* from_deriv;
+    regex_deriv* deriv;
+    int mismatches;
+} front_ends;
+
+static bool compare_word(void* ctx, const char* word) {
+    front_ends* f = ctx;
+    bool expect = ast_matches(f->raw, word);
+    // The derivative automaton only has columns for the bytes of the pattern
+    bool covered = true;
+    for (const char* p = word; *p; p++) {
+        covered &= test_alphabet_reads(f->from_deriv, (unsigned char)*p);
+    }
+    bool got[5] = {
+        ast_matches(f->simple, word),
+        f->thompson ? test_run(f->thompson, word) : expect,
+        f->glushkov ? test_run(f->glushkov, word) : expect,
+        regex_deriv_matches(f->deriv, word),
+        covered ? test_run(f->from_deriv, word) : expect,
+    };
+    static const char* names[] = { "simplify", "thompson", "glushkov", "derivative",
+                                   "derivative automaton" };
+    for (int i = 0; i < 5; i++) {
+        if (got[i] != expect && f->mismatches++ == 0) {
+            fprintf(stderr, "  /%s/ %s: \"%s\" gives %d\n", f->pattern, names[i], word, got[i]);
+        }
+    }
+    return f->mismatches == 0;
+}
+
+static void check_pattern(const char* pattern, bool boolean) {
+    regex_parse_flags flags = boolean ? REGEX_PARSE_BOOLEAN : REGEX_PARSE_DEFAULT;
+    fa_error_t err;
+    front_ends f = { pattern, NULL, NULL, NULL, NULL, NULL, NULL, 0 };
+    f.raw = regex_parse(pattern, flags, &err);
+    f.simple = regex_parse(pattern, flags, NULL);
+    CHECK_MSG(f.raw && f.simple && err == FA_SUCCESS, "/%s/ does not parse", pattern);
+    if (!f.raw || !f.simple) goto done;
+    CHECK(regex_simplify(f.simple) == FA_SUCCESS);
+    if (!boolean) {
+        f.thompson = fa_auto_from_regex(pattern);
+        f.glushkov = fa_auto_from_regex_glushkov(pattern);
+        CHECK(f.thompson && f.glushkov);
+    }
+    f.deriv = regex_deriv_create(pattern);
+    CHECK(f.deriv != NULL);
+    if (!f.deriv) goto done;
+    f.from_deriv = regex_deriv_to_auto(f.deriv);
+    CHECK(f.from_deriv && fa_auto_is_deterministic(f.from_deriv));
+    if (!f.from_deriv) goto done;
+    test_each_word(LETTERS, MAX_LEN, compare_word, &f);
+    CHECK_MSG(f.mismatches == 0, "/%s/", pattern);
+
+    // The Glushkov automaton has no ε-transitions
+    if (f.glushkov) {
+        for (size_t s = 0; s < f.glushkov->nstates; s++) {
+            for (fa_trans* t = f.glushkov->states[s]->trans; t; t = t->next) {
+                CHECK(strcmp(t->symbol, FA_EPS_SYMBOL) != 0);
+            }
+        }
+    }
+done:
+    fa_auto_destroy(f.from_deriv);
+    regex_deriv_destroy(f.deriv);
+    fa_auto_destroy(f.glushkov);
+    fa_auto_destroy(f.thompson);
+    regex_ast_destroy(f.simple);
+    regex_ast_destroy(f.raw);
+}
+
+static void test_random_patterns(void) {
+    uint64_t rng = 31;
+    char pattern[512];
+    for (int round = 0; round < 300; round++) {
+        pattern[0] = '\0';
+        random_pattern(&rng, 4, false, pattern, sizeof(pattern));
+        check_pattern(pattern, false);
+    }
+    for (int round = 0; round < 200; round++) {
+        pattern[0] = '\0';
+        random_pattern(&rng, 3, true, pattern, sizeof(pattern));
+        check_pattern(pattern, true);
+    }
+}
+
+static void test_known_patterns(void) {
+    static const struct {
+        const char* pattern;
+        const char* yes[4];
+        const char* no[4];
+    } cases[] = {
+        { "a{2,3}", { "aa", "aaa" }, { "a", "aaaa" } },
+        { "a{2,}b", { "aab", "aaaaab" }, { "ab", "aa" } },
+        { "[a-c]+\\d", { "abc1", "c9" }, { "abc", "d1" } },
+        { "\\w\\s\\W", { "a .", "_\t-" }, { "ab.", "a a" } },
+        { "[^abc]x", { "dx", "zx" }, { "ax", "x" } },
+        { "\\x41\\.\\*", { "A.*" }, { "A..", "a.*" } },
+        { "^(ab|cd)*$", { "", "abcd", "cdab" }, { "abc", "ba" } },
+        { "a.c", { "abc", "a-c" }, { "a\nc", "ac" } },
+        { "(a|b)*abb", { "abb", "babb", "aabb" }, { "ab", "abba" } },
+        // Anchors only match at the ends of the word
+        { "a^b", { NULL }, { "ab", "b", "a" } },
+        { "a$b", { NULL }, { "ab", "a", "b" } },
+        { "(^a|b)c", { "ac", "bc" }, { "aac", "bac", "c" } },
+        { "a(b$|c)d", { "acd" }, { "abd", "ab", "ad", "abcd" } },
+    };
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        fa_auto* t = fa_auto_from_regex(cases[i].pattern);
+        fa_auto* g = fa_auto_from_regex_glushkov(cases[i].pattern);
+        regex_deriv* d = regex_deriv_create(cases[i].pattern);
+        CHECK_MSG(t && g && d, "/%s/", cases[i].pattern);
+        if (!t || !g || !d) continue;
+        for (int k = 0; k < 4; k++) {
+            const char* yes = cases[i].yes[k];
+            const char* no = cases[i].no[k];
+            if (yes) CHECK_MSG(test_run(t, yes) && test_run(g, yes) &&
+                               regex_deriv_matches(d, yes), "/%s/ on \"%s\"", cases[i].pattern, yes);
+            if (no) CHECK_MSG(!test_run(t, no) && !test_run(g, no) &&
+                              !regex_deriv_matches(d, no), "/%s/ on \"%s\"", cases[i].pattern, no);
+        }
+        regex_deriv_destroy(d);
+        fa_auto_destroy(g);
+        fa_auto_destroy(t);
+    }
+
+    // Boolean operators only exist for the derivative engine
+    regex_deriv* d = regex_deriv_create("(a|b)*&!(a*)");
+    CHECK(d && regex_deriv_matches(d, "ab") && !regex_deriv_matches(d, "aa") &&
+          !regex_deriv_matches(d, ""));
+    regex_deriv_destroy(d);
+}
+
+static void test_malformed(void) {
+    static const struct {
+        const char* pattern;
+        fa_error_t error;
+    } cases[] = {
+        { "(ab", FA_ERR_REGEX_UNBALANCED_PARENTHESES },
+        { "ab)", FA_ERR_REGEX_UNBALANCED_PARENTHESES },
+        { "a\\", FA_ERR_REGEX_TRAILING_BACKSLASH },
+        { "a{3,2}", FA_ERR_REGEX_INVALID_PATTERN },
+        { "a{1001}", FA_ERR_REGEX_INVALID_PATTERN },
+        { "a{,2}", FA_ERR_REGEX_INVALID_PATTERN },
+        { "a{2", FA_ERR_REGEX_UNEXPECTED_TOKEN },
+        { "[z-a]", FA_ERR_REGEX_INVALID_PATTERN },
+        { "*a", FA_ERR_REGEX_UNEXPECTED_TOKEN },
+        { "\\xZZ", FA_ERR_REGEX_INVALID_ESCAPE },
+    };
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        fa_error_t err = FA_SUCCESS;
+        regex_ast* ast = regex_parse(cases[i].pattern, REGEX_PARSE_DEFAULT, &err);
+        CHECK_MSG(ast == NULL && err == cases[i].error, "/%s/ gives %d", cases[i].pattern, (int)err);
+        regex_ast_destroy(ast);
+        CHECK(fa_auto_from_regex(cases[i].pattern) == NULL);
+        CHECK(fa_auto_from_regex_glushkov(cases[i].pattern) == NULL);
+        CHECK(regex_deriv_create(cases[i].pattern) == NULL);
+    }
+
+    fa_error_t err = FA_SUCCESS;
+    CHECK(regex_parse(NULL, REGEX_PARSE_DEFAULT, &err) == NULL && err == FA_ERR_NULL_ARGUMENT);
+    // Without REGEX_PARSE_BOOLEAN, & and ! are literals
+    regex_ast* ast = regex_parse("a&!b", REGEX_PARSE_DEFAULT, &err);
+    CHECK(ast && ast_matches(ast, "a&!b"));
+    regex_ast_destroy(ast);
+}
+
+// Parses `pattern` and reports whether it failed with `expected`
+static bool parse_fails_with(const char* pattern, regex_parse_flags flags, fa_error_t expected) {
+    fa_error_t err = FA_SUCCESS;
+    regex_ast* ast = regex_parse(pattern, flags, &err);
+    regex_ast_destroy(ast);
+    return ast == NULL && err == expected;
+}
+
+static void test_limits(void) {
+    // Deep nesting fails cleanly instead of overflowing the stack
+    size_t n = 100000;
+    char* deep = malloc(2 * n + 2);
+    memset(deep, '(', n);
+    deep[n] = 'a';
+    memset(deep + n + 1, ')', n);
+    deep[2 * n + 1] = '\0';
+    CHECK(parse_fails_with(deep, REGEX_PARSE_DEFAULT, FA_ERR_REGEX_TOO_COMPLEX));
+    CHECK(fa_auto_from_regex(deep) == NULL);
+    memset(deep, '!', n);
+    deep[n] = 'a';
+    deep[n + 1] = '\0';
+    CHECK(parse_fails_with(deep, REGEX_PARSE_BOOLEAN, FA_ERR_REGEX_TOO_COMPLEX));
+    memset(deep + 1, '*', n);
+    deep[0] = 'a';
+    deep[n + 1] = '\0';
+    CHECK(parse_fails_with(deep, REGEX_PARSE_DEFAULT, FA_ERR_REGEX_TOO_COMPLEX));
+
+    // Modest nesting is still fine
+    memset(deep, '(', 500);
+    deep[500] = 'a';
+    memset(deep + 501, ')', 500);
+    deep[1001] = '\0';
+    regex_ast* ast = regex_parse(deep, REGEX_PARSE_DEFAULT, NULL);
+    CHECK(ast && ast_matches(ast, "a") && !ast_matches(ast, "aa"));
+    regex_ast_destroy(ast);
+    free(deep);
+
+    // Nested counted repeats multiply
+    CHECK(parse_fails_with("a{1000}{1000}", REGEX_PARSE_DEFAULT, FA_ERR_REGEX_TOO_COMPLEX));
+    CHECK(parse_fails_with("(a{100}){100}{100}", REGEX_PARSE_DEFAULT, FA_ERR_REGEX_TOO_COMPLEX));
+    CHECK(parse_fails_with("(ab{1000}){200}", REGEX_PARSE_DEFAULT, FA_ERR_REGEX_TOO_COMPLEX));
+    ast = regex_parse("a{1000}", REGEX_PARSE_DEFAULT, NULL);
+    CHECK(ast != NULL);
+    regex_ast_destroy(ast);
+    ast = regex_parse("(a{10}b){10}{10}", REGEX_PARSE_DEFAULT, NULL);
+    CHECK(ast != NULL);
+    regex_ast_destroy(ast);
+}
+
+int main(void) {
+    test_known_patterns();
+    test_random_patterns();
+    test_malformed();
+    test_limits();
+    return test_report("test_regex");
+}
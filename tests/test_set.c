@@ -0,0 +1,208 @@
+#include "test_util.h"
+#include "set/set.h"
+#include "set/bitset.h"
+#include "common.h"
+
+/*
+ * Set and BitSet against plain arrays: the hash index must agree with a
+ * linear model through growth, removals and the set algebra, and the
+ * BitSet word kernels must report changes exactly.
+ */
+
+#define UNIVERSE 4096
+
+// set_create_int_set copies members as pointers; ints need copy_int
+static Set* int_set(void) {
+    return set_create_with_functions(sizeof(int), compare_ints, hash_int, copy_int, free);
+}
+
+// Insertion order is kept, so members can be compared to the model in order
+static bool matches_model(const Set* s, const bool* model) {
+    size_t count = 0;
+    for (int v = 0; v < UNIVERSE; v++) {
+        if (set_contains(s, &v) != model[v]) return false;
+        count += model[v];
+    }
+    return set_size(s) == count;
+}
+
+static void test_set_model(void) {
+    uint64_t rng = 49;
+    Set* s = int_set();
+    static bool model[UNIVERSE];
+    for (int op = 0; op < 20000; op++) {
+        int v = (int)test_below(&rng, UNIVERSE);
+        if (test_below(&rng, 4) == 0) {
+            CHECK(set_remove(s, &v) == model[v]);
+            model[v] = false;
+        } else {
+            CHECK(set_insert(s, &v) == !model[v]);
+            model[v] = true;
+        }
+        if (op % 2500 == 0) CHECK(matches_model(s, model));
+    }
+    CHECK(matches_model(s, model));
+    CHECK(set_load_factor(s) <= 1.0);
+
+    Set* copy = set_copy(s);
+    CHECK(copy && set_is_equal(copy, s) && matches_model(copy, model));
+    for (size_t i = 0; i < set_size(s); i++) {
+        CHECK(*(int*)copy->members[i] == *(int*)s->members[i]);
+    }
+    set_clear(s);
+    CHECK(set_is_empty(s) && !set_is_equal(copy, s));
+    int v = 7;
+    CHECK(set_insert(s, &v) && set_contains(s, &v) && set_size(s) == 1);
+    set_destroy(copy);
+    set_destroy(s);
+}
+
+static void test_set_algebra(void) {
+    uint64_t rng = 50;
+    for (int round = 0; round < 20; round++) {
+        static bool in_a[UNIVERSE], in_b[UNIVERSE], expect[UNIVERSE];
+        Set* a = int_set();
+        Set* b = int_set();
+        for (int v = 0; v < UNIVERSE; v++) {
+            in_a[v] = test_below(&rng, 3) == 0;
+            in_b[v] = test_below(&rng, 3) == 0;
+            if (in_a[v]) set_insert(a, &v);
+            if (in_b[v]) set_insert(b, &v);
+        }
+
+        Set* u = set_union(a, b);
+        for (int v = 0; v < UNIVERSE; v++) expect[v] = in_a[v] || in_b[v];
+        CHECK(u && matches_model(u, expect));
+        Set* x = set_intersection(a, b);
+        for (int v = 0; v < UNIVERSE; v++) expect[v] = in_a[v] && in_b[v];
+        CHECK(x && matches_model(x, expect));
+        Set* d = set_difference(a, b);
+        for (int v = 0; v < UNIVERSE; v++) expect[v] = in_a[v] && !in_b[v];
+        CHECK(d && matches_model(d, expect));
+        Set* sd = set_symmetric_difference(a, b);
+        for (int v = 0; v < UNIVERSE; v++) expect[v] = in_a[v] != in_b[v];
+        CHECK(sd && matches_model(sd, expect));
+
+        CHECK(set_is_subset(x, a) && set_is_subset(x, b) && set_is_superset(u, a));
+        CHECK(set_is_disjoint(d, b) && !set_is_subset(u, x));
+
+        set_destroy(sd);
+        set_destroy(d);
+        set_destroy(x);
+        set_destroy(u);
+        set_destroy(b);
+        set_destroy(a);
+    }
+}
+
+static void test_string_set(void) {
+    // Distinct pointers to equal strings are one member
+    Set* s = set_create_string_set();
+    char words[500][8];
+    for (int i = 0; i < 500; i++) {
+        snprintf(words[i], sizeof(words[i]), "w%d", i);
+        const char* w = words[i];
+        CHECK(set_insert(s, &w));
+    }
+    char again[8] = "w123";
+    const char* p = again;
+    CHECK(!set_insert(s, &p) && set_contains(s, &p) && set_size(s) == 500);
+    CHECK(set_remove(s, &p) && !set_contains(s, &p) && set_size(s) == 499);
+    const char* missing = "w500";
+    CHECK(!set_contains(s, &missing) && !set_remove(s, &missing));
+    set_destroy(s);
+}
+
+static void test_bitset(void) {
+    uint64_t rng = 51;
+    static const size_t sizes[] = { 1, 63, 64, 65, 200, 1000 };
+    for (size_t k = 0; k < sizeof(sizes) / sizeof(sizes[0]); k++) {
+        size_t n = sizes[k];
+        for (int round = 0; round < 30; round++) {
+            BitSet* a = bitset_create(n);
+            BitSet* b = bitset_create(n);
+            bool* ma = calloc(n, sizeof(bool));
+            bool* mb = calloc(n, sizeof(bool));
+            for (size_t i = 0; i < n; i++) {
+                if (test_below(&rng, 4) == 0) { bitset_add(a, i); ma[i] = true; }
+                if (test_below(&rng, 4) == 0) { bitset_add(b, i); mb[i] = true; }
+            }
+            CHECK(!bitset_contains(a, n) && !bitset_contains(a, n + 64));
+
+            // Iteration visits exactly the members, in order
+            size_t count = 0, prev = 0;
+            bool ordered = true, present = true;
+            for (size_t q = bitset_next(a, 0); q != BITSET_END; q = bitset_next(a, q + 1)) {
+                if (count && q <= prev) ordered = false;
+                if (q >= n || !ma[q]) present = false;
+                prev = q;
+                count++;
+            }
+            size_t expected = 0;
+            for (size_t i = 0; i < n; i++) expected += ma[i];
+            CHECK(ordered && present && count == expected && bitset_count(a) == expected);
+            CHECK(bitset_is_empty(a) == (expected == 0));
+
+            // Each kernel reports whether it changed its destination
+            BitSet* u = bitset_copy(a);
+            bool grows = false, shrinks = false, loses = false;
+            for (size_t i = 0; i < n; i++) {
+                grows |= mb[i] && !ma[i];
+                shrinks |= ma[i] && !mb[i];
+                loses |= ma[i] && mb[i];
+            }
+            CHECK(bitset_union(u, b) == grows);
+            bool ok = true;
+            for (size_t i = 0; i < n; i++) ok &= bitset_contains(u, i) == (ma[i] || mb[i]);
+            CHECK(ok && !bitset_union(u, b));
+
+            BitSet* x = bitset_copy(a);
+            CHECK(bitset_intersection(x, b) == shrinks);
+            ok = true;
+            for (size_t i = 0; i < n; i++) ok &= bitset_contains(x, i) == (ma[i] && mb[i]);
+            CHECK(ok);
+
+            BitSet* d = bitset_copy(a);
+            CHECK(bitset_difference(d, b) == loses);
+            ok = true;
+            for (size_t i = 0; i < n; i++) ok &= bitset_contains(d, i) == (ma[i] && !mb[i]);
+            CHECK(ok);
+
+            // a ∩ b ⊆ a, and a ⊆ a ∩ b only when nothing was dropped
+            CHECK(bitset_words_is_subset(x->words, a->words, a->nwords));
+            CHECK(bitset_words_is_subset(a->words, x->words, a->nwords) == !shrinks);
+            CHECK(bitset_words_intersects(a->words, b->words, a->nwords) == loses);
+            CHECK(!bitset_words_intersects(d->words, b->words, a->nwords));
+
+            // Equal sets hash alike however they were built
+            BitSet* again = bitset_create(n);
+            bitset_assign(again, x);
+            bitset_union(again, d);
+            CHECK(bitset_is_equal(again, a) && bitset_hash(again) == bitset_hash(a));
+            if (expected) {
+                size_t first = bitset_next(a, 0);
+                bitset_remove(again, first);
+                CHECK(!bitset_is_equal(again, a) && bitset_count(again) == expected - 1);
+            }
+            bitset_clear(again);
+            CHECK(bitset_is_empty(again));
+
+            bitset_destroy(again);
+            bitset_destroy(d);
+            bitset_destroy(x);
+            bitset_destroy(u);
+            free(mb);
+            free(ma);
+            bitset_destroy(b);
+            bitset_destroy(a);
+        }
+    }
+}
+
+int main(void) {
+    test_set_model();
+    test_set_algebra();
+    test_string_set();
+    test_bitset();
+    return test_report("test_set");
+}
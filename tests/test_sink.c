@@ -0,0 +1,231 @@
+#include "test_util.h"
+#include "io/fa_dfa_image.h"
+
+/*
+ * The implicit accepting sink (fa_auto.sink_accepts): every operation on
+ * a DFA with the flag must agree with the same operation on its
+ * fa_auto_materialize_sink form, where the sink is an ordinary state.
+ * Membership and ε-removal also take ε-NFAs with the flag.
+ */
+
+#define LETTERS "abc"
+#define MAX_LEN 6
+
+// Random ε-NFA with the flag set; equal seeds give equal automata
+static fa_auto* random_sink_nfa(uint64_t seed) {
+    int n = 1 + (int)test_below(&seed, 5);
+    fa_auto* a = test_random_nfa(&seed, n, 3, 2 * n + 1, 20, 30);
+    if (a) a->sink_accepts = true;
+    return a;
+}
+
+// Random partial DFA with the flag set
+static fa_auto* random_sink_dfa(uint64_t* rng) {
+    int n = 1 + (int)test_below(rng, 5);
+    fa_auto* nfa = test_random_nfa(rng, n, 3, 2 * n, 10, 30);
+    fa_auto* dfa = fa_auto_determinize(nfa, FA_DETERMINIZE_SUBSET);
+    fa_auto_destroy(nfa);
+    if (dfa) dfa->sink_accepts = true;
+    return dfa;
+}
+
+static bool check_accepts(void* ctx, const char* word) {
+    const fa_auto* const* pair = ctx;
+    CHECK_MSG(fa_auto_accepts(pair[0], word) == test_run(pair[1], word), "\"%s\"", word);
+    return true;
+}
+
+static void test_known_complement(void) {
+    // Complement of a*b: everything but a^n b, including "ba" and "abb"
+    fa_auto* ab = fa_auto_from_regex("a*b");
+    fa_auto* c = fa_auto_complement(ab);
+    fa_auto* m = fa_auto_materialize_sink(c);
+    CHECK(c && m && !m->sink_accepts);
+    static const char* in[] = { "", "a", "aa", "ba", "abb", "bb", "aba", "bab" };
+    static const char* out[] = { "b", "ab", "aab", "aaab" };
+    for (size_t i = 0; i < sizeof(in) / sizeof(in[0]); i++) {
+        CHECK_MSG(fa_auto_accepts(c, in[i]) && fa_auto_accepts(m, in[i]), "\"%s\"", in[i]);
+    }
+    for (size_t i = 0; i < sizeof(out) / sizeof(out[0]); i++) {
+        CHECK_MSG(!fa_auto_accepts(c, out[i]) && !fa_auto_accepts(m, out[i]), "\"%s\"", out[i]);
+    }
+    // The sink reads alphabet symbols only
+    CHECK(!fa_auto_accepts(c, "bz") && !fa_auto_accepts(m, "bz"));
+
+    fa_dfa_image* image = fa_dfa_image_create(c, NULL, NULL);
+    CHECK(image && fa_dfa_image_matches(image, "ba") && fa_dfa_image_matches(image, "abb"));
+    CHECK(image && !fa_dfa_image_matches(image, "aab") && !fa_dfa_image_matches(image, "bz"));
+    fa_dfa_image_close(image);
+
+    fa_auto_destroy(m);
+    fa_auto_destroy(c);
+    fa_auto_destroy(ab);
+}
+
+static void test_epsilon(void) {
+    uint64_t rng = 52;
+    for (int round = 0; round < 150; round++) {
+        uint64_t seed = test_rand(&rng);
+        fa_auto* r = random_sink_nfa(seed);
+        fa_auto* m = fa_auto_materialize_sink(r);
+        CHECK(test_same_language(r, m, LETTERS, MAX_LEN, "materialize"));
+        const fa_auto* pair[2] = { r, m };
+        test_each_word(LETTERS, MAX_LEN, check_accepts, pair);
+
+        // ε-removal makes the sink explicit first
+        fa_auto* e = random_sink_nfa(seed);
+        fa_auto_remove_epsilon(e);
+        CHECK(test_same_language(e, m, LETTERS, MAX_LEN, "remove_epsilon"));
+        const fa_auto* epair[2] = { e, m };
+        test_each_word(LETTERS, MAX_LEN, check_accepts, epair);
+        fa_auto* t = random_sink_nfa(seed);
+        CHECK(fa_auto_trim(t) == FA_SUCCESS);
+        CHECK(test_same_language(t, m, LETTERS, MAX_LEN, "trim"));
+
+        fa_auto_destroy(t);
+        fa_auto_destroy(e);
+        fa_auto_destroy(m);
+        fa_auto_destroy(r);
+    }
+}
+
+static void test_unary(void) {
+    uint64_t rng = 54;
+    for (int round = 0; round < 150; round++) {
+        fa_auto* r = random_sink_dfa(&rng);
+        fa_auto* m = fa_auto_materialize_sink(r);
+        CHECK(test_same_language(r, m, LETTERS, MAX_LEN, "materialize"));
+        const fa_auto* pair[2] = { r, m };
+        test_each_word(LETTERS, MAX_LEN, check_accepts, pair);
+
+        fa_auto* d = fa_auto_determinize(r, FA_DETERMINIZE_SUBSET);
+        CHECK(test_same_language(d, m, LETTERS, MAX_LEN, "determinize"));
+        fa_auto* bfs = fa_auto_determinize(r, FA_DETERMINIZE_BFS);
+        CHECK(test_same_language(bfs, m, LETTERS, MAX_LEN, "determinize bfs"));
+        fa_auto* hop = fa_auto_minimize(r, FA_MINIMIZE_HOPCROFT);
+        CHECK(test_same_language(hop, m, LETTERS, MAX_LEN, "hopcroft"));
+        fa_auto* brz = fa_auto_minimize(r, FA_MINIMIZE_BRZOZOWSKI);
+        CHECK(test_same_language(brz, m, LETTERS, MAX_LEN, "brzozowski"));
+        fa_auto* red = fa_auto_reduce_nfa(r);
+        CHECK(test_same_language(red, m, LETTERS, MAX_LEN, "reduce_nfa"));
+
+        fa_auto* rev = fa_auto_reverse(r);
+        fa_auto* rev_m = fa_auto_reverse(m);
+        CHECK(test_same_language(rev, rev_m, LETTERS, MAX_LEN, "reverse"));
+        fa_auto* star = fa_auto_kleene(r, FA_KLEENE_STAR);
+        fa_auto* star_m = fa_auto_kleene(m, FA_KLEENE_STAR);
+        CHECK(test_same_language(star, star_m, LETTERS, MAX_LEN, "star"));
+        fa_auto* c = fa_auto_complement(r);
+        fa_auto* c_m = fa_auto_complement(m);
+        CHECK(test_same_language(c, c_m, LETTERS, MAX_LEN, "complement"));
+
+        for (uint64_t len = 0; len <= 4; len++) {
+            fa_word_count got, expected;
+            CHECK(fa_auto_count_words(r, len, &got) == FA_SUCCESS);
+            CHECK(fa_auto_count_words(m, len, &expected) == FA_SUCCESS);
+            CHECK_MSG(got.low == expected.low && got.high == expected.high, "count %u",
+                      (unsigned)len);
+        }
+
+        // The sampler draws words of exactly length 3
+        fa_word_sampler* sampler = fa_word_sampler_create(r, 3, NULL);
+        fa_word_count drawn, upto3, upto2;
+        fa_auto_count_words(m, 3, &upto3);
+        fa_auto_count_words(m, 2, &upto2);
+        CHECK(sampler != NULL);
+        if (sampler) {
+            fa_word_sampler_count(sampler, &drawn);
+            CHECK(drawn.low == upto3.low - upto2.low);
+            char word[8];
+            for (int k = 0; k < 10 && drawn.low; k++) {
+                CHECK(fa_word_sampler_draw(sampler, &rng, word, sizeof(word), NULL) == FA_SUCCESS);
+                CHECK_MSG(test_run(m, word), "sampled \"%s\"", word);
+            }
+            fa_word_sampler_destroy(sampler);
+        }
+        CHECK(fa_auto_is_infinite(r) == fa_auto_is_infinite(m));
+        CHECK(fa_auto_is_universal(r, NULL) == fa_auto_is_universal(m, NULL));
+        CHECK(fa_auto_equivalent(r, m, NULL));
+
+        if (d) {
+            fa_dfa_image* image = fa_dfa_image_create(d, NULL, NULL);
+            CHECK(image != NULL);
+            for (size_t i = 0; image && i < 40; i++) {
+                char word[8];
+                size_t len = test_below(&rng, 7);
+                for (size_t k = 0; k < len; k++) word[k] = LETTERS[test_below(&rng, 3)];
+                word[len] = '\0';
+                CHECK_MSG(fa_dfa_image_matches(image, word) == test_run(m, word), "image \"%s\"",
+                          word);
+            }
+            fa_dfa_image_close(image);
+        }
+
+        fa_auto_destroy(c_m);
+        fa_auto_destroy(c);
+        fa_auto_destroy(star_m);
+        fa_auto_destroy(star);
+        fa_auto_destroy(rev_m);
+        fa_auto_destroy(rev);
+        fa_auto_destroy(red);
+        fa_auto_destroy(brz);
+        fa_auto_destroy(hop);
+        fa_auto_destroy(bfs);
+        fa_auto_destroy(d);
+        fa_auto_destroy(m);
+        fa_auto_destroy(r);
+    }
+}
+
+static void test_binary(void) {
+    uint64_t rng = 53;
+    for (int round = 0; round < 150; round++) {
+        fa_auto* r = random_sink_dfa(&rng);
+        fa_auto* m = fa_auto_materialize_sink(r);
+        fa_auto* b;
+        if (test_below(&rng, 2)) {
+            b = random_sink_dfa(&rng);
+        } else {
+            int n = 1 + (int)test_below(&rng, 4);
+            b = test_random_nfa(&rng, n, 3, 2 * n + 1, 20, 40);
+        }
+        fa_auto* bm = fa_auto_materialize_sink(b);
+
+        fa_auto* (*const ops[])(const fa_auto*, const fa_auto*) = {
+            fa_auto_union, fa_auto_product, fa_auto_concat, fa_auto_difference,
+            fa_auto_symmetric_difference,
+        };
+        static const char* names[] = { "union", "product", "concat", "difference", "xor" };
+        for (size_t k = 0; k < sizeof(ops) / sizeof(ops[0]); k++) {
+            fa_auto* got = ops[k](r, b);
+            fa_auto* expected = ops[k](m, bm);
+            CHECK(test_same_language(got, expected, LETTERS, MAX_LEN, names[k]));
+            fa_auto_destroy(expected);
+            fa_auto_destroy(got);
+            got = ops[k](b, r);
+            expected = ops[k](bm, m);
+            CHECK(test_same_language(got, expected, LETTERS, MAX_LEN, names[k]));
+            fa_auto_destroy(expected);
+            fa_auto_destroy(got);
+        }
+
+        CHECK(fa_auto_is_subset(r, b, NULL) == fa_auto_is_subset(m, bm, NULL));
+        CHECK(fa_auto_is_subset(b, r, NULL) == fa_auto_is_subset(bm, m, NULL));
+        CHECK(fa_auto_is_empty_intersection(r, b, NULL) ==
+              fa_auto_is_empty_intersection(m, bm, NULL));
+        CHECK(fa_auto_equivalent(r, b, NULL) == fa_auto_equivalent(m, bm, NULL));
+
+        fa_auto_destroy(bm);
+        fa_auto_destroy(b);
+        fa_auto_destroy(m);
+        fa_auto_destroy(r);
+    }
+}
+
+int main(void) {
+    test_known_complement();
+    test_epsilon();
+    test_unary();
+    test_binary();
+    return test_report("test_sink");
+}
@@ -0,0 +1,211 @@
+#ifndef FA_TEST_UTIL_H
+#define FA_TEST_UTIL_H
+
+#include "fa/fa.h"
+#include "fa/fa_operations.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Shared helpers of the test programs. Each test is one executable that
+ * runs its cases in main and exits non-zero if any CHECK failed.
+ *
+ * Most cases compare a construction against an independent reference: the
+ * automata are run on every word up to a small length by test_run, a
+ * plain set simulation over the state and transition lists that shares no
+ * code with fa_index or fa_auto_accepts.
+ */
+
+static int test_failures;
+
+#define CHECK(cond)                                                            \
+    do {                                                                       \
+        if (!(cond)) {                                                         \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__,   \
+                    #cond);                                                    \
+            test_failures++;                                                   \
+        }                                                                      \
+    } while (0)
+
+#define CHECK_MSG(cond, ...)                                                   \
+    do {                                                                       \
+        if (!(cond)) {                                                         \
+            fprintf(stderr, "%s:%d: check failed: %s: ", __FILE__, __LINE__,   \
+                    #cond);                                                    \
+            fprintf(stderr, __VA_ARGS__);                                      \
+            fputc('\n', stderr);                                               \
+            test_failures++;                                                   \
+        }                                                                      \
+    } while (0)
+
+static inline int test_report(const char* name) {
+    if (test_failures) fprintf(stderr, "%s: %d check(s) failed\n", name, test_failures);
+    else printf("%s: ok\n", name);
+    return test_failures ? 1 : 0;
+}
+
+// splitmix64, so every run sees the same automata
+static inline uint64_t test_rand(uint64_t* state) {
+    uint64_t z = (*state += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+static inline size_t test_below(uint64_t* state, size_t n) {
+    return (size_t)(test_rand(state) % n);
+}
+
+/*
+ * Random NFA over the first `nsyms` letters of "abcd...": state 0 starts,
+ * each state accepts with probability `accept_pct`%, and `ntrans` edges are
+ * drawn with `eps_pct`% of them ε-edges.
+ */
+static inline fa_auto* test_random_nfa(uint64_t* rng, int nstates, int nsyms, int ntrans,
+                                       int eps_pct, int accept_pct) {
+    static const char* letters[] = { "a", "b", "c", "d", "e", "f", "g", "h" };
+    fa_auto* a = fa_auto_create(nstates);
+    if (!a) return NULL;
+    for (int i = 0; i < nsyms; i++) set_insert(a->alphabet, &letters[i]);
+    for (int i = 0; i < nstates; i++) {
+        char label[16];
+        snprintf(label, sizeof(label), "q%d", i);
+        a->states[a->nstates++] = fa_state_create(label, i == 0,
+                                                  (int)test_below(rng, 100) < accept_pct);
+    }
+    for (int j = 0; j < ntrans; j++) {
+        fa_state* src = a->states[test_below(rng, (size_t)nstates)];
+        fa_state* dest = a->states[test_below(rng, (size_t)nstates)];
+        const char* symbol = (int)test_below(rng, 100) < eps_pct
+                           ? FA_EPS_SYMBOL : letters[test_below(rng, (size_t)nsyms)];
+        if (!fa_trans_exists(src, dest, symbol)) fa_trans_create(src, dest, symbol);
+    }
+    return a;
+}
+
+// Whether `symbol` reads the byte `c`: itself, or an interval label holding it
+static inline bool test_symbol_reads(const char* symbol, unsigned char c) {
+    if (strcmp(symbol, FA_EPS_SYMBOL) == 0) return false;
+    if (symbol[0] == (char)c && symbol[1] == '\0') return true;
+    return symbol[0] == '[' && fa_range_contains(symbol, c);
+}
+
+static inline bool test_alphabet_reads(const fa_auto* a, unsigned char c) {
+    for (size_t i = 0; i < a->alphabet->length; i++) {
+        const char* symbol = *(const char* const*)a->alphabet->members[i];
+        if (test_symbol_reads(symbol, c)) return true;
+    }
+    return false;
+}
+
+static inline size_t test_state_id(const fa_auto* a, const fa_state* state) {
+    for (size_t s = 0; s < a->nstates; s++) {
+        if (a->states[s] == state) return s;
+    }
+    return a->nstates;
+}
+
+static inline void test_closure(const fa_auto* a, bool* set) {
+    for (bool grew = true; grew; ) {
+        grew = false;
+        for (size_t s = 0; s < a->nstates; s++) {
+            if (!set[s]) continue;
+            for (fa_trans* t = a->states[s]->trans; t; t = t->next) {
+                size_t d = test_state_id(a, t->dest);
+                if (strcmp(t->symbol, FA_EPS_SYMBOL) == 0 && !set[d]) set[d] = grew = true;
+            }
+        }
+    }
+}
+
+/*
+ * Reference membership over bytes. With sink_accepts, a state without a
+ * move on an alphabet byte falls into the accepting sink, which keeps
+ * reading alphabet bytes (the fa_auto_materialize_sink semantics).
+ */
+static inline bool test_run(const fa_auto* a, const char* word) {
+    size_t n = a->nstates;
+    bool* cur = calloc(n + 1, sizeof(bool));
+    bool* next = calloc(n + 1, sizeof(bool));
+    bool sink = false, accepted = false;
+    for (size_t s = 0; s < n; s++) cur[s] = a->states[s]->is_start;
+    test_closure(a, cur);
+    for (const unsigned char* p = (const unsigned char*)word; *p; p++) {
+        bool known = a->sink_accepts && test_alphabet_reads(a, *p);
+        bool next_sink = sink && known;
+        memset(next, 0, n * sizeof(bool));
+        for (size_t s = 0; s < n; s++) {
+            if (!cur[s]) continue;
+            bool moved = false;
+            for (fa_trans* t = a->states[s]->trans; t; t = t->next) {
+                if (!test_symbol_reads(t->symbol, *p)) continue;
+                next[test_state_id(a, t->dest)] = moved = true;
+            }
+            if (!moved && known) next_sink = true;
+        }
+        test_closure(a, next);
+        bool* tmp = cur; cur = next; next = tmp;
+        sink = next_sink;
+    }
+    accepted = sink;
+    for (size_t s = 0; s < n; s++) accepted |= cur[s] && a->states[s]->is_accept;
+    free(cur);
+    free(next);
+    return accepted;
+}
+
+/*
+ * Calls fn on every word over `letters` of length 0 .. max_len, shortest
+ * first; stops early when fn returns false.
+ */
+typedef bool (*test_word_fn)(void* ctx, const char* word);
+
+static inline void test_each_word(const char* letters, size_t max_len, test_word_fn fn, void* ctx) {
+    size_t k = strlen(letters);
+    char word[32];
+    size_t digits[32];
+    for (size_t len = 0; len <= max_len && len < sizeof(word); len++) {
+        memset(digits, 0, sizeof(digits));
+        for (;;) {
+            for (size_t i = 0; i < len; i++) word[i] = letters[digits[i]];
+            word[len] = '\0';
+            if (!fn(ctx, word)) return;
+            size_t i = len;
+            while (i > 0 && ++digits[i - 1] == k) digits[--i] = 0;
+            if (i == 0) break;
+        }
+    }
+}
+
+typedef struct {
+    const fa_auto* a;
+    const fa_auto* b;
+    const char* what;
+    int mismatches;
+} test_pair;
+
+static inline bool test_same_word(void* ctx, const char* word) {
+    test_pair* pair = ctx;
+    if (test_run(pair->a, word) != test_run(pair->b, word)) {
+        if (pair->mismatches++ == 0) {
+            fprintf(stderr, "  %s: differ on \"%s\"\n", pair->what, word);
+        }
+    }
+    return pair->mismatches < 1;
+}
+
+// Whether a and b agree on every word up to max_len over `letters`
+static inline bool test_same_language(const fa_auto* a, const fa_auto* b, const char* letters,
+                                      size_t max_len, const char* what) {
+    if (!a || !b) {
+        fprintf(stderr, "  %s: missing automaton\n", what);
+        return false;
+    }
+    test_pair pair = { a, b, what, 0 };
+    test_each_word(letters, max_len, test_same_word, &pair);
+    return pair.mismatches == 0;
+}
+
+#endif // FA_TEST_UTIL_H